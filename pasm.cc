@@ -26,9 +26,14 @@
 
 //------------------------------------------------------------------------------
 
+#include <algorithm>
+#include <bitset>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <sstream>
 #include <string>
 
 #include "psim.h"
@@ -37,7 +42,9 @@
 // Global Constants
 //------------------------------------------------------------------------------
 
-static bool UnifiedMemory;
+static bool SourceMapping;
+static bool ObjectOutput;
+static RewriteTable Rewrites;
 
 //------------------------------------------------------------------------------
 // Main
@@ -47,19 +54,66 @@ int		main		    (int argc, char *argv[]) {
     LabelTable	lt;
     DataList	dl;
     TextList	tl;
+    SourceMap	sm;
     int		i;
 
     if (argc < 2) {
-	std::cerr << "usage: pasm s0, s1, s2 ..." << std::endl;
+	std::cerr << "usage: pasm [u] [g] [c] [o|o1|o2] [r=db] [w16|w32] s0, s1, s2 ..." << std::endl;
 	return (EXIT_FAILURE);
     }
 
-    if (strncmp(argv[1], "u", 2) == 0) {
-	UnifiedMemory = true;
-	i = 2;
-    } else {
-	UnifiedMemory = false;
-	i = 1;
+    SourceMapping = false;
+    ObjectOutput  = false;
+    asm_init(Assembler);
+
+    for (i = 1; i < argc; i++) {
+	if (strncmp(argv[i], "u", 2) == 0)
+	    Assembler.unified = true;
+	else if (strncmp(argv[i], "g", 2) == 0)
+	    SourceMapping = true;
+	else if (strncmp(argv[i], "c", 2) == 0)
+	    ObjectOutput = true;
+	else if (strncmp(argv[i], "o", 2) == 0 || strncmp(argv[i], "o2", 3) == 0)
+	    Assembler.optimize = 2;
+	else if (strncmp(argv[i], "o1", 3) == 0)
+	    Assembler.optimize = 1;
+	else if (strncmp(argv[i], "r=", 2) == 0) {
+	    std::ifstream db(argv[i] + 2);
+
+	    if (!db.is_open() || !rewrite_load(db, Rewrites)) {
+		std::cerr << "Unable to load rewrites from " << argv[i] + 2 << std::endl;
+		return (EXIT_FAILURE);
+	    }
+	    Assembler.rewrites = &Rewrites;
+	    Assembler.optimize = std::max(Assembler.optimize, (size_t)1);
+	}
+	else if (strncmp(argv[i], "w16", 4) == 0 || strncmp(argv[i], "w32", 4) == 0)
+	    Assembler.width = strtol(argv[i] + 1, NULL, 10);
+	else
+	    break;
+    }
+
+    // Objects keep data labels relative to the data; plink places them
+    if (ObjectOutput) {
+	Assembler.unified = false;
+	SourceMapping = false;
+    }
+
+    // Objects and the optimizer both assume 16-bit fields and arithmetic
+    if (Assembler.width == 32 && ObjectOutput) {
+	std::cerr << "Relocatable objects are 16-bit only" << std::endl;
+	return (EXIT_FAILURE);
+    }
+    if (Assembler.width == 32 && Assembler.optimize) {
+	std::cerr << "Optimizer is 16-bit only, not optimizing" << std::endl;
+	Assembler.optimize = 0;
+    }
+
+    // Every label of an object may be entered from another module, which
+    // the optimizer (rooted at the first instruction) cannot see
+    if (ObjectOutput && Assembler.optimize) {
+	std::cerr << "Optimizer does not apply to objects, not optimizing" << std::endl;
+	Assembler.optimize = 0;
     }
 
     for (; i < argc; i++) {
@@ -70,7 +124,20 @@ int		main		    (int argc, char *argv[]) {
 	src.open(argv[i]);
 
 	if (src.is_open()) {
-	    parse_stream(src, lt, dl, tl);
+	    parse_stream(src, lt, dl, tl, sm);
+
+	    if (Assembler.optimize && Assembler.optimized.skipped.size()) {
+		std::cerr << argv[i] << ": not optimized: " << Assembler.optimized.skipped << std::endl;
+	    } else if (Assembler.optimize) {
+		std::cout << argv[i] << ": " << Assembler.optimized.after << " instructions, "
+			  << Assembler.optimized.before - Assembler.optimized.after << " saved ("
+			  << Assembler.optimized.threaded << " threaded, "
+			  << Assembler.optimized.folded << " folded, "
+			  << Assembler.optimized.redundant << " redundant, "
+			  << Assembler.optimized.jumps << " jumps, "
+			  << Assembler.optimized.dead << " dead, "
+			  << Assembler.optimized.rewritten << " rewritten)" << std::endl;
+	    }
 
 #ifdef __DEBUG__/*{{{*/
 	    std::cout << "Label Table = " << std::endl;
@@ -94,10 +161,21 @@ int		main		    (int argc, char *argv[]) {
 
 	    tgt_file = argv[i];
 	    tgt_file.erase(tgt_file.rfind("."));
-	    tgt_file += (UnifiedMemory ? ".ubin" : ".bin");
+	    tgt_file += (ObjectOutput ? ".pobj" : Assembler.unified ? ".ubin" : ".bin");
 	    tgt.open(tgt_file.c_str());
-	    assemble_stream(tgt, lt, dl, tl);
+	    if (ObjectOutput)
+		assemble_object(tgt, argv[i], lt, dl, tl, sm);
+	    else
+		assemble_stream(tgt, lt, dl, tl);
 	    tgt.close();
+
+	    if (SourceMapping) {
+		tgt_file.erase(tgt_file.rfind("."));
+		tgt_file += ".map";
+		tgt.open(tgt_file.c_str());
+		write_source_map(tgt, argv[i], sm);
+		tgt.close();
+	    }
 	} else {
 	    std::cerr << "unable to open source file: " << argv[i] << std::endl;
 	    return (EXIT_FAILURE);
@@ -106,6 +184,9 @@ int		main		    (int argc, char *argv[]) {
 	lt.clear();
 	dl.clear();
 	tl.clear();
+	sm.clear();
+	Assembler.exports.clear();
+	Assembler.data_values.clear();
 
 	src.close();
     }
@@ -113,297 +194,6 @@ int		main		    (int argc, char *argv[]) {
     return (EXIT_SUCCESS);
 }
 
-//------------------------------------------------------------------------------
-// Assemble Stream
-//------------------------------------------------------------------------------
-
-bool		assemble_stream	    (std::ostream& out, LabelTable& lt, DataList& dl, TextList& tl) {
-    Tokens  tokens;
-    CWord   C;
-    JWord   J;
-    LWord   L;
-    RWord   Ra;
-    RWord   Rb;
-    RWord   Rc;
-
-    for (size_t i = 0; i < tl.size(); i++) {
-	tokens = tl[i];
-	
-#if __DEBUG__/*{{{*/
-	std::cout << "tokens[ " << i << "] =";
-	for (size_t j = 0; j < tokens.size(); j++)
-	    std::cout << " " << tokens[j];
-	std::cout << std::endl;
-#endif/*}}}*/
-
-	if (tokens[0] == "ADD" || tokens[0] == "SUB") {
-	    if (tokens.size() == 4 &&
-		token_is_register(tokens[1]) &&
-		token_is_register(tokens[2]) &&
-		token_is_register(tokens[3])) {
-		Ra = RWord(strtol(tokens[1].substr(1).c_str(), NULL, 10));
-		Rb = RWord(strtol(tokens[2].substr(1).c_str(), NULL, 10));
-		Rc = RWord(strtol(tokens[3].substr(1).c_str(), NULL, 10));
-		out << (tokens[0] == "ADD" ? OWord(OP_ADD) : OWord(OP_SUB)) << Ra << Rb << Rc;
-	    } else {
-		std::cerr << "Invalid " << tokens[0] << " instruction (" << tokens_to_string(tokens) << ")" << std::endl;
-		return (false);
-	    }
-	} else if (tokens[0] == "MOV") {
-	    if (tokens.size() == 3) {
-		if (token_is_register(tokens[1])) {
-		    Ra = RWord(strtol(tokens[1].substr(1).c_str(), NULL, 10));
-
-		    if (token_is_constant(tokens[2])) {
-			C = CWord(strtol(tokens[2].substr(1).c_str(), NULL, 10));
-			out << OWord(OP_LOADC) << Ra << C;
-		    } else if (token_is_address(tokens[2])) {
-			if (get_label_value(lt, tokens[2].substr(1)) < 0)
-			    goto AS_LABEL_ERROR;
-			L = LWord(lt[tokens[2].substr(1)]);
-			out << OWord(OP_LOADC) << Ra << L;
-		    } else if (token_is_label(tokens[2])) {
-			if (get_label_value(lt, tokens[2]) < 0)
-			    goto AS_LABEL_ERROR;
-			L = LWord(lt[tokens[2]]);
-			out << OWord(OP_LOAD) << Ra << L; 
-		    } else if (token_is_number(tokens[2])) {
-			C = CWord(strtol(tokens[2].c_str(), NULL, 10));
-			out << OWord(OP_LOAD) << Ra << C;
-		    } else {
-			goto AS_MOV_ERROR;
-		    }
-		} else {
-		    Ra = RWord(strtol(tokens[2].substr(1).c_str(), NULL, 10));
-
-		    if (token_is_label(tokens[1])) {
-			if (get_label_value(lt, tokens[1]) < 0)
-			    goto AS_LABEL_ERROR;
-			L = LWord(lt[tokens[1]]);
-			out << OWord(OP_STORE) << Ra << L;
-		    } else if (token_is_number(tokens[1])) {
-			C = CWord(strtol(tokens[1].c_str(), NULL, 10));
-			out << OWord(OP_STORE) << Ra << C;
-		    } else {
-			goto AS_MOV_ERROR;
-		    }
-		}
-	    } else if (tokens.size() == 4 &&
-		       token_is_dio(tokens[1]) &&
-		       token_is_register(tokens[2]) &&
-		       token_is_pio(tokens[3])) {
-		Ra = RWord(strtol(tokens[2].substr(1).c_str(), NULL, 10));
-		Rb = RWord((strtol(tokens[3].substr(1).c_str(), NULL, 10) << 1) + 
-			   (strtol(tokens[1].substr(1).c_str(), NULL, 10)));
-		Rc = RWord(0);
-		out << OWord(OP_IO) << Ra << Rb << Rc;
-	    } else {
-AS_MOV_ERROR:
-		std::cerr << "Invalid MOV instruction (" << tokens_to_string(tokens) << ")" << std::endl;
-		return (false);
-	    }
-	} else if (tokens[0] == "MOVR") {
-	    if (tokens.size() == 4 && token_is_register(tokens[1]) && token_is_register(tokens[2])) {
-		Ra = RWord(strtol(tokens[1].substr(1).c_str(), NULL, 10));
-		Rb = RWord(strtol(tokens[2].substr(1).c_str(), NULL, 10));
-		if (token_is_constant(tokens[3])) {
-		    Rc = RWord(strtol(tokens[3].substr(1).c_str(), NULL, 10));
-		    out << OWord(OP_MOVR) << Ra << Rb << Rc;
-		} else if (token_is_address(tokens[3])) {
-		    if (get_label_value(lt, tokens[3].substr(1)) < 0)
-			goto AS_LABEL_ERROR;
-		    Rc = RWord(lt[tokens[3].substr(1)]);
-		    out << OWord(OP_MOVR) << Ra << Rb << Rc;
-		} else {
-		    goto AS_MOVR_ERROR;
-		}
-	    } else {
-AS_MOVR_ERROR:
-		std::cerr << "Invalid MOVR instruction (" << tokens_to_string(tokens) << ")" << std::endl;
-		return (false);
-	    }
-	} else if (tokens[0] == "JMPZ") {
-	    if (tokens.size() == 3 && token_is_register(tokens[1])) {
-		Ra = RWord(strtol(tokens[1].substr(1).c_str(), NULL, 10));
-
-		if (token_is_label(tokens[2])) {
-		    if (get_label_value(lt, tokens[2]) < 0)
-			goto AS_LABEL_ERROR;
-		    L = LWord(lt[tokens[2]] - i);
-		    out << OWord(OP_JMPZ) << Ra << L;
-		} else if (token_is_number(tokens[2])) {
-		    C = CWord(strtol(tokens[1].c_str(), NULL, 10));
-		    out << OWord(OP_JMPZ) << Ra << C;
-		} else {
-		    goto AS_JMPZ_ERROR;
-		}
-	    } else {
-AS_JMPZ_ERROR:
-		std::cerr << "Invalid JMPZ instruction (" << tokens_to_string(tokens) << ")" << std::endl;
-		return (false);
-	    }
-	} else if (tokens[0] == "JMPN") {
-	    if (tokens.size() == 3 && token_is_register(tokens[1])) {
-		Ra = RWord(strtol(tokens[1].substr(1).c_str(), NULL, 10));
-
-		if (token_is_label(tokens[2])) {
-		    if (get_label_value(lt, tokens[2]) < 0)
-			goto AS_LABEL_ERROR;
-		    L = LWord(lt[tokens[2]] - i);
-		    out << OWord(OP_JMPN) << Ra << L;
-		} else if (token_is_number(tokens[2])) {
-		    C = CWord(strtol(tokens[1].c_str(), NULL, 10));
-		    out << OWord(OP_JMPN) << Ra << C;
-		} else {
-		    goto AS_JMPN_ERROR;
-		}
-	    } else {
-AS_JMPN_ERROR:
-		std::cerr << "Invalid JMPN instruction (" << tokens_to_string(tokens) << ")" << std::endl;
-		return (false);
-	    }
-	} else if (tokens[0] == "JMP") {
-	    if (tokens.size() == 2) {
-		if (token_is_label(tokens[1])) {
-		    if (get_label_value(lt, tokens[1]) < 0)
-			goto AS_LABEL_ERROR;
-		    J = JWord(lt[tokens[1]] - i);
-		} else if (token_is_number(tokens[1])) {
-		    J = JWord(strtol(tokens[1].c_str(), NULL, 10));
-		} else {
-		    goto AS_JMP_ERROR;
-		}
-		out << OWord(OP_JMP) << J;
-	    } else {
-AS_JMP_ERROR:
-		std::cerr << "Invalid JMP instruction (" << tokens_to_string(tokens) << ")" << std::endl;
-		return (false);
-	    }
-	} else if (tokens[0] == "END") {
-	    if (tokens.size() == 1) {
-		out << OWord(OP_END) << JWord(0);
-	    } else {
-		std::cerr << "Invalid END instruction (" << tokens_to_string(tokens) << ")" << std::endl;
-		return (false);
-	    }
-	} else {
-	    std::cerr << "Unknown instruction (" << tokens[0] << ")" << std::endl;
-	    return (false);
-	}
-
-	out << std::endl;
-    }
-
-    if (UnifiedMemory)
-	for (size_t i = 0; i < dl.size(); i++) 
-	    out << dl[i] << std::endl;
-
-    return (true);
-
-AS_LABEL_ERROR:
-    std::cerr << "Unknown label in instruction (" << tokens_to_string(tokens) << ")" << std::endl;
-    return (false);
-}
-
-//------------------------------------------------------------------------------
-// Parse Stream
-//------------------------------------------------------------------------------
-
-bool		parse_stream	    (std::istream& in, LabelTable& lt, DataList& dl, TextList& tl) {
-    enum	ParseState  { ST_DATA, ST_TEXT };
-
-    LabelTable	dt;
-    std::string	line;
-    std::string	label;
-    size_t	data_addr;
-    size_t	inst_addr;
-    Tokens	tokens;
-    ParseState	state;
-
-    data_addr	= inst_addr = 0;
-    state	= ST_TEXT;
-
-    while (!in.eof()) {
-	getline(in, line);
-	trim_comment(line);
-
-	if (line.size() == 0)	continue;
-
-	label = get_label(line);
-
-	trim_whitespace(label);
-	trim_whitespace(line);
-
-#ifdef __DEBUG__/*{{{*/
-	std::cout << "[D] label = (" << label << ") line = (" << line << ")" << std::endl;
-#endif/*}}}*/
-	
-
-	if (line.size())
-	    tokens = tokenize(line);
-	else
-	    continue;
-
-	for (size_t i = 0; i < tokens.size(); i++)
-	    trim_comma(tokens[i]);
-
-#ifdef __DEBUG__/*{{{*/
-		std::cout << "tokens = ";
-		for (size_t i = 0; i < tokens.size(); i++) {
-		    std::cout << "(" << tokens[i] << ") ";
-		}
-		std::cout << std::endl;
-#endif/*}}}*/
-
-	if (line == ".data") {
-	    state = ST_DATA;
-	    continue;
-	} else if (line == ".text") {
-	    state = ST_TEXT;
-	    continue;
-	}
-
-	switch (state) {
-	    case ST_DATA:
-		if (label.size() != 0) dt[label] = data_addr;
-
-		if (tokens[0] == "WORD") {
-		    for (size_t j = 1; j < tokens.size(); j++) {
-			data_addr++;
-			dl.push_back(DWord(strtol(tokens[j].c_str(), NULL, 10)));
-		    }
-		} else {
-		    std::cerr << "Unknown data directive (" << tokens[0] << ")" << std::endl;
-		    return (false);
-		}
-		break;
-	    case ST_TEXT:
-		if (label.size() != 0) lt[label] = inst_addr;
-		if (tokens[0] == "MOV" ||
-		    tokens[0] == "ADD" ||
-		    tokens[0] == "SUB" ||
-		    tokens[0] == "JMPZ" ||
-		    tokens[0] == "JMPN" ||
-		    tokens[0] == "JMP" ||
-		    tokens[0] == "MOVR" ||
-		    tokens[0] == "END") {
-		    tl.push_back(tokens);
-		} else {
-		    std::cerr << "Unknown instruction (" << tokens[0] << ")" << std::endl;
-		    return (false);
-		}
-
-		inst_addr++;
-		break;
-	}
-    }
-
-    for (LabelTable::iterator dti = dt.begin(); dti != dt.end(); dti++) 
-	lt[dti->first] = (UnifiedMemory ? dti->second + tl.size() : dti->second);
-
-    return (true);
-}
-
 //------------------------------------------------------------------------------
 // vim: sts=4 sw=4 ts=8 ft=cpp
 //------------------------------------------------------------------------------
@@ -0,0 +1,199 @@
+//------------------------------------------------------------------------------
+// pcov.cc: psim coverage merge and report
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Structures
+//------------------------------------------------------------------------------
+
+struct MergeWorker {
+    char      **files;
+    size_t	first;		// Every stride-th file starting here
+    size_t	stride;
+    size_t	count;
+    Coverage	merged;
+    bool	empty;		// Nothing merged yet
+    std::string	error;		// File that failed to load or merge
+    pthread_t	thread;
+};
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static void    *merge_worker	    (void *arg) {
+    MergeWorker *mw = (MergeWorker *)arg;
+    Coverage	 cov;
+
+    for (size_t i = mw->first; i < mw->count; i += mw->stride) {
+	std::ifstream in(mw->files[i], std::ios::in | std::ios::binary);
+
+	if (!in.is_open() || !coverage_load(in, mw->empty ? mw->merged : cov) ||
+	    (!mw->empty && !coverage_merge(mw->merged, cov))) {
+	    mw->error = mw->files[i];
+	    break;
+	}
+	mw->empty = false;
+    }
+
+    return (NULL);
+}
+
+static void	usage		    () {
+    std::cerr << "usage: pcov [options] r0.cov r1.cov ..." << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "    -b <file>       Print a report annotated with the disassembly of this binary" << std::endl;
+    std::cerr << "    -j <n>          Number of threads (defaults to online cores)" << std::endl;
+    std::cerr << "    -o <file>       Write the merged coverage to a file" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// Main
+//------------------------------------------------------------------------------
+
+int		main		    (int argc, char *argv[]) {
+    std::vector<MergeWorker> workers;
+    std::string	image;
+    std::string	output;
+    Coverage	merged;
+    bool	empty;
+    size_t	jobs;
+    size_t	count;
+    size_t	executed;
+    int		c;
+
+    jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    while ((c = getopt(argc, argv, "b:j:o:h")) != -1) {
+	switch (c) {
+	    case 'b': image  = optarg; break;
+	    case 'j': jobs   = strtol(optarg, NULL, 10); break;
+	    case 'o': output = optarg; break;
+	    default:
+		usage();
+		return (EXIT_FAILURE);
+	}
+    }
+
+    if (optind >= argc || jobs == 0) {
+	usage();
+	return (EXIT_FAILURE);
+    }
+
+    // Each thread unions its share of the files, then the shares are unioned
+    count = argc - optind;
+    workers.resize(std::min(jobs, count));
+    for (size_t t = 0; t < workers.size(); t++) {
+	workers[t].files  = argv + optind;
+	workers[t].first  = t;
+	workers[t].stride = workers.size();
+	workers[t].count  = count;
+	workers[t].empty  = true;
+	pthread_create(&workers[t].thread, NULL, merge_worker, &workers[t]);
+    }
+
+    empty = true;
+    for (size_t t = 0; t < workers.size(); t++) {
+	pthread_join(workers[t].thread, NULL);
+
+	if (workers[t].error.size()) {
+	    std::cerr << "Unable to merge coverage file: " << workers[t].error << std::endl;
+	    return (EXIT_FAILURE);
+	}
+
+	if (empty)
+	    merged = workers[t].merged;
+	else if (!workers[t].empty && !coverage_merge(merged, workers[t].merged)) {
+	    std::cerr << "Coverage files are from different binaries" << std::endl;
+	    return (EXIT_FAILURE);
+	}
+	empty = false;
+    }
+
+    if (output.size()) {
+	std::ofstream out(output.c_str(), std::ios::out | std::ios::binary);
+
+	if (!out.is_open() || !coverage_write(out, merged)) {
+	    std::cerr << "Unable to write coverage file: " << output << std::endl;
+	    return (EXIT_FAILURE);
+	}
+    }
+
+    if (image.size()) {
+	Memory	    memory;
+	RegisterFile regfile(RF_SIZE);
+	RegisterFile pregfile(PRF_SIZE);
+	Coverage    check;
+	SymbolTable symbols;
+	SymbolTable *st = NULL;
+	std::ifstream src(image.c_str());
+
+	if (!src.is_open() || !load_stream(src, memory, regfile, pregfile)) {
+	    std::cerr << "Unable to load binary file: " << image << std::endl;
+	    return (EXIT_FAILURE);
+	}
+	src.close();
+
+	coverage_reset(check, memory);
+	if (check.image != merged.image)
+	    std::cerr << "Coverage was not collected from " << image << std::endl;
+
+	// Pick up the source map written by pasm g, if there is one
+	image.erase(image.rfind(".") == std::string::npos ? image.size() : image.rfind("."));
+	image += ".map";
+	src.clear();
+	src.open(image.c_str());
+	if (src.is_open() && load_symbols(src, symbols))
+	    st = &symbols;
+
+	print_coverage(std::cout, merged, memory, st);
+    } else if (output.empty()) {
+	executed = 0;
+	for (size_t a = 0; a < merged.size; a++)
+	    executed += (merged.executed[a >> 6] >> (a & 63)) & 1;
+
+	std::cout << count << " runs, " << executed << " of " << merged.size << " addresses executed" << std::endl;
+    }
+
+    return (EXIT_SUCCESS);
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
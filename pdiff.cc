@@ -0,0 +1,265 @@
+//------------------------------------------------------------------------------
+// pdiff.cc: psim binary trace first-divergence diff
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Structures
+//------------------------------------------------------------------------------
+
+struct DiffSearch {
+    const char		   *files[2];
+    std::vector<TraceChunk> index[2];
+    size_t		    chunks;	// Chunks both traces have
+    size_t		    next;	// Next chunk to hand out
+    size_t		    first;	// Earliest chunk known to differ, chunks for none
+    std::string		    error;
+    pthread_mutex_t	    lock;
+};
+
+struct DiffWorker {
+    DiffSearch *search;
+    pthread_t	thread;
+};
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static bool	same_step	    (TraceStep& a, TraceStep& b) {
+    return (a.pc == b.pc && a.ir == b.ir && a.kind == b.kind &&
+	    (a.kind == TK_NONE || (a.location == b.location && a.value == b.value)));
+}
+
+// Equal records encode to equal bytes, so most chunks are compared without
+// decompressing them.
+
+static bool	chunk_differs	    (DiffSearch& ds, FILE *f[2], size_t c, std::string& error) {
+    std::vector<uint8_t>   packed[2];
+    std::vector<TraceStep> steps[2];
+
+    for (size_t t = 0; t < 2; t++) {
+	if (!tracefile_read(f[t], ds.index[t][c], packed[t])) {
+	    error = std::string("Unable to read chunk from ") + ds.files[t];
+	    return (true);
+	}
+    }
+
+    if (ds.index[0][c].steps == ds.index[1][c].steps && packed[0] == packed[1])
+	return (false);
+
+    for (size_t t = 0; t < 2; t++) {
+	if (!tracefile_decode(ds.index[t][c], packed[t], steps[t])) {
+	    error = std::string("Corrupt chunk in ") + ds.files[t];
+	    return (true);
+	}
+    }
+
+    for (size_t s = 0; s < steps[0].size() && s < steps[1].size(); s++)
+	if (!same_step(steps[0][s], steps[1][s]))
+	    return (true);
+
+    // A shorter chunk is the end of its trace
+    return (steps[0].size() != steps[1].size());
+}
+
+// Chunks are handed out in order and a worker stops once every chunk left
+// is past the earliest difference found, so the first divergence is exact
+// whatever the number of threads.
+
+static void    *diff_worker	    (void *arg) {
+    DiffWorker *w  = (DiffWorker *)arg;
+    DiffSearch& ds = *w->search;
+    FILE       *f[2];
+    std::string error;
+    size_t	c;
+
+    f[0] = fopen(ds.files[0], "rb");
+    f[1] = fopen(ds.files[1], "rb");
+
+    while (f[0] && f[1]) {
+	pthread_mutex_lock(&ds.lock);
+	c = ds.next++;
+	pthread_mutex_unlock(&ds.lock);
+
+	if (c >= ds.chunks || c >= ds.first)
+	    break;
+
+	if (chunk_differs(ds, f, c, error)) {
+	    pthread_mutex_lock(&ds.lock);
+	    if (c < ds.first) {
+		ds.first = c;
+		ds.error = error;
+	    }
+	    pthread_mutex_unlock(&ds.lock);
+	}
+    }
+
+    if (f[0]) fclose(f[0]);
+    if (f[1]) fclose(f[1]);
+
+    return (NULL);
+}
+
+static uint64_t trace_steps	    (std::vector<TraceChunk>& index) {
+    return (index.empty() ? 0 : index.back().first + index.back().steps);
+}
+
+static void	usage		    () {
+    std::cerr << "usage: pdiff [options] a.ptrace b.ptrace" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "    -c <n>          Steps of context before the divergence (defaults to 4)" << std::endl;
+    std::cerr << "    -j <n>          Number of threads (defaults to online cores)" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// Main
+//------------------------------------------------------------------------------
+
+int		main		    (int argc, char *argv[]) {
+    std::vector<DiffWorker> workers;
+    std::vector<TraceStep>  steps[2];
+    std::vector<uint8_t>    packed;
+    DiffSearch		    ds;
+    size_t		    jobs;
+    size_t		    context;
+    size_t		    s;
+    int			    c;
+
+    jobs    = sysconf(_SC_NPROCESSORS_ONLN);
+    context = 4;
+
+    while ((c = getopt(argc, argv, "c:j:h")) != -1) {
+	switch (c) {
+	    case 'c': context = strtol(optarg, NULL, 10); break;
+	    case 'j': jobs    = strtol(optarg, NULL, 10); break;
+	    default:
+		usage();
+		return (EXIT_FAILURE);
+	}
+    }
+
+    if (argc - optind != 2 || jobs == 0) {
+	usage();
+	return (EXIT_FAILURE);
+    }
+
+    for (size_t t = 0; t < 2; t++) {
+	FILE *f;
+
+	ds.files[t] = argv[optind + t];
+	if ((f = fopen(ds.files[t], "rb")) == NULL || !tracefile_index(f, ds.index[t])) {
+	    std::cerr << "Unable to read binary trace: " << ds.files[t] << std::endl;
+	    return (EXIT_FAILURE);
+	}
+	fclose(f);
+    }
+
+    // Chunks hold a fixed number of steps, so chunk c covers the same steps
+    // in both traces
+    ds.chunks = std::min(ds.index[0].size(), ds.index[1].size());
+    for (size_t k = 0; k < ds.chunks; k++) {
+	if (ds.index[0][k].first != ds.index[1][k].first) {
+	    std::cerr << "Binary traces have different chunk layouts" << std::endl;
+	    return (EXIT_FAILURE);
+	}
+    }
+
+    ds.next  = 0;
+    ds.first = ds.chunks;
+    pthread_mutex_init(&ds.lock, NULL);
+
+    workers.resize(std::min(jobs, std::max<size_t>(ds.chunks, 1)));
+    for (size_t t = 0; t < workers.size(); t++) {
+	workers[t].search = &ds;
+	pthread_create(&workers[t].thread, NULL, diff_worker, &workers[t]);
+    }
+    for (size_t t = 0; t < workers.size(); t++)
+	pthread_join(workers[t].thread, NULL);
+
+    pthread_mutex_destroy(&ds.lock);
+
+    if (ds.error.size()) {
+	std::cerr << ds.error << std::endl;
+	return (EXIT_FAILURE);
+    }
+
+    if (ds.first == ds.chunks) {
+	if (trace_steps(ds.index[0]) == trace_steps(ds.index[1])) {
+	    std::cout << "Traces match for " << trace_steps(ds.index[0]) << " steps" << std::endl;
+	    return (EXIT_SUCCESS);
+	}
+
+	// Every common chunk matched, so the divergence is where one ends
+	std::cout << "First divergence at step " << std::min(trace_steps(ds.index[0]), trace_steps(ds.index[1])) << ": "
+		  << ds.files[trace_steps(ds.index[0]) < trace_steps(ds.index[1]) ? 0 : 1] << " ends" << std::endl;
+	return (EXIT_FAILURE);
+    }
+
+    for (size_t t = 0; t < 2; t++) {
+	FILE *f = fopen(ds.files[t], "rb");
+
+	if (f == NULL || !tracefile_read(f, ds.index[t][ds.first], packed) ||
+	    !tracefile_decode(ds.index[t][ds.first], packed, steps[t])) {
+	    std::cerr << "Unable to read chunk from " << ds.files[t] << std::endl;
+	    return (EXIT_FAILURE);
+	}
+	fclose(f);
+    }
+
+    for (s = 0; s < steps[0].size() && s < steps[1].size() && same_step(steps[0][s], steps[1][s]); s++)
+	;
+
+    std::cout << "First divergence at step " << ds.index[0][ds.first].first + s << std::endl;
+    for (size_t k = (s > context ? s - context : 0); k < s; k++)
+	std::cout << "    " << tracefile_string(steps[0][k]) << std::endl;
+    for (size_t t = 0; t < 2; t++) {
+	std::cout << ds.files[t] << ":" << std::endl;
+	if (s < steps[t].size())
+	    std::cout << "  > " << tracefile_string(steps[t][s]) << std::endl;
+	else
+	    std::cout << "  > (end of trace)" << std::endl;
+    }
+
+    return (EXIT_FAILURE);
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
@@ -0,0 +1,298 @@
+//------------------------------------------------------------------------------
+// pdis.cc: psim bulk disassembler
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Global Constants
+//------------------------------------------------------------------------------
+
+static const size_t MinChunkSize    = 1 << 20;	// Smaller images use fewer threads
+static const size_t MaxLineSize	    = 24 + 8 + ISA_FORMAT_SIZE;
+
+//------------------------------------------------------------------------------
+// Structures
+//------------------------------------------------------------------------------
+
+struct DisChunk {
+    const char	       *begin;	// Starts at a line boundary
+    const char	       *end;
+    size_t		first;	// Address of the first word
+    size_t		words;
+    std::vector<char>	output;
+};
+
+struct Disassembly {
+    std::vector<DisChunk> chunks;
+    bool		  raw;	    // Instructions only (no address or hex)
+    bool		  counting; // First pass counts words for addresses
+};
+
+struct DisWorker {
+    Disassembly	       *dis;
+    DisChunk	       *chunk;
+};
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+// Returns the start of the next line and whether [p, eol) is a binary word.
+
+static const char *next_word	    (const char *p, const char *end, uint16_t *w, bool *valid) {
+    const char *eol = (const char *)memchr(p, '\n', end - p);
+    const char *next;
+
+    if (eol == NULL)
+	eol = end;
+    next = (eol < end ? eol + 1 : end);
+
+    if (eol > p && eol[-1] == '\r')
+	eol--;
+
+    *valid = (eol - p == (long)WORD_SIZE);
+    if (*valid && w) {
+	*w = 0;
+	for (; p < eol; p++)
+	    *w = (*w << 1) | (*p == '1');
+    }
+
+    return (next);
+}
+
+static char    *append_decimal	    (char *p, size_t n) {
+    char    digits[24];
+    size_t  i = 0;
+
+    do {
+	digits[i++] = '0' + n % 10;
+	n /= 10;
+    } while (n);
+
+    while (i)
+	*p++ = digits[--i];
+
+    return (p);
+}
+
+static void    *dis_worker	    (void *arg) {
+    DisWorker  *dw = (DisWorker *)arg;
+    DisChunk&	c  = *dw->chunk;
+    const char *p;
+    const char *hex = "0123456789abcdef";
+    char       *o;
+    uint16_t	w;
+    bool	valid;
+    size_t	a;
+
+    if (dw->dis->counting) {
+	c.words = 0;
+	for (p = c.begin; p < c.end; ) {
+	    p = next_word(p, c.end, NULL, &valid);
+	    c.words += valid;
+	}
+	return (NULL);
+    }
+
+    c.output.resize(c.words * MaxLineSize);
+    o = c.output.size() ? &c.output[0] : NULL;
+    a = c.first;
+
+    for (p = c.begin; p < c.end; ) {
+	p = next_word(p, c.end, &w, &valid);
+	if (!valid)
+	    continue;
+
+	if (!dw->dis->raw) {
+	    o	 = append_decimal(o, a++);
+	    *o++ = ':';
+	    *o++ = '\t';
+	    *o++ = hex[(w >> 12) & 0xf];
+	    *o++ = hex[(w >> 8) & 0xf];
+	    *o++ = hex[(w >> 4) & 0xf];
+	    *o++ = hex[w & 0xf];
+	    *o++ = '\t';
+	}
+	o   += isa_format(o, w);
+	*o++ = '\n';
+    }
+
+    c.output.resize(o - (c.output.size() ? &c.output[0] : o));
+    return (NULL);
+}
+
+static void	dis_run		    (Disassembly& dis) {
+    std::vector<pthread_t>  threads(dis.chunks.size());
+    std::vector<DisWorker>  workers(dis.chunks.size());
+
+    for (size_t i = 0; i < dis.chunks.size(); i++) {
+	workers[i].dis	 = &dis;
+	workers[i].chunk = &dis.chunks[i];
+	pthread_create(&threads[i], NULL, dis_worker, &workers[i]);
+    }
+    for (size_t i = 0; i < dis.chunks.size(); i++)
+	pthread_join(threads[i], NULL);
+}
+
+static bool	disassemble	    (const char *path, FILE *out, bool raw, size_t jobs) {
+    Disassembly	dis;
+    struct stat	st;
+    const char *data;
+    size_t	size;
+    size_t	n;
+    int		fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+	if (fd >= 0) close(fd);
+	return (false);
+    }
+
+    size = st.st_size;
+    if (size == 0) {
+	close(fd);
+	return (true);
+    }
+
+    data = (const char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+	return (false);
+    madvise((void *)data, size, MADV_SEQUENTIAL);
+
+    // Split at line boundaries; each chunk is counted, then formatted
+    n = std::max((size_t)1, std::min(jobs, size / MinChunkSize));
+    for (size_t i = 0, start = 0; i < n && start < size; i++) {
+	DisChunk    c;
+	const char *e = (i + 1 == n ? data + size : data + size * (i + 1) / n);
+
+	if (e < data + start)
+	    e = data + start;
+	if ((e = (const char *)memchr(e, '\n', data + size - e)) == NULL || i + 1 == n)
+	    e = data + size;
+	else
+	    e++;
+
+	c.begin = data + start;
+	c.end	= e;
+	c.first = c.words = 0;
+	dis.chunks.push_back(c);
+	start = e - data;
+    }
+
+    dis.raw	 = raw;
+    dis.counting = true;
+    dis_run(dis);
+
+    for (size_t i = 1; i < dis.chunks.size(); i++)
+	dis.chunks[i].first = dis.chunks[i - 1].first + dis.chunks[i - 1].words;
+
+    dis.counting = false;
+    dis_run(dis);
+
+    for (size_t i = 0; i < dis.chunks.size(); i++)
+	if (dis.chunks[i].output.size())
+	    fwrite(&dis.chunks[i].output[0], 1, dis.chunks[i].output.size(), out);
+
+    munmap((void *)data, size);
+    return (true);
+}
+
+static void	usage		    () {
+    std::cerr << "usage: pdis [options] i0.ubin i1.bin ..." << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "    -j <n>          Number of threads for large images (defaults to online cores)" << std::endl;
+    std::cerr << "    -o <file>       Output file (defaults to stdout)" << std::endl;
+    std::cerr << "    -r              Print instructions only (no address or hex word)" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// Main
+//------------------------------------------------------------------------------
+
+int		main		    (int argc, char *argv[]) {
+    std::string	output;
+    FILE       *out;
+    size_t	jobs;
+    bool	raw;
+    int		c;
+
+    jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    raw	 = false;
+
+    while ((c = getopt(argc, argv, "j:o:rh")) != -1) {
+	switch (c) {
+	    case 'j': jobs   = strtol(optarg, NULL, 10); break;
+	    case 'o': output = optarg; break;
+	    case 'r': raw    = true; break;
+	    default:
+		usage();
+		return (EXIT_FAILURE);
+	}
+    }
+
+    if (optind >= argc || jobs == 0) {
+	usage();
+	return (EXIT_FAILURE);
+    }
+
+    if ((out = (output.size() ? fopen(output.c_str(), "w") : stdout)) == NULL) {
+	std::cerr << "Unable to open output file: " << output << std::endl;
+	return (EXIT_FAILURE);
+    }
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+
+    for (; optind < argc; optind++) {
+	if (!disassemble(argv[optind], out, raw, jobs)) {
+	    std::cerr << "Unable to load binary file: " << argv[optind] << std::endl;
+	    return (EXIT_FAILURE);
+	}
+    }
+
+    if (out != stdout)
+	fclose(out);
+
+    return (EXIT_SUCCESS);
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
@@ -0,0 +1,220 @@
+//------------------------------------------------------------------------------
+// pfuzz.cc: psim assembler and simulator fuzzer
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <dirent.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Global Variables
+//------------------------------------------------------------------------------
+
+static volatile sig_atomic_t Interrupted;
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static void	interrupt	    (int) {
+    Interrupted = 1;
+}
+
+static double	now		    () {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec + tv.tv_usec / 1e6);
+}
+
+static bool	read_source	    (const std::string& path, std::string& source) {
+    std::ifstream	in(path.c_str());
+    std::ostringstream	ss;
+
+    if (!in.is_open())
+	return (false);
+
+    ss << in.rdbuf();
+    source = ss.str();
+    return (true);
+}
+
+// Every .s file in the corpus directory is a seed
+static size_t	read_corpus	    (Fuzzer& fz, const std::string& dir) {
+    struct dirent *de;
+    std::string	   source;
+    size_t	   n = 0;
+    DIR		  *d;
+
+    if ((d = opendir(dir.c_str())) == NULL)
+	return (0);
+
+    while ((de = readdir(d)) != NULL) {
+	std::string name = de->d_name;
+
+	if (name.size() > 2 && name.compare(name.size() - 2, 2, ".s") == 0 &&
+	    read_source(dir + "/" + name, source)) {
+	    fuzz_add(fz, source);
+	    n++;
+	}
+    }
+    closedir(d);
+
+    return (n);
+}
+
+static void	write_corpus	    (const std::string& dir, FuzzCase& c, size_t n) {
+    std::ostringstream path;
+    std::ofstream      out;
+
+    path << dir << "/" << getpid() << "-" << n << ".s";
+    out.open(path.str().c_str());
+    out << c.source;
+}
+
+static void	usage		    () {
+    std::cerr << "usage: pfuzz [options] [s0.s s1.s ...]" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "    -b <n>          Steps per run (defaults to 1000)" << std::endl;
+    std::cerr << "    -c <dir>        Corpus directory (seeds are read from it, new sources written to it)" << std::endl;
+    std::cerr << "    -n <n>          Number of executions (defaults to until interrupted)" << std::endl;
+    std::cerr << "    -o <dir>        Findings directory (defaults to .)" << std::endl;
+    std::cerr << "    -s <seed>       Random seed (defaults to the time)" << std::endl;
+    std::cerr << "    -t <seconds>    Time limit" << std::endl;
+    std::cerr << "    -x              Also compare the reference and generic engines" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// Main
+//------------------------------------------------------------------------------
+
+int		main		    (int argc, char *argv[]) {
+    static Fuzzer fz;
+    std::string	  corpus;
+    std::string	  findings;
+    std::string	  source;
+    uint64_t	  seed;
+    size_t	  budget;
+    size_t	  execs;
+    size_t	  added;
+    double	  limit;
+    double	  start;
+    double	  status;
+    bool	  engines;
+    int		  c;
+
+    findings = ".";
+    seed     = time(NULL) ^ getpid();
+    budget   = 1000;
+    execs    = 0;
+    limit    = 0;
+    engines  = false;
+    added    = 0;
+
+    while ((c = getopt(argc, argv, "b:c:n:o:s:t:xh")) != -1) {
+	switch (c) {
+	    case 'b': budget   = strtoul(optarg, NULL, 10); break;
+	    case 'c': corpus   = optarg; break;
+	    case 'n': execs    = strtoul(optarg, NULL, 10); break;
+	    case 'o': findings = optarg; break;
+	    case 's': seed     = strtoull(optarg, NULL, 10); break;
+	    case 't': limit    = strtod(optarg, NULL); break;
+	    case 'x': engines  = true; break;
+	    default:
+		usage();
+		return (EXIT_FAILURE);
+	}
+    }
+
+    if (budget == 0) {
+	usage();
+	return (EXIT_FAILURE);
+    }
+
+    mkdir(findings.c_str(), 0755);
+    if (corpus.size())
+	mkdir(corpus.c_str(), 0755);
+
+    fuzz_init(fz, seed, budget, engines, findings);
+
+    for (int i = optind; i < argc; i++) {
+	if (!read_source(argv[i], source)) {
+	    std::cerr << "Unable to read seed: " << argv[i] << std::endl;
+	    return (EXIT_FAILURE);
+	}
+	fuzz_add(fz, source);
+    }
+    if (corpus.size())
+	read_corpus(fz, corpus);
+
+    std::cout << "pfuzz: seed " << seed << ", " << fz.corpus.size() << " seeds, " << budget << " steps per run" << std::endl;
+
+    signal(SIGINT, interrupt);
+    start = status = now();
+
+    while (!Interrupted && (execs == 0 || fz.execs < execs)) {
+	if (fuzz_one(fz) && corpus.size() && fz.corpus.back().source.size())
+	    write_corpus(corpus, fz.corpus.back(), added++);
+
+	// Checking the clock every execution would cost more than some runs
+	if ((fz.execs & 0x3ff) == 0) {
+	    double t = now();
+
+	    if (limit > 0 && t - start >= limit)
+		break;
+	    if (t - status >= 2) {
+		print_fuzzer(fz, t - start);
+		status = t;
+	    }
+	}
+    }
+
+    print_fuzzer(fz, now() - start);
+
+    for (size_t k = 0; k < FK_SIZE; k++)
+	if (fz.found[k])
+	    return (EXIT_FAILURE);
+
+    return (EXIT_SUCCESS);
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
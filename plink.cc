@@ -0,0 +1,115 @@
+//------------------------------------------------------------------------------
+// plink.cc: psim object linker
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static void	usage		    () {
+    std::cerr << "usage: plink [options] m0.pobj m1.pobj ..." << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "    -o <file>       Output binary (defaults to the first object with .ubin or .bin)" << std::endl;
+    std::cerr << "    -u              Unified memory binary (data follows the text)" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// Main
+//------------------------------------------------------------------------------
+
+int		main		    (int argc, char *argv[]) {
+    std::vector<ObjectModule> objs;
+    std::ofstream out;
+    std::string	output;
+    std::string	error;
+    Memory	image;
+    bool	unified;
+    int		c;
+
+    unified = false;
+
+    while ((c = getopt(argc, argv, "o:uh")) != -1) {
+	switch (c) {
+	    case 'o': output  = optarg; break;
+	    case 'u': unified = true; break;
+	    default:
+		usage();
+		return (EXIT_FAILURE);
+	}
+    }
+
+    if (optind >= argc) {
+	usage();
+	return (EXIT_FAILURE);
+    }
+
+    objs.resize(argc - optind);
+    for (int i = optind; i < argc; i++) {
+	std::ifstream src(argv[i]);
+
+	if (!src.is_open() || !object_load(src, objs[i - optind])) {
+	    std::cerr << "Unable to load object file: " << argv[i] << std::endl;
+	    return (EXIT_FAILURE);
+	}
+    }
+
+    if (!link_objects(objs, unified, image, error)) {
+	std::cerr << "Unable to link: " << error << std::endl;
+	return (EXIT_FAILURE);
+    }
+
+    if (output.empty()) {
+	output = argv[optind];
+	output.erase(output.rfind(".") == std::string::npos ? output.size() : output.rfind("."));
+	output += (unified ? ".ubin" : ".bin");
+    }
+
+    out.open(output.c_str());
+    for (size_t a = 0; a < image.size() && out.is_open(); a++)
+	out << image[a] << std::endl;
+
+    if (!out.is_open() || out.fail()) {
+	std::cerr << "Unable to write binary file: " << output << std::endl;
+	return (EXIT_FAILURE);
+    }
+
+    return (EXIT_SUCCESS);
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
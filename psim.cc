@@ -27,6 +27,9 @@
 //------------------------------------------------------------------------------
 
 #include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -34,26 +37,248 @@
 #include <sstream>
 #include <string>
 
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/time.h>
+
 #include "psim.h"
 
+//------------------------------------------------------------------------------
+// Structures
+//------------------------------------------------------------------------------
+
+struct Background {
+    Machine	   *machine;
+    Multiprocessor *mp;		// Runs the cores instead when not NULL
+    size_t	    budget;
+    pthread_t	    thread;
+    bool	    active;	// Thread has been started and not yet joined
+
+    double	    start_time;	// For instructions per second
+    size_t	    start_steps;
+    double	    last_time;
+    size_t	    last_steps;
+};
+
+//------------------------------------------------------------------------------
+// Global Variables
+//------------------------------------------------------------------------------
+
+static RunControl *Control = NULL;
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static double	now		    () {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec + tv.tv_usec / 1000000.0);
+}
+
+// SIGINT pauses a running step command at the next instruction boundary and
+// otherwise terminates psim as usual.
+
+static void	interrupt	    (int sig) {
+    if (Control && Control->running.load()) {
+	Control->stop.store(true);
+    } else {
+	signal(sig, SIG_DFL);
+	raise(sig);
+    }
+}
+
+static void	print_stop	    (Machine& mc) {
+    if (mc.control && mc.control->stop.load())
+	std::cout << "Paused at PC " << mc.pc << " " << symbol_string(mc.symbols, mc.pc) << std::endl;
+    else if (mc.loop && mc.loop->found)
+	print_loop(*mc.loop);
+    else if (!mc.halted && mc.pc < mc.breakpoints.size() && mc.breakpoints[mc.pc])
+	std::cout << "Breakpoint at PC " << mc.pc << " " << symbol_string(mc.symbols, mc.pc) << std::endl;
+}
+
+static void    *run_worker	    (void *arg) {
+    Background *bg = (Background *)arg;
+
+    if (bg->mp)
+	mp_run(*bg->mp, *bg->machine, bg->budget);
+    else
+	step(*bg->machine, bg->budget);
+
+    std::cout << std::endl;
+    print_stop(*bg->machine);
+    std::cout << "Stopped at PC " << bg->machine->pc << " after " << bg->machine->steps << " steps"
+	      << (bg->machine->halted ? " (halted)" : "") << std::endl;
+
+    bg->machine->control->running.store(false);
+    return (NULL);
+}
+
+static void	run_start	    (Background& bg, Machine& mc, Multiprocessor *mp, size_t budget) {
+    bg.machine	   = &mc;
+    bg.mp	   = mp;
+    bg.budget	   = budget;
+    bg.start_time  = bg.last_time  = now();
+    bg.start_steps = bg.last_steps = mc.steps;
+
+    mc.control->stop.store(false);
+    mc.control->running.store(true);
+    control_publish(*mc.control, mc.pc, mc.steps);
+
+    if (pthread_create(&bg.thread, NULL, run_worker, &bg) != 0) {
+	mc.control->running.store(false);
+	std::cerr << "Unable to start background run" << std::endl;
+	return;
+    }
+
+    bg.active = true;
+}
+
+static void	run_status	    (Background& bg, Machine& mc) {
+    RunControl&	rc    = *mc.control;
+    bool	busy  = rc.running.load();
+    size_t	pc    = rc.pc.load(std::memory_order_relaxed);
+    size_t	steps = rc.steps.load(std::memory_order_relaxed);
+    double	t     = now();
+    std::ios::fmtflags flags	 = std::cout.flags();
+    std::streamsize    precision = std::cout.precision();
+
+    std::cout << (busy ? "Running" : "Stopped") << " at PC " << pc << " " << symbol_string(mc.symbols, pc)
+	      << "\n    " << steps << " steps";
+
+    if (bg.active || busy) {
+	std::cout << std::fixed << std::setprecision(0)
+		  << ", " << (t > bg.last_time ? (steps - bg.last_steps) / (t - bg.last_time) : 0.0)
+		  << " instructions/s (" << (t > bg.start_time ? (steps - bg.start_steps) / (t - bg.start_time) : 0.0)
+		  << " average)";
+	bg.last_time  = t;
+	bg.last_steps = steps;
+    }
+    std::cout << std::endl;
+
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
+
+static void	run_wait	    (Background& bg) {
+    if (bg.active) {
+	pthread_join(bg.thread, NULL);
+	bg.active = false;
+    }
+}
+
+static long	parse_address	    (Machine& mc, std::string& s) {
+    if (token_is_number(s))
+	return (strtol(s.c_str(), NULL, 10));
+    if (mc.symbols)
+	return (symbol_address(*mc.symbols, s));
+    return (-1);
+}
+
+// 32-bit images run on the word-width template, which has registers, memory,
+// pregisters, tracing and stepping but none of the 16-bit machine's tools.
+
+static void	wide_command	    (WideMachine<32>& wm, Tokens& tokens, std::string& line) {
+    if (tokens[0] == "s" || tokens[0] == "step") {
+	if (tokens.size() <= 2) {
+	    wm.control->stop.store(false);
+	    wm.control->running.store(true);
+	    wide_step(wm, tokens.size() == 2 ? strtoul(tokens[1].c_str(), NULL, 10) : 1);
+	    wm.control->running.store(false);
+	} else {
+	    std::cerr << "Invalid print command format: " << line << std::endl;
+	}
+    } else if (tokens[0] == "m" || tokens[0] == "printm") {
+	if (tokens.size() <= 3)
+	    wide_print_memory(wm, tokens.size() >= 2 ? strtoul(tokens[1].c_str(), NULL, 10) : 0,
+				  tokens.size() == 3 ? strtoul(tokens[2].c_str(), NULL, 10) : wm.memory.size());
+	else
+	    std::cerr << "Invalid print command format: " << line << std::endl;
+    } else if (tokens[0] == "o" || tokens[0] == "printo") {
+	wide_print_pregfile(wm);
+    } else if (tokens[0] == "r" || tokens[0] == "printr") {
+	wide_print_regfile(wm);
+    } else if (tokens[0] == "p" || tokens[0] == "print") {
+	wide_print_regfile(wm);
+	wide_print_pregfile(wm);
+	wide_print_memory(wm, 0, wm.memory.size());
+    } else if (tokens[0] == "t" || tokens[0] == "trace") {
+	if (tokens.size() == 2 && (tokens[1] == "on" || tokens[1] == "off"))
+	    wm.trace = (tokens[1] == "on");
+	else
+	    std::cerr << "Invalid trace command format: " << line << std::endl;
+    } else if (tokens[0] == "i" || tokens[0] == "io") {
+	if (tokens.size() == 3 && token_is_number(tokens[1]) && token_is_number(tokens[2]) &&
+	    strtoul(tokens[1].c_str(), NULL, 10) < PRF_SIZE)
+	    wm.pregfile[strtol(tokens[1].c_str(), NULL, 10)] = strtol(tokens[2].c_str(), NULL, 10);
+	else
+	    std::cerr << "Invalid io command format: " << line << std::endl;
+    } else {
+	std::cerr << "Command not available for 32-bit images: " << line << std::endl;
+    }
+}
+
 //------------------------------------------------------------------------------
 // Main
 //------------------------------------------------------------------------------
 
 int		main		    (int argc, char *argv[]) {
-    Memory	    memory;
-    RegisterFile    regfile(RF_SIZE);
-    RegisterFile    pregfile(PRF_SIZE);
+    Machine	    machine;
+    RunControl	    control;
+    Background	    background;
+    struct sigaction sa;
+    CacheModel	    cache;
+    Coverage	    coverage;
+    DeviceBus	    devices;
+    Heatmap	    heatmap;
+    Waveform	    waveform;
+    TraceFile	    tracefile;
+    DumpState	    dump;
+    LoopCheck	    loop;
+    PageTable	    pages;
+    MemoCache	    memo;
+    MemoCache	   *mm;
+    Multiprocessor  mp;
+    Multiprocessor *mpp;
+    SampleStats	    sample;
+    SymbolTable	    symbols;
+    Profile	    profile;
+    WideMachine<32> wide;
+    bool	    widened;
     Tokens	    tokens;
     std::string	    file;
     std::string	    line;
     size_t	    command;
     size_t	    index;
-    size_t	    pc;
     DWord	    dw;
 
+    // psim --serve <socket> [threads] answers requests instead of commands
+    if (argc >= 3 && strcmp(argv[1], "--serve") == 0)
+	return (server_run(argv[2], argc > 3 ? strtoul(argv[3], NULL, 10) : 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+
     command = 0;
-    pc	    = 0;
+    mm	    = NULL;
+    mpp	    = NULL;
+    widened = false;
+    dump.valid = false;
+    machine_init(machine);
+    sample_init(sample, 0, 0);
+    device_clear(devices);
+
+    control.stop.store(false);
+    control.running.store(false);
+    control_publish(control, 0, 0);
+    machine.control   = &control;
+    wide.control      = &control;
+    cost_init(wide.cost);
+    background.active = false;
+    Control	      = &control;
+
+    sa.sa_handler = interrupt;
+    sa.sa_flags	  = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
 
     dw	    = 38;
 
@@ -64,6 +289,25 @@ int		main		    (int argc, char *argv[]) {
 
 	getline(std::cin, line);
 	tokens = tokenize(line);
+	if (tokens.empty())
+	    continue;
+
+	// Reap a finished background run; the machine is off limits until then
+	if (background.active && !control.running.load())
+	    run_wait(background);
+
+	if (background.active &&
+	    tokens[0] != "w" && tokens[0] != "status" && tokens[0] != "z" && tokens[0] != "pause" &&
+	    tokens[0] != "q" && tokens[0] != "quit" && tokens[0] != "h" && tokens[0] != "help") {
+	    std::cerr << "Machine is running (w shows status, z pauses)" << std::endl;
+	    continue;
+	}
+
+	if (widened && tokens[0] != "l" && tokens[0] != "load" &&
+	    tokens[0] != "q" && tokens[0] != "quit" && tokens[0] != "h" && tokens[0] != "help") {
+	    wide_command(wide, tokens, line);
+	    continue;
+	}
 
 	if (tokens[0] == "l" || tokens[0] == "load") {
 	    std::ifstream src;
@@ -78,44 +322,505 @@ int		main		    (int argc, char *argv[]) {
 
 	    src.open(file.c_str());
 	    
-	    if (!src.is_open() || !load_stream(src, memory, regfile, pregfile))
+	    if (!src.is_open() || !load_stream(src, machine.memory, machine.regfile, machine.pregfile))
 		std::cerr << "Unable to load assembly file: " << file << std::endl;
 
+	    // Images without a single 16-bit word may be 32-bit ones (pasm w32)
+	    src.clear();
+	    src.seekg(0);
+	    widened = (src.is_open() && machine.memory.empty() && wide_load(src, wide));
+	    wide_reset(wide);
+	    wide.trace = machine.trace;
+
 	    src.close();
-	    
-	    pc = 0;
+
+	    // Pick up the source map written by pasm g, if there is one
+	    file.erase(file.rfind(".") == std::string::npos ? file.size() : file.rfind("."));
+	    file += ".map";
+	    src.clear();
+	    src.open(file.c_str());
+	    machine.symbols = (src.is_open() && load_symbols(src, symbols) ? &symbols : NULL);
+	    wide.symbols    = machine.symbols;
+	    src.close();
+
+	    machine.breakpoints.clear();
+	    machine_reset(machine);
+	    dump.valid = false;
+	    if (machine.pages) pages_reset(pages, machine);
+	    if (mpp) mp_reset(mp, machine);
+	    if (machine.coverage) coverage_reset(coverage, machine.memory);
+	    if (machine.heatmap) heatmap_reset(heatmap, machine.memory.size(), heatmap.window);
+	} else if (tokens[0] == "a" || tokens[0] == "native") {
+	    if (tokens.size() == 1) {
+		if (machine.native)
+		    std::cout << "Native program " << (native_valid(machine) ? "matches" : "does not match")
+			      << " memory (used when trace, profile, cache, coverage, heatmap, loop detection and breakpoints are off)" << std::endl;
+		else
+		    std::cerr << "Native program is disabled" << std::endl;
+	    } else if (tokens.size() == 2 && tokens[1] == "off") {
+		machine.native = NULL;
+	    } else if (tokens.size() == 2) {
+		if (!native_attach(machine, tokens[1]))
+		    std::cerr << "Unable to attach native program: " << tokens[1] << std::endl;
+		else if (!native_valid(machine))
+		    std::cerr << "Native program does not match memory, steps will be interpreted" << std::endl;
+	    } else {
+		std::cerr << "Invalid native command format: " << line << std::endl;
+	    }
+	} else if (tokens[0] == "c" || tokens[0] == "cache") {
+	    if (tokens.size() == 1) {
+		if (machine.cache)
+		    print_cache(*machine.cache, machine.symbols);
+		else
+		    std::cerr << "Cache model is disabled" << std::endl;
+	    } else if (tokens.size() == 2 && tokens[1] == "off") {
+		machine.cache = NULL;
+	    } else if (tokens.size() >= 4 && tokens.size() <= 7) {
+		size_t	     penalty = 10;
+		WRITE_POLICY policy  = WP_WRITE_BACK;
+		bool	     unified = false;
+		bool	     valid   = true;
+
+		for (size_t t = 4; t < tokens.size(); t++) {
+		    if (tokens[t] == "wb")
+			policy = WP_WRITE_BACK;
+		    else if (tokens[t] == "wt")
+			policy = WP_WRITE_THROUGH;
+		    else if (tokens[t] == "split")
+			unified = false;
+		    else if (tokens[t] == "unified")
+			unified = true;
+		    else if (token_is_number(tokens[t]))
+			penalty = strtol(tokens[t].c_str(), NULL, 10);
+		    else
+			valid = false;
+		}
+
+		if (valid && cache_configure(cache, strtol(tokens[1].c_str(), NULL, 10),
+						    strtol(tokens[2].c_str(), NULL, 10),
+						    strtol(tokens[3].c_str(), NULL, 10),
+						    1, penalty, policy, unified))
+		    machine.cache = &cache;
+		else
+		    std::cerr << "Invalid cache configuration: " << line << std::endl;
+	    } else {
+		std::cerr << "Invalid cache command format: " << line << std::endl;
+	    }
+	} else if (tokens[0] == "b" || tokens[0] == "break") {
+	    if (tokens.size() == 1) {
+		for (size_t a = 0; a < machine.breakpoints.size(); a++)
+		    if (machine.breakpoints[a])
+			std::cout << "Breakpoint at PC " << a << " " << symbol_string(machine.symbols, a) << std::endl;
+	    } else if (tokens.size() == 2 && (index = parse_address(machine, tokens[1])) < machine.memory.size()) {
+		machine.breakpoints.resize(machine.memory.size(), false);
+		machine.breakpoints[index] = !machine.breakpoints[index];
+	    } else {
+		std::cerr << "Invalid break command format: " << line << std::endl;
+	    }
+	} else if (tokens[0] == "e" || tokens[0] == "engine") {
+	    if (tokens.size() == 1)
+		std::cout << "Step engine: " << (machine.engine == SE_REFERENCE ? "reference" :
+						 machine.engine == SE_GENERIC ? "generic" : "template")
+			  << (machine.checked ? ", bounds checked" : ", bounds unchecked") << std::endl;
+	    else if (tokens.size() == 2 && (tokens[1] == "template" || tokens[1] == "reference" || tokens[1] == "generic"))
+		machine.engine = (tokens[1] == "reference" ? SE_REFERENCE : tokens[1] == "generic" ? SE_GENERIC : SE_TEMPLATE);
+	    else if (tokens.size() == 2 && (tokens[1] == "checked" || tokens[1] == "unchecked"))
+		machine.checked = (tokens[1] == "checked");
+	    else
+		std::cerr << "Invalid engine command format: " << line << std::endl;
+	} else if (tokens[0] == "f" || tokens[0] == "profile") {
+	    if (tokens.size() == 1) {
+		if (machine.profile)
+		    print_profile(profile, machine.symbols);
+		else
+		    std::cerr << "Profiling is disabled" << std::endl;
+	    } else if (tokens.size() == 2 && tokens[1] == "on") {
+		profile.assign(machine.memory.size(), 0);
+		machine.profile = &profile;
+	    } else if (tokens.size() == 2 && tokens[1] == "off") {
+		machine.profile = NULL;
+	    } else {
+		std::cerr << "Invalid profile command format: " << line << std::endl;
+	    }
+	} else if (tokens[0] == "v" || tokens[0] == "coverage") {
+	    if (tokens.size() == 1) {
+		if (machine.coverage)
+		    print_coverage(std::cout, coverage, machine.memory, machine.symbols);
+		else
+		    std::cerr << "Coverage is disabled" << std::endl;
+	    } else if (tokens.size() == 2 && tokens[1] == "on") {
+		coverage_reset(coverage, machine.memory);
+		machine.coverage = &coverage;
+	    } else if (tokens.size() == 2 && tokens[1] == "off") {
+		machine.coverage = NULL;
+	    } else if (tokens.size() == 2 && machine.coverage) {
+		std::ofstream out(tokens[1].c_str(), std::ios::out | std::ios::binary);
+
+		if (!out.is_open() || !coverage_write(out, coverage))
+		    std::cerr << "Unable to write coverage file: " << tokens[1] << std::endl;
+	    } else {
+		std::cerr << "Invalid coverage command format: " << line << std::endl;
+	    }
+	} else if (tokens[0] == "d" || tokens[0] == "heatmap") {
+	    if (tokens.size() == 1) {
+		if (machine.heatmap)
+		    print_heatmap(heatmap, machine.symbols);
+		else
+		    std::cerr << "Heatmap is disabled" << std::endl;
+	    } else if ((tokens.size() == 2 || (tokens.size() == 3 && token_is_number(tokens[2]))) && tokens[1] == "on") {
+		heatmap_reset(heatmap, machine.memory.size(), tokens.size() == 3 ? strtol(tokens[2].c_str(), NULL, 10) : 1000);
+		machine.heatmap = &heatmap;
+	    } else if (tokens.size() == 2 && tokens[1] == "off") {
+		machine.heatmap = NULL;
+	    } else if (tokens.size() == 2 && machine.heatmap) {
+		std::ofstream out(tokens[1].c_str());
+
+		if (!out.is_open() || !heatmap_write(out, heatmap, machine.symbols))
+		    std::cerr << "Unable to write heatmap file: " << tokens[1] << std::endl;
+	    } else {
+		std::cerr << "Invalid heatmap command format: " << line << std::endl;
+	    }
+	} else if (tokens[0] == "j" || tokens[0] == "waveform") {
+	    uint32_t	selected;
+
+	    if (tokens.size() == 1) {
+		if (machine.waveform)
+		    print_waveform(waveform);
+		else
+		    std::cerr << "Waveform is disabled" << std::endl;
+	    } else if (tokens.size() == 2 && tokens[1] == "off") {
+		if (machine.waveform) waveform_close(waveform);
+		machine.waveform = NULL;
+	    } else if (waveform_select(tokens, 2, selected)) {
+		if (machine.waveform) waveform_close(waveform);
+		machine.waveform = (waveform_open(waveform, tokens[1], selected) ? &waveform : NULL);
+		if (!machine.waveform)
+		    std::cerr << "Unable to open waveform file: " << tokens[1] << std::endl;
+	    } else {
+		std::cerr << "Invalid waveform command format: " << line << std::endl;
+	    }
+	} else if (tokens[0] == "y" || tokens[0] == "device") {
+	    Device	dv;
+	    bool	valid = true;
+
+	    if (tokens.size() == 1) {
+		if (machine.devices)
+		    print_devices(devices, machine);
+		else
+		    std::cerr << "Devices are disabled" << std::endl;
+		continue;
+	    } else if (tokens.size() == 2 && tokens[1] == "off") {
+		device_clear(devices);
+		machine.devices = NULL;
+		continue;
+	    } else if (tokens.size() == 3 && tokens[1] == "clock" && (tokens[2] == "steps" || tokens[2] == "cycles")) {
+		devices.clock = (tokens[2] == "cycles" ? DC_CYCLES : DC_STEPS);
+		device_reset(devices, machine);
+		continue;
+	    } else if (tokens.size() < 3 || !token_is_number(tokens[2])) {
+		std::cerr << "Invalid device command format: " << line << std::endl;
+		continue;
+	    }
+
+	    device_init(dv, DV_TIMER, strtol(tokens[2].c_str(), NULL, 10));
+	    if (tokens[1] == "timer" && tokens.size() == 4 && token_is_number(tokens[3])) {
+		dv.period = strtol(tokens[3].c_str(), NULL, 10);
+	    } else if (tokens[1] == "input" && tokens.size() == 4) {
+		dv.type	      = DV_INPUT;
+		dv.input_path = tokens[3];
+	    } else if (tokens[1] == "output" && tokens.size() <= 4) {
+		dv.type	       = DV_OUTPUT;
+		dv.output_path = (tokens.size() == 4 ? tokens[3] : "");
+	    } else if (tokens[1] == "uart" && tokens.size() >= 5 && tokens.size() <= 7) {
+		dv.type	       = DV_UART;
+		dv.input_path  = (tokens[3] == "-" ? "" : tokens[3]);
+		dv.output_path = (tokens[4] == "-" ? "" : tokens[4]);
+		dv.period      = (tokens.size() > 5 ? strtol(tokens[5].c_str(), NULL, 10) : 10);
+		dv.depth       = (tokens.size() > 6 ? strtol(tokens[6].c_str(), NULL, 10) : 16);
+		valid	       = (tokens.size() <= 5 || token_is_number(tokens[5])) &&
+				 (tokens.size() <= 6 || token_is_number(tokens[6]));
+	    } else {
+		valid = false;
+	    }
+
+	    if (valid && device_attach(devices, machine, dv))
+		machine.devices = &devices;
+	    else
+		std::cerr << "Invalid device configuration: " << line << std::endl;
+	} else if (tokens[0] == "k" || tokens[0] == "memo") {
+	    if (tokens.size() == 1) {
+		if (mm)
+		    print_memo(*mm);
+		else
+		    std::cerr << "Memoized runs are disabled" << std::endl;
+	    } else if (tokens.size() == 2 && tokens[1] == "off") {
+		mm = NULL;
+	    } else if (tokens.size() <= 4) {
+		if (memo_init(memo, tokens[1],
+			      tokens.size() > 2 ? strtol(tokens[2].c_str(), NULL, 10) : 1024,
+			      tokens.size() > 3 ? strtol(tokens[3].c_str(), NULL, 10) : 0))
+		    mm = &memo;
+		else
+		    std::cerr << "Unable to use memo directory: " << tokens[1] << std::endl;
+	    } else {
+		std::cerr << "Invalid memo command format: " << line << std::endl;
+	    }
+	} else if (tokens[0] == "n" || tokens[0] == "loop") {
+	    if (tokens.size() == 1) {
+		if (machine.loop)
+		    print_loop(*machine.loop);
+		else
+		    std::cerr << "Loop detection is disabled" << std::endl;
+	    } else if (tokens.size() == 2 && tokens[1] == "on") {
+		machine.loop = &loop;
+		loop_reset(loop, machine);
+	    } else if (tokens.size() == 2 && tokens[1] == "off") {
+		machine.loop = NULL;
+	    } else {
+		std::cerr << "Invalid loop command format: " << line << std::endl;
+	    }
+	} else if (tokens[0] == "u" || tokens[0] == "mp") {
+	    if (tokens.size() == 1) {
+		if (mpp)
+		    print_mp(mp, machine.symbols);
+		else
+		    std::cerr << "Multiprocessor mode is disabled" << std::endl;
+	    } else if (tokens.size() == 2 && tokens[1] == "off") {
+		mpp = NULL;
+	    } else if (mpp && tokens.size() == 3 && tokens[1] == "log" && (tokens[2] == "on" || tokens[2] == "off")) {
+		mp.logging = (tokens[2] == "on");
+		mp.log.clear();
+	    } else if (mpp && tokens.size() <= 3 && tokens[1] == "log") {
+		std::ofstream out;
+
+		if (tokens.size() == 3) {
+		    out.open(tokens[2].c_str());
+		    if (!out.is_open()) {
+			std::cerr << "Unable to open log file: " << tokens[2] << std::endl;
+			continue;
+		    }
+		}
+		print_mp_log(mp, tokens.size() == 3 ? out : std::cout, machine.symbols);
+	    } else if (mpp && tokens.size() == 3 && tokens[1] == "threads" && token_is_number(tokens[2])) {
+		mp.threads = strtol(tokens[2].c_str(), NULL, 10);
+	    } else if (tokens.size() <= 5 && token_is_number(tokens[1])) {
+		INTERLEAVE_POLICY policy = IP_ORDER;
+		size_t		  quantum = 1;
+		uint64_t	  seed	  = 0;
+		bool		  valid	  = true;
+
+		if (tokens.size() > 2) {
+		    if (token_is_number(tokens[2]))
+			quantum = strtol(tokens[2].c_str(), NULL, 10);
+		    else
+			valid = false;
+		}
+		if (tokens.size() > 3) {
+		    if (tokens[3] == "order")
+			policy = IP_ORDER;
+		    else if (tokens[3] == "reverse")
+			policy = IP_REVERSE;
+		    else if (tokens[3] == "rotate")
+			policy = IP_ROTATE;
+		    else if (tokens[3] == "random")
+			policy = IP_RANDOM;
+		    else
+			valid = false;
+		}
+		if (tokens.size() > 4) {
+		    if (token_is_number(tokens[4]))
+			seed = strtoull(tokens[4].c_str(), NULL, 10);
+		    else
+			valid = false;
+		}
+
+		if (valid && mp_configure(mp, machine, strtol(tokens[1].c_str(), NULL, 10), quantum, policy, seed))
+		    mpp = &mp;
+		else
+		    std::cerr << "Invalid multiprocessor configuration: " << line << std::endl;
+	    } else {
+		std::cerr << "Invalid multiprocessor command format: " << line << std::endl;
+	    }
+	} else if ((tokens[0] == "m" || tokens[0] == "printm") && tokens.size() >= 2 && tokens[1] == "pages") {
+	    if (machine.pages)
+		print_pages(pages);
+	    else
+		std::cerr << "Paged memory is disabled" << std::endl;
+	} else if ((tokens[0] == "m" || tokens[0] == "printm") && tokens.size() >= 2 && tokens[1] == "size") {
+	    if (tokens.size() == 3 && tokens[2] == "off") {
+		machine.pages = NULL;
+	    } else if ((tokens.size() == 3 || tokens.size() == 4) && token_is_number(tokens[2]) &&
+		       (tokens.size() == 3 || token_is_number(tokens[3])) &&
+		       pages_configure(pages, machine, strtoul(tokens[2].c_str(), NULL, 10),
+				       tokens.size() == 4 ? strtoul(tokens[3].c_str(), NULL, 10) : 256)) {
+		machine.pages = &pages;
+		if (machine.loop) loop_reset(*machine.loop, machine);
+	    } else {
+		std::cerr << "Invalid memory size: " << line << std::endl;
+	    }
+	} else if ((tokens[0] == "m" || tokens[0] == "printm") && tokens.size() >= 2 && tokens[1] == "protect") {
+	    uint8_t f;
+
+	    if (!machine.pages)
+		std::cerr << "Paged memory is disabled" << std::endl;
+	    else if (tokens.size() != 5 || !page_permissions(tokens[4], f) ||
+		     parse_address(machine, tokens[2]) < 0 || parse_address(machine, tokens[3]) < 0 ||
+		     !pages_protect(pages, parse_address(machine, tokens[2]), parse_address(machine, tokens[3]), f))
+		std::cerr << "Invalid protect command format: " << line << std::endl;
 	} else if (tokens[0] == "m" || tokens[0] == "printm") {
+	    Memory  view;
+
+	    // Paged addresses past the image are printed from a flat copy
+	    if (machine.pages && tokens.size() == 3 && parse_address(machine, tokens[2]) >= (long)machine.memory.size())
+		pages_copy(machine, parse_address(machine, tokens[2]) + 1, view);
+
 	    if (tokens.size() == 1) 
-		print_memory(memory, 0, memory.size());
+		print_memory(machine.memory, 0, machine.memory.size(), machine.symbols);
 	    else if (tokens.size() == 2) 
-		print_memory(memory, strtol(tokens[1].c_str(), NULL, 10), memory.size());
+		print_memory(machine.memory, parse_address(machine, tokens[1]), machine.memory.size(), machine.symbols);
 	    else if (tokens.size() == 3)
-		print_memory(memory, strtol(tokens[1].c_str(), NULL, 10), strtol(tokens[2].c_str(), NULL, 10));
+		print_memory(view.size() ? view : machine.memory, parse_address(machine, tokens[1]), parse_address(machine, tokens[2]), machine.symbols);
 	    else
 		std::cerr << "Invalid print command format: " << line << std::endl;
 	} else if (tokens[0] == "o" || tokens[0] == "printo") {
-	    print_pregfile(pregfile);
+	    print_pregfile(machine.pregfile);
 	} else if (tokens[0] == "r" || tokens[0] == "printr") {
-	    print_regfile(regfile, pc);
+	    print_regfile(machine.regfile, machine.pc, machine.symbols);
 	} else if (tokens[0] == "s" || tokens[0] == "step") {
-	    if (tokens.size() == 1) {
-		pc = step(memory, regfile, pregfile, pc, 1);
-	    } else if (tokens.size() == 2) {
-		pc = step(memory, regfile, pregfile, pc, strtol(tokens[1].c_str(), NULL, 10));
+	    if (tokens.size() <= 2) {
+		size_t	    n = (tokens.size() == 2 ? strtol(tokens[1].c_str(), NULL, 10) : 1);
+		std::string key;
+
+		control.stop.store(false);
+		control.running.store(true);
+
+		// Only untraced runs from a freshly loaded machine are memoized;
+		// breakpoints stop runs early and profiles are not stored
+		if (mpp) {
+		    mp_run(mp, machine, n);
+		} else if (mm && !machine.trace && !machine.cache && !machine.coverage && !machine.heatmap && !machine.devices &&
+			   !machine.waveform && !machine.tracefile && !machine.pages && !machine.profile &&
+			   machine.breakpoints.empty() && machine.steps == 0 && !machine.halted) {
+		    key = memo_key(machine, n);
+		    if (!memo_lookup(*mm, key, machine)) {
+			step(machine, n);
+			if (!control.stop.load())
+			    memo_store(*mm, key, machine);
+		    }
+		} else {
+		    step(machine, n);
+		}
+
+		control.running.store(false);
 	    } else {
 		std::cerr << "Invalid print command format: " << line << std::endl;
 	    }
+
+	    print_stop(machine);
+	} else if (tokens[0] == "x" || tokens[0] == "sample") {
+	    if (tokens.size() == 1) {
+		print_sample(sample);
+	    } else if (!mpp && (tokens.size() == 3 || tokens.size() == 4) &&
+		       token_is_number(tokens[1]) && token_is_number(tokens[2]) && strtol(tokens[2].c_str(), NULL, 10) > 0) {
+		sample_init(sample, strtol(tokens[1].c_str(), NULL, 10), strtol(tokens[2].c_str(), NULL, 10));
+
+		control.stop.store(false);
+		control.running.store(true);
+		sample_run(sample, machine, tokens.size() == 4 ? strtoul(tokens[3].c_str(), NULL, 10) : SIZE_MAX);
+		control.running.store(false);
+
+		print_stop(machine);
+		print_sample(sample);
+	    } else {
+		std::cerr << "Invalid sample command format: " << line << std::endl;
+	    }
+	} else if (tokens[0] == "g" || tokens[0] == "run" || tokens[0] == "continue") {
+	    if (tokens.size() <= 2)
+		run_start(background, machine, mpp, tokens.size() == 2 ? strtoul(tokens[1].c_str(), NULL, 10) : SIZE_MAX);
+	    else
+		std::cerr << "Invalid run command format: " << line << std::endl;
+	} else if (tokens[0] == "w" || tokens[0] == "status") {
+	    run_status(background, machine);
+	} else if (tokens[0] == "z" || tokens[0] == "pause") {
+	    if (background.active) {
+		control.stop.store(true);
+		run_wait(background);
+	    } else {
+		std::cerr << "Machine is not running" << std::endl;
+	    }
+	} else if (tokens[0] == "t" || tokens[0] == "trace") {
+	    if (tokens.size() == 2 && (tokens[1] == "on" || tokens[1] == "off")) {
+		machine.trace = (tokens[1] == "on");
+	    } else if (tokens.size() == 2 && tokens[1] == "record") {
+		if (machine.tracefile)
+		    print_tracefile(tracefile);
+		else
+		    std::cerr << "Binary trace is disabled" << std::endl;
+	    } else if (tokens.size() == 3 && tokens[1] == "record") {
+		if (machine.tracefile && !tracefile_close(tracefile))
+		    std::cerr << "Unable to finish binary trace" << std::endl;
+		machine.tracefile = NULL;
+		if (tokens[2] != "off" && tracefile_open(tracefile, tokens[2]))
+		    machine.tracefile = &tracefile;
+		else if (tokens[2] != "off")
+		    std::cerr << "Unable to open binary trace file: " << tokens[2] << std::endl;
+	    } else
+		std::cerr << "Invalid trace command format: " << line << std::endl;
+	} else if ((tokens[0] == "p" || tokens[0] == "print") && tokens.size() == 1) {
+	    print_regfile(machine.regfile, machine.pc, machine.symbols);
+	    print_pregfile(machine.pregfile);
+	    print_memory(machine.memory, 0, machine.memory.size(), machine.symbols);
 	} else if (tokens[0] == "p" || tokens[0] == "print") {
-	    print_regfile(regfile, pc);
-	    print_pregfile(pregfile);
-	    print_memory(memory, 0, memory.size());
+	    DUMP_FORMAT	format;
+	    std::string	out;
+	    std::string	path;
+	    size_t	n     = tokens.size();
+	    long	start = 0;
+	    long	end   = machine.memory.size();
+	    bool	diff  = false;
+
+	    if (n >= 4 && tokens[n - 2] == ">") {
+		path = tokens[n - 1];
+		n   -= 2;
+	    }
+	    if (n >= 3 && tokens[n - 1] == "diff") {
+		diff = true;
+		n--;
+	    }
+	    if (n >= 3)
+		start = parse_address(machine, tokens[2]);
+	    if (n >= 4)
+		end = parse_address(machine, tokens[3]) + 1;
+
+	    if (!dump_format(tokens[1], format) || n > 4 || start < 0 || end <= 0) {
+		std::cerr << "Invalid print command format: " << line << std::endl;
+		continue;
+	    }
+
+	    dump_state(out, machine, format, start, end, dump, diff);
+
+	    if (path.empty()) {
+		std::cout.write(out.data(), out.size());
+		std::cout.flush();
+	    } else {
+		std::ofstream dst(path.c_str(), std::ios::binary);
+
+		if (!dst.write(out.data(), out.size()))
+		    std::cerr << "Unable to write dump file: " << path << std::endl;
+	    }
 	} else if (tokens[0] == "i" || tokens[0] == "io") {
 	    if (tokens.size() == 3 && token_is_number(tokens[1]) && token_is_number(tokens[2])) {
-		pregfile[strtol(tokens[1].c_str(), NULL, 10)] = strtol(tokens[2].c_str(), NULL, 10);
+		machine.pregfile[strtol(tokens[1].c_str(), NULL, 10)] = strtol(tokens[2].c_str(), NULL, 10);
+		if (machine.loop) loop_reset(*machine.loop, machine);
+		if (mpp) mp_set_pregister(mp, strtol(tokens[1].c_str(), NULL, 10), strtol(tokens[2].c_str(), NULL, 10));
 	    } else {
 		std::cerr << "Invalid io command format: " << line << std::endl;
 	    }
 	} else if (tokens[0] == "q" || tokens[0] == "quit") {
+	    control.stop.store(true);
+	    run_wait(background);
+	    if (machine.waveform) waveform_close(waveform);
+	    if (machine.tracefile) tracefile_close(tracefile);
 	    return (EXIT_SUCCESS);
 	} else if (tokens[0] == "h" || tokens[0] == "help") {
 	    print_help();
@@ -124,29 +829,12 @@ int		main		    (int argc, char *argv[]) {
 	}
     }
 
-    return (EXIT_SUCCESS);
-}
-
-//------------------------------------------------------------------------------
-// Load Stream
-//------------------------------------------------------------------------------
-
-bool		load_stream	    (std::istream& in, Memory& m, RegisterFile& r, RegisterFile& p) {
-    std::string	    word;
-
-    m.clear();
-
-    while (!in.eof()) {
-	getline(in, word);
-
-	if (word.size() == WORD_SIZE)
-	    m.push_back(DWord(strtol(word.c_str(), NULL, 2))); 
-    }
-
-    for (size_t i = 0; i < r.size(); i++)   r[i] = 0;
-    for (size_t i = 0; i < p.size(); i++)   p[i] = 0;
+    control.stop.store(true);
+    run_wait(background);
+    if (machine.waveform) waveform_close(waveform);
+    if (machine.tracefile) tracefile_close(tracefile);
 
-    return (true);
+    return (EXIT_SUCCESS);
 }
 
 //------------------------------------------------------------------------------
@@ -156,241 +844,61 @@ bool		load_stream	    (std::istream& in, Memory& m, RegisterFile& r, RegisterFil
 void		print_help	    () {
     std::cerr << "\tCommand   Description" << std::endl;
     std::cerr << "\t---------------------------------------------" << std::endl;
-    std::cerr << "\tl <file>  Load binary file (must be unified memory)" << std::endl;
+    std::cerr << "\tl <file>  Load binary file (must be unified memory, 16 or 32-bit words)" << std::endl;
+    std::cerr << "\ta <lib>   Attach native program translated by ptrans (off detaches)" << std::endl;
+    std::cerr << "\tc <size> <line> <ways> [penalty] [wb|wt] [split|unified]" << std::endl;
+    std::cerr << "\t          Enable cache model (sizes in words, penalty defaults to 10)" << std::endl;
+    std::cerr << "\tc [off]   Print cache statistics or disable cache model" << std::endl;
+    std::cerr << "\tb <a>     Toggle breakpoint at address or label <a> (no argument lists breakpoints)" << std::endl;
+    std::cerr << "\tg [n]     Run n steps (defaults to until stopped) in the background" << std::endl;
+    std::cerr << "\tw         Print run status (PC, steps and instructions/s)" << std::endl;
+    std::cerr << "\tz         Pause background run (so does Ctrl-C for any step command)" << std::endl;
+    std::cerr << "\te [template|reference|generic] Print or select the step engine" << std::endl;
+    std::cerr << "\te <checked|unchecked> Enable (default) or skip memory bounds checks" << std::endl;
+    std::cerr << "\tf [on|off] Print execution profile or enable/disable profiling" << std::endl;
+    std::cerr << "\tv [on|off] Print coverage report or enable/disable instruction and branch coverage" << std::endl;
+    std::cerr << "\tv <file>  Write coverage bitmaps to <file> (merge and report with pcov)" << std::endl;
+    std::cerr << "\td on [w]  Count memory accesses per address, working set per w instructions (defaults to 1000)" << std::endl;
+    std::cerr << "\td [off]   Print memory heatmap summary or disable heatmap" << std::endl;
+    std::cerr << "\td <file>  Write heatmap histograms to <file>" << std::endl;
+    std::cerr << "\tj <file> [signals] Write a VCD waveform of pc, ir, r0-r15 and p0-p7 (or the signals given)" << std::endl;
+    std::cerr << "\t          to <file>, compressed when it ends in .gz" << std::endl;
+    std::cerr << "\tj [off]   Print waveform statistics or close the waveform" << std::endl;
     std::cerr << "\ti <p> <v> Set pregister <p> to <v>" << std::endl;
+    std::cerr << "\ty timer <p> <period> | input <p> <file> | output <p> [file]" << std::endl;
+    std::cerr << "\t          Back pregister <p> with a timer, an input file or an output capture" << std::endl;
+    std::cerr << "\ty uart <p> <in|-> <out|-> [period] [depth]" << std::endl;
+    std::cerr << "\t          Back <p> (data) and <p+1> (status) with a UART (period defaults to 10, depth to 16)" << std::endl;
+    std::cerr << "\ty clock <steps|cycles> Time device events by steps (default) or cycles" << std::endl;
+    std::cerr << "\ty [off]   Print device states or detach all devices" << std::endl;
+    std::cerr << "\tk <dir> [entries] [bytes]" << std::endl;
+    std::cerr << "\t          Memoize untraced runs in <dir> (entries defaults to 1024, 0 is unlimited)" << std::endl;
+    std::cerr << "\tk [off]   Print memo statistics or disable memoized runs" << std::endl;
+    std::cerr << "\tn [on|off] Print loop verdict or enable/disable non-terminating loop detection" << std::endl;
     std::cerr << "\to         Print i/o pregister file" << std::endl;
     std::cerr << "\tp         Print register file, i/o, and memory" << std::endl;
+    std::cerr << "\tp <text|raw|hex|json|csv> [s] [e] [diff] [> file]" << std::endl;
+    std::cerr << "\t          Dump registers, i/o and memory from s to e (diff keeps what changed since the last dump)" << std::endl;
+    std::cerr << "\tu <cores> [quantum] [order|reverse|rotate|random] [seed]" << std::endl;
+    std::cerr << "\t          Run cores on shared memory (quantum defaults to 1, P7 is the core number)" << std::endl;
+    std::cerr << "\tu [off]   Print core states or disable multiprocessor mode" << std::endl;
+    std::cerr << "\tu log [on|off|<file>] Enable/disable or print the shared-memory access log" << std::endl;
+    std::cerr << "\tu threads <n> Host threads for the cores (0 is one per processor)" << std::endl;
     std::cerr << "\tm <s> <e> Print memory regions from s to e (s defaults to 0, e to end of memory)" << std::endl;
+    std::cerr << "\tm size <words> [page] Reserve an address space of lazily allocated pages (page defaults to 256)" << std::endl;
+    std::cerr << "\tm size off Limit memory to the loaded image" << std::endl;
+    std::cerr << "\tm protect <s> <e> <rwx> Set permissions of the pages from s to e (e.g. r-x, rw-)" << std::endl;
+    std::cerr << "\tm pages  Print page permissions, allocated and dirty pages, and faults" << std::endl;
     std::cerr << "\tr         Print register file" << std::endl;
     std::cerr << "\ts <n>     Step n times (n defaults to 1)" << std::endl;
+    std::cerr << "\tx <k> <w> [n] Run n steps (defaults to until stopped) detailing w of every k+w" << std::endl;
+    std::cerr << "\tx         Print sampled instruction mix, branch and CPI estimates" << std::endl;
+    std::cerr << "\tt <on|off> Enable or disable instruction trace" << std::endl;
+    std::cerr << "\tt record [<file>|off] Print, start (in <file>) or finish a binary trace (compare with pdiff)" << std::endl;
     std::cerr << "\tq         Quit this program" << std::endl;
     std::cerr << "\th         This help message" << std::endl;
 }
 
-//------------------------------------------------------------------------------
-// Print Memory
-//------------------------------------------------------------------------------
-
-void		print_memory	    (Memory& m, size_t s, size_t e) {
-    std::cout << "<MEM> Decimal Hex    Binary" << std::endl;
-    std::cout << "----------------------------------------" << std::endl;
-    for (; s <= e && s < m.size(); s++) 
-	std::cout << "<" << std::setfill('0') << std::setw(3) << s << "> " << dword_to_pretty_string(m[s]) << std::endl;
-    std::cout << "----------------------------------------" << std::endl;
-}
-
-//------------------------------------------------------------------------------
-// Print PRegister File 
-//------------------------------------------------------------------------------
-
-void		print_pregfile	    (RegisterFile& prf) {
-    std::cout << "|REG| Decimal Hex    Binary" << std::endl;
-    std::cout << "----------------------------------------" << std::endl;
-    for (size_t p = 0; p < prf.size(); p++) 
-	std::cout << "|P" << std::setfill('0') << std::setw(2) << p << "| " << dword_to_pretty_string(prf[p]) << std::endl;
-    std::cout << "----------------------------------------" << std::endl;
-}
-
-//------------------------------------------------------------------------------
-// Print Register File 
-//------------------------------------------------------------------------------
-
-void		print_regfile	    (RegisterFile& rf, size_t pc) {
-    std::cout << "|REG| Decimal Hex    Binary" << std::endl;
-    std::cout << "----------------------------------------" << std::endl;
-    for (size_t r = 0; r < rf.size(); r++) 
-	std::cout << "|R" << std::setfill('0') << std::setw(2) << r << "| " << dword_to_pretty_string(rf[r]) << std::endl;
-    std::cout << "----------------------------------------" << std::endl;
-    std::cout << "[PC ] " << dword_to_pretty_string(DWord(pc)) << std::endl;
-    std::cout << "----------------------------------------" << std::endl;
-}
-
-//------------------------------------------------------------------------------
-// Step
-//------------------------------------------------------------------------------
-
-size_t		step		    (Memory& m, RegisterFile& rf, RegisterFile& prf, size_t pc, size_t s) {
-    DWord   inst;
-    OWord   Op;
-    RWord   Ra;
-    RWord   Rb;
-    RWord   Rc;
-    LWord   L;
-
-    long    ra;
-    long    rb;
-    long    rc;
-    long    jl;
-
-    for (size_t i = 0; i < s && pc < m.size(); i++) {
-	inst = m[pc];
-
-	Op = OWord(strtol(dword_to_string(inst).substr(0, 4).c_str(), NULL, 2));
-
-	switch (Op.to_ulong()) {
-	    case OP_LOAD:
-		Ra = RWord(strtol(dword_to_string(inst).substr(4, 4).c_str(), NULL, 2));
-		L  = LWord(strtol(dword_to_string(inst).substr(8, 8).c_str(), NULL, 2));
-
-		
-		std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
-			    << "Inst = " << dword_to_pretty_string(inst)
-			    << " -> MOV  R" << Ra.to_ulong() << ", " << L.to_ulong()
-			    << std::endl;
-
-		rf[Ra.to_ulong()] = m[L.to_ulong()];
-		break;
-	    case OP_STORE:
-		Ra = RWord(strtol(dword_to_string(inst).substr(4, 4).c_str(), NULL, 2));
-		L  = LWord(strtol(dword_to_string(inst).substr(8, 8).c_str(), NULL, 2));
-
-		std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
-			    << "Inst = " << dword_to_pretty_string(inst)
-			    << " -> MOV  " << L.to_ulong() << ", R" << Ra.to_ulong()
-			    << std::endl;
-		
-		m[L.to_ulong()] = rf[Ra.to_ulong()];
-		break;
-	    case OP_ADD:
-		Ra = RWord(strtol(dword_to_string(inst).substr(4, 4).c_str(), NULL, 2));
-		Rb = RWord(strtol(dword_to_string(inst).substr(8, 4).c_str(), NULL, 2));
-		Rc = RWord(strtol(dword_to_string(inst).substr(12, 4).c_str(), NULL, 2));
-		
-		std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
-			    << "Inst = " << dword_to_pretty_string(inst)
-			    << " -> ADD  R" << Ra.to_ulong()
-			    << ", R" << Rb.to_ulong()
-			    << ", R" << Rc.to_ulong()
-			    << std::endl;
-
-		rb = dword_to_long(rf[Rb.to_ulong()]);
-		rc = dword_to_long(rf[Rc.to_ulong()]);
-
-		rf[Ra.to_ulong()] = rb + rc;
-		break;
-	    case OP_LOADC:
-		Ra = RWord(strtol(dword_to_string(inst).substr(4, 4).c_str(), NULL, 2));
-		L  = LWord(strtol(dword_to_string(inst).substr(8, 8).c_str(), NULL, 2));
-
-		std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
-			    << "Inst = " << dword_to_pretty_string(inst)
-			    << " -> MOV  R" << Ra.to_ulong() << ", #" << lword_to_long(L)
-			    << std::endl;
-
-		rf[Ra.to_ulong()] = L.to_ulong();
-		if (L[L.size() - 1] == 1) 
-		    rf[Ra.to_ulong()] |= DWord(65280); // 1111 1111 0000 0000
-		break;
-	    case OP_SUB:
-		Ra = RWord(strtol(dword_to_string(inst).substr(4, 4).c_str(), NULL, 2));
-		Rb = RWord(strtol(dword_to_string(inst).substr(8, 4).c_str(), NULL, 2));
-		Rc = RWord(strtol(dword_to_string(inst).substr(12, 4).c_str(), NULL, 2));
-		
-		std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
-			    << "Inst = " << dword_to_pretty_string(inst)
-			    << " -> SUB  R" << Ra.to_ulong()
-			    << ", R" << Rb.to_ulong()
-			    << ", R" << Rc.to_ulong()
-			    << std::endl;
-
-		rb = dword_to_long(rf[Rb.to_ulong()]);
-		rc = dword_to_long(rf[Rc.to_ulong()]);
-		
-		rf[Ra.to_ulong()] = rb - rc;
-		break;
-	    case OP_JMPZ:
-		Ra = RWord(strtol(dword_to_string(inst).substr(4, 4).c_str(), NULL, 2));
-		L  = LWord(strtol(dword_to_string(inst).substr(8, 8).c_str(), NULL, 2));
-		
-		std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
-			    << "Inst = " << dword_to_pretty_string(inst)
-			    << " -> JMPZ R" << Ra.to_ulong()
-			    << ", " << lword_to_long(L)
-			    << std::endl;
-		
-		ra = dword_to_long(rf[Ra.to_ulong()]);
-		jl = lword_to_long(L);
-		
-		if (ra == 0) pc = pc + jl - 1;
-		break;
-	    case OP_JMPN:
-		Ra = RWord(strtol(dword_to_string(inst).substr(4, 4).c_str(), NULL, 2));
-		L  = LWord(strtol(dword_to_string(inst).substr(8, 8).c_str(), NULL, 2));
-		
-		std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
-			    << "Inst = " << dword_to_pretty_string(inst)
-			    << " -> JMPN R" << Ra.to_ulong()
-			    << ", " << lword_to_long(L)
-			    << std::endl;
-
-		ra = dword_to_long(rf[Ra.to_ulong()]);
-		jl = lword_to_long(L);
-		
-		if (ra < 0) pc = pc + jl - 1;
-		break;
-	    case OP_JMP:
-		L  = LWord(strtol(dword_to_string(inst).substr(8, 8).c_str(), NULL, 2));
-		
-		std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
-			    << "Inst = " << dword_to_pretty_string(inst)
-			    << " -> JMP  " << lword_to_long(L)
-			    << std::endl;
-
-		jl = lword_to_long(L);
-		
-		pc = pc + jl - 1;
-		break;
-	    case OP_MOVR:
-		Ra = RWord(strtol(dword_to_string(inst).substr(4, 4).c_str(), NULL, 2));
-		Rb = RWord(strtol(dword_to_string(inst).substr(8, 4).c_str(), NULL, 2));
-		L  = LWord(strtol(dword_to_string(inst).substr(12, 4).c_str(), NULL, 2));
-		
-		std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
-			    << "Inst = " << dword_to_pretty_string(inst)
-			    << " -> MOVR R" << Ra.to_ulong() 
-			    << ", R" << Rb.to_ulong() 
-			    << ", #" << lword_to_long(L) 
-			    << std::endl;
-
-		jl = lword_to_long(L);
-
-		rf[Ra.to_ulong()] = m[rf[Rb.to_ulong()].to_ulong() + jl];
-		break;
-	    case OP_IO:
-		Ra = RWord(strtol(dword_to_string(inst).substr(4, 4).c_str(), NULL, 2));
-		Rb = RWord(strtol(dword_to_string(inst).substr(8, 3).c_str(), NULL, 2));
-		rc = strtol(dword_to_string(inst).substr(11, 1).c_str(), NULL, 2);
-		
-		std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
-			    << "Inst = " << dword_to_pretty_string(inst)
-			    << " -> MOV  D" << rc
-			    << ", R" << Ra.to_ulong() 
-			    << ", P" << Rb.to_ulong()
-			    << std::endl;
-
-		if (rc) 
-		    prf[Rb.to_ulong()] = rf[Ra.to_ulong()];
-		else 
-		    rf[Ra.to_ulong()] = prf[Rb.to_ulong()];
-		break;
-	    case OP_END:
-		std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
-			    << "Inst = " << dword_to_pretty_string(inst)
-			    << " -> END"
-			    << std::endl;
-		return (pc);
-		break;
-	    default:
-		std::cerr   << "Unknown opcode: " << Op << " in " << dword_to_pretty_string(inst) << std::endl;
-		break;
-	}
-
-	pc++;
-    }
-
-    return (pc);
-}
-
 //------------------------------------------------------------------------------
 // vim: sts=4 sw=4 ts=8 ft=cpp
 //------------------------------------------------------------------------------
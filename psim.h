@@ -29,9 +29,18 @@
 #ifndef	__PSIM_H__
 #define	__PSIM_H__
 
+#include <array>
+#include <atomic>
 #include <bitset>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <stdint.h>
 #include <iostream>
+#include <list>
 #include <map>
+#include <queue>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -42,6 +51,7 @@
 static const size_t WORD_SIZE	=   16;
 static const size_t PRF_SIZE	=   8;
 static const size_t RF_SIZE	=   16;
+static const size_t OP_SIZE	=   16;
 
 //------------------------------------------------------------------------------
 // Type Definitions
@@ -64,6 +74,9 @@ typedef std::vector<Tokens>		TextList;
 typedef std::vector<DWord>		Memory;
 typedef std::vector<DWord>		RegisterFile;
 
+typedef std::map<size_t, size_t>	CounterTable;
+typedef std::vector<size_t>		Profile;
+
 //------------------------------------------------------------------------------
 // Enumerations
 //------------------------------------------------------------------------------
@@ -83,15 +96,708 @@ typedef enum {
     OP_UNKNOWN
 } OPCODE;
 
+typedef enum {
+    IS_NONE = 0,	// Unused field
+    IS_RA,		// Instruction field slots in a decoded instruction
+    IS_RB,
+    IS_RC,
+    IS_IMM
+} ISA_SLOT;
+
+typedef enum {
+    WP_WRITE_BACK	= 0,	// Write-back, write-allocate
+    WP_WRITE_THROUGH		// Write-through, no write-allocate
+} WRITE_POLICY;
+
+typedef enum {
+    SE_TEMPLATE = 0,	// Policy engine specialized for the enabled features
+    SE_REFERENCE,	// Untemplated loop with runtime feature checks
+    SE_GENERIC		// Word-width template instantiated for 16 bits
+} STEP_ENGINE;
+
+typedef enum {
+    IP_ORDER	= 0,	// Stores are committed in core order at each barrier
+    IP_REVERSE,		// Highest core first
+    IP_ROTATE,		// Core order rotated by one every quantum
+    IP_RANDOM		// Seeded shuffle every quantum
+} INTERLEAVE_POLICY;
+
+typedef enum {
+    DV_TIMER	= 0,	// Counts elapsed periods, writes set the period
+    DV_INPUT,		// Reads take the next word of a file, -1 after the end
+    DV_OUTPUT,		// Writes are captured and optionally written to a file
+    DV_UART		// Data pregister with receive and transmit FIFOs, status in the next
+} DEVICE_TYPE;
+
+typedef enum {
+    DC_STEPS	= 0,	// Event times are instruction counts
+    DC_CYCLES		// Event times are cycle counts
+} DEVICE_CLOCK;
+
+typedef enum {
+    DE_TICK	= 0,	// Timer period elapsed
+    DE_RECEIVE,		// UART input word arrived
+    DE_TRANSMIT		// UART output word finished sending
+} DEVICE_EVENT;
+
+typedef enum {
+    SV_LOAD	= 1,	// Image text (.ubin); replies hash and word count
+    SV_LOAD_HASH,	// Hash of an image loaded before; replies word count
+    SV_INPUT,		// Pregister and value pairs
+    SV_RUN,		// Step budget, 0 runs until END; replies steps, PC and halted
+    SV_STATE,		// Optional memory start and count; replies the machine state
+    SV_SNAPSHOT,	// Saves the machine state for SV_RESET
+    SV_RESET		// Restores the snapshot, or the loaded image without one
+} SERVER_REQUEST;
+
+typedef enum {
+    SS_OK	= 0,
+    SS_ERROR		// Payload is the error message
+} SERVER_STATUS;
+
+typedef enum {
+    WS_PC	= 0,			// Waveform signals, one bit each in a selection
+    WS_IR,
+    WS_REGFILE,
+    WS_PREGFILE = WS_REGFILE + RF_SIZE,
+    WS_SIZE	= WS_PREGFILE + PRF_SIZE
+} WAVE_SIGNAL;
+
+typedef enum {
+    DF_TEXT	= 0,	// Columns of the print commands
+    DF_RAW,		// Binary, the layout of the server's state reply
+    DF_HEX,
+    DF_JSON,
+    DF_CSV
+} DUMP_FORMAT;
+
+typedef enum {
+    TK_NONE	= 0,	// Location an instruction wrote, in a binary trace
+    TK_REGISTER,
+    TK_PREGISTER,
+    TK_MEMORY
+} TRACE_KIND;
+
+typedef enum {
+    FK_CRASH	= 0,	// Signal while assembling or running (a reproducer is all there is)
+    FK_EXCEPTION,	// Exception escaped the assembler or a step engine
+    FK_ASSEMBLY,	// Assembled image is the wrong size or has the wrong opcodes
+    FK_REPEAT,		// Runs from the same snapshot disagree
+    FK_ENGINE,		// Reference or generic engine disagrees with the template
+    FK_RANGE,		// Memory access outside the image, or a stop without one
+    FK_SIZE
+} FUZZ_KIND;
+
+typedef enum {
+    PF_READ	= 1 << 0,	// LOAD and MOVR may read the page
+    PF_WRITE	= 1 << 1,	// STORE may write the page
+    PF_EXEC	= 1 << 2,	// Instructions may be fetched from the page
+    PF_DIRTY	= 1 << 3,	// Executable page written since it was last found clean
+    PF_RWX	= PF_READ | PF_WRITE | PF_EXEC
+} PAGE_FLAG;
+
+typedef enum {
+    LK_MEMORY	= 0,		// State hash keys, offset by address or index
+    LK_REGFILE	= 1 << 20,
+    LK_PREGFILE = 2 << 20,
+    LK_PC	= 3 << 20
+} LOOP_KEY;
+
+//------------------------------------------------------------------------------
+// Structures
+//------------------------------------------------------------------------------
+
+struct IsaField {
+    uint8_t	slot;		// ISA_SLOT
+    uint8_t	shift;		// Position of the least significant bit
+    uint8_t	width;
+    bool	sign;		// Sign-extended (constants and jump offsets)
+};
+
+struct IsaOp {
+    const char *name;		// Assembler mnemonic, NULL for undefined opcodes
+    const char *format;		// Disassembly, %a %b %c %i are replaced by slots
+    IsaField	fields[3];	// Assembler operand order
+};
+
+struct DecodedInst {
+    uint8_t	op;		// OPCODE, OP_UNKNOWN when undefined
+    uint8_t	ra;
+    uint8_t	rb;
+    uint8_t	rc;
+    int16_t	imm;
+};
+
+typedef std::array<DecodedInst, 1 << WORD_SIZE> DecodeTableType;
+
+struct OptimizeStats {
+    size_t	before;		// Static instructions
+    size_t	after;
+    size_t	threaded;	// Jumps retargeted past jump chains
+    size_t	folded;		// Conditional branches with a known outcome
+    size_t	redundant;	// Reloads, constant loads and no-op arithmetic
+    size_t	jumps;		// Jumps to the next instruction
+    size_t	dead;		// Unreachable instructions
+    size_t	rewritten;	// Instructions saved by rewrite database entries
+    std::string	skipped;	// Why the text was left alone, empty if it was not
+};
+
+// A straight-line sequence and a shorter one with the same effect on every
+// register and memory word.  Registers R0, R1, ... and addresses A0, A1, ...
+// stand for any distinct registers and data words; constants are literal.
+
+struct Rewrite {
+    TextList	pattern;
+    TextList	replacement;
+    bool	proved;		// Checked exhaustively, otherwise on random tests only
+};
+
+typedef std::vector<Rewrite>		RewriteTable;
+
+// Assembler settings (the pasm flags) and what it collects while parsing
+struct AsmState {
+    bool	  unified;	// Data follows the text in one memory
+    size_t	  optimize;	// Optimizer level, 0 when off
+    RewriteTable *rewrites;	// Optional, NULL when disabled
+    size_t	  width;	// Word width, 16 or 32
+    Tokens	  exports;	// .global labels
+    std::vector<long> data_values; // Untruncated WORD values for wide images
+    OptimizeStats optimized;
+};
+
+struct SuperStats {
+    size_t	alphabet;	// Candidate instructions per position
+    size_t	candidates;	// Sequences evaluated
+    size_t	survivors;	// Sequences that passed the first test vector
+    double	seconds;
+};
+
+struct SourceLine {
+    size_t	address;
+    size_t	line;
+    bool	data;		// Data word rather than instruction
+    std::string label;		// Label defined on this line, if any
+};
+
+typedef std::vector<SourceLine>		SourceMap;
+
+struct Relocation {
+    size_t	address;	// Text word whose operand is filled in
+    size_t	shift;		// Operand field
+    size_t	width;
+    bool	relative;	// Jump offset from the word rather than an address
+    std::string	symbol;
+};
+
+struct ObjectModule {
+    std::string	source;
+    DataList	text;		// Relocated operands are 0
+    DataList	data;
+    LabelTable	text_labels;	// Relative to the start of each section
+    LabelTable	data_labels;
+    Tokens	exports;	// Labels named by .global
+    std::vector<Relocation> relocations;
+};
+
+struct SymbolTable {
+    std::string	file;
+    SourceMap	lines;		// Indexed by address
+    Tokens	names;		// Label or label+offset, indexed by address
+    Tokens	locations;	// file:line, indexed by address
+    Tokens	strings;	// Name and location as printed, indexed by address
+    LabelTable	labels;
+};
+
+struct CacheLine {
+    size_t	tag;
+    size_t	used;		// Timestamp of last access (for LRU)
+    bool	valid;
+    bool	dirty;
+};
+
+struct Cache {
+    size_t	size;		// Total size in words
+    size_t	line;		// Line size in words
+    size_t	ways;		// Associativity (1 = direct-mapped)
+    size_t	sets;
+    WRITE_POLICY policy;
+
+    std::vector<CacheLine> lines;
+    size_t	tick;
+
+    size_t	reads;
+    size_t	writes;
+    size_t	read_misses;
+    size_t	write_misses;
+    size_t	writebacks;
+};
+
+struct CacheModel {
+    Cache	icache;
+    Cache	dcache;
+    bool	unified;	// Fetches go through dcache when set
+
+    size_t	hit_cycles;
+    size_t	miss_cycles;
+    size_t	cycles;		// Memory cycles spent by fetches and data accesses
+
+    CounterTable misses;	// Misses per PC
+};
+
+struct LoopCheck {
+    uint64_t	hash;		// Incremental hash of memory, regfile and pregfile
+
+    uint64_t	saved_hash;	// State saved at the last power of two (Brent)
+    size_t	saved_pc;
+    Memory	saved_memory;
+    std::vector<Memory> saved_frames;
+    RegisterFile saved_regfile;
+    RegisterFile saved_pregfile;
+    size_t	power;
+    size_t	lambda;
+
+    bool	found;		// Exact state repetition detected
+    size_t	loop_pc;
+    size_t	period;
+};
+
+struct MemoEntry {
+    size_t	size;		// Bytes in the file
+    std::list<std::string>::iterator use;
+};
+
+struct MemoCache {
+    std::string	path;		// Directory with one file per memoized run
+    size_t	max_entries;	// 0 means unlimited
+    size_t	max_bytes;	// 0 means unlimited
+
+    std::map<std::string, MemoEntry> entries;	// Per key, scanned when opened
+    std::list<std::string> lru;	// Keys, least recently used first
+    size_t	bytes;		// Total size of the entries
+
+    size_t	hits;
+    size_t	misses;
+    size_t	evictions;
+};
+
+struct CostModel {
+    size_t	op_cycles[OP_SIZE];	// Execute cycles per opcode
+    size_t	mem_cycles;		// Cycles per memory access without cache
+};
+
+struct Coverage {
+    size_t	size;		// Addresses covered by the bitmaps
+    uint64_t	image;		// Hash of the memory image the run started from
+
+    std::vector<uint64_t> executed;	// One bit per address
+    std::vector<uint64_t> taken;	// JMPZ and JMPN directions
+    std::vector<uint64_t> not_taken;
+};
+
+struct Heatmap {
+    size_t	window;		// Instructions per working-set window
+
+    std::vector<size_t>	 reads;		// LOAD and MOVR, per address
+    std::vector<size_t>	 writes;	// STORE, per address
+    std::vector<uint8_t> code;		// Fetched as an instruction
+
+    std::vector<size_t>	 last;		// Time of the previous access, 0 for never
+    std::vector<long>	 tree;		// Fenwick tree marking each address's last time
+    size_t	time;		// Accesses since the tree was last compacted
+    size_t	accesses;
+    size_t	cold;		// First accesses to an address
+    std::vector<size_t>	 reuse;		// Reuse distances in powers of two
+
+    std::vector<size_t>	 epoch;		// Window of the last access plus one
+    std::vector<size_t>	 working_set;	// Distinct addresses per finished window
+    size_t	current;	// Window of the latest access
+    size_t	touched;	// Distinct addresses so far in the current window
+};
+
+struct Device {
+    DEVICE_TYPE	type;
+    size_t	pregister;	// UART status is the next pregister
+    size_t	period;		// Timer period, UART time per word
+    size_t	attached;	// Timer period given at attach, restored on reset
+    size_t	depth;		// UART FIFO capacity
+    size_t	generation;	// Events scheduled before the last reschedule are stale
+    uint16_t	count;		// Timer periods elapsed
+
+    std::string		  input_path;	// Empty when none
+    std::vector<uint16_t> input;
+    size_t		  position;	// Next input word
+    std::string		  output_path;	// Empty when only captured
+    FILE		 *output;
+    std::vector<uint16_t> captured;
+
+    std::deque<uint16_t>  rx;
+    std::deque<uint16_t>  tx;
+    bool		  sending;	// A DE_TRANSMIT is scheduled
+    size_t		  overruns;	// Words dropped by a full FIFO
+};
+
+struct DeviceEvent {
+    uint64_t	time;
+    size_t	device;
+    size_t	generation;
+    DEVICE_EVENT kind;
+
+    bool	operator> (const DeviceEvent& e) const { return (time > e.time); }
+};
+
+struct DeviceBus {
+    DEVICE_CLOCK	clock;
+    std::vector<Device>	devices;
+    int			map[PRF_SIZE];	// Device per pregister, -1 for a plain pregister
+    std::priority_queue<DeviceEvent, std::vector<DeviceEvent>, std::greater<DeviceEvent> > events;
+    uint64_t		next;		// Time of the earliest event, UINT64_MAX for none
+    size_t		fired;		// Events handled
+    size_t		calls;		// Pregister reads and writes handled by devices
+};
+
+struct Waveform {
+    FILE	       *file;
+    bool		piped;		// Written through gzip
+    std::vector<char>	buffer;
+    size_t		used;
+    uint32_t		selected;	// One bit per WAVE_SIGNAL
+    uint16_t		value[WS_SIZE];	// Last value written
+    bool		started;	// Initial values have been dumped
+    size_t		time;		// Last timestamp written
+    size_t		offset;		// Added to steps so times never go back
+    long		written;	// Signal the previous instruction wrote, -1 for none
+    size_t		changes;	// Value changes written
+    size_t		bytes;		// Before compression
+};
+
+struct DumpState {
+    bool		  valid;	// A dump has been taken
+    size_t		  pc;
+    std::vector<uint16_t> regfile;
+    std::vector<uint16_t> pregfile;
+    std::vector<uint16_t> memory;
+};
+
+struct TraceChunk {
+    uint64_t	offset;		// File offset of the compressed chunk
+    uint64_t	first;		// Step of the first record
+    uint32_t	steps;		// Records in the chunk
+    uint32_t	bytes;		// Compressed size
+    uint32_t	raw;		// Delta-encoded size
+};
+
+struct TraceStep {
+    uint64_t	step;
+    size_t	pc;
+    uint16_t	ir;
+    uint8_t	kind;		// TRACE_KIND
+    size_t	location;	// Register, pregister or address
+    uint16_t	value;		// Written value
+};
+
+struct TraceFile {
+    FILE	       *file;
+    std::vector<TraceChunk> index;
+    std::vector<uint8_t> raw;		// Current chunk, delta encoded
+    std::vector<uint8_t> packed;	// Current chunk, compressed
+    uint64_t		steps;		// Records written, including the current chunk
+    uint64_t		offset;		// End of the file
+    size_t		records;	// In the current chunk
+    size_t		pc;		// Expected pc of the next record
+
+    // Delta state, reset at every chunk so chunks decode independently
+    std::vector<uint16_t> words;	// Last instruction word per pc
+    std::vector<uint16_t> values;	// Last value per register, pregister and address
+
+    bool		pending;	// An instruction awaits its written value
+    size_t		pending_pc;
+    uint16_t		pending_ir;
+};
+
+struct SampleMetric {
+    double	sum;		// Of per-window values
+    double	sum2;		// Of squared per-window values
+    size_t	n;		// Windows that contributed
+};
+
+struct SampleStats {
+    size_t	period;		// Instructions fast-forwarded before each window
+    size_t	window;		// Instructions per detailed window
+
+    size_t	windows;
+    size_t	steps;		// All instructions run while sampling
+    size_t	detailed;	// Instructions run inside windows
+
+    size_t	ops[OP_SIZE];	// Executed in windows
+    size_t	taken[OP_SIZE];	// Conditional branches taken in windows
+
+    SampleMetric mix[OP_SIZE];	// Fraction of each window's instructions
+    SampleMetric taken_rate[OP_SIZE];
+    SampleMetric cpi;
+};
+
+struct RunControl {
+    std::atomic<bool>	stop;		// Pause at the next instruction boundary
+    std::atomic<bool>	running;	// A step command is executing
+    std::atomic<size_t> pc;		// Published periodically while running
+    std::atomic<size_t> steps;
+};
+
+struct NativeState {
+    uint16_t	regfile[RF_SIZE];
+    uint16_t	pregfile[PRF_SIZE];
+    uint16_t   *memory;
+    size_t	size;
+    size_t	pc;
+    size_t	steps;
+    size_t	cycles;
+    bool	halted;
+    bool	fallback;	// Instruction at pc must be run by step()
+    bool	stale;		// Translated code no longer matches memory
+    const CostModel *cost;
+    const uint8_t *guarded;	// Addresses whose translation checks memory
+};
+
+struct MemAccess {
+    size_t	step;		// Instructions executed before the access
+    size_t	pc;
+    size_t	address;
+    uint16_t	value;		// Word read or written
+    bool	write;
+};
+
+typedef std::vector<MemAccess>		AccessLog;
+
+typedef void (*NativeProgram)(NativeState&, size_t);
+
+struct NativeImage {
+    const uint16_t *image;	// Memory image the program was translated from
+    const uint8_t  *guarded;
+    size_t	    size;
+    NativeProgram   program;
+};
+
+// Addresses in the image stay in the machine memory; the rest of the address
+// space is backed by frames allocated a page at a time on the first store.
+
+struct PageTable {
+    size_t	size;		// Address space in words, at least the image
+    size_t	reserved;	// Size asked for, kept across loads
+    size_t	shift;		// Pages are 1 << shift words
+    size_t	image;		// Words backed by the machine memory
+
+    std::vector<uint8_t> flags;		// PAGE_FLAG bits per page
+    std::vector<Memory>	 frames;	// Per page, empty until written
+
+    const NativeImage *checked;	// Translation clean image pages match, NULL for none
+    size_t	allocated;	// Frames allocated
+    size_t	faults;		// Accesses page protection stopped
+    size_t	dirtied;	// Clean executable pages written
+};
+
+struct Machine {
+    Memory	    memory;
+    RegisterFile    regfile;
+    RegisterFile    pregfile;
+    size_t	    pc;
+    size_t	    steps;	// Instructions executed (including END)
+    size_t	    cycles;	// Execute plus memory cycles
+    bool	    halted;	// END was executed
+    bool	    trace;	// Print each instruction as it executes
+
+    std::vector<bool> breakpoints; // Indexed by address, empty when none
+    Profile	   *profile;	// Optional executions per PC
+    SymbolTable	   *symbols;	// Optional source map
+
+    CostModel	    cost;
+    CacheModel	   *cache;	// Optional, NULL when disabled
+    LoopCheck	   *loop;	// Optional, NULL when disabled
+    const NativeImage *native;	// Optional translated program, NULL when disabled
+    RunControl	   *control;	// Optional, NULL when disabled
+    AccessLog	   *accesses;	// Optional, NULL when disabled
+    Coverage	   *coverage;	// Optional, NULL when disabled
+    Heatmap	   *heatmap;	// Optional, NULL when disabled
+    DeviceBus	   *devices;	// Optional, NULL when disabled
+    Waveform	   *waveform;	// Optional, NULL when disabled
+    TraceFile	   *tracefile;	// Optional, NULL when disabled
+    PageTable	   *pages;	// Optional, NULL when memory is just the image
+    STEP_ENGINE	    engine;
+    bool	    checked;	// Stop on out-of-range memory accesses
+};
+
+struct SharedAccess {
+    size_t	quantum;
+    size_t	core;
+    MemAccess	access;
+    bool	race;		// Another core wrote or read a written word in the quantum
+};
+
+struct Multiprocessor {
+    size_t	cores;
+    size_t	quantum;	// Instructions per core between barriers
+    size_t	threads;	// Host threads, 0 for one per online processor
+    INTERLEAVE_POLICY policy;
+    uint64_t	seed;
+    uint64_t	random;		// IP_RANDOM generator state
+
+    std::vector<Machine>   machines;	// Private registers, pc and memory view
+    std::vector<AccessLog> accesses;	// Per core, for the current quantum
+
+    size_t	quanta;		// Barriers so far
+    size_t	races;		// Conflicting words summed over quanta
+    bool	logging;
+    std::vector<SharedAccess> log;
+};
+
+// A program and the pregister values it starts with.  Cases mutated as
+// images have no source and skip the assembler.
+
+struct FuzzCase {
+    std::string	 source;
+    Memory	 image;
+    RegisterFile inputs;
+};
+
+struct Fuzzer {
+    uint64_t	random;		// xorshift64* state
+    size_t	budget;		// Steps per run
+    bool	engines;	// Also run the reference and generic engines
+    std::string	findings;	// Directory for reproducers
+
+    std::vector<FuzzCase> corpus;	// Cases that reached new features
+    std::vector<uint8_t>  features;	// Indexed by feature hash
+    std::set<uint64_t>	  reported;	// Kind and opcode of findings written
+
+    Machine	machine;	// Reset from each case, never reloaded
+    Coverage	coverage;
+    AccessLog	accesses;
+    FuzzCase	current;
+
+    size_t	execs;
+    size_t	assembled;	// Sources the assembler accepted
+    size_t	rejected;
+    size_t	stopped;	// Runs stopped at an out-of-range access
+    size_t	covered;	// Distinct features
+    size_t	found[FK_SIZE];	// Distinct findings
+};
+
+//------------------------------------------------------------------------------
+// Instruction Set
+//------------------------------------------------------------------------------
+
+// The only description of the instruction encodings: the assembler encoder,
+// the decode table used by the simulator and the disassembler are all
+// generated from it.
+
+static constexpr IsaOp IsaTable[OP_SIZE] = {
+    { "MOV",  "MOV  R%a, %i",	     { { IS_RA, 8, 4, false }, { IS_IMM, 0, 8, false } } },	// LOAD
+    { "MOV",  "MOV  %i, R%a",	     { { IS_RA, 8, 4, false }, { IS_IMM, 0, 8, false } } },	// STORE
+    { "ADD",  "ADD  R%a, R%b, R%c",  { { IS_RA, 8, 4, false }, { IS_RB, 4, 4, false }, { IS_RC, 0, 4, false } } },
+    { "MOV",  "MOV  R%a, #%i",	     { { IS_RA, 8, 4, false }, { IS_IMM, 0, 8, true } } },	// LOADC
+    { "SUB",  "SUB  R%a, R%b, R%c",  { { IS_RA, 8, 4, false }, { IS_RB, 4, 4, false }, { IS_RC, 0, 4, false } } },
+    { "JMPZ", "JMPZ R%a, %i",	     { { IS_RA, 8, 4, false }, { IS_IMM, 0, 8, true } } },
+    { "JMPN", "JMPN R%a, %i",	     { { IS_RA, 8, 4, false }, { IS_IMM, 0, 8, true } } },
+    { "JMP",  "JMP  %i",	     { { IS_IMM, 0, 12, true } } },
+    { "MOVR", "MOVR R%a, R%b, #%c",  { { IS_RA, 8, 4, false }, { IS_RB, 4, 4, false }, { IS_RC, 0, 4, false } } },
+    { NULL,   NULL,		     { } },
+    { NULL,   NULL,		     { } },
+    { NULL,   NULL,		     { } },
+    { NULL,   NULL,		     { } },
+    { NULL,   NULL,		     { } },
+    { "MOV",  "MOV  D%c, R%a, P%b",  { { IS_RA, 8, 4, false }, { IS_RB, 5, 3, false }, { IS_RC, 4, 1, false } } },	// IO
+    { "END",  "END",		     { } },
+};
+
+static const size_t ISA_FORMAT_SIZE =	32;	// Longest isa_format() output
+static const size_t WORD_FORMAT_SIZE =	40;	// Longest word_format() output
+
+//------------------------------------------------------------------------------
+// Word Widths
+//------------------------------------------------------------------------------
+
+// Wider words keep the opcode and register fields at the top of the word and
+// widen the immediate in the low bits, so 32-bit words have 24-bit addresses
+// and constants and 28-bit jump offsets.  Field masks are compile-time
+// constants of each instantiation.
+
+template <size_t W> struct WordTraits;
+
+template <> struct WordTraits<16> {
+    typedef uint16_t	Word;
+    typedef int16_t	Signed;
+};
+
+template <> struct WordTraits<32> {
+    typedef uint32_t	Word;
+    typedef int32_t	Signed;
+};
+
+template <size_t W>
+static constexpr IsaField isa_wide_field (const IsaField& f) {
+    return (f.slot == IS_IMM ? IsaField{ f.slot, f.shift, (uint8_t)(f.width + W - WORD_SIZE), f.sign }
+			     : IsaField{ f.slot, (uint8_t)(f.shift + W - WORD_SIZE), f.width, f.sign });
+}
+
+template <size_t W>
+static constexpr typename WordTraits<W>::Word isa_encode_word (OPCODE op, long a = 0, long b = 0, long c = 0) {
+    long			  operands[3] = { a, b, c };
+    typename WordTraits<W>::Word  w	      = (typename WordTraits<W>::Word)op << (W - 4);
+
+    for (size_t i = 0; i < 3; i++) {
+	IsaField f = isa_wide_field<W>(IsaTable[op].fields[i]);
+
+	if (f.slot != IS_NONE)
+	    w |= (operands[i] & ((1L << f.width) - 1)) << f.shift;
+    }
+
+    return (w);
+}
+
+template <size_t W>
+struct WideMachine {
+    typedef typename WordTraits<W>::Word Word;
+
+    std::vector<Word> memory;
+    Word	regfile[RF_SIZE];
+    Word	pregfile[PRF_SIZE];
+    size_t	pc;
+    size_t	steps;
+    size_t	cycles;
+    bool	halted;
+    bool	trace;
+    CostModel	cost;
+    SymbolTable *symbols;	// Optional source map
+    RunControl	*control;	// Optional, NULL when disabled
+};
+
+extern AsmState	Assembler;
+extern const DecodeTableType DecodeTable;
+
 //------------------------------------------------------------------------------
 // Function Prototypes
 //------------------------------------------------------------------------------
 
+extern void	asm_init	    (AsmState&);
+extern bool	assemble_object	    (std::ostream&, std::string, LabelTable&, DataList&, TextList&, SourceMap&);
 extern bool	assemble_stream	    (std::ostream&, LabelTable&, DataList&, TextList&);
-extern bool	parse_stream	    (std::istream&, LabelTable&, DataList&, TextList&);
+extern bool	parse_stream	    (std::istream&, LabelTable&, DataList&, TextList&, SourceMap&);
+extern void	write_source_map    (std::ostream&, std::string, SourceMap&);
 extern std::string  get_label	    (std::string&);
 extern int	get_label_value	    (LabelTable&, std::string);
 
+extern bool	link_objects	    (std::vector<ObjectModule>&, bool, Memory&, std::string&);
+extern bool	object_load	    (std::istream&, ObjectModule&);
+extern void	object_write	    (std::ostream&, ObjectModule&);
+
+extern bool	optimize_text	    (TextList&, SourceMap&, LabelTable&, LabelTable&, size_t, bool, RewriteTable*, OptimizeStats&);
+extern bool	rewrite_load	    (std::istream&, RewriteTable&);
+extern void	rewrite_write	    (std::ostream&, RewriteTable&);
+
+extern bool	superoptimize	    (TextList&, size_t, size_t, Rewrite&, SuperStats&, std::string&);
+
+extern DWord	isa_encode	    (OPCODE, long = 0, long = 0, long = 0);
+extern size_t	isa_format	    (char *, uint16_t);
+
 extern Tokens	tokenize	    (std::string&);
 extern bool	token_is_address    (std::string&);
 extern bool	token_is_constant   (std::string&);
@@ -107,16 +813,135 @@ extern void	trim_comma	    (std::string&);
 extern void	trim_comment	    (std::string&);
 extern void	trim_whitespace	    (std::string&);
 
-extern bool	load_stream	    (std::istream&, Memory&, RegisterFile&, RegisterFile&);
 extern long	dword_to_long	    (DWord);
 extern std::string dword_to_pretty_string (DWord);
 extern std::string dword_to_string  (DWord);
+extern size_t	word_format	    (char *, uint16_t);
 extern long	lword_to_long	    (LWord);
 extern void	print_help	    ();
-extern void	print_memory	    (Memory&, size_t, size_t);
+
+extern void	control_publish	    (RunControl&, size_t, size_t);
+extern void	cost_init	    (CostModel&);
+extern bool	load_stream	    (std::istream&, Memory&, RegisterFile&, RegisterFile&);
+extern void	machine_init	    (Machine&);
+extern void	machine_reset	    (Machine&);
+extern void	print_memory	    (Memory&, size_t, size_t, SymbolTable*);
 extern void	print_pregfile	    (RegisterFile&);
-extern void	print_regfile	    (RegisterFile&, size_t);
-extern size_t	step		    (Memory&, RegisterFile&, RegisterFile&, size_t, size_t);
+extern void	print_profile	    (Profile&, SymbolTable*);
+extern void	print_regfile	    (RegisterFile&, size_t, SymbolTable*);
+extern size_t	step_reference	    (Machine&, size_t);
+extern std::string trace_symbol	    (SymbolTable*, size_t, long);
+
+extern size_t	step		    (Machine&, size_t);
+
+extern bool	cache_access	    (Cache&, size_t, bool);
+extern bool	cache_configure	    (CacheModel&, size_t, size_t, size_t, size_t, size_t, WRITE_POLICY, bool);
+extern size_t	cache_fetch	    (CacheModel&, size_t);
+extern size_t	cache_read	    (CacheModel&, size_t, size_t);
+extern void	cache_reset	    (CacheModel&);
+extern size_t	cache_write	    (CacheModel&, size_t, size_t);
+extern void	print_cache	    (CacheModel&, SymbolTable*);
+
+extern bool	loop_check	    (LoopCheck&, Machine&, size_t);
+extern void	loop_reset	    (LoopCheck&, Machine&);
+extern void	loop_write	    (LoopCheck&, size_t, DWord, DWord);
+extern void	print_loop	    (LoopCheck&);
+
+extern void	heatmap_access	    (Heatmap&, size_t, size_t, bool);
+extern void	heatmap_reset	    (Heatmap&, size_t, size_t);
+extern bool	heatmap_write	    (std::ostream&, Heatmap&, SymbolTable*);
+extern void	print_heatmap	    (Heatmap&, SymbolTable*);
+
+extern bool	device_attach	    (DeviceBus&, Machine&, Device&);
+extern void	device_clear	    (DeviceBus&);
+extern void	device_events	    (DeviceBus&, Machine&, uint64_t);
+extern void	device_init	    (Device&, DEVICE_TYPE, size_t);
+extern uint16_t	device_read	    (DeviceBus&, Machine&, size_t);
+extern void	device_reset	    (DeviceBus&, Machine&);
+extern void	device_write	    (DeviceBus&, Machine&, size_t, uint64_t);
+extern void	print_devices	    (DeviceBus&, Machine&);
+
+extern void	fuzz_add	    (Fuzzer&, const std::string&);
+extern void	fuzz_init	    (Fuzzer&, uint64_t, size_t, bool, const std::string&);
+extern bool	fuzz_one	    (Fuzzer&);
+extern void	print_fuzzer	    (Fuzzer&, double);
+
+extern bool	dump_format	    (const std::string&, DUMP_FORMAT&);
+extern void	dump_state	    (std::string&, Machine&, DUMP_FORMAT, size_t, size_t, DumpState&, bool);
+
+extern void	print_tracefile	    (TraceFile&);
+extern bool	tracefile_close	    (TraceFile&);
+extern bool	tracefile_decode    (const TraceChunk&, std::vector<uint8_t>&, std::vector<TraceStep>&);
+extern void	tracefile_finish    (TraceFile&, Machine&);
+extern bool	tracefile_index	    (FILE *, std::vector<TraceChunk>&);
+extern bool	tracefile_open	    (TraceFile&, const std::string&);
+extern bool	tracefile_read	    (FILE *, const TraceChunk&, std::vector<uint8_t>&);
+extern void	tracefile_record    (TraceFile&, Machine&, size_t, uint16_t);
+extern std::string tracefile_string (TraceStep&);
+
+extern void	print_waveform	    (Waveform&);
+extern void	waveform_close	    (Waveform&);
+extern bool	waveform_open	    (Waveform&, const std::string&, uint32_t);
+extern void	waveform_sample	    (Waveform&, Machine&, size_t, size_t, uint16_t, bool);
+extern bool	waveform_select	    (Tokens&, size_t, uint32_t&);
+
+extern size_t	step_generic	    (Machine&, size_t);
+template <size_t W> extern bool	  wide_load	(std::istream&, WideMachine<W>&);
+template <size_t W> extern void	  wide_print_memory (WideMachine<W>&, size_t, size_t);
+template <size_t W> extern void	  wide_print_pregfile (WideMachine<W>&);
+template <size_t W> extern void	  wide_print_regfile (WideMachine<W>&);
+template <size_t W> extern void	  wide_reset	(WideMachine<W>&);
+template <size_t W> extern size_t wide_step	(WideMachine<W>&, size_t);
+
+extern bool	load_symbols	    (std::istream&, SymbolTable&);
+extern long	symbol_address	    (SymbolTable&, std::string);
+extern const std::string& symbol_location (SymbolTable*, size_t);
+extern const std::string& symbol_name	   (SymbolTable*, size_t);
+extern const std::string& symbol_string	   (SymbolTable*, size_t);
+
+extern bool	server_run	    (const std::string&, size_t);
+
+extern bool	coverage_load	    (std::istream&, Coverage&);
+extern bool	coverage_merge	    (Coverage&, Coverage&);
+extern void	coverage_reset	    (Coverage&, Memory&);
+extern bool	coverage_write	    (std::ostream&, Coverage&);
+extern void	print_coverage	    (std::ostream&, Coverage&, Memory&, SymbolTable*);
+
+extern void	memo_evict	    (MemoCache&);
+extern bool	memo_init	    (MemoCache&, const std::string&, size_t, size_t);
+extern std::string memo_key	    (Machine&, size_t);
+extern bool	memo_lookup	    (MemoCache&, const std::string&, Machine&);
+extern bool	memo_store	    (MemoCache&, const std::string&, Machine&);
+extern void	print_memo	    (MemoCache&);
+
+extern bool	mp_configure	    (Multiprocessor&, Machine&, size_t, size_t, INTERLEAVE_POLICY, uint64_t);
+extern void	mp_reset	    (Multiprocessor&, Machine&);
+extern size_t	mp_run		    (Multiprocessor&, Machine&, size_t);
+extern void	mp_set_pregister    (Multiprocessor&, size_t, DWord);
+extern void	print_mp	    (Multiprocessor&, SymbolTable*);
+extern void	print_mp_log	    (Multiprocessor&, std::ostream&, SymbolTable*);
+
+extern void	print_sample	    (SampleStats&);
+extern void	sample_init	    (SampleStats&, size_t, size_t);
+extern size_t	sample_run	    (SampleStats&, Machine&, size_t);
+
+extern bool	native_attach	    (Machine&, const std::string&);
+extern bool	native_execute	    (NativeState&);
+extern int	native_main	    (int, char *[], const NativeImage&);
+extern size_t	native_run	    (Machine&, size_t);
+extern bool	native_valid	    (Machine&);
+
+extern void	page_dirty	    (PageTable&, size_t);
+extern bool	page_fault	    (PageTable&, size_t, size_t, PAGE_FLAG);
+extern bool	page_permissions    (const std::string&, uint8_t&);
+extern DWord	page_read	    (PageTable&, size_t);
+extern void	page_write	    (PageTable&, size_t, DWord);
+extern bool	pages_configure	    (PageTable&, Machine&, size_t, size_t);
+extern void	pages_copy	    (Machine&, size_t, Memory&);
+extern bool	pages_protect	    (PageTable&, size_t, size_t, uint8_t);
+extern void	pages_reset	    (PageTable&, Machine&);
+extern uint16_t	memory_word	    (Machine&, size_t);
+extern void	print_pages	    (PageTable&);
 
 //------------------------------------------------------------------------------
 
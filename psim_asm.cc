@@ -0,0 +1,491 @@
+//------------------------------------------------------------------------------
+// psim_asm.cc: psim assembler
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+
+#include <bitset>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Global Variables
+//------------------------------------------------------------------------------
+
+AsmState	Assembler;
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static std::ostream& emit_word	    (std::ostream& out, OPCODE op, long a = 0, long b = 0, long c = 0) {
+    if (Assembler.width == 32)
+	return (out << std::bitset<32>(isa_encode_word<32>(op, a, b, c)));
+
+    return (out << isa_encode(op, a, b, c));
+}
+
+//------------------------------------------------------------------------------
+// Asm Init
+//------------------------------------------------------------------------------
+
+void		asm_init	    (AsmState& as) {
+    as.unified	= false;
+    as.optimize = 0;
+    as.rewrites = NULL;
+    as.width	= 16;
+    as.exports.clear();
+    as.data_values.clear();
+}
+
+//------------------------------------------------------------------------------
+// Assemble Object
+//------------------------------------------------------------------------------
+
+// Every operand that names a label gets a relocation and is assembled as 0,
+// except jumps to the module's own text, which are relative and stay put
+// when the text moves.  The encoder itself is assemble_stream's.
+
+bool		assemble_object	    (std::ostream& out, std::string file, LabelTable& lt, DataList& dl, TextList& tl, SourceMap& sm) {
+    ObjectModule	om;
+    TextList		text = tl;
+    DataList		none;
+    std::stringstream	words;
+    DWord		w;
+
+    om.source = file;
+
+    for (size_t i = 0; i < sm.size(); i++)
+	if (sm[i].data && sm[i].label.size())
+	    om.data_labels[sm[i].label] = lt[sm[i].label];
+    for (LabelTable::iterator lti = lt.begin(); lti != lt.end(); lti++)
+	if (om.data_labels.find(lti->first) == om.data_labels.end())
+	    om.text_labels[lti->first] = lti->second;
+
+    for (size_t e = 0; e < Assembler.exports.size(); e++) {
+	if (get_label_value(lt, Assembler.exports[e]) < 0) {
+	    std::cerr << "Unknown .global label (" << Assembler.exports[e] << ")" << std::endl;
+	    return (false);
+	}
+	om.exports.push_back(Assembler.exports[e]);
+    }
+
+    for (size_t i = 0; i < text.size(); i++) {
+	Tokens&	    tokens = text[i];
+	size_t	    o	   = tokens.size() - 1;
+	OPCODE	    op;
+	Relocation  rl;
+	bool	    address;
+
+	// The label operand is the last one, except for a STORE
+	if (tokens[0] == "MOV" && tokens.size() == 3 && !token_is_register(tokens[1]))
+	    o = 1;
+	if (o == 0)
+	    continue;
+
+	address	  = token_is_address(tokens[o]);
+	rl.symbol = (address ? tokens[o].substr(1) : tokens[o]);
+	if (!token_is_label(rl.symbol))
+	    continue;
+
+	if (tokens[0] == "JMP")
+	    op = OP_JMP;
+	else if (tokens[0] == "JMPZ")
+	    op = OP_JMPZ;
+	else if (tokens[0] == "JMPN")
+	    op = OP_JMPN;
+	else if (tokens[0] == "MOVR")
+	    op = OP_MOVR;
+	else if (tokens[0] == "MOV" && o == 1)
+	    op = OP_STORE;
+	else if (tokens[0] == "MOV" && tokens.size() == 3 && address)
+	    op = OP_LOADC;
+	else if (tokens[0] == "MOV" && tokens.size() == 3)
+	    op = OP_LOAD;
+	else
+	    continue;
+
+	rl.relative = (op == OP_JMP || op == OP_JMPZ || op == OP_JMPN);
+	if (rl.relative && om.text_labels.find(rl.symbol) != om.text_labels.end())
+	    continue;
+
+	// The operand is the last field isa_encode fills
+	for (size_t f = 0; f < 3 && IsaTable[op].fields[f].slot != IS_NONE; f++) {
+	    rl.shift = IsaTable[op].fields[f].shift;
+	    rl.width = IsaTable[op].fields[f].width;
+	}
+	rl.address = i;
+	om.relocations.push_back(rl);
+
+	tokens[o] = (address ? "#0" : "0");
+    }
+
+    if (!assemble_stream(words, lt, none, text))
+	return (false);
+    while (words >> w)
+	om.text.push_back(w);
+    om.data = dl;
+
+    object_write(out, om);
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Assemble Stream
+//------------------------------------------------------------------------------
+
+bool		assemble_stream	    (std::ostream& out, LabelTable& lt, DataList& dl, TextList& tl) {
+    Tokens  tokens;
+    long    Ra;
+    long    Rb;
+
+    for (size_t i = 0; i < tl.size(); i++) {
+	tokens = tl[i];
+	
+#if __DEBUG__/*{{{*/
+	std::cout << "tokens[ " << i << "] =";
+	for (size_t j = 0; j < tokens.size(); j++)
+	    std::cout << " " << tokens[j];
+	std::cout << std::endl;
+#endif/*}}}*/
+
+	if (tokens[0] == "ADD" || tokens[0] == "SUB") {
+	    if (tokens.size() == 4 &&
+		token_is_register(tokens[1]) &&
+		token_is_register(tokens[2]) &&
+		token_is_register(tokens[3])) {
+		emit_word(out, tokens[0] == "ADD" ? OP_ADD : OP_SUB,
+			       strtol(tokens[1].substr(1).c_str(), NULL, 10),
+			       strtol(tokens[2].substr(1).c_str(), NULL, 10),
+			       strtol(tokens[3].substr(1).c_str(), NULL, 10));
+	    } else {
+		std::cerr << "Invalid " << tokens[0] << " instruction (" << tokens_to_string(tokens) << ")" << std::endl;
+		return (false);
+	    }
+	} else if (tokens[0] == "MOV") {
+	    if (tokens.size() == 3) {
+		if (token_is_register(tokens[1])) {
+		    Ra = strtol(tokens[1].substr(1).c_str(), NULL, 10);
+
+		    if (token_is_constant(tokens[2])) {
+			emit_word(out, OP_LOADC, Ra, strtol(tokens[2].substr(1).c_str(), NULL, 10));
+		    } else if (token_is_address(tokens[2])) {
+			if (get_label_value(lt, tokens[2].substr(1)) < 0)
+			    goto AS_LABEL_ERROR;
+			emit_word(out, OP_LOADC, Ra, lt[tokens[2].substr(1)]);
+		    } else if (token_is_label(tokens[2])) {
+			if (get_label_value(lt, tokens[2]) < 0)
+			    goto AS_LABEL_ERROR;
+			emit_word(out, OP_LOAD, Ra, lt[tokens[2]]);
+		    } else if (token_is_number(tokens[2])) {
+			emit_word(out, OP_LOAD, Ra, strtol(tokens[2].c_str(), NULL, 10));
+		    } else {
+			goto AS_MOV_ERROR;
+		    }
+		} else {
+		    Ra = strtol(tokens[2].substr(1).c_str(), NULL, 10);
+
+		    if (token_is_label(tokens[1])) {
+			if (get_label_value(lt, tokens[1]) < 0)
+			    goto AS_LABEL_ERROR;
+			emit_word(out, OP_STORE, Ra, lt[tokens[1]]);
+		    } else if (token_is_number(tokens[1])) {
+			emit_word(out, OP_STORE, Ra, strtol(tokens[1].c_str(), NULL, 10));
+		    } else {
+			goto AS_MOV_ERROR;
+		    }
+		}
+	    } else if (tokens.size() == 4 &&
+		       token_is_dio(tokens[1]) &&
+		       token_is_register(tokens[2]) &&
+		       token_is_pio(tokens[3])) {
+		emit_word(out, OP_IO,
+			       strtol(tokens[2].substr(1).c_str(), NULL, 10),
+			       strtol(tokens[3].substr(1).c_str(), NULL, 10),
+			       strtol(tokens[1].substr(1).c_str(), NULL, 10));
+	    } else {
+AS_MOV_ERROR:
+		std::cerr << "Invalid MOV instruction (" << tokens_to_string(tokens) << ")" << std::endl;
+		return (false);
+	    }
+	} else if (tokens[0] == "MOVR") {
+	    if (tokens.size() == 4 && token_is_register(tokens[1]) && token_is_register(tokens[2])) {
+		Ra = strtol(tokens[1].substr(1).c_str(), NULL, 10);
+		Rb = strtol(tokens[2].substr(1).c_str(), NULL, 10);
+		if (token_is_constant(tokens[3])) {
+		    emit_word(out, OP_MOVR, Ra, Rb, strtol(tokens[3].substr(1).c_str(), NULL, 10));
+		} else if (token_is_address(tokens[3])) {
+		    if (get_label_value(lt, tokens[3].substr(1)) < 0)
+			goto AS_LABEL_ERROR;
+		    emit_word(out, OP_MOVR, Ra, Rb, lt[tokens[3].substr(1)]);
+		} else {
+		    goto AS_MOVR_ERROR;
+		}
+	    } else {
+AS_MOVR_ERROR:
+		std::cerr << "Invalid MOVR instruction (" << tokens_to_string(tokens) << ")" << std::endl;
+		return (false);
+	    }
+	} else if (tokens[0] == "JMPZ") {
+	    if (tokens.size() == 3 && token_is_register(tokens[1])) {
+		Ra = strtol(tokens[1].substr(1).c_str(), NULL, 10);
+
+		if (token_is_label(tokens[2])) {
+		    if (get_label_value(lt, tokens[2]) < 0)
+			goto AS_LABEL_ERROR;
+		    emit_word(out, OP_JMPZ, Ra, lt[tokens[2]] - (long)i);
+		} else if (token_is_number(tokens[2])) {
+		    emit_word(out, OP_JMPZ, Ra, strtol(tokens[2].c_str(), NULL, 10));
+		} else {
+		    goto AS_JMPZ_ERROR;
+		}
+	    } else {
+AS_JMPZ_ERROR:
+		std::cerr << "Invalid JMPZ instruction (" << tokens_to_string(tokens) << ")" << std::endl;
+		return (false);
+	    }
+	} else if (tokens[0] == "JMPN") {
+	    if (tokens.size() == 3 && token_is_register(tokens[1])) {
+		Ra = strtol(tokens[1].substr(1).c_str(), NULL, 10);
+
+		if (token_is_label(tokens[2])) {
+		    if (get_label_value(lt, tokens[2]) < 0)
+			goto AS_LABEL_ERROR;
+		    emit_word(out, OP_JMPN, Ra, lt[tokens[2]] - (long)i);
+		} else if (token_is_number(tokens[2])) {
+		    emit_word(out, OP_JMPN, Ra, strtol(tokens[2].c_str(), NULL, 10));
+		} else {
+		    goto AS_JMPN_ERROR;
+		}
+	    } else {
+AS_JMPN_ERROR:
+		std::cerr << "Invalid JMPN instruction (" << tokens_to_string(tokens) << ")" << std::endl;
+		return (false);
+	    }
+	} else if (tokens[0] == "JMP") {
+	    if (tokens.size() == 2) {
+		if (token_is_label(tokens[1])) {
+		    if (get_label_value(lt, tokens[1]) < 0)
+			goto AS_LABEL_ERROR;
+		    emit_word(out, OP_JMP, lt[tokens[1]] - (long)i);
+		} else if (token_is_number(tokens[1])) {
+		    emit_word(out, OP_JMP, strtol(tokens[1].c_str(), NULL, 10));
+		} else {
+		    goto AS_JMP_ERROR;
+		}
+	    } else {
+AS_JMP_ERROR:
+		std::cerr << "Invalid JMP instruction (" << tokens_to_string(tokens) << ")" << std::endl;
+		return (false);
+	    }
+	} else if (tokens[0] == "END") {
+	    if (tokens.size() == 1) {
+		emit_word(out, OP_END);
+	    } else {
+		std::cerr << "Invalid END instruction (" << tokens_to_string(tokens) << ")" << std::endl;
+		return (false);
+	    }
+	} else {
+	    std::cerr << "Unknown instruction (" << tokens[0] << ")" << std::endl;
+	    return (false);
+	}
+
+	out << std::endl;
+    }
+
+    if (Assembler.unified && Assembler.width == 32)
+	for (size_t i = 0; i < dl.size(); i++) 
+	    out << std::bitset<32>(Assembler.data_values[i]) << std::endl;
+    else if (Assembler.unified)
+	for (size_t i = 0; i < dl.size(); i++) 
+	    out << dl[i] << std::endl;
+
+    return (true);
+
+AS_LABEL_ERROR:
+    std::cerr << "Unknown label in instruction (" << tokens_to_string(tokens) << ")" << std::endl;
+    return (false);
+}
+
+//------------------------------------------------------------------------------
+// Parse Stream
+//------------------------------------------------------------------------------
+
+bool		parse_stream	    (std::istream& in, LabelTable& lt, DataList& dl, TextList& tl, SourceMap& sm) {
+    enum	ParseState  { ST_DATA, ST_TEXT };
+
+    LabelTable	dt;
+    SourceMap	dsm;
+    SourceLine	sl;
+    std::string	line;
+    std::string	label;
+    size_t	data_addr;
+    size_t	inst_addr;
+    size_t	line_number;
+    Tokens	tokens;
+    ParseState	state;
+
+    data_addr	= inst_addr = 0;
+    line_number = 0;
+    state	= ST_TEXT;
+
+    while (!in.eof()) {
+	getline(in, line);
+	line_number++;
+	trim_comment(line);
+
+	if (line.size() == 0)	continue;
+
+	label = get_label(line);
+
+	trim_whitespace(label);
+	trim_whitespace(line);
+
+#ifdef __DEBUG__/*{{{*/
+	std::cout << "[D] label = (" << label << ") line = (" << line << ")" << std::endl;
+#endif/*}}}*/
+	
+
+	if (line.size())
+	    tokens = tokenize(line);
+	else
+	    continue;
+
+	for (size_t i = 0; i < tokens.size(); i++)
+	    trim_comma(tokens[i]);
+
+#ifdef __DEBUG__/*{{{*/
+		std::cout << "tokens = ";
+		for (size_t i = 0; i < tokens.size(); i++) {
+		    std::cout << "(" << tokens[i] << ") ";
+		}
+		std::cout << std::endl;
+#endif/*}}}*/
+
+	// A line of nothing but separators has no tokens
+	if (tokens.empty())
+	    continue;
+
+	if (tokens[0] == ".global") {
+	    Assembler.exports.insert(Assembler.exports.end(), tokens.begin() + 1, tokens.end());
+	    continue;
+	}
+
+	if (line == ".data") {
+	    state = ST_DATA;
+	    continue;
+	} else if (line == ".text") {
+	    state = ST_TEXT;
+	    continue;
+	}
+
+	switch (state) {
+	    case ST_DATA:
+		if (label.size() != 0) dt[label] = data_addr;
+
+		if (tokens[0] == "WORD") {
+		    for (size_t j = 1; j < tokens.size(); j++) {
+			sl.address = data_addr;
+			sl.line	   = line_number;
+			sl.data	   = true;
+			sl.label   = (j == 1 ? label : "");
+			dsm.push_back(sl);
+
+			data_addr++;
+			dl.push_back(DWord(strtol(tokens[j].c_str(), NULL, 10)));
+			Assembler.data_values.push_back(strtol(tokens[j].c_str(), NULL, 10));
+		    }
+		} else {
+		    std::cerr << "Unknown data directive (" << tokens[0] << ")" << std::endl;
+		    return (false);
+		}
+		break;
+	    case ST_TEXT:
+		if (label.size() != 0) lt[label] = inst_addr;
+		if (tokens[0] == "MOV" ||
+		    tokens[0] == "ADD" ||
+		    tokens[0] == "SUB" ||
+		    tokens[0] == "JMPZ" ||
+		    tokens[0] == "JMPN" ||
+		    tokens[0] == "JMP" ||
+		    tokens[0] == "MOVR" ||
+		    tokens[0] == "END") {
+		    tl.push_back(tokens);
+
+		    sl.address = inst_addr;
+		    sl.line    = line_number;
+		    sl.data    = false;
+		    sl.label   = label;
+		    sm.push_back(sl);
+		} else {
+		    std::cerr << "Unknown instruction (" << tokens[0] << ")" << std::endl;
+		    return (false);
+		}
+
+		inst_addr++;
+		break;
+	}
+    }
+
+    // Text labels are all that lt holds until the data labels are added below
+    if (Assembler.optimize)
+	optimize_text(tl, sm, lt, dt, Assembler.optimize, Assembler.unified, Assembler.rewrites, Assembler.optimized);
+
+    for (LabelTable::iterator dti = dt.begin(); dti != dt.end(); dti++) 
+	lt[dti->first] = (Assembler.unified ? dti->second + tl.size() : dti->second);
+
+    for (size_t d = 0; d < dsm.size(); d++) {
+	dsm[d].address += (Assembler.unified ? tl.size() : 0);
+	sm.push_back(dsm[d]);
+    }
+
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Write Source Map
+//------------------------------------------------------------------------------
+
+void		write_source_map    (std::ostream& out, std::string file, SourceMap& sm) {
+    out << "psim-map 1" << std::endl;
+    out << "memory " << (Assembler.unified ? "unified" : "split") << std::endl;
+    out << "file " << file << std::endl;
+
+    for (size_t i = 0; i < sm.size(); i++) {
+	out << sm[i].address << " " << sm[i].line << " " << (sm[i].data ? "D" : "T");
+	if (sm[i].label.size())
+	    out << " " << sm[i].label;
+	out << std::endl;
+    }
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
@@ -0,0 +1,225 @@
+//------------------------------------------------------------------------------
+// psim_cache.cc: psim cache model
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include <iomanip>
+#include <iostream>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static void	cache_init	    (Cache& c, size_t size, size_t line, size_t ways, WRITE_POLICY policy) {
+    CacheLine	cl;
+
+    cl.tag   = 0;
+    cl.used  = 0;
+    cl.valid = false;
+    cl.dirty = false;
+
+    c.size   = size;
+    c.line   = line;
+    c.ways   = ways;
+    c.sets   = size / (line * ways);
+    c.policy = policy;
+    c.lines.assign(c.sets * c.ways, cl);
+    c.tick   = 0;
+
+    c.reads = c.writes = c.read_misses = c.write_misses = c.writebacks = 0;
+}
+
+static size_t	cache_account	    (CacheModel& cm, Cache& c, size_t pc, size_t addr, bool write) {
+    size_t  writebacks;
+    size_t  cycles;
+    bool    hit;
+
+    writebacks = c.writebacks;
+    hit	       = cache_access(c, addr, write);
+
+    cycles = cm.hit_cycles;
+    if (write && c.policy == WP_WRITE_THROUGH)
+	cycles += cm.miss_cycles;	    // Every write goes to memory
+    else if (!hit)
+	cycles += cm.miss_cycles;	    // Line fill
+    cycles += (c.writebacks - writebacks) * cm.miss_cycles;
+
+    if (!hit) cm.misses[pc]++;
+
+    cm.cycles += cycles;
+    return (cycles);
+}
+
+static void	print_cache_stats   (const char *name, Cache& c) {
+    size_t  accesses = c.reads + c.writes;
+    size_t  misses   = c.read_misses + c.write_misses;
+
+    std::cout << name << " " << c.size << " words, " << c.line << " words/line, "
+	      << c.ways << "-way, " << c.sets << " sets, "
+	      << (c.policy == WP_WRITE_BACK ? "write-back" : "write-through") << std::endl;
+    std::cout << std::setfill(' ');
+    std::cout << "    Reads:  " << std::setw(10) << c.reads  << "  Misses: " << std::setw(10) << c.read_misses << std::endl;
+    std::cout << "    Writes: " << std::setw(10) << c.writes << "  Misses: " << std::setw(10) << c.write_misses << std::endl;
+    std::cout << "    Writebacks: " << c.writebacks << std::endl;
+    std::cout << "    Hit Rate: " << std::fixed << std::setprecision(2)
+	      << (accesses ? 100.0 * (accesses - misses) / accesses : 0.0) << "%" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// Cache Access
+//------------------------------------------------------------------------------
+
+bool		cache_access	    (Cache& c, size_t addr, bool write) {
+    CacheLine  *set;
+    CacheLine  *victim;
+    size_t	block;
+    size_t	tag;
+
+    block = addr / c.line;
+    tag	  = block / c.sets;
+    set	  = &c.lines[(block % c.sets) * c.ways];
+
+    c.tick++;
+    if (write) c.writes++; else c.reads++;
+
+    for (size_t w = 0; w < c.ways; w++) {
+	if (set[w].valid && set[w].tag == tag) {
+	    set[w].used = c.tick;
+	    if (write && c.policy == WP_WRITE_BACK) set[w].dirty = true;
+	    return (true);
+	}
+    }
+
+    if (write) c.write_misses++; else c.read_misses++;
+
+    if (write && c.policy == WP_WRITE_THROUGH)
+	return (false);
+
+    victim = &set[0];
+    for (size_t w = 1; w < c.ways && victim->valid; w++)
+	if (!set[w].valid || set[w].used < victim->used)
+	    victim = &set[w];
+
+    if (victim->valid && victim->dirty)
+	c.writebacks++;
+
+    victim->tag	  = tag;
+    victim->used  = c.tick;
+    victim->valid = true;
+    victim->dirty = (write && c.policy == WP_WRITE_BACK);
+
+    return (false);
+}
+
+//------------------------------------------------------------------------------
+// Cache Configure
+//------------------------------------------------------------------------------
+
+bool		cache_configure	    (CacheModel& cm, size_t size, size_t line, size_t ways, size_t hit, size_t penalty, WRITE_POLICY policy, bool unified) {
+    if (size == 0 || line == 0 || ways == 0 || size % (line * ways) != 0)
+	return (false);
+
+    cache_init(cm.icache, size, line, ways, policy);
+    cache_init(cm.dcache, size, line, ways, policy);
+
+    cm.unified	   = unified;
+    cm.hit_cycles  = hit;
+    cm.miss_cycles = penalty;
+    cm.cycles	   = 0;
+    cm.misses.clear();
+
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Cache Fetch
+//------------------------------------------------------------------------------
+
+size_t		cache_fetch	    (CacheModel& cm, size_t pc) {
+    return (cache_account(cm, cm.unified ? cm.dcache : cm.icache, pc, pc, false));
+}
+
+//------------------------------------------------------------------------------
+// Cache Read
+//------------------------------------------------------------------------------
+
+size_t		cache_read	    (CacheModel& cm, size_t pc, size_t addr) {
+    return (cache_account(cm, cm.dcache, pc, addr, false));
+}
+
+//------------------------------------------------------------------------------
+// Cache Reset
+//------------------------------------------------------------------------------
+
+void		cache_reset	    (CacheModel& cm) {
+    cache_configure(cm, cm.dcache.size, cm.dcache.line, cm.dcache.ways, cm.hit_cycles, cm.miss_cycles, cm.dcache.policy, cm.unified);
+}
+
+//------------------------------------------------------------------------------
+// Cache Write
+//------------------------------------------------------------------------------
+
+size_t		cache_write	    (CacheModel& cm, size_t pc, size_t addr) {
+    return (cache_account(cm, cm.dcache, pc, addr, true));
+}
+
+//------------------------------------------------------------------------------
+// Print Cache
+//------------------------------------------------------------------------------
+
+void		print_cache	    (CacheModel& cm, SymbolTable *st) {
+    std::ios::fmtflags flags	 = std::cout.flags();
+    std::streamsize    precision = std::cout.precision();
+
+    std::cout << "----------------------------------------" << std::endl;
+    if (cm.unified) {
+	print_cache_stats("[U$]", cm.dcache);
+    } else {
+	print_cache_stats("[I$]", cm.icache);
+	print_cache_stats("[D$]", cm.dcache);
+    }
+    std::cout << "    Memory Cycles: " << cm.cycles
+	      << " (hit " << cm.hit_cycles << ", miss " << cm.miss_cycles << ")" << std::endl;
+    std::cout << "----------------------------------------" << std::endl;
+    std::cout << "[PC ]  Misses" << std::endl;
+    for (CounterTable::iterator mi = cm.misses.begin(); mi != cm.misses.end(); mi++) {
+	std::cout << "[" << std::setfill('0') << std::setw(3) << mi->first << "] "
+		  << std::setfill(' ') << std::setw(7) << mi->second;
+	if (symbol_string(st, mi->first).size())
+	    std::cout << " " << symbol_string(st, mi->first);
+	std::cout << std::endl;
+    }
+    std::cout << "----------------------------------------" << std::endl;
+
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
@@ -72,14 +72,51 @@ std::string	dword_to_string	    (DWord d) {
 //------------------------------------------------------------------------------
 
 std::string	dword_to_pretty_string	(DWord d) {
-    std::stringstream ss;
+    char    text[WORD_FORMAT_SIZE];
 
-    ss << std::setfill(' ') << std::setw(7) << dword_to_long(d);
-    ss << " 0x" << std::hex << std::setfill('0') << std::setw(4) << d.to_ulong();
-    for (size_t i = 0; i < WORD_SIZE/4; i++) 
-	ss << " " << dword_to_string(d).substr(i*4, 4);
+    return (std::string(text, word_format(text, d.to_ulong())));
+}
+
+//------------------------------------------------------------------------------
+// Word Format
+//------------------------------------------------------------------------------
+
+// The dword_to_pretty_string() columns (signed decimal, hex and binary by
+// nibble) written straight into a buffer, for dumps of many words.
+
+size_t		word_format	    (char *s, uint16_t w) {
+    static const char *Hex = "0123456789abcdef";
+    char	      *p   = s;
+    char	       digits[8];
+    size_t	       n   = 0;
+    long	       v   = (int16_t)w;
+    unsigned long      u   = (v < 0 ? -v : v);
+
+    do {
+	digits[n++] = '0' + u % 10;
+	u /= 10;
+    } while (u);
+    if (v < 0)
+	digits[n++] = '-';
+
+    for (size_t i = n; i < 7; i++)
+	*p++ = ' ';
+    while (n)
+	*p++ = digits[--n];
+
+    *p++ = ' ';
+    *p++ = '0';
+    *p++ = 'x';
+    for (int i = WORD_SIZE - 4; i >= 0; i -= 4)
+	*p++ = Hex[(w >> i) & 0xf];
+
+    for (int i = WORD_SIZE - 1; i >= 0; i--) {
+	if ((i & 3) == 3)
+	    *p++ = ' ';
+	*p++ = '0' + ((w >> i) & 1);
+    }
 
-    return (ss.str());
+    return (p - s);
 }
 
 //------------------------------------------------------------------------------
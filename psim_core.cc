@@ -0,0 +1,535 @@
+//------------------------------------------------------------------------------
+// psim_core.cc: psim simulator core
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.  
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+// The step engine's bounds check, for the reference loop
+static bool	reference_bounds    (Machine& mc, size_t pc) {
+    const DecodedInst& d = DecodeTable[mc.memory[pc].to_ulong()];
+    size_t	       a;
+
+    if (d.op != OP_LOAD && d.op != OP_STORE && d.op != OP_MOVR)
+	return (true);
+
+    a = (d.op == OP_MOVR ? mc.regfile[d.rb].to_ulong() + d.rc : d.imm);
+    if (a < mc.memory.size())
+	return (true);
+
+    std::cerr << "Memory access out of bounds at PC " << pc << ": address " << a << std::endl;
+    return (false);
+}
+
+//------------------------------------------------------------------------------
+// Trace Symbol
+//------------------------------------------------------------------------------
+
+std::string	trace_symbol	    (SymbolTable *st, size_t pc, long operand) {
+    const std::string& where = symbol_string(st, pc);
+    const std::string& name  = symbol_name(st, operand >= 0 ? operand : SIZE_MAX);
+    std::string	       s;
+
+    if (where.empty())
+	return (s);
+
+    // One allocation per traced instruction
+    s.reserve(where.size() + name.size() + 8);
+    s += "\t// ";
+    s += where;
+    if (name.size()) {
+	s += " [";
+	s += name;
+	s += "]";
+    }
+
+    return (s);
+}
+
+//------------------------------------------------------------------------------
+// Control Publish
+//------------------------------------------------------------------------------
+
+// Readers on other threads only need a recent PC and step count, so relaxed
+// stores keep the hot loop free of fences.
+
+void		control_publish	    (RunControl& rc, size_t pc, size_t steps) {
+    rc.pc.store(pc, std::memory_order_relaxed);
+    rc.steps.store(steps, std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------
+// Cost Init
+//------------------------------------------------------------------------------
+
+void		cost_init	    (CostModel& cost) {
+    for (size_t i = 0; i < OP_SIZE; i++) cost.op_cycles[i] = 1;
+    cost.mem_cycles = 0;
+}
+
+//------------------------------------------------------------------------------
+// Load Stream
+//------------------------------------------------------------------------------
+
+bool		load_stream	    (std::istream& in, Memory& m, RegisterFile& r, RegisterFile& p) {
+    std::string	    word;
+
+    m.clear();
+
+    while (!in.eof()) {
+	getline(in, word);
+
+	if (word.size() == WORD_SIZE)
+	    m.push_back(DWord(strtol(word.c_str(), NULL, 2))); 
+    }
+
+    for (size_t i = 0; i < r.size(); i++)   r[i] = 0;
+    for (size_t i = 0; i < p.size(); i++)   p[i] = 0;
+
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Machine Init
+//------------------------------------------------------------------------------
+
+void		machine_init	    (Machine& mc) {
+    mc.memory.clear();
+    mc.regfile.assign(RF_SIZE, DWord(0));
+    mc.pregfile.assign(PRF_SIZE, DWord(0));
+    mc.trace = true;
+    mc.cache   = NULL;
+    mc.loop    = NULL;
+    mc.profile = NULL;
+    mc.symbols = NULL;
+    mc.native  = NULL;
+    mc.control = NULL;
+    mc.accesses = NULL;
+    mc.coverage = NULL;
+    mc.heatmap	= NULL;
+    mc.devices	= NULL;
+    mc.waveform = NULL;
+    mc.tracefile = NULL;
+    mc.pages	 = NULL;
+    mc.engine  = SE_TEMPLATE;
+    mc.checked = true;
+    mc.breakpoints.clear();
+    cost_init(mc.cost);
+    machine_reset(mc);
+}
+
+//------------------------------------------------------------------------------
+// Machine Reset
+//------------------------------------------------------------------------------
+
+void		machine_reset	    (Machine& mc) {
+    mc.pc     = 0;
+    mc.steps  = 0;
+    mc.cycles = 0;
+    mc.halted = false;
+    if (mc.cache) cache_reset(*mc.cache);
+    if (mc.loop)  loop_reset(*mc.loop, mc);
+    if (mc.profile) mc.profile->assign(mc.memory.size(), 0);
+    if (mc.devices) device_reset(*mc.devices, mc);
+}
+
+//------------------------------------------------------------------------------
+// Print Memory
+//------------------------------------------------------------------------------
+
+void		print_memory	    (Memory& m, size_t s, size_t e, SymbolTable *st) {
+    std::string	out;
+    char	text[WORD_FORMAT_SIZE + 8];
+
+    // One buffer and one write, rather than a flush per word
+    out.reserve(48 * (std::min(e + 1, m.size()) - std::min(s, m.size())) + 128);
+    out += "<MEM> Decimal Hex    Binary\n";
+    out += "----------------------------------------\n";
+    for (; s <= e && s < m.size(); s++) {
+	snprintf(text, sizeof(text), "<%03zu> ", s);
+	out += text;
+	out.append(text, word_format(text, m[s].to_ulong()));
+	if (symbol_name(st, s).size()) {
+	    out += " ";
+	    out += symbol_name(st, s);
+	}
+	out += "\n";
+    }
+    out += "----------------------------------------\n";
+    std::cout << out << std::flush;
+}
+
+//------------------------------------------------------------------------------
+// Print PRegister File 
+//------------------------------------------------------------------------------
+
+void		print_pregfile	    (RegisterFile& prf) {
+    std::string	out;
+    char	text[WORD_FORMAT_SIZE + 8];
+
+    out += "|REG| Decimal Hex    Binary\n";
+    out += "----------------------------------------\n";
+    for (size_t p = 0; p < prf.size(); p++) {
+	snprintf(text, sizeof(text), "|P%02zu| ", p);
+	out += text;
+	out.append(text, word_format(text, prf[p].to_ulong()));
+	out += "\n";
+    }
+    out += "----------------------------------------\n";
+    std::cout << out << std::flush;
+}
+
+//------------------------------------------------------------------------------
+// Print Profile
+//------------------------------------------------------------------------------
+
+void		print_profile	    (Profile& pf, SymbolTable *st) {
+    std::ios::fmtflags flags	 = std::cout.flags();
+    std::streamsize    precision = std::cout.precision();
+    size_t	       total	 = 0;
+
+    for (size_t pc = 0; pc < pf.size(); pc++)
+	total += pf[pc];
+
+    std::cout << "[PC ]   Count      %" << std::endl;
+    std::cout << "----------------------------------------" << std::endl;
+    for (size_t pc = 0; pc < pf.size(); pc++) {
+	if (pf[pc] == 0)
+	    continue;
+
+	std::cout << "[" << std::setfill('0') << std::setw(3) << pc << "] "
+		  << std::setfill(' ') << std::setw(7) << pf[pc] << " "
+		  << std::setw(6) << std::fixed << std::setprecision(2) << 100.0 * pf[pc] / total;
+	if (symbol_string(st, pc).size())
+	    std::cout << " " << symbol_string(st, pc);
+	std::cout << std::endl;
+    }
+    std::cout << "----------------------------------------" << std::endl;
+
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
+
+//------------------------------------------------------------------------------
+// Print Register File 
+//------------------------------------------------------------------------------
+
+void		print_regfile	    (RegisterFile& rf, size_t pc, SymbolTable *st) {
+    std::string	out;
+    char	text[WORD_FORMAT_SIZE + 8];
+
+    out += "|REG| Decimal Hex    Binary\n";
+    out += "----------------------------------------\n";
+    for (size_t r = 0; r < rf.size(); r++) {
+	snprintf(text, sizeof(text), "|R%02zu| ", r);
+	out += text;
+	out.append(text, word_format(text, rf[r].to_ulong()));
+	out += "\n";
+    }
+    out += "----------------------------------------\n";
+    out += "[PC ] ";
+    out.append(text, word_format(text, DWord(pc).to_ulong()));
+    if (symbol_string(st, pc).size())
+	out += " " + symbol_string(st, pc);
+    out += "\n";
+    out += "----------------------------------------\n";
+    std::cout << out << std::flush;
+}
+
+//------------------------------------------------------------------------------
+// Step Reference
+//------------------------------------------------------------------------------
+
+// The original interpreter loop with runtime checks for every feature; step()
+// normally uses the specialized engine instead (see psim_engine.cc).
+
+size_t		step_reference	    (Machine& mc, size_t s) {
+    Memory&	  m   = mc.memory;
+    RegisterFile& rf  = mc.regfile;
+    RegisterFile& prf = mc.pregfile;
+    CacheModel	 *cm  = mc.cache;
+    LoopCheck	 *lc  = mc.loop;
+    RunControl	 *ctl = mc.control;
+    size_t	  pc  = mc.pc;
+    size_t	  i;
+
+    DWord   inst;
+    DWord   value;
+    OWord   Op;
+    RWord   Ra;
+    RWord   Rb;
+    RWord   Rc;
+    LWord   L;
+
+    long    ra;
+    long    rb;
+    long    rc;
+    long    jl;
+
+    for (i = 0; i < s && !mc.halted && !(lc && lc->found) && pc < m.size(); i++) {
+	if (ctl) {
+	    if (ctl->stop.load(std::memory_order_relaxed))
+		break;
+	    if ((i & 0xff) == 0)
+		control_publish(*ctl, pc, mc.steps + i);
+	}
+	if (i > 0 && pc < mc.breakpoints.size() && mc.breakpoints[pc])
+	    break;
+	if (mc.checked && !reference_bounds(mc, pc))
+	    break;
+	if (mc.profile)
+	    (*mc.profile)[pc]++;
+
+	inst = m[pc];
+	mc.cycles += (cm ? cache_fetch(*cm, pc) : mc.cost.mem_cycles);
+
+	Op = OWord(strtol(dword_to_string(inst).substr(0, 4).c_str(), NULL, 2));
+	mc.cycles += mc.cost.op_cycles[Op.to_ulong()];
+
+	switch (Op.to_ulong()) {
+	    case OP_LOAD:
+		Ra = RWord(strtol(dword_to_string(inst).substr(4, 4).c_str(), NULL, 2));
+		L  = LWord(strtol(dword_to_string(inst).substr(8, 8).c_str(), NULL, 2));
+
+		
+		if (mc.trace)
+		    std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
+				<< "Inst = " << dword_to_pretty_string(inst)
+				<< " -> MOV  R" << Ra.to_ulong() << ", " << L.to_ulong()
+				<< trace_symbol(mc.symbols, pc, L.to_ulong())
+				<< std::endl;
+
+		if (lc) loop_write(*lc, LK_REGFILE + Ra.to_ulong(), rf[Ra.to_ulong()], m[L.to_ulong()]);
+		rf[Ra.to_ulong()] = m[L.to_ulong()];
+		mc.cycles += (cm ? cache_read(*cm, pc, L.to_ulong()) : mc.cost.mem_cycles);
+		break;
+	    case OP_STORE:
+		Ra = RWord(strtol(dword_to_string(inst).substr(4, 4).c_str(), NULL, 2));
+		L  = LWord(strtol(dword_to_string(inst).substr(8, 8).c_str(), NULL, 2));
+
+		if (mc.trace)
+		    std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
+				<< "Inst = " << dword_to_pretty_string(inst)
+				<< " -> MOV  " << L.to_ulong() << ", R" << Ra.to_ulong()
+				<< trace_symbol(mc.symbols, pc, L.to_ulong())
+				<< std::endl;
+		
+		if (lc) loop_write(*lc, LK_MEMORY + L.to_ulong(), m[L.to_ulong()], rf[Ra.to_ulong()]);
+		m[L.to_ulong()] = rf[Ra.to_ulong()];
+		mc.cycles += (cm ? cache_write(*cm, pc, L.to_ulong()) : mc.cost.mem_cycles);
+		break;
+	    case OP_ADD:
+		Ra = RWord(strtol(dword_to_string(inst).substr(4, 4).c_str(), NULL, 2));
+		Rb = RWord(strtol(dword_to_string(inst).substr(8, 4).c_str(), NULL, 2));
+		Rc = RWord(strtol(dword_to_string(inst).substr(12, 4).c_str(), NULL, 2));
+		
+		if (mc.trace)
+		    std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
+				<< "Inst = " << dword_to_pretty_string(inst)
+				<< " -> ADD  R" << Ra.to_ulong()
+				<< ", R" << Rb.to_ulong()
+				<< ", R" << Rc.to_ulong()
+				<< trace_symbol(mc.symbols, pc, -1)
+				<< std::endl;
+
+		rb = dword_to_long(rf[Rb.to_ulong()]);
+		rc = dword_to_long(rf[Rc.to_ulong()]);
+
+		value = rb + rc;
+		if (lc) loop_write(*lc, LK_REGFILE + Ra.to_ulong(), rf[Ra.to_ulong()], value);
+		rf[Ra.to_ulong()] = value;
+		break;
+	    case OP_LOADC:
+		Ra = RWord(strtol(dword_to_string(inst).substr(4, 4).c_str(), NULL, 2));
+		L  = LWord(strtol(dword_to_string(inst).substr(8, 8).c_str(), NULL, 2));
+
+		if (mc.trace)
+		    std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
+				<< "Inst = " << dword_to_pretty_string(inst)
+				<< " -> MOV  R" << Ra.to_ulong() << ", #" << lword_to_long(L)
+				<< trace_symbol(mc.symbols, pc, -1)
+				<< std::endl;
+
+		value = L.to_ulong();
+		if (L[L.size() - 1] == 1) 
+		    value |= DWord(65280); // 1111 1111 0000 0000
+		if (lc) loop_write(*lc, LK_REGFILE + Ra.to_ulong(), rf[Ra.to_ulong()], value);
+		rf[Ra.to_ulong()] = value;
+		break;
+	    case OP_SUB:
+		Ra = RWord(strtol(dword_to_string(inst).substr(4, 4).c_str(), NULL, 2));
+		Rb = RWord(strtol(dword_to_string(inst).substr(8, 4).c_str(), NULL, 2));
+		Rc = RWord(strtol(dword_to_string(inst).substr(12, 4).c_str(), NULL, 2));
+		
+		if (mc.trace)
+		    std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
+				<< "Inst = " << dword_to_pretty_string(inst)
+				<< " -> SUB  R" << Ra.to_ulong()
+				<< ", R" << Rb.to_ulong()
+				<< ", R" << Rc.to_ulong()
+				<< trace_symbol(mc.symbols, pc, -1)
+				<< std::endl;
+
+		rb = dword_to_long(rf[Rb.to_ulong()]);
+		rc = dword_to_long(rf[Rc.to_ulong()]);
+		
+		value = rb - rc;
+		if (lc) loop_write(*lc, LK_REGFILE + Ra.to_ulong(), rf[Ra.to_ulong()], value);
+		rf[Ra.to_ulong()] = value;
+		break;
+	    case OP_JMPZ:
+		Ra = RWord(strtol(dword_to_string(inst).substr(4, 4).c_str(), NULL, 2));
+		L  = LWord(strtol(dword_to_string(inst).substr(8, 8).c_str(), NULL, 2));
+		
+		if (mc.trace)
+		    std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
+				<< "Inst = " << dword_to_pretty_string(inst)
+				<< " -> JMPZ R" << Ra.to_ulong()
+				<< ", " << lword_to_long(L)
+				<< trace_symbol(mc.symbols, pc, -1)
+				<< std::endl;
+		
+		ra = dword_to_long(rf[Ra.to_ulong()]);
+		jl = lword_to_long(L);
+		
+		if (ra == 0) pc = pc + jl - 1;
+		break;
+	    case OP_JMPN:
+		Ra = RWord(strtol(dword_to_string(inst).substr(4, 4).c_str(), NULL, 2));
+		L  = LWord(strtol(dword_to_string(inst).substr(8, 8).c_str(), NULL, 2));
+		
+		if (mc.trace)
+		    std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
+				<< "Inst = " << dword_to_pretty_string(inst)
+				<< " -> JMPN R" << Ra.to_ulong()
+				<< ", " << lword_to_long(L)
+				<< trace_symbol(mc.symbols, pc, -1)
+				<< std::endl;
+
+		ra = dword_to_long(rf[Ra.to_ulong()]);
+		jl = lword_to_long(L);
+		
+		if (ra < 0) pc = pc + jl - 1;
+		break;
+	    case OP_JMP:
+		// The offset is all 12 bits after the opcode, not an LWord
+		jl = strtol(dword_to_string(inst).substr(4, 12).c_str(), NULL, 2);
+		if (jl & 0x800)
+		    jl -= 0x1000;
+
+		if (mc.trace)
+		    std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
+				<< "Inst = " << dword_to_pretty_string(inst)
+				<< " -> JMP  " << jl
+				<< trace_symbol(mc.symbols, pc, -1)
+				<< std::endl;
+
+		pc = pc + jl - 1;
+		break;
+	    case OP_MOVR:
+		Ra = RWord(strtol(dword_to_string(inst).substr(4, 4).c_str(), NULL, 2));
+		Rb = RWord(strtol(dword_to_string(inst).substr(8, 4).c_str(), NULL, 2));
+		L  = LWord(strtol(dword_to_string(inst).substr(12, 4).c_str(), NULL, 2));
+		
+		if (mc.trace)
+		    std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
+				<< "Inst = " << dword_to_pretty_string(inst)
+				<< " -> MOVR R" << Ra.to_ulong() 
+				<< ", R" << Rb.to_ulong() 
+				<< ", #" << lword_to_long(L) 
+				<< trace_symbol(mc.symbols, pc, -1)
+				<< std::endl;
+
+		jl = lword_to_long(L);
+
+		rb = rf[Rb.to_ulong()].to_ulong() + jl;
+
+		if (lc) loop_write(*lc, LK_REGFILE + Ra.to_ulong(), rf[Ra.to_ulong()], m[rb]);
+		rf[Ra.to_ulong()] = m[rb];
+		mc.cycles += (cm ? cache_read(*cm, pc, rb) : mc.cost.mem_cycles);
+		break;
+	    case OP_IO:
+		Ra = RWord(strtol(dword_to_string(inst).substr(4, 4).c_str(), NULL, 2));
+		Rb = RWord(strtol(dword_to_string(inst).substr(8, 3).c_str(), NULL, 2));
+		rc = strtol(dword_to_string(inst).substr(11, 1).c_str(), NULL, 2);
+		
+		if (mc.trace)
+		    std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
+				<< "Inst = " << dword_to_pretty_string(inst)
+				<< " -> MOV  D" << rc
+				<< ", R" << Ra.to_ulong() 
+				<< ", P" << Rb.to_ulong()
+				<< trace_symbol(mc.symbols, pc, -1)
+				<< std::endl;
+
+		if (rc) {
+		    if (lc) loop_write(*lc, LK_PREGFILE + Rb.to_ulong(), prf[Rb.to_ulong()], rf[Ra.to_ulong()]);
+		    prf[Rb.to_ulong()] = rf[Ra.to_ulong()];
+		} else {
+		    if (lc) loop_write(*lc, LK_REGFILE + Ra.to_ulong(), rf[Ra.to_ulong()], prf[Rb.to_ulong()]);
+		    rf[Ra.to_ulong()] = prf[Rb.to_ulong()];
+		}
+		break;
+	    case OP_END:
+		if (mc.trace)
+		    std::cout   << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
+				<< "Inst = " << dword_to_pretty_string(inst)
+				<< " -> END"
+				<< trace_symbol(mc.symbols, pc, -1)
+				<< std::endl;
+		mc.halted = true;
+		continue;
+	    default:
+		std::cerr   << "Unknown opcode: " << Op << " in " << dword_to_pretty_string(inst) << std::endl;
+		break;
+	}
+
+	pc++;
+
+	if (lc) loop_check(*lc, mc, pc);
+    }
+
+    mc.pc     = pc;
+    mc.steps += i;
+    if (ctl) control_publish(*ctl, mc.pc, mc.steps);
+
+    return (i);
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
@@ -0,0 +1,218 @@
+//------------------------------------------------------------------------------
+// psim_coverage.cc: psim instruction and branch coverage
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Global Constants
+//------------------------------------------------------------------------------
+
+static const char *CoverageMagic = "psim-coverage 1";
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static bool	coverage_bit	    (std::vector<uint64_t>& bm, size_t a) {
+    return ((bm[a >> 6] >> (a & 63)) & 1);
+}
+
+static uint64_t coverage_hash	    (Memory& m) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (size_t a = 0; a < m.size(); a++) {
+	h ^= m[a].to_ulong();
+	h *= 0x100000001b3ULL;
+    }
+
+    return (h);
+}
+
+static bool	read_bitmap	    (std::istream& in, std::vector<uint64_t>& bm, size_t words) {
+    bm.resize(words);
+    if (words)
+	in.read((char *)&bm[0], words * sizeof(uint64_t));
+
+    return (!in.fail());
+}
+
+static void	write_bitmap	    (std::ostream& out, std::vector<uint64_t>& bm) {
+    if (bm.size())
+	out.write((const char *)&bm[0], bm.size() * sizeof(uint64_t));
+}
+
+//------------------------------------------------------------------------------
+// Coverage Load
+//------------------------------------------------------------------------------
+
+bool		coverage_load	    (std::istream& in, Coverage& cov) {
+    std::string	line;
+    std::string	tag;
+    std::string	image;
+    size_t	words;
+
+    if (!getline(in, line) || line != CoverageMagic || !getline(in, line))
+	return (false);
+
+    std::istringstream ss(line);
+    if (!(ss >> tag >> cov.size) || tag != "size" || !(ss >> tag >> image) || tag != "image")
+	return (false);
+
+    cov.image = strtoull(image.c_str(), NULL, 16);
+    words     = (cov.size + 63) / 64;
+
+    return (read_bitmap(in, cov.executed, words) &&
+	    read_bitmap(in, cov.taken, words) &&
+	    read_bitmap(in, cov.not_taken, words));
+}
+
+//------------------------------------------------------------------------------
+// Coverage Merge
+//------------------------------------------------------------------------------
+
+// Runs of the same image merge by union; anything else is rejected.
+
+bool		coverage_merge	    (Coverage& dst, Coverage& src) {
+    if (dst.size != src.size || dst.image != src.image)
+	return (false);
+
+    for (size_t i = 0; i < dst.executed.size(); i++) {
+	dst.executed[i]	 |= src.executed[i];
+	dst.taken[i]	 |= src.taken[i];
+	dst.not_taken[i] |= src.not_taken[i];
+    }
+
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Coverage Reset
+//------------------------------------------------------------------------------
+
+void		coverage_reset	    (Coverage& cov, Memory& m) {
+    size_t  words = (m.size() + 63) / 64;
+
+    cov.size  = m.size();
+    cov.image = coverage_hash(m);
+    cov.executed.assign(words, 0);
+    cov.taken.assign(words, 0);
+    cov.not_taken.assign(words, 0);
+}
+
+//------------------------------------------------------------------------------
+// Coverage Write
+//------------------------------------------------------------------------------
+
+// A text header followed by the executed, taken and not-taken bitmaps as
+// native 64-bit words.
+
+bool		coverage_write	    (std::ostream& out, Coverage& cov) {
+    out << CoverageMagic << "\n";
+    out << "size " << cov.size << " image " << std::hex << std::setfill('0') << std::setw(16) << cov.image
+	<< std::dec << "\n";
+
+    write_bitmap(out, cov.executed);
+    write_bitmap(out, cov.taken);
+    write_bitmap(out, cov.not_taken);
+
+    return (!out.fail());
+}
+
+//------------------------------------------------------------------------------
+// Print Coverage
+//------------------------------------------------------------------------------
+
+// Every instruction address with whether it ran and, for conditional
+// branches, which directions were seen (T taken, N not taken, - missing).
+// Data words from the source map are left out of the totals.
+
+void		print_coverage	    (std::ostream& out, Coverage& cov, Memory& m, SymbolTable *st) {
+    std::ios::fmtflags flags	 = out.flags();
+    std::streamsize    precision = out.precision();
+    std::ostringstream body;
+    size_t	       insts	 = 0;
+    size_t	       executed	 = 0;
+    size_t	       branches	 = 0;
+    size_t	       directions = 0;
+    char	       text[ISA_FORMAT_SIZE];
+
+    for (size_t a = 0; a < cov.size && a < m.size(); a++) {
+	uint16_t    w	   = m[a].to_ulong();
+	size_t	    op	   = DecodeTable[w].op;
+	bool	    data   = (st && a < st->lines.size() && st->lines[a].line && st->lines[a].data);
+	bool	    ran	   = coverage_bit(cov.executed, a);
+	bool	    branch = (op == OP_JMPZ || op == OP_JMPN);
+
+	if (data && !ran)
+	    continue;
+
+	if (!data) {
+	    insts++;
+	    executed += ran;
+	    if (branch) {
+		branches   += 2;
+		directions += coverage_bit(cov.taken, a) + coverage_bit(cov.not_taken, a);
+	    }
+	}
+
+	body << "[" << std::setfill('0') << std::setw(3) << a << "] "
+	     << (ran ? "  *  " : "  -  ");
+	if (branch)
+	    body << (coverage_bit(cov.taken, a) ? "T" : "-") << (coverage_bit(cov.not_taken, a) ? "N" : "-");
+	else
+	    body << "  ";
+	body << "  0x" << std::hex << std::setw(4) << w << std::dec << "  "
+	     << std::left << std::setfill(' ') << std::setw(20) << std::string(text, isa_format(text, w)) << std::right;
+	if (symbol_string(st, a).size())
+	    body << "  // " << symbol_string(st, a);
+	body << "\n";
+    }
+
+    out << std::fixed << std::setprecision(2)
+	<< "Coverage: " << executed << " of " << insts << " instructions executed ("
+	<< (insts ? 100.0 * executed / insts : 0.0) << "%), "
+	<< directions << " of " << branches << " branch directions ("
+	<< (branches ? 100.0 * directions / branches : 0.0) << "%)" << std::endl;
+    out << "[PC ] Exec Br  Word    Instruction" << std::endl;
+    out << "----------------------------------------" << std::endl;
+    out << body.str();
+    out << "----------------------------------------" << std::endl;
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
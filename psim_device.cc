@@ -0,0 +1,408 @@
+//------------------------------------------------------------------------------
+// psim_device.cc: psim event-driven pregister devices
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Global Constants
+//------------------------------------------------------------------------------
+
+static const char  *DeviceNames[] = { "timer", "input", "output", "uart" };
+
+static const size_t CapturedShown = 16;	// Latest output words printed
+
+static const uint16_t UartReceived = 1;	// Status bits
+static const uint16_t UartReady	   = 2;
+static const uint16_t UartDone	   = 4;
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static uint64_t device_now	    (DeviceBus& db, Machine& mc) {
+    return (db.clock == DC_CYCLES ? mc.cycles : mc.steps);
+}
+
+static void	device_schedule	    (DeviceBus& db, size_t d, uint64_t time, DEVICE_EVENT kind) {
+    DeviceEvent e;
+
+    e.time	 = time;
+    e.device	 = d;
+    e.generation = db.devices[d].generation;
+    e.kind	 = kind;
+    db.events.push(e);
+    db.next	 = db.events.top().time;
+}
+
+// The data pregister shows the oldest received word and the status
+// pregister what a read of it would return, so o prints the UART state.
+
+static void	uart_publish	    (Device& dv, Machine& mc) {
+    uint16_t status = 0;
+
+    if (dv.rx.size())
+	status |= UartReceived;
+    if (dv.tx.size() < dv.depth)
+	status |= UartReady;
+    if (dv.rx.empty() && dv.position >= dv.input.size())
+	status |= UartDone;
+
+    mc.pregfile[dv.pregister]	  = dv.rx.size() ? dv.rx.front() : 0;
+    mc.pregfile[dv.pregister + 1] = status;
+}
+
+static void	device_emit	    (Device& dv, uint16_t v) {
+    dv.captured.push_back(v);
+
+    if (dv.output) {
+	if (dv.type == DV_UART)
+	    fputc(v & 0xff, dv.output);
+	else
+	    fprintf(dv.output, "%d\n", (int)(int16_t)v);
+    }
+}
+
+// Input devices read whitespace-separated words; a UART reads bytes.
+
+static bool	device_load	    (Device& dv) {
+    std::ifstream in(dv.input_path.c_str(), std::ios::in | std::ios::binary);
+    long	  v;
+    char	  c;
+
+    dv.input.clear();
+    if (!in.is_open())
+	return (false);
+
+    if (dv.type == DV_UART) {
+	while (in.get(c))
+	    dv.input.push_back((unsigned char)c);
+    } else {
+	while (in >> v)
+	    dv.input.push_back(v);
+	if (!in.eof())
+	    return (false);
+    }
+
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Device Attach
+//------------------------------------------------------------------------------
+
+bool		device_attach	    (DeviceBus& db, Machine& mc, Device& dv) {
+    size_t  width = (dv.type == DV_UART ? 2 : 1);
+
+    if (dv.pregister + width > PRF_SIZE)
+	return (false);
+    if ((dv.type == DV_TIMER || dv.type == DV_UART) && dv.period == 0)
+	return (false);
+    if (dv.type == DV_UART && dv.depth == 0)
+	return (false);
+    if (dv.input_path.size() && !device_load(dv))
+	return (false);
+
+    dv.output = NULL;
+    if (dv.output_path.size() && (dv.output = fopen(dv.output_path.c_str(), "w")) == NULL)
+	return (false);
+
+    // A device on a pregister that is already taken replaces the old one
+    for (size_t d = 0; d < db.devices.size(); d++) {
+	Device& old = db.devices[d];
+
+	if (old.pregister < dv.pregister + width &&
+	    dv.pregister < old.pregister + (old.type == DV_UART ? 2 : 1)) {
+	    if (old.output) fclose(old.output);
+	    db.devices.erase(db.devices.begin() + d--);
+	}
+    }
+
+    dv.attached = dv.period;
+    db.devices.push_back(dv);
+    device_reset(db, mc);
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Device Clear
+//------------------------------------------------------------------------------
+
+void		device_clear	    (DeviceBus& db) {
+    for (size_t d = 0; d < db.devices.size(); d++)
+	if (db.devices[d].output)
+	    fclose(db.devices[d].output);
+
+    db.clock = DC_STEPS;
+    db.devices.clear();
+    db.events = std::priority_queue<DeviceEvent, std::vector<DeviceEvent>, std::greater<DeviceEvent> >();
+    db.next   = UINT64_MAX;
+    db.fired  = 0;
+    db.calls  = 0;
+    for (size_t p = 0; p < PRF_SIZE; p++)
+	db.map[p] = -1;
+}
+
+//------------------------------------------------------------------------------
+// Device Events
+//------------------------------------------------------------------------------
+
+void		device_events	    (DeviceBus& db, Machine& mc, uint64_t now) {
+    while (db.events.size() && db.events.top().time <= now) {
+	DeviceEvent e  = db.events.top();
+	Device&	    dv = db.devices[e.device];
+
+	db.events.pop();
+	if (e.generation != dv.generation)
+	    continue;
+
+	db.fired++;
+	switch (e.kind) {
+	    case DE_TICK:
+		mc.pregfile[dv.pregister] = ++dv.count;
+		if (dv.period)
+		    device_schedule(db, e.device, e.time + dv.period, DE_TICK);
+		break;
+	    case DE_RECEIVE:
+		if (dv.rx.size() < dv.depth)
+		    dv.rx.push_back(dv.input[dv.position]);
+		else
+		    dv.overruns++;
+		if (++dv.position < dv.input.size())
+		    device_schedule(db, e.device, e.time + dv.period, DE_RECEIVE);
+		uart_publish(dv, mc);
+		break;
+	    case DE_TRANSMIT:
+		device_emit(dv, dv.tx.front());
+		dv.tx.pop_front();
+		if ((dv.sending = dv.tx.size()))
+		    device_schedule(db, e.device, e.time + dv.period, DE_TRANSMIT);
+		uart_publish(dv, mc);
+		break;
+	}
+    }
+
+    db.next = (db.events.size() ? db.events.top().time : UINT64_MAX);
+}
+
+//------------------------------------------------------------------------------
+// Device Init
+//------------------------------------------------------------------------------
+
+void		device_init	    (Device& dv, DEVICE_TYPE type, size_t p) {
+    dv.type	  = type;
+    dv.pregister  = p;
+    dv.period	  = 0;
+    dv.attached	  = 0;
+    dv.depth	  = 0;
+    dv.generation = 0;
+    dv.count	  = 0;
+    dv.position	  = 0;
+    dv.output	  = NULL;
+    dv.sending	  = false;
+    dv.overruns	  = 0;
+    dv.input_path.clear();
+    dv.output_path.clear();
+    dv.input.clear();
+    dv.captured.clear();
+    dv.rx.clear();
+    dv.tx.clear();
+}
+
+//------------------------------------------------------------------------------
+// Device Read
+//------------------------------------------------------------------------------
+
+uint16_t	device_read	    (DeviceBus& db, Machine& mc, size_t p) {
+    Device&  dv = db.devices[db.map[p]];
+    uint16_t v	= mc.pregfile[p].to_ulong();
+
+    db.calls++;
+    switch (dv.type) {
+	case DV_INPUT:
+	    v = (dv.position < dv.input.size() ? dv.input[dv.position++] : 0xffff);
+	    mc.pregfile[p] = v;
+	    break;
+	case DV_UART:
+	    // Events due at this instruction have already run
+	    if (p == dv.pregister && dv.rx.size()) {
+		v = dv.rx.front();
+		dv.rx.pop_front();
+		uart_publish(dv, mc);
+	    }
+	    break;
+	default:
+	    break;
+    }
+
+    return (v);
+}
+
+//------------------------------------------------------------------------------
+// Device Reset
+//------------------------------------------------------------------------------
+
+// Rewinds every device to its attached state and schedules its first events
+// from the machine's current time (0 after a load).
+
+void		device_reset	    (DeviceBus& db, Machine& mc) {
+    uint64_t now = device_now(db, mc);
+
+    db.events = std::priority_queue<DeviceEvent, std::vector<DeviceEvent>, std::greater<DeviceEvent> >();
+    db.next   = UINT64_MAX;
+    for (size_t p = 0; p < PRF_SIZE; p++)
+	db.map[p] = -1;
+
+    for (size_t d = 0; d < db.devices.size(); d++) {
+	Device& dv = db.devices[d];
+
+	dv.generation++;
+	dv.count    = 0;
+	dv.position = 0;
+	dv.sending  = false;
+	dv.overruns = 0;
+	dv.captured.clear();
+	dv.rx.clear();
+	dv.tx.clear();
+	if (dv.output)
+	    dv.output = freopen(dv.output_path.c_str(), "w", dv.output);
+
+	db.map[dv.pregister] = d;
+	switch (dv.type) {
+	    case DV_TIMER:
+		// The program may have stopped the timer (period 0)
+		dv.period		  = dv.attached;
+		mc.pregfile[dv.pregister] = 0;
+		if (dv.period)
+		    device_schedule(db, d, now + dv.period, DE_TICK);
+		break;
+	    case DV_UART:
+		db.map[dv.pregister + 1] = d;
+		if (dv.input.size())
+		    device_schedule(db, d, now + dv.period, DE_RECEIVE);
+		uart_publish(dv, mc);
+		break;
+	    default:
+		break;
+	}
+    }
+}
+
+//------------------------------------------------------------------------------
+// Device Write
+//------------------------------------------------------------------------------
+
+void		device_write	    (DeviceBus& db, Machine& mc, size_t p, uint64_t now) {
+    Device&  dv = db.devices[db.map[p]];
+    uint16_t v	= mc.pregfile[p].to_ulong();
+
+    db.calls++;
+    switch (dv.type) {
+	case DV_TIMER:
+	    // A new period restarts the count; 0 stops the timer
+	    dv.generation++;
+	    dv.count	   = 0;
+	    dv.period	   = v;
+	    mc.pregfile[p] = 0;
+	    if (dv.period)
+		device_schedule(db, db.map[p], now + dv.period, DE_TICK);
+	    break;
+	case DV_OUTPUT:
+	    device_emit(dv, v);
+	    break;
+	case DV_UART:
+	    if (p == dv.pregister) {
+		if (dv.tx.size() < dv.depth)
+		    dv.tx.push_back(v);
+		else
+		    dv.overruns++;
+		if (!dv.sending) {
+		    dv.sending = true;
+		    device_schedule(db, db.map[p], now + dv.period, DE_TRANSMIT);
+		}
+	    }
+	    uart_publish(dv, mc);
+	    break;
+	default:
+	    break;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Print Devices
+//------------------------------------------------------------------------------
+
+void		print_devices	    (DeviceBus& db, Machine& mc) {
+    std::cout << "Devices (" << (db.clock == DC_CYCLES ? "cycle" : "step") << " clock at " << device_now(db, mc)
+	      << "): " << db.fired << " events, " << db.calls << " accesses";
+    if (db.next != UINT64_MAX)
+	std::cout << ", next event at " << db.next;
+    std::cout << std::endl;
+
+    for (size_t d = 0; d < db.devices.size(); d++) {
+	Device& dv = db.devices[d];
+
+	std::cout << "    P" << dv.pregister << " " << DeviceNames[dv.type];
+	switch (dv.type) {
+	    case DV_TIMER:
+		std::cout << ": period " << dv.period << ", " << dv.count << " ticks";
+		break;
+	    case DV_INPUT:
+		std::cout << " " << dv.input_path << ": " << dv.position << " of " << dv.input.size() << " words read";
+		break;
+	    case DV_OUTPUT:
+		std::cout << (dv.output_path.size() ? " " : "") << dv.output_path << ": " << dv.captured.size() << " words";
+		break;
+	    case DV_UART:
+		std::cout << " (status P" << dv.pregister + 1 << "): period " << dv.period
+			  << ", rx " << dv.rx.size() << "/" << dv.depth << ", tx " << dv.tx.size() << "/" << dv.depth
+			  << ", " << dv.position << " of " << dv.input.size() << " received, "
+			  << dv.captured.size() << " sent, " << dv.overruns << " overruns";
+		break;
+	}
+	std::cout << std::endl;
+
+	if (dv.captured.size()) {
+	    std::cout << "\t" << (dv.captured.size() > CapturedShown ? "..." : "");
+	    for (size_t i = dv.captured.size() > CapturedShown ? dv.captured.size() - CapturedShown : 0; i < dv.captured.size(); i++)
+		std::cout << " " << (int16_t)dv.captured[i];
+	    std::cout << std::endl;
+	}
+
+	if (dv.output) fflush(dv.output);
+    }
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
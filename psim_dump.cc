@@ -0,0 +1,370 @@
+//------------------------------------------------------------------------------
+// psim_dump.cc: psim bulk state dumps
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Global Constants
+//------------------------------------------------------------------------------
+
+static const char *DumpFormats[] = { "text", "raw", "hex", "json", "csv" };
+static const char *DumpRule	 = "----------------------------------------\n";
+
+//------------------------------------------------------------------------------
+// Structures
+//------------------------------------------------------------------------------
+
+// One register, pregister or memory word of a dump, in dump order
+struct DumpWord {
+    uint8_t	kind;		// TRACE_KIND
+    size_t	index;
+    uint16_t	value;
+};
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+// Formatting appends to one buffer, so nothing goes through a stream until
+// the whole dump is written at once.
+
+static void	put_unsigned	    (std::string& out, uint64_t v, size_t width = 0, char fill = '0') {
+    char    digits[24];
+    size_t  n = 0;
+
+    do {
+	digits[n++] = '0' + v % 10;
+	v /= 10;
+    } while (v);
+
+    for (size_t i = n; i < width; i++)
+	out.push_back(fill);
+    while (n)
+	out.push_back(digits[--n]);
+}
+
+static void	put_signed	    (std::string& out, int16_t v) {
+    if (v < 0)
+	out.push_back('-');
+    put_unsigned(out, v < 0 ? -(long)v : v);
+}
+
+static void	put_hex		    (std::string& out, uint16_t v) {
+    static const char *Hex = "0123456789abcdef";
+
+    for (int i = 12; i >= 0; i -= 4)
+	out.push_back(Hex[(v >> i) & 0xf]);
+}
+
+static void	put_word	    (std::string& out, uint16_t v) {
+    char    text[WORD_FORMAT_SIZE];
+
+    out.append(text, word_format(text, v));
+}
+
+template <class T>
+static void	put_binary	    (std::string& out, T v) {
+    out.append((const char *)&v, sizeof(v));
+}
+
+static void	put_name	    (std::string& out, uint8_t kind, size_t index) {
+    out.push_back(kind == TK_REGISTER ? 'r' : kind == TK_PREGISTER ? 'p' : 'm');
+    put_unsigned(out, index);
+}
+
+// Every word in the dump, or only those that changed since the last dump
+static void	dump_words	    (Machine& mc, size_t start, size_t end, DumpState& last, bool diff, std::vector<DumpWord>& words) {
+    DumpWord	w;
+
+    for (size_t r = 0; r < RF_SIZE; r++) {
+	w.kind	= TK_REGISTER;
+	w.index = r;
+	w.value = mc.regfile[r].to_ulong();
+	if (!diff || w.value != last.regfile[r])
+	    words.push_back(w);
+    }
+
+    for (size_t p = 0; p < PRF_SIZE; p++) {
+	w.kind	= TK_PREGISTER;
+	w.index = p;
+	w.value = mc.pregfile[p].to_ulong();
+	if (!diff || w.value != last.pregfile[p])
+	    words.push_back(w);
+    }
+
+    for (size_t a = start; a < end; a++) {
+	w.kind	= TK_MEMORY;
+	w.index = a;
+	w.value = mc.memory[a].to_ulong();
+	if (!diff || a >= last.memory.size() || w.value != last.memory[a])
+	    words.push_back(w);
+    }
+}
+
+static void	dump_text	    (std::string& out, Machine& mc, std::vector<DumpWord>& words, bool pc) {
+    size_t  w = 0;
+
+    out += "|REG| Decimal Hex    Binary\n";
+    out += DumpRule;
+    for (; w < words.size() && words[w].kind == TK_REGISTER; w++) {
+	out += "|R";
+	put_unsigned(out, words[w].index, 2);
+	out += "| ";
+	put_word(out, words[w].value);
+	out += "\n";
+    }
+    out += DumpRule;
+    if (pc) {
+	out += "[PC ] ";
+	put_word(out, mc.pc);
+	if (symbol_string(mc.symbols, mc.pc).size())
+	    out += " " + symbol_string(mc.symbols, mc.pc);
+	out += "\n";
+	out += DumpRule;
+    }
+
+    out += "|REG| Decimal Hex    Binary\n";
+    out += DumpRule;
+    for (; w < words.size() && words[w].kind == TK_PREGISTER; w++) {
+	out += "|P";
+	put_unsigned(out, words[w].index, 2);
+	out += "| ";
+	put_word(out, words[w].value);
+	out += "\n";
+    }
+    out += DumpRule;
+
+    out += "<MEM> Decimal Hex    Binary\n";
+    out += DumpRule;
+    for (; w < words.size(); w++) {
+	out += "<";
+	put_unsigned(out, words[w].index, 3);
+	out += "> ";
+	put_word(out, words[w].value);
+	if (symbol_name(mc.symbols, words[w].index).size()) {
+	    out += " ";
+	    out += symbol_name(mc.symbols, words[w].index);
+	}
+	out += "\n";
+    }
+    out += DumpRule;
+}
+
+// The server's state reply, or for a diff the changed words as kind, index
+// and value after the same machine header
+static void	dump_raw	    (std::string& out, Machine& mc, std::vector<DumpWord>& words, size_t start, size_t end, bool diff) {
+    put_binary<uint64_t>(out, mc.pc);
+    put_binary<uint64_t>(out, mc.steps);
+    put_binary<uint64_t>(out, mc.cycles);
+    put_binary<uint8_t>(out, mc.halted);
+
+    if (diff) {
+	put_binary<uint32_t>(out, words.size());
+	for (size_t w = 0; w < words.size(); w++) {
+	    put_binary<uint8_t>(out, words[w].kind);
+	    put_binary<uint32_t>(out, words[w].index);
+	    put_binary<uint16_t>(out, words[w].value);
+	}
+	return;
+    }
+
+    for (size_t w = 0; w < words.size(); w++) {
+	if (words[w].kind == TK_MEMORY && words[w].index == start) {
+	    put_binary<uint32_t>(out, start);
+	    put_binary<uint32_t>(out, end - start);
+	}
+	put_binary<uint16_t>(out, words[w].value);
+    }
+    if (start == end) {
+	put_binary<uint32_t>(out, start);
+	put_binary<uint32_t>(out, 0);
+    }
+}
+
+// Full dumps put eight memory words on a line after their address; diffs
+// name each changed word
+static void	dump_hex	    (std::string& out, Machine& mc, std::vector<DumpWord>& words, bool diff) {
+    out += "pc ";
+    put_hex(out, mc.pc);
+    out += " steps ";
+    put_unsigned(out, mc.steps);
+    out += (mc.halted ? " halted\n" : "\n");
+
+    for (size_t w = 0; w < words.size(); w++) {
+	if (diff) {
+	    put_name(out, words[w].kind, words[w].index);
+	    out += " ";
+	} else if (words[w].kind != TK_MEMORY) {
+	    if (words[w].index == 0)
+		out += (words[w].kind == TK_REGISTER ? "r   " : "p   ");
+	} else if (w == 0 || words[w - 1].kind != TK_MEMORY || (words[w].index & 7) == 0) {
+	    put_hex(out, words[w].index);
+	    out += ":";
+	}
+
+	if (!diff && words[w].kind == TK_MEMORY)
+	    out += " ";
+	put_hex(out, words[w].value);
+
+	if (diff || w + 1 == words.size() || words[w + 1].kind != words[w].kind ||
+	    (words[w].kind == TK_MEMORY && (words[w + 1].index & 7) == 0))
+	    out += "\n";
+	else if (words[w].kind != TK_MEMORY)
+	    out += " ";
+    }
+}
+
+// Full dumps hold arrays; diffs hold objects keyed by index
+static void	dump_json	    (std::string& out, Machine& mc, std::vector<DumpWord>& words, size_t start, bool diff) {
+    static const char *Keys[] = { "", "registers", "pregisters", "memory" };
+    size_t	       w      = 0;
+
+    out += "{\"pc\": ";
+    put_unsigned(out, mc.pc);
+    out += ", \"steps\": ";
+    put_unsigned(out, mc.steps);
+    out += ", \"cycles\": ";
+    put_unsigned(out, mc.cycles);
+    out += (mc.halted ? ", \"halted\": true" : ", \"halted\": false");
+
+    for (uint8_t kind = TK_REGISTER; kind <= TK_MEMORY; kind++) {
+	bool first = true;
+
+	out += ", \"";
+	out += Keys[kind];
+	out += "\": ";
+	if (!diff && kind == TK_MEMORY) {
+	    out += "{\"start\": ";
+	    put_unsigned(out, start);
+	    out += ", \"words\": ";
+	}
+	out += (diff ? "{" : "[");
+
+	for (; w < words.size() && words[w].kind == kind; w++) {
+	    if (!first)
+		out += ", ";
+	    if (diff) {
+		out += "\"";
+		put_unsigned(out, words[w].index);
+		out += "\": ";
+	    }
+	    put_signed(out, words[w].value);
+	    first = false;
+	}
+
+	out += (diff ? "}" : "]");
+	if (!diff && kind == TK_MEMORY)
+	    out += "}";
+    }
+
+    out += "}\n";
+}
+
+static void	dump_csv	    (std::string& out, Machine& mc, std::vector<DumpWord>& words) {
+    out += "kind,index,value\n";
+    out += "pc,0,";
+    put_unsigned(out, mc.pc);
+    out += "\nsteps,0,";
+    put_unsigned(out, mc.steps);
+    out += "\n";
+
+    for (size_t w = 0; w < words.size(); w++) {
+	out += (words[w].kind == TK_REGISTER ? "r," : words[w].kind == TK_PREGISTER ? "p," : "m,");
+	put_unsigned(out, words[w].index);
+	out += ",";
+	put_signed(out, words[w].value);
+	out += "\n";
+    }
+}
+
+//------------------------------------------------------------------------------
+// Dump Format
+//------------------------------------------------------------------------------
+
+bool		dump_format	    (const std::string& s, DUMP_FORMAT& f) {
+    for (size_t i = 0; i < sizeof(DumpFormats) / sizeof(DumpFormats[0]); i++) {
+	if (s == DumpFormats[i]) {
+	    f = (DUMP_FORMAT)i;
+	    return (true);
+	}
+    }
+
+    return (false);
+}
+
+//------------------------------------------------------------------------------
+// Dump State
+//------------------------------------------------------------------------------
+
+// Appends the registers, pregisters and memory from start up to (not
+// including) end to out.  A diff only has the words that changed since the
+// last dump into the same state (everything when there was none); every dump
+// becomes the new last one.
+
+void		dump_state	    (std::string& out, Machine& mc, DUMP_FORMAT f, size_t start, size_t end, DumpState& last, bool diff) {
+    std::vector<DumpWord> words;
+    bool		  pc;
+
+    end	  = std::min(end, mc.memory.size());
+    start = std::min(start, end);
+    diff  = diff && last.valid;
+    pc	  = !diff || mc.pc != last.pc;
+
+    words.reserve(RF_SIZE + PRF_SIZE + end - start);
+    dump_words(mc, start, end, last, diff, words);
+    out.reserve(out.size() + words.size() * (f == DF_TEXT ? 48 : 12) + 256);
+
+    switch (f) {
+	case DF_TEXT: dump_text(out, mc, words, pc); break;
+	case DF_RAW:  dump_raw(out, mc, words, start, end, diff); break;
+	case DF_HEX:  dump_hex(out, mc, words, diff); break;
+	case DF_JSON: dump_json(out, mc, words, start, diff); break;
+	case DF_CSV:  dump_csv(out, mc, words); break;
+    }
+
+    last.valid = true;
+    last.pc    = mc.pc;
+    last.regfile.resize(RF_SIZE);
+    last.pregfile.resize(PRF_SIZE);
+    last.memory.resize(mc.memory.size(), 0);
+    for (size_t r = 0; r < RF_SIZE; r++)
+	last.regfile[r] = mc.regfile[r].to_ulong();
+    for (size_t p = 0; p < PRF_SIZE; p++)
+	last.pregfile[p] = mc.pregfile[p].to_ulong();
+    for (size_t a = 0; a < mc.memory.size(); a++)
+	last.memory[a] = mc.memory[a].to_ulong();
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
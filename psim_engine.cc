@@ -0,0 +1,481 @@
+//------------------------------------------------------------------------------
+// psim_engine.cc: psim policy-specialized step engine
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static void	trace_instruction   (Machine& mc, size_t pc, uint16_t w) {
+    const DecodedInst& d = DecodeTable[w];
+    char	       text[ISA_FORMAT_SIZE];
+
+    if (d.op == OP_UNKNOWN)
+	return;
+
+    std::cout << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
+	      << "Inst = " << dword_to_pretty_string(DWord(w))
+	      << " -> " << std::string(text, isa_format(text, w))
+	      << trace_symbol(mc.symbols, pc, d.op == OP_LOAD || d.op == OP_STORE ? d.imm : -1)
+	      << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// Policies
+//------------------------------------------------------------------------------
+
+// Each feature of the step loop is a policy with a disabled variant whose
+// functions are empty, so an engine instantiated without the feature has no
+// trace of it in the loop.
+
+struct NoTrace {
+    static void	instruction	    (Machine&, size_t, size_t, uint16_t) {}
+};
+
+struct PrintTrace {
+    static void	instruction	    (Machine& mc, size_t, size_t pc, uint16_t w) { trace_instruction(mc, pc, w); }
+};
+
+// Waveforms and binary traces also carry the printed trace when it is on
+struct RecordTrace {
+    static void	instruction	    (Machine& mc, size_t i, size_t pc, uint16_t w) {
+	if (mc.trace)
+	    trace_instruction(mc, pc, w);
+	if (mc.waveform)
+	    waveform_sample(*mc.waveform, mc, mc.steps + i, pc, w, false);
+	if (mc.tracefile)
+	    tracefile_record(*mc.tracefile, mc, pc, w);
+    }
+};
+
+struct NoProfile {
+    static void	count		    (Machine&, size_t) {}
+};
+
+struct CountProfile {
+    static void	count		    (Machine& mc, size_t pc) { (*mc.profile)[pc]++; }
+};
+
+struct FlatTiming {
+    static size_t fetch		    (Machine& mc, size_t) { return (mc.cost.mem_cycles); }
+    static size_t read		    (Machine& mc, size_t, size_t) { return (mc.cost.mem_cycles); }
+    static size_t write		    (Machine& mc, size_t, size_t) { return (mc.cost.mem_cycles); }
+};
+
+struct CacheTiming {
+    static size_t fetch		    (Machine& mc, size_t pc) { return (cache_fetch(*mc.cache, pc)); }
+    static size_t read		    (Machine& mc, size_t pc, size_t a) { return (cache_read(*mc.cache, pc, a)); }
+    static size_t write		    (Machine& mc, size_t pc, size_t a) { return (cache_write(*mc.cache, pc, a)); }
+};
+
+struct NoBreak {
+    static bool	stop		    (Machine&, size_t, size_t) { return (false); }
+};
+
+// Breakpoints and run control (pause requests and published counters)
+struct CheckBreak {
+    static bool	stop		    (Machine& mc, size_t pc, size_t i) {
+	if (mc.control) {
+	    if (mc.control->stop.load(std::memory_order_relaxed))
+		return (true);
+	    if ((i & 0xff) == 0)
+		control_publish(*mc.control, pc, mc.steps + i);
+	}
+
+	return (i > 0 && pc < mc.breakpoints.size() && mc.breakpoints[pc]);
+    }
+};
+
+// Bounds also own the memory accesses, so paged memory can put the address
+// space past the image in frames and check each page's permissions.
+struct UncheckedBounds {
+    static bool	fetch		    (Machine&, size_t) { return (true); }
+    static bool	valid		    (Machine&, size_t, size_t, bool) { return (true); }
+    static DWord read		    (Machine& mc, size_t a) { return (mc.memory[a]); }
+    static void	write		    (Machine& mc, size_t a, DWord v) { mc.memory[a] = v; }
+};
+
+struct CheckedBounds {
+    static bool	fetch		    (Machine&, size_t) { return (true); }
+    static bool	valid		    (Machine& mc, size_t pc, size_t a, bool) {
+	if (a < mc.memory.size())
+	    return (true);
+
+	std::cerr << "Memory access out of bounds at PC " << pc << ": address " << a << std::endl;
+	return (false);
+    }
+    static DWord read		    (Machine& mc, size_t a) { return (mc.memory[a]); }
+    static void	write		    (Machine& mc, size_t a, DWord v) { mc.memory[a] = v; }
+};
+
+// Stores to executable pages mark them dirty, so translations of the image
+// are revalidated a page at a time instead of word by word.
+struct PagedBounds {
+    static bool	fetch		    (Machine& mc, size_t pc) {
+	if (mc.pages->flags[pc >> mc.pages->shift] & PF_EXEC)
+	    return (true);
+	return (page_fault(*mc.pages, pc, pc, PF_EXEC));
+    }
+    static bool	valid		    (Machine& mc, size_t pc, size_t a, bool write) {
+	if (a < mc.pages->size && (mc.pages->flags[a >> mc.pages->shift] & (write ? PF_WRITE : PF_READ)))
+	    return (true);
+	return (page_fault(*mc.pages, pc, a, write ? PF_WRITE : PF_READ));
+    }
+    static DWord read		    (Machine& mc, size_t a) {
+	return (a < mc.memory.size() ? mc.memory[a] : page_read(*mc.pages, a));
+    }
+    static void	write		    (Machine& mc, size_t a, DWord v) {
+	page_dirty(*mc.pages, a);
+	if (a < mc.memory.size())
+	    mc.memory[a] = v;
+	else
+	    page_write(*mc.pages, a, v);
+    }
+};
+
+struct NoLoop {
+    static bool	found		    (Machine&) { return (false); }
+    static void	write		    (Machine&, size_t, DWord, DWord) {}
+    static void	check		    (Machine&, size_t) {}
+};
+
+struct HashLoop {
+    static bool	found		    (Machine& mc) { return (mc.loop->found); }
+    static void	write		    (Machine& mc, size_t k, DWord f, DWord t) { loop_write(*mc.loop, k, f, t); }
+    static void	check		    (Machine& mc, size_t pc) { loop_check(*mc.loop, mc, pc); }
+};
+
+struct NoAccessLog {
+    static void	fetch		    (Machine&, size_t) {}
+    static void	record		    (Machine&, size_t, size_t, size_t, DWord, bool) {}
+};
+
+struct RecordAccess {
+    static void	fetch		    (Machine&, size_t) {}
+    static void	record		    (Machine& mc, size_t i, size_t pc, size_t a, DWord v, bool write) {
+	MemAccess ma;
+
+	ma.step	   = mc.steps + i;
+	ma.pc	   = pc;
+	ma.address = a;
+	ma.value   = v.to_ulong();
+	ma.write   = write;
+	mc.accesses->push_back(ma);
+    }
+};
+
+// The heatmap covers the image; paged scratch space past it is not counted
+struct CountAccess {
+    static void	fetch		    (Machine& mc, size_t pc) { mc.heatmap->code[pc] = 1; }
+    static void	record		    (Machine& mc, size_t i, size_t, size_t a, DWord, bool write) {
+	if (a < mc.heatmap->reads.size())
+	    heatmap_access(*mc.heatmap, mc.steps + i, a, write);
+    }
+};
+
+struct NoCoverage {
+    static void	executed	    (Machine&, size_t) {}
+    static void	branch		    (Machine&, size_t, bool) {}
+};
+
+struct RecordCoverage {
+    static void	executed	    (Machine& mc, size_t pc) {
+	mc.coverage->executed[pc >> 6] |= 1ULL << (pc & 63);
+    }
+    static void	branch		    (Machine& mc, size_t pc, bool taken) {
+	(taken ? mc.coverage->taken : mc.coverage->not_taken)[pc >> 6] |= 1ULL << (pc & 63);
+    }
+};
+
+// Devices are consulted only when an event is due or a device pregister is
+// accessed; every other instruction costs one comparison.
+struct NoDevices {
+    static void	events		    (Machine&, size_t) {}
+    static uint16_t read	    (Machine& mc, size_t, size_t p) { return (mc.pregfile[p].to_ulong()); }
+    static void	write		    (Machine&, size_t, size_t) {}
+};
+
+struct BusDevices {
+    static uint64_t now		    (Machine& mc, size_t i) {
+	return (mc.devices->clock == DC_CYCLES ? mc.cycles : mc.steps + i);
+    }
+    static void	events		    (Machine& mc, size_t i) {
+	if (now(mc, i) >= mc.devices->next)
+	    device_events(*mc.devices, mc, now(mc, i));
+    }
+    static uint16_t read	    (Machine& mc, size_t, size_t p) {
+	if (mc.devices->map[p] < 0)
+	    return (mc.pregfile[p].to_ulong());
+	return (device_read(*mc.devices, mc, p));
+    }
+    static void	write		    (Machine& mc, size_t i, size_t p) {
+	if (mc.devices->map[p] >= 0)
+	    device_write(*mc.devices, mc, p, now(mc, i));
+    }
+};
+
+//------------------------------------------------------------------------------
+// Step Engine
+//------------------------------------------------------------------------------
+
+template <class Trace, class Profile, class Timing, class Breaker, class Bounds, class Loop, class Access, class Cover, class Devices>
+static size_t	step_engine	    (Machine& mc, size_t s) {
+    Memory&	  m   = mc.memory;
+    RegisterFile& rf  = mc.regfile;
+    RegisterFile& prf = mc.pregfile;
+    size_t	  pc  = mc.pc;
+    size_t	  i;
+
+    uint16_t	w;
+    size_t	op;
+    size_t	ra;
+    size_t	rb;
+    size_t	rc;
+    long	imm;
+    size_t	a;
+
+    for (i = 0; i < s && !mc.halted && !Loop::found(mc) && pc < m.size(); i++) {
+	if (Breaker::stop(mc, pc, i))
+	    break;
+
+	Devices::events(mc, i);
+
+	w   = m[pc].to_ulong();
+	op  = DecodeTable[w].op;
+	ra  = DecodeTable[w].ra;
+	rb  = DecodeTable[w].rb;
+	rc  = DecodeTable[w].rc;
+	imm = DecodeTable[w].imm;
+
+	// Fetches and memory operands are checked before anything is accounted for
+	if (!Bounds::fetch(mc, pc))
+	    break;
+
+	a = (op == OP_MOVR ? rf[rb].to_ulong() + rc : imm);
+	if ((op == OP_LOAD || op == OP_STORE || op == OP_MOVR) && !Bounds::valid(mc, pc, a, op == OP_STORE))
+	    break;
+
+	Profile::count(mc, pc);
+	Cover::executed(mc, pc);
+	Access::fetch(mc, pc);
+	mc.cycles += Timing::fetch(mc, pc);
+	mc.cycles += mc.cost.op_cycles[w >> (WORD_SIZE - 4)];
+
+	Trace::instruction(mc, i, pc, w);
+
+	switch (op) {
+	    case OP_LOAD:
+		Loop::write(mc, LK_REGFILE + ra, rf[ra], Bounds::read(mc, a));
+		rf[ra] = Bounds::read(mc, a);
+		mc.cycles += Timing::read(mc, pc, a);
+		Access::record(mc, i, pc, a, rf[ra], false);
+		break;
+	    case OP_STORE:
+		Loop::write(mc, LK_MEMORY + a, Bounds::read(mc, a), rf[ra]);
+		Bounds::write(mc, a, rf[ra]);
+		mc.cycles += Timing::write(mc, pc, a);
+		Access::record(mc, i, pc, a, rf[ra], true);
+		break;
+	    case OP_ADD:
+		Loop::write(mc, LK_REGFILE + ra, rf[ra], DWord(rf[rb].to_ulong() + rf[rc].to_ulong()));
+		rf[ra] = rf[rb].to_ulong() + rf[rc].to_ulong();
+		break;
+	    case OP_LOADC:
+		Loop::write(mc, LK_REGFILE + ra, rf[ra], DWord(imm));
+		rf[ra] = imm;
+		break;
+	    case OP_SUB:
+		Loop::write(mc, LK_REGFILE + ra, rf[ra], DWord(rf[rb].to_ulong() - rf[rc].to_ulong()));
+		rf[ra] = rf[rb].to_ulong() - rf[rc].to_ulong();
+		break;
+	    case OP_JMPZ:
+		Cover::branch(mc, pc, rf[ra].none());
+		if (rf[ra].none()) pc = pc + imm - 1;
+		break;
+	    case OP_JMPN:
+		Cover::branch(mc, pc, rf[ra][WORD_SIZE - 1]);
+		if (rf[ra][WORD_SIZE - 1]) pc = pc + imm - 1;
+		break;
+	    case OP_JMP:
+		pc = pc + imm - 1;
+		break;
+	    case OP_MOVR:
+		Loop::write(mc, LK_REGFILE + ra, rf[ra], Bounds::read(mc, a));
+		rf[ra] = Bounds::read(mc, a);
+		mc.cycles += Timing::read(mc, pc, a);
+		Access::record(mc, i, pc, a, rf[ra], false);
+		break;
+	    case OP_IO:
+		if (rc) {
+		    Loop::write(mc, LK_PREGFILE + rb, prf[rb], rf[ra]);
+		    prf[rb] = rf[ra];
+		    Devices::write(mc, i, rb);
+		} else {
+		    DWord v = Devices::read(mc, i, rb);
+
+		    Loop::write(mc, LK_REGFILE + ra, rf[ra], v);
+		    rf[ra] = v;
+		}
+		break;
+	    case OP_END:
+		mc.halted = true;
+		continue;
+	    default:
+		std::cerr << "Unknown opcode: " << OWord(w >> (WORD_SIZE - 4)) << " in " << dword_to_pretty_string(DWord(w)) << std::endl;
+		break;
+	}
+
+	pc++;
+
+	Loop::check(mc, pc);
+    }
+
+    mc.pc     = pc;
+    mc.steps += i;
+    if (mc.control) control_publish(*mc.control, mc.pc, mc.steps);
+
+    return (i);
+}
+
+//------------------------------------------------------------------------------
+// Engine Selection
+//------------------------------------------------------------------------------
+
+// Each level picks one policy from the machine configuration and passes the
+// choice down as a template argument, so the selection costs a handful of
+// branches per run instead of per instruction.
+
+template <class T, class P, class C, class B, class M, class L, class A, class V>
+static size_t	select_devices	    (Machine& mc, size_t s) {
+    if (mc.devices) return (step_engine<T, P, C, B, M, L, A, V, BusDevices>(mc, s));
+    return (step_engine<T, P, C, B, M, L, A, V, NoDevices>(mc, s));
+}
+
+template <class T, class P, class C, class B, class M, class L, class A>
+static size_t	select_coverage	    (Machine& mc, size_t s) {
+    if (mc.coverage) return (select_devices<T, P, C, B, M, L, A, RecordCoverage>(mc, s));
+    return (select_devices<T, P, C, B, M, L, A, NoCoverage>(mc, s));
+}
+
+template <class T, class P, class C, class B, class M, class L>
+static size_t	select_access	    (Machine& mc, size_t s) {
+    if (mc.accesses) return (select_coverage<T, P, C, B, M, L, RecordAccess>(mc, s));
+    if (mc.heatmap)  return (select_coverage<T, P, C, B, M, L, CountAccess>(mc, s));
+    return (select_coverage<T, P, C, B, M, L, NoAccessLog>(mc, s));
+}
+
+// Device state is not part of the machine state, so a repeated state does
+// not prove a loop while devices are attached
+template <class T, class P, class C, class B, class M>
+static size_t	select_loop	    (Machine& mc, size_t s) {
+    if (mc.loop && !mc.devices) return (select_access<T, P, C, B, M, HashLoop>(mc, s));
+    return (select_access<T, P, C, B, M, NoLoop>(mc, s));
+}
+
+// Paged memory is always checked, since it has no flat vector to walk off
+template <class T, class P, class C, class B>
+static size_t	select_bounds	    (Machine& mc, size_t s) {
+    if (mc.pages)   return (select_loop<T, P, C, B, PagedBounds>(mc, s));
+    if (mc.checked) return (select_loop<T, P, C, B, CheckedBounds>(mc, s));
+    return (select_loop<T, P, C, B, UncheckedBounds>(mc, s));
+}
+
+template <class T, class P, class C>
+static size_t	select_breaker	    (Machine& mc, size_t s) {
+    if (mc.control || !mc.breakpoints.empty()) return (select_bounds<T, P, C, CheckBreak>(mc, s));
+    return (select_bounds<T, P, C, NoBreak>(mc, s));
+}
+
+template <class T, class P>
+static size_t	select_timing	    (Machine& mc, size_t s) {
+    if (mc.cache) return (select_breaker<T, P, CacheTiming>(mc, s));
+    return (select_breaker<T, P, FlatTiming>(mc, s));
+}
+
+template <class T>
+static size_t	select_profile	    (Machine& mc, size_t s) {
+    if (mc.profile) return (select_timing<T, CountProfile>(mc, s));
+    return (select_timing<T, NoProfile>(mc, s));
+}
+
+// Full waveform samples before and after the run pick up registers changed
+// between runs, and both files are left current when the run stops.
+static size_t	step_record	    (Machine& mc, size_t s) {
+    uint16_t	w = (mc.pc < mc.memory.size() ? mc.memory[mc.pc].to_ulong() : 0);
+    size_t	n;
+
+    if (mc.waveform)
+	waveform_sample(*mc.waveform, mc, mc.steps, mc.pc, w, true);
+
+    n = select_profile<RecordTrace>(mc, s);
+    w = (mc.pc < mc.memory.size() ? mc.memory[mc.pc].to_ulong() : 0);
+
+    if (mc.waveform)
+	waveform_sample(*mc.waveform, mc, mc.steps, mc.pc, w, true);
+    if (mc.tracefile)
+	tracefile_finish(*mc.tracefile, mc);
+
+    return (n);
+}
+
+//------------------------------------------------------------------------------
+// Step
+//------------------------------------------------------------------------------
+
+size_t		step		    (Machine& mc, size_t s) {
+    // Only the template engine records waveforms and binary traces
+    if (mc.waveform || mc.tracefile)
+	return (step_record(mc, s));
+
+    // Translated programs run natively when nothing observes individual steps
+    if (mc.native && !mc.trace && !mc.profile && !mc.cache && !mc.loop && !mc.accesses && !mc.coverage &&
+	!mc.heatmap && !mc.devices && mc.breakpoints.empty())
+	return (native_run(mc, s));
+
+    // The reference loop predates access logging, coverage, heatmaps,
+    // devices and paged memory, so runs that use any of them never use it
+    if (mc.engine == SE_REFERENCE && !mc.accesses && !mc.coverage && !mc.heatmap && !mc.devices && !mc.pages)
+	return (step_reference(mc, s));
+
+    // The word-width template only knows tracing and run control
+    if (mc.engine == SE_GENERIC && !mc.profile && !mc.cache && !mc.loop && !mc.accesses && !mc.coverage &&
+	!mc.heatmap && !mc.devices && !mc.pages && mc.breakpoints.empty())
+	return (step_generic(mc, s));
+
+    if (mc.trace) return (select_profile<PrintTrace>(mc, s));
+    return (select_profile<NoTrace>(mc, s));
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
@@ -0,0 +1,690 @@
+//------------------------------------------------------------------------------
+// psim_fuzz.cc: psim coverage-guided fuzzing
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Global Constants
+//------------------------------------------------------------------------------
+
+static const char  *FuzzKinds[FK_SIZE] = { "crash", "exception", "assembly", "repeat", "engine", "range" };
+static const size_t FuzzFeatures       = 1 << 16;
+static const size_t FuzzLabels	       = 8;
+
+//------------------------------------------------------------------------------
+// Global Variables
+//------------------------------------------------------------------------------
+
+// What the crash handler writes out; only one fuzzer runs per process
+static Fuzzer	   *Crashing;
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static uint64_t fuzz_random	    (Fuzzer& fz) {
+    fz.random ^= fz.random >> 12;
+    fz.random ^= fz.random << 25;
+    fz.random ^= fz.random >> 27;
+    return (fz.random * 0x2545f4914f6cdd1dULL);
+}
+
+static size_t	fuzz_below	    (Fuzzer& fz, size_t n) {
+    return (n ? fuzz_random(fz) % n : 0);
+}
+
+static uint64_t fuzz_hash	    (uint64_t h, uint64_t v) {
+    h ^= v;
+    h *= 0x100000001b3ULL;
+    return (h ^ (h >> 29));
+}
+
+static uint64_t fuzz_hash	    (uint64_t h, const std::string& s) {
+    for (size_t i = 0; i < s.size(); i++)
+	h = fuzz_hash(h, (unsigned char)s[i]);
+    return (h);
+}
+
+// Whatever the end state of a run depends on
+static uint64_t state_hash	    (Machine& mc) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (size_t a = 0; a < mc.memory.size(); a++)
+	h = fuzz_hash(h, mc.memory[a].to_ulong());
+    for (size_t r = 0; r < RF_SIZE; r++)
+	h = fuzz_hash(h, mc.regfile[r].to_ulong());
+    for (size_t p = 0; p < PRF_SIZE; p++)
+	h = fuzz_hash(h, mc.pregfile[p].to_ulong());
+
+    h = fuzz_hash(h, mc.pc);
+    h = fuzz_hash(h, mc.steps);
+    h = fuzz_hash(h, mc.cycles);
+    return (fuzz_hash(h, mc.halted));
+}
+
+static size_t	fuzz_feature	    (Fuzzer& fz, uint64_t h) {
+    uint8_t& f = fz.features[(h ^ (h >> 16) ^ (h >> 32)) & (FuzzFeatures - 1)];
+
+    if (f)
+	return (0);
+
+    f = 1;
+    fz.covered++;
+    return (1);
+}
+
+// The address a memory instruction uses, or -1 for the others
+static long	fuzz_address	    (Machine& mc, uint16_t w) {
+    const DecodedInst& d = DecodeTable[w];
+
+    if (d.op == OP_LOAD || d.op == OP_STORE)
+	return (d.imm);
+    if (d.op == OP_MOVR)
+	return (mc.regfile[d.rb].to_ulong() + d.rc);
+    return (-1);
+}
+
+//------------------------------------------------------------------------------
+// Reproducers
+//------------------------------------------------------------------------------
+
+// Word lines as load_stream reads them, built without the heap so the crash
+// handler can use it too
+static size_t	image_text	    (const Memory& m, char *p) {
+    char   *s = p;
+
+    for (size_t a = 0; a < m.size(); a++) {
+	for (int b = WORD_SIZE - 1; b >= 0; b--)
+	    *p++ = '0' + m[a][b];
+	*p++ = '\n';
+    }
+
+    return (p - s);
+}
+
+static void	write_file	    (const std::string& path, const char *p, size_t n) {
+    int	    fd;
+
+    if ((fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+	return;
+    while (n > 0) {
+	ssize_t w = write(fd, p, n);
+
+	if (w <= 0)
+	    break;
+	p += w;
+	n -= w;
+    }
+    close(fd);
+}
+
+// A source (if there is one), the image and a psim script that loads the
+// image, sets the pregisters and runs it
+static void	write_case	    (Fuzzer& fz, FuzzCase& c, const std::string& base) {
+    std::vector<char>	text(c.image.size() * (WORD_SIZE + 1) + 1);
+    std::ostringstream	script;
+    size_t		slash = base.rfind('/');
+
+    if (c.source.size())
+	write_file(base + ".s", c.source.data(), c.source.size());
+    write_file(base + ".ubin", &text[0], image_text(c.image, &text[0]));
+
+    script << "t off\n";
+    script << "l " << base.substr(slash == std::string::npos ? 0 : slash + 1) << ".ubin\n";
+    for (size_t p = 0; p < PRF_SIZE; p++)
+	if (c.inputs[p].any())
+	    script << "i " << p << " " << c.inputs[p].to_ulong() << "\n";
+    script << "s " << fz.budget << "\np\nq\n";
+    write_file(base + ".psim", script.str().data(), script.str().size());
+}
+
+static void	fuzz_report	    (Fuzzer& fz, FUZZ_KIND kind, uint16_t w, const std::string& detail) {
+    std::ostringstream base;
+    uint64_t	       h = fuzz_hash(fuzz_hash(0, kind), DecodeTable[w].op);
+    uint64_t	       name = fuzz_hash(0, fz.current.source);
+
+    // One reproducer per kind of finding and opcode involved
+    if (!fz.reported.insert(h).second)
+	return;
+
+    for (size_t a = 0; a < fz.current.image.size(); a++)
+	name = fuzz_hash(name, fz.current.image[a].to_ulong());
+
+    base << fz.findings << "/" << FuzzKinds[kind] << "-" << std::hex << name << std::dec;
+    write_case(fz, fz.current, base.str());
+    fz.found[kind]++;
+
+    std::cout << "pfuzz: " << FuzzKinds[kind] << ": " << detail << " (" << base.str() << ".psim)" << std::endl;
+}
+
+static void	fuzz_crash	    (int sig) {
+    static char	text[1 << 20];
+    std::string	base;
+
+    // Not async-signal-safe in general, but the process is done for anyway
+    if (Crashing) {
+	base = Crashing->findings + "/crash";
+	if (Crashing->current.source.size())
+	    write_file(base + ".s", Crashing->current.source.data(), Crashing->current.source.size());
+	if (Crashing->current.image.size() * (WORD_SIZE + 1) < sizeof(text))
+	    write_file(base + ".ubin", text, image_text(Crashing->current.image, text));
+	write(STDERR_FILENO, "pfuzz: crash (", 14);
+	write(STDERR_FILENO, base.data(), base.size());
+	write(STDERR_FILENO, ")\n", 2);
+    }
+
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+//------------------------------------------------------------------------------
+// Generation and Mutation
+//------------------------------------------------------------------------------
+
+static std::string random_register  (Fuzzer& fz, char prefix, size_t n) {
+    std::ostringstream ss;
+
+    // Now and then a register the machine does not have
+    ss << prefix << (fuzz_below(fz, 32) ? fuzz_below(fz, n) : fuzz_below(fz, 100));
+    return (ss.str());
+}
+
+static std::string random_number    (Fuzzer& fz, long lo, long hi) {
+    std::ostringstream ss;
+
+    ss << (fuzz_below(fz, 32) ? lo + (long)fuzz_below(fz, hi - lo + 1) : (long)fuzz_below(fz, 70000) - 35000);
+    return (ss.str());
+}
+
+static std::string random_target    (Fuzzer& fz, bool data) {
+    std::ostringstream ss;
+
+    if (fuzz_below(fz, 4))
+	ss << (data ? "d" : "L") << fuzz_below(fz, FuzzLabels);
+    else
+	ss << random_number(fz, data ? 0 : -16, data ? 40 : 16);
+    return (ss.str());
+}
+
+static std::string random_line	    (Fuzzer& fz) {
+    std::string	s;
+
+    switch (fuzz_below(fz, 11)) {
+	case 0:
+	    return ("MOV " + random_register(fz, 'R', RF_SIZE) + ", #" + random_number(fz, -128, 127));
+	case 1:
+	    return ("MOV " + random_register(fz, 'R', RF_SIZE) + ", " + random_target(fz, true));
+	case 2:
+	    return ("MOV " + random_target(fz, true) + ", " + random_register(fz, 'R', RF_SIZE));
+	case 3:
+	case 4:
+	    s = (fuzz_below(fz, 2) ? "ADD " : "SUB ");
+	    return (s + random_register(fz, 'R', RF_SIZE) + ", " + random_register(fz, 'R', RF_SIZE) + ", " +
+		    random_register(fz, 'R', RF_SIZE));
+	case 5:
+	case 6:
+	    s = (fuzz_below(fz, 2) ? "JMPZ " : "JMPN ");
+	    return (s + random_register(fz, 'R', RF_SIZE) + ", " + random_target(fz, false));
+	case 7:
+	    return ("JMP " + random_target(fz, false));
+	case 8:
+	    return ("MOVR " + random_register(fz, 'R', RF_SIZE) + ", " + random_register(fz, 'R', RF_SIZE) +
+		    ", #" + random_number(fz, 0, 15));
+	case 9:
+	    return ("MOV " + random_register(fz, 'D', 2) + ", " + random_register(fz, 'R', RF_SIZE) + ", " +
+		    random_register(fz, 'P', PRF_SIZE));
+	default:
+	    return ("END");
+    }
+}
+
+static std::string random_source    (Fuzzer& fz) {
+    std::ostringstream ss;
+    size_t	       n     = 4 + fuzz_below(fz, 24);
+    std::vector<int>   label(n, -1);
+
+    for (size_t l = 0; l < FuzzLabels; l++)
+	label[fuzz_below(fz, n)] = l;
+
+    for (size_t i = 0; i < n; i++) {
+	if (label[i] >= 0)
+	    ss << "L" << label[i] << ":";
+	ss << "\t" << (i + 1 == n ? "END" : random_line(fz)) << "\n";
+    }
+
+    // Every data label a line may name
+    ss << ".data\n";
+    for (size_t d = 0; d < FuzzLabels; d++)
+	ss << "d" << d << ":\tWORD " << random_number(fz, -32768, 32767) << "\n";
+
+    return (ss.str());
+}
+
+static void	split_lines	    (const std::string& s, Tokens& lines) {
+    std::istringstream in(s);
+    std::string	       line;
+
+    lines.clear();
+    while (getline(in, line))
+	lines.push_back(line);
+}
+
+static void	mutate_source	    (Fuzzer& fz, FuzzCase& c) {
+    static const char *Alphabet = " \t,#:.-0123456789RPDLdMOVADSUBJPZNEWR/";
+    Tokens	       lines;
+    size_t	       i;
+    std::string	       s;
+
+    split_lines(c.source, lines);
+    if (lines.empty())
+	lines.push_back("END");
+    i = fuzz_below(fz, lines.size());
+
+    switch (fuzz_below(fz, 8)) {
+	case 0:
+	    lines[i] = random_line(fz);
+	    break;
+	case 1:
+	    lines.insert(lines.begin() + i, "\t" + random_line(fz));
+	    break;
+	case 2:
+	    if (lines.size() > 1)
+		lines.erase(lines.begin() + i);
+	    break;
+	case 3:
+	    lines.insert(lines.begin() + i, lines[i]);
+	    break;
+	case 4:
+	    std::swap(lines[i], lines[fuzz_below(fz, lines.size())]);
+	    break;
+	case 5: {
+	    Tokens other;
+
+	    // Splice in lines of another source in the corpus
+	    split_lines(fz.corpus[fuzz_below(fz, fz.corpus.size())].source, other);
+	    if (other.size())
+		lines[i] = other[fuzz_below(fz, other.size())];
+	    break;
+	}
+	case 6:
+	    if (lines[i].size())
+		lines[i][fuzz_below(fz, lines[i].size())] = Alphabet[fuzz_below(fz, strlen(Alphabet))];
+	    break;
+	default:
+	    lines[i].insert(fuzz_below(fz, lines[i].size() + 1), 1, Alphabet[fuzz_below(fz, strlen(Alphabet))]);
+	    break;
+    }
+
+    for (size_t l = 0; l < lines.size(); l++)
+	s += lines[l] + "\n";
+    c.source = s;
+}
+
+static void	mutate_image	    (Fuzzer& fz, FuzzCase& c) {
+    size_t  a;
+
+    c.source.clear();
+    if (c.image.empty())
+	c.image.push_back(DWord(0xf000));
+    a = fuzz_below(fz, c.image.size());
+
+    switch (fuzz_below(fz, 6)) {
+	case 0:
+	    c.image[a].flip(fuzz_below(fz, WORD_SIZE));
+	    break;
+	case 1:
+	    c.image[a] = DWord(fuzz_random(fz));
+	    break;
+	case 2:
+	    c.image[a] = isa_encode((OPCODE)fuzz_below(fz, OP_SIZE), fuzz_below(fz, 16), fuzz_below(fz, 16),
+				    (long)fuzz_below(fz, 256) - 128);
+	    break;
+	case 3:
+	    c.image.insert(c.image.begin() + a, DWord(fuzz_random(fz)));
+	    break;
+	case 4:
+	    if (c.image.size() > 1)
+		c.image.erase(c.image.begin() + a);
+	    break;
+	default:
+	    // Small values reach the boundary conditions most often
+	    c.image[a] = DWord(fuzz_below(fz, 4) ? fuzz_below(fz, 64) : 0xffff - fuzz_below(fz, 64));
+	    break;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Execution
+//------------------------------------------------------------------------------
+
+// Assembles the source into the image, as pasm u does; false when the
+// assembler rejects it
+static bool	fuzz_assemble	    (Fuzzer& fz, FuzzCase& c, size_t& novel) {
+    std::istringstream	src(c.source);
+    std::ostringstream	out;
+    std::ostringstream	errors;
+    std::streambuf     *cerr = std::cerr.rdbuf(errors.rdbuf());
+    LabelTable		lt;
+    DataList		dl;
+    TextList		tl;
+    SourceMap		sm;
+    RegisterFile	rf;
+    RegisterFile	prf;
+    bool		ok = false;
+
+    Assembler.exports.clear();
+    Assembler.data_values.clear();
+
+    try {
+	ok = parse_stream(src, lt, dl, tl, sm) && assemble_stream(out, lt, dl, tl);
+    } catch (std::exception& e) {
+	std::cerr.rdbuf(cerr);
+	fuzz_report(fz, FK_EXCEPTION, 0, std::string("assembler: ") + e.what());
+	return (false);
+    }
+    std::cerr.rdbuf(cerr);
+
+    // Each instruction shape the assembler was given, and why it gave up
+    for (size_t i = 0; i < tl.size(); i++) {
+	uint64_t h = fuzz_hash(1, tl[i][0]);
+
+	for (size_t t = 1; t < tl[i].size(); t++)
+	    h = fuzz_hash(h, tl[i][t].empty() ? ' ' : isdigit((unsigned char)tl[i][t][0]) ? '0' : tl[i][t][0]);
+	novel += fuzz_feature(fz, fuzz_hash(h, tl[i].size()));
+    }
+
+    if (!ok) {
+	novel += fuzz_feature(fz, fuzz_hash(2, errors.str().substr(0, errors.str().find('('))));
+	fz.rejected++;
+	return (false);
+    }
+
+    std::istringstream bin(out.str());
+
+    load_stream(bin, c.image, rf, prf);
+    fz.assembled++;
+
+    if (c.image.size() != tl.size() + dl.size()) {
+	std::ostringstream ss;
+
+	ss << tl.size() << " instructions and " << dl.size() << " words assembled to " << c.image.size() << " words";
+	fuzz_report(fz, FK_ASSEMBLY, 0, ss.str());
+	return (false);
+    }
+
+    for (size_t i = 0; i < tl.size(); i++) {
+	uint16_t w  = c.image[i].to_ulong();
+	uint8_t	 op = DecodeTable[w].op;
+
+	if (op == OP_UNKNOWN || tl[i][0] != IsaTable[op].name) {
+	    fuzz_report(fz, FK_ASSEMBLY, w, tl[i][0] + " assembled to " + dword_to_string(DWord(w)));
+	    return (false);
+	}
+    }
+
+    return (true);
+}
+
+// Restores the machine to the case's starting state in place
+static void	fuzz_reset	    (Fuzzer& fz, FuzzCase& c, STEP_ENGINE engine, bool cover, bool log) {
+    Machine& mc = fz.machine;
+
+    mc.memory.assign(c.image.begin(), c.image.end());
+    mc.regfile.assign(RF_SIZE, DWord(0));
+    mc.pregfile.assign(c.inputs.begin(), c.inputs.end());
+    mc.engine	= engine;
+    mc.coverage = (cover ? &fz.coverage : NULL);
+    mc.accesses = (log ? &fz.accesses : NULL);
+    machine_reset(mc);
+
+    if (cover) {
+	fz.coverage.size = c.image.size();
+	fz.coverage.executed.assign((c.image.size() + 63) / 64, 0);
+	fz.coverage.taken.assign(fz.coverage.executed.size(), 0);
+	fz.coverage.not_taken.assign(fz.coverage.executed.size(), 0);
+    }
+    if (log)
+	fz.accesses.clear();
+}
+
+static bool	fuzz_step	    (Fuzzer& fz, size_t n) {
+    try {
+	step(fz.machine, n);
+    } catch (std::exception& e) {
+	fuzz_report(fz, FK_EXCEPTION, fz.machine.pc < fz.machine.memory.size() ? fz.machine.memory[fz.machine.pc].to_ulong() : 0,
+		    std::string("step: ") + e.what());
+	return (false);
+    }
+
+    return (true);
+}
+
+static size_t	fuzz_run	    (Fuzzer& fz, FuzzCase& c) {
+    Machine&	mc    = fz.machine;
+    Coverage&	cov   = fz.coverage;
+    size_t	novel = 0;
+    size_t	split;
+    uint64_t	state;
+    uint16_t	w;
+    bool	early;
+
+    if (c.source.size() && !fuzz_assemble(fz, c, novel))
+	return (novel);
+    if (c.image.empty())
+	return (novel);
+
+    fuzz_reset(fz, c, SE_TEMPLATE, true, false);
+    if (!fuzz_step(fz, fz.budget))
+	return (novel);
+    state = state_hash(mc);
+    w	  = (mc.pc < mc.memory.size() ? mc.memory[mc.pc].to_ulong() : 0);
+
+    // Instruction pairs and branch directions executed, and how the run ended
+    for (size_t pc = 0; pc < c.image.size(); pc++) {
+	uint64_t h;
+
+	if (!(cov.executed[pc >> 6] & (1ULL << (pc & 63))))
+	    continue;
+
+	h = fuzz_hash(3, DecodeTable[c.image[pc].to_ulong()].op);
+	h = fuzz_hash(h, pc + 1 < c.image.size() ? DecodeTable[c.image[pc + 1].to_ulong()].op : OP_SIZE + 1);
+	h = fuzz_hash(h, ((cov.taken[pc >> 6] >> (pc & 63)) & 1) | ((cov.not_taken[pc >> 6] >> (pc & 63)) & 1) << 1);
+	novel += fuzz_feature(fz, h);
+    }
+
+    // Nothing else stops a run early: there are no breakpoints or controls
+    early = (!mc.halted && mc.pc < mc.memory.size() && mc.steps < fz.budget);
+
+    novel += fuzz_feature(fz, fuzz_hash(fuzz_hash(fuzz_hash(4, mc.halted), early ? DecodeTable[w].op : OP_SIZE),
+					64 - __builtin_clzll(mc.steps | 1)));
+
+    if (early) {
+	fz.stopped++;
+	if (fuzz_address(mc, w) >= 0 && (size_t)fuzz_address(mc, w) < mc.memory.size())
+	    fuzz_report(fz, FK_RANGE, w, "stopped at an in-range access");
+    }
+
+    // Cases that found something new are checked, like calibration in other
+    // coverage-guided fuzzers, and a sample of the rest
+    if (novel == 0 && fuzz_below(fz, 16))
+	return (novel);
+
+    // The same run in two parts must end in the same state
+    split = fuzz_below(fz, fz.budget + 1);
+    fuzz_reset(fz, c, SE_TEMPLATE, false, true);
+    if (!fuzz_step(fz, split) || !fuzz_step(fz, fz.budget - split))
+	return (novel);
+    if (state_hash(mc) != state)
+	fuzz_report(fz, FK_REPEAT, w, "run differs when split after the first " + std::to_string(split) + " steps");
+
+    for (size_t i = 0; i < fz.accesses.size(); i++)
+	if (fz.accesses[i].address >= c.image.size())
+	    fuzz_report(fz, FK_RANGE, c.image[fz.accesses[i].pc].to_ulong(), "accessed address " +
+			std::to_string(fz.accesses[i].address) + " at PC " + std::to_string(fz.accesses[i].pc));
+
+    if (!fz.engines)
+	return (novel);
+
+    for (size_t e = SE_REFERENCE; e <= SE_GENERIC; e++) {
+	fuzz_reset(fz, c, (STEP_ENGINE)e, false, false);
+	if (!fuzz_step(fz, fz.budget))
+	    return (novel);
+	if (state_hash(mc) != state)
+	    fuzz_report(fz, FK_ENGINE, w, e == SE_REFERENCE ? "reference engine disagrees" : "generic engine disagrees");
+    }
+
+    return (novel);
+}
+
+//------------------------------------------------------------------------------
+// Fuzz Add
+//------------------------------------------------------------------------------
+
+// Seeds are assembled and run like any other case, but always kept
+void		fuzz_add	    (Fuzzer& fz, const std::string& source) {
+    std::streambuf *cerr = std::cerr.rdbuf(NULL);
+
+    fz.current.source = source;
+    fz.current.image.clear();
+    fz.current.inputs.assign(PRF_SIZE, DWord(0));
+
+    fuzz_run(fz, fz.current);
+    fz.corpus.push_back(fz.current);
+    std::cerr.rdbuf(cerr);
+}
+
+//------------------------------------------------------------------------------
+// Fuzz Init
+//------------------------------------------------------------------------------
+
+void		fuzz_init	    (Fuzzer& fz, uint64_t seed, size_t budget, bool engines, const std::string& findings) {
+    struct sigaction sa;
+    int		     signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+
+    fz.random	= seed | 1;
+    fz.budget	= budget;
+    fz.engines	= engines;
+    fz.findings = findings;
+    fz.corpus.clear();
+    fz.features.assign(FuzzFeatures, 0);
+    fz.reported.clear();
+
+    fz.execs	 = 0;
+    fz.assembled = 0;
+    fz.rejected	 = 0;
+    fz.stopped	 = 0;
+    fz.covered	 = 0;
+    for (size_t k = 0; k < FK_SIZE; k++)
+	fz.found[k] = 0;
+
+    machine_init(fz.machine);
+    fz.machine.trace = false;
+
+    asm_init(Assembler);
+    Assembler.unified = true;
+
+    Crashing = &fz;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = fuzz_crash;
+    sigemptyset(&sa.sa_mask);
+    for (size_t s = 0; s < sizeof(signals) / sizeof(signals[0]); s++)
+	sigaction(signals[s], &sa, NULL);
+}
+
+//------------------------------------------------------------------------------
+// Fuzz One
+//------------------------------------------------------------------------------
+
+// Mutates a corpus case (or makes up a program while there are none) and
+// runs it; true when it reached new features and joined the corpus.  Error
+// messages are swallowed while the simulator runs.
+
+bool		fuzz_one	    (Fuzzer& fz) {
+    std::streambuf *cerr = std::cerr.rdbuf(NULL);
+    size_t	    novel;
+
+    if (fz.corpus.empty() || fuzz_below(fz, 64) == 0) {
+	fz.current.source = random_source(fz);
+	fz.current.image.clear();
+	fz.current.inputs.assign(PRF_SIZE, DWord(0));
+    } else {
+	fz.current = fz.corpus[fuzz_below(fz, fz.corpus.size())];
+
+	for (size_t n = 1 + fuzz_below(fz, 4); n > 0; n--) {
+	    if (fuzz_below(fz, 8) == 0)
+		fz.current.inputs[fuzz_below(fz, PRF_SIZE)] = DWord(fuzz_random(fz));
+	    else if (fz.current.source.size() && fuzz_below(fz, 4) == 0)
+		mutate_source(fz, fz.current);
+	    else
+		mutate_image(fz, fz.current);
+	}
+    }
+
+    novel = fuzz_run(fz, fz.current);
+    fz.execs++;
+    std::cerr.rdbuf(cerr);
+
+    if (novel == 0)
+	return (false);
+
+    fz.corpus.push_back(fz.current);
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Print Fuzzer
+//------------------------------------------------------------------------------
+
+void		print_fuzzer	    (Fuzzer& fz, double seconds) {
+    std::cout << "#" << fz.execs << " cov " << fz.covered << " corpus " << fz.corpus.size()
+	      << " assembled " << fz.assembled << " rejected " << fz.rejected << " stopped " << fz.stopped
+	      << " exec/s " << (size_t)(fz.execs / (seconds > 0 ? seconds : 1));
+
+    for (size_t k = 0; k < FK_SIZE; k++)
+	if (fz.found[k])
+	    std::cout << " " << FuzzKinds[k] << " " << fz.found[k];
+    std::cout << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
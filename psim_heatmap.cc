@@ -0,0 +1,287 @@
+//------------------------------------------------------------------------------
+// psim_heatmap.cc: psim data-memory heatmap and working set
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Global Constants
+//------------------------------------------------------------------------------
+
+static const char  *HeatmapMagic    = "psim-heatmap 1";
+static const size_t HottestSize	    = 10;	// Addresses listed in the summary
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static void	tree_add	    (Heatmap& hm, size_t t, long v) {
+    for (; t < hm.tree.size(); t += t & -t)
+	hm.tree[t] += v;
+}
+
+static long	tree_sum	    (Heatmap& hm, size_t t) {
+    long s = 0;
+
+    for (; t > 0; t -= t & -t)
+	s += hm.tree[t];
+
+    return (s);
+}
+
+// Renumbers the last access times 1..n in order, so the tree only needs room
+// for a couple of accesses per address no matter how long the run is.
+
+static void	heatmap_compact	    (Heatmap& hm) {
+    std::vector<std::pair<size_t, size_t> > live;
+
+    for (size_t a = 0; a < hm.last.size(); a++)
+	if (hm.last[a])
+	    live.push_back(std::make_pair(hm.last[a], a));
+    std::sort(live.begin(), live.end());
+
+    std::fill(hm.tree.begin(), hm.tree.end(), 0);
+    for (size_t i = 0; i < live.size(); i++) {
+	hm.last[live[i].second] = i + 1;
+	tree_add(hm, i + 1, 1);
+    }
+    hm.time = live.size();
+}
+
+static size_t	heatmap_bucket	    (size_t d) {
+    size_t b = 0;
+
+    while (d) {
+	d >>= 1;
+	b++;
+    }
+
+    return (b);
+}
+
+// Words fetched as instructions, or text in the source map, are code.
+
+static bool	heatmap_code	    (Heatmap& hm, SymbolTable *st, size_t a) {
+    if (hm.code[a])
+	return (true);
+
+    return (st && a < st->lines.size() && st->lines[a].line && !st->lines[a].data);
+}
+
+// Most accessed first, lower addresses first among equals
+
+static bool	heatmap_hotter	    (const std::pair<size_t, size_t>& x, const std::pair<size_t, size_t>& y) {
+    return (x.first > y.first || (x.first == y.first && x.second < y.second));
+}
+
+static void	heatmap_windows	    (Heatmap& hm, std::vector<size_t>& ws) {
+    ws = hm.working_set;
+    if (hm.accesses)
+	ws.push_back(hm.touched);
+}
+
+//------------------------------------------------------------------------------
+// Heatmap Access
+//------------------------------------------------------------------------------
+
+void		heatmap_access	    (Heatmap& hm, size_t step, size_t a, bool write) {
+    size_t  w = step / hm.window;
+    size_t  t;
+
+    (write ? hm.writes : hm.reads)[a]++;
+    hm.accesses++;
+
+    if (w != hm.current) {
+	hm.working_set.push_back(hm.touched);
+	while (hm.working_set.size() < w)
+	    hm.working_set.push_back(0);
+	hm.current = w;
+	hm.touched = 0;
+    }
+    if (hm.epoch[a] != w + 1) {
+	hm.epoch[a] = w + 1;
+	hm.touched++;
+    }
+
+    // Reuse distance is the number of distinct addresses since the last access
+    if (hm.time + 1 == hm.tree.size())
+	heatmap_compact(hm);
+    t = ++hm.time;
+
+    if (hm.last[a]) {
+	hm.reuse[heatmap_bucket(tree_sum(hm, t - 1) - tree_sum(hm, hm.last[a]))]++;
+	tree_add(hm, hm.last[a], -1);
+    } else {
+	hm.cold++;
+    }
+
+    tree_add(hm, t, 1);
+    hm.last[a] = t;
+}
+
+//------------------------------------------------------------------------------
+// Heatmap Reset
+//------------------------------------------------------------------------------
+
+void		heatmap_reset	    (Heatmap& hm, size_t size, size_t window) {
+    hm.window = std::max(window, (size_t)1);
+    hm.reads.assign(size, 0);
+    hm.writes.assign(size, 0);
+    hm.code.assign(size, 0);
+    hm.last.assign(size, 0);
+    hm.epoch.assign(size, 0);
+    hm.tree.assign(2 * size + 2, 0);
+    hm.reuse.assign(8 * sizeof(size_t) + 1, 0);
+    hm.working_set.clear();
+    hm.time	= 0;
+    hm.accesses = 0;
+    hm.cold	= 0;
+    hm.current	= 0;
+    hm.touched	= 0;
+}
+
+//------------------------------------------------------------------------------
+// Heatmap Write
+//------------------------------------------------------------------------------
+
+// Only addresses that were accessed are listed, followed by the reuse
+// distance histogram and the working set of every window.
+
+bool		heatmap_write	    (std::ostream& out, Heatmap& hm, SymbolTable *st) {
+    std::vector<size_t> ws;
+
+    out << HeatmapMagic << "\n";
+    out << "window " << hm.window << "\n";
+    for (size_t a = 0; a < hm.reads.size(); a++)
+	if (hm.reads[a] || hm.writes[a])
+	    out << "address " << a << " " << hm.reads[a] << " " << hm.writes[a] << " "
+		<< (heatmap_code(hm, st, a) ? "C" : "D") << "\n";
+
+    out << "cold " << hm.cold << "\n";
+    out << "reuse";
+    for (size_t b = 0; b < hm.reuse.size(); b++)
+	if (hm.reuse[b])
+	    out << " " << b << ":" << hm.reuse[b];
+    out << "\n";
+
+    heatmap_windows(hm, ws);
+    out << "working_set " << ws.size();
+    for (size_t i = 0; i < ws.size(); i++)
+	out << " " << ws[i];
+    out << "\n";
+
+    return (!out.fail());
+}
+
+//------------------------------------------------------------------------------
+// Print Heatmap
+//------------------------------------------------------------------------------
+
+void		print_heatmap	    (Heatmap& hm, SymbolTable *st) {
+    std::ios::fmtflags flags	 = std::cout.flags();
+    std::streamsize    precision = std::cout.precision();
+    std::vector<std::pair<size_t, size_t> > hottest;
+    std::vector<size_t> ws;
+    size_t	       counts[2][2] = { { 0, 0 }, { 0, 0 } };	// [code][write]
+    size_t	       words[2]	    = { 0, 0 };
+    size_t	       total	    = 0;
+    size_t	       peak	    = 0;
+
+    for (size_t a = 0; a < hm.reads.size(); a++) {
+	bool code = heatmap_code(hm, st, a);
+
+	if (hm.reads[a] + hm.writes[a] == 0)
+	    continue;
+
+	counts[code][0] += hm.reads[a];
+	counts[code][1] += hm.writes[a];
+	words[code]++;
+	hottest.push_back(std::make_pair(hm.reads[a] + hm.writes[a], a));
+    }
+
+    std::cout << std::setfill(' ') << std::fixed << std::setprecision(2);
+    std::cout << "Accesses: " << hm.accesses << " (" << words[0] + words[1] << " words)" << std::endl;
+    std::cout << "    Data: " << std::setw(10) << counts[0][0] << " reads " << std::setw(10) << counts[0][1]
+	      << " writes " << std::setw(6) << words[0] << " words" << std::endl;
+    std::cout << "    Code: " << std::setw(10) << counts[1][0] << " reads " << std::setw(10) << counts[1][1]
+	      << " writes " << std::setw(6) << words[1] << " words" << std::endl;
+
+    std::sort(hottest.begin(), hottest.end(), heatmap_hotter);
+
+    std::cout << "----------------------------------------" << std::endl;
+    std::cout << "<MEM>      Reads     Writes      %" << std::endl;
+    std::cout << "----------------------------------------" << std::endl;
+    for (size_t i = 0; i < hottest.size() && i < HottestSize; i++) {
+	size_t a = hottest[i].second;
+
+	std::cout << "<" << std::setfill('0') << std::setw(3) << a << "> " << std::setfill(' ')
+		  << std::setw(10) << hm.reads[a] << " " << std::setw(10) << hm.writes[a] << " "
+		  << std::setw(6) << 100.0 * hottest[i].first / hm.accesses
+		  << (heatmap_code(hm, st, a) ? " code" : "");
+	if (symbol_string(st, a).size())
+	    std::cout << " " << symbol_string(st, a);
+	std::cout << std::endl;
+    }
+
+    std::cout << "----------------------------------------" << std::endl;
+    std::cout << "Reuse distance (distinct words between accesses)" << std::endl;
+    std::cout << "    cold     " << std::setw(10) << hm.cold << std::endl;
+    for (size_t b = 0; b < hm.reuse.size(); b++) {
+	if (hm.reuse[b] == 0)
+	    continue;
+
+	std::cout << "    ";
+	if (b <= 1)
+	    std::cout << std::left << std::setw(9) << b;
+	else
+	    std::cout << std::left << std::setw(9) << (std::to_string(1UL << (b - 1)) + "-" + std::to_string((1UL << b) - 1));
+	std::cout << std::right << std::setw(10) << hm.reuse[b] << std::endl;
+    }
+
+    heatmap_windows(hm, ws);
+    for (size_t i = 0; i < ws.size(); i++) {
+	total += ws[i];
+	peak   = std::max(peak, ws[i]);
+    }
+
+    std::cout << "----------------------------------------" << std::endl;
+    std::cout << "Working set (" << hm.window << " instruction windows): "
+	      << (ws.size() ? (double)total / ws.size() : 0.0) << " words average, "
+	      << peak << " peak, " << ws.size() << " windows" << std::endl;
+
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
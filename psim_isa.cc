@@ -0,0 +1,145 @@
+//------------------------------------------------------------------------------
+// psim_isa.cc: psim instruction set encoding and decoding
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static constexpr long isa_field	    (const IsaField& f, uint16_t w) {
+    long v = (w >> f.shift) & ((1L << f.width) - 1);
+
+    return (f.sign && (v >> (f.width - 1)) ? v - (1L << f.width) : v);
+}
+
+static constexpr DecodedInst isa_decode (uint16_t w) {
+    DecodedInst	 d  = { OP_UNKNOWN, 0, 0, 0, 0 };
+    const IsaOp& op = IsaTable[w >> (WORD_SIZE - 4)];
+
+    if (op.name == NULL)
+	return (d);
+
+    d.op = w >> (WORD_SIZE - 4);
+    for (size_t i = 0; i < 3; i++) {
+	switch (op.fields[i].slot) {
+	    case IS_RA:	 d.ra  = isa_field(op.fields[i], w); break;
+	    case IS_RB:	 d.rb  = isa_field(op.fields[i], w); break;
+	    case IS_RC:	 d.rc  = isa_field(op.fields[i], w); break;
+	    case IS_IMM: d.imm = isa_field(op.fields[i], w); break;
+	}
+    }
+
+    return (d);
+}
+
+static constexpr DecodeTableType isa_table () {
+    DecodeTableType t = { };
+
+    for (size_t w = 0; w < t.size(); w++)
+	t[w] = isa_decode(w);
+
+    return (t);
+}
+
+static char    *append_number	    (char *p, long n) {
+    char    digits[24];
+    size_t  i = 0;
+
+    if (n < 0) {
+	*p++ = '-';
+	n    = -n;
+    }
+
+    do {
+	digits[i++] = '0' + n % 10;
+	n /= 10;
+    } while (n);
+
+    while (i)
+	*p++ = digits[--i];
+
+    return (p);
+}
+
+//------------------------------------------------------------------------------
+// Global Constants
+//------------------------------------------------------------------------------
+
+// Built by the compiler, so the table is ready in read-only data at startup
+constexpr DecodeTableType DecodeTable = isa_table();
+
+//------------------------------------------------------------------------------
+// ISA Encode
+//------------------------------------------------------------------------------
+
+// Operands are given in the field order of the instruction set table and are
+// truncated to their field widths.
+
+DWord		isa_encode	    (OPCODE op, long a, long b, long c) {
+    return (DWord(isa_encode_word<WORD_SIZE>(op, a, b, c)));
+}
+
+//------------------------------------------------------------------------------
+// ISA Format
+//------------------------------------------------------------------------------
+
+// Writes the assembly for w to buffer (at least ISA_FORMAT_SIZE bytes) without
+// a terminator and returns its length.
+
+size_t		isa_format	    (char *buffer, uint16_t w) {
+    const DecodedInst& d = DecodeTable[w];
+    const char	      *f;
+    char	      *p = buffer;
+
+    if (d.op == OP_UNKNOWN) {
+	f = "???";
+	while (*f) *p++ = *f++;
+	return (p - buffer);
+    }
+
+    for (f = IsaTable[d.op].format; *f; f++) {
+	if (*f != '%') {
+	    *p++ = *f;
+	    continue;
+	}
+
+	switch (*++f) {
+	    case 'a': p = append_number(p, d.ra); break;
+	    case 'b': p = append_number(p, d.rb); break;
+	    case 'c': p = append_number(p, d.rc); break;
+	    case 'i': p = append_number(p, d.imm); break;
+	}
+    }
+
+    return (p - buffer);
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
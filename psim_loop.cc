@@ -0,0 +1,139 @@
+//------------------------------------------------------------------------------
+// psim_loop.cc: psim non-terminating loop detection
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include <iostream>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+// The machine state hash is the sum of a mixed (key, value) pair for every
+// memory word and register, so a write only has to subtract the old pair and
+// add the new one.
+
+static uint64_t loop_mix	    (size_t key, DWord value) {
+    uint64_t z;
+
+    z = ((uint64_t)key << 32) + value.to_ulong() + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+    return (z ^ (z >> 31));
+}
+
+static void	loop_save	    (LoopCheck& lc, Machine& mc, uint64_t hash, size_t pc) {
+    lc.saved_hash     = hash;
+    lc.saved_pc	      = pc;
+    lc.saved_memory   = mc.memory;
+    lc.saved_frames   = (mc.pages ? mc.pages->frames : std::vector<Memory>());
+    lc.saved_regfile  = mc.regfile;
+    lc.saved_pregfile = mc.pregfile;
+}
+
+//------------------------------------------------------------------------------
+// Loop Check
+//------------------------------------------------------------------------------
+
+bool		loop_check	    (LoopCheck& lc, Machine& mc, size_t pc) {
+    uint64_t hash;
+
+    hash = lc.hash + loop_mix(LK_PC, DWord(pc));
+
+    lc.lambda++;
+
+    if (hash == lc.saved_hash && pc == lc.saved_pc &&
+	mc.regfile  == lc.saved_regfile &&
+	mc.pregfile == lc.saved_pregfile &&
+	mc.memory   == lc.saved_memory &&
+	(mc.pages == NULL || mc.pages->frames == lc.saved_frames)) {
+	lc.found   = true;
+	lc.loop_pc = pc;
+	lc.period  = lc.lambda;
+	return (true);
+    }
+
+    if (lc.lambda == lc.power) {
+	loop_save(lc, mc, hash, pc);
+	lc.power *= 2;
+	lc.lambda = 0;
+    }
+
+    return (false);
+}
+
+//------------------------------------------------------------------------------
+// Loop Reset
+//------------------------------------------------------------------------------
+
+void		loop_reset	    (LoopCheck& lc, Machine& mc) {
+    lc.hash = 0;
+    for (size_t i = 0; i < mc.memory.size(); i++)
+	lc.hash += loop_mix(LK_MEMORY + i, mc.memory[i]);
+
+    // Paged words count from zero, the value of a word in an unallocated page
+    for (size_t a = mc.memory.size(); mc.pages && a < mc.pages->size; a++)
+	if (mc.pages->frames[a >> mc.pages->shift].size())
+	    lc.hash += loop_mix(LK_MEMORY + a, page_read(*mc.pages, a)) - loop_mix(LK_MEMORY + a, DWord(0));
+    for (size_t i = 0; i < mc.regfile.size(); i++)
+	lc.hash += loop_mix(LK_REGFILE + i, mc.regfile[i]);
+    for (size_t i = 0; i < mc.pregfile.size(); i++)
+	lc.hash += loop_mix(LK_PREGFILE + i, mc.pregfile[i]);
+
+    loop_save(lc, mc, lc.hash + loop_mix(LK_PC, DWord(mc.pc)), mc.pc);
+
+    lc.power   = 1;
+    lc.lambda  = 0;
+    lc.found   = false;
+    lc.loop_pc = 0;
+    lc.period  = 0;
+}
+
+//------------------------------------------------------------------------------
+// Loop Write
+//------------------------------------------------------------------------------
+
+void		loop_write	    (LoopCheck& lc, size_t key, DWord from, DWord to) {
+    lc.hash += loop_mix(key, to) - loop_mix(key, from);
+}
+
+//------------------------------------------------------------------------------
+// Print Loop
+//------------------------------------------------------------------------------
+
+void		print_loop	    (LoopCheck& lc) {
+    if (lc.found)
+	std::cout << "Non-terminating loop at PC " << lc.loop_pc << ", period " << lc.period << std::endl;
+    else
+	std::cout << "No state repetition detected" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
@@ -0,0 +1,338 @@
+//------------------------------------------------------------------------------
+// psim_memo.cc: psim memoized run results
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Global Constants
+//------------------------------------------------------------------------------
+
+static const char *MemoMagic	= "psim-memo 1";
+static const char *MemoSuffix	= ".memo";
+
+//------------------------------------------------------------------------------
+// Structures
+//------------------------------------------------------------------------------
+
+struct MemoFile {
+    std::string	name;
+    time_t	mtime;
+    size_t	size;
+
+    bool	operator< (const MemoFile& f) const { return (mtime < f.mtime); }
+};
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static uint64_t memo_hash	    (const std::string& s, uint64_t h) {
+    for (size_t i = 0; i < s.size(); i++) {
+	h ^= (unsigned char)s[i];
+	h *= 0x100000001b3ULL;
+    }
+
+    return (h);
+}
+
+static std::string memo_path	    (MemoCache& mc, const std::string& key) {
+    return (mc.path + "/" + key + MemoSuffix);
+}
+
+// Records an entry as the most recently used one
+
+static void	memo_touch	    (MemoCache& mc, const std::string& key, size_t size) {
+    std::map<std::string, MemoEntry>::iterator e = mc.entries.find(key);
+
+    if (e != mc.entries.end()) {
+	mc.bytes -= e->second.size;
+	mc.lru.erase(e->second.use);
+    }
+
+    mc.lru.push_back(key);
+    mc.entries[key].size = size;
+    mc.entries[key].use	 = --mc.lru.end();
+    mc.bytes += size;
+}
+
+// Reads the entries already in the directory, oldest first
+
+static void	memo_scan	    (MemoCache& mc) {
+    std::vector<MemoFile> files;
+    struct dirent	 *de;
+    struct stat		  st;
+    DIR			 *dir;
+
+    mc.entries.clear();
+    mc.lru.clear();
+    mc.bytes = 0;
+
+    if ((dir = opendir(mc.path.c_str())) == NULL)
+	return;
+
+    while ((de = readdir(dir)) != NULL) {
+	MemoFile    f;
+	std::string name = de->d_name;
+
+	if (name.size() <= strlen(MemoSuffix) ||
+	    name.compare(name.size() - strlen(MemoSuffix), std::string::npos, MemoSuffix) != 0)
+	    continue;
+	if (stat((mc.path + "/" + name).c_str(), &st) != 0)
+	    continue;
+
+	f.name	= name.substr(0, name.size() - strlen(MemoSuffix));
+	f.mtime = st.st_mtime;
+	f.size	= st.st_size;
+	files.push_back(f);
+    }
+    closedir(dir);
+
+    // Least recently used entries have the oldest modification times
+    std::sort(files.begin(), files.end());
+
+    for (size_t i = 0; i < files.size(); i++)
+	memo_touch(mc, files[i].name, files[i].size);
+}
+
+static void	write_words	    (std::ostream& out, const char *name, std::vector<DWord>& words) {
+    out << name << " " << words.size();
+    for (size_t i = 0; i < words.size(); i++)
+	out << " " << words[i].to_ulong();
+    out << "\n";
+}
+
+static bool	read_words	    (std::istream& in, const char *name, std::vector<DWord>& words) {
+    std::string	tag;
+    size_t	n;
+    size_t	w;
+
+    if (!(in >> tag >> n) || tag != name)
+	return (false);
+
+    words.resize(n);
+    for (size_t i = 0; i < n; i++) {
+	if (!(in >> w))
+	    return (false);
+	words[i] = DWord(w);
+    }
+
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Memo Evict
+//------------------------------------------------------------------------------
+
+// Entries stored by other processes sharing the directory are only counted
+// from the next time it is opened.
+
+void		memo_evict	    (MemoCache& mc) {
+    while (mc.lru.size() &&
+	   ((mc.max_entries && mc.lru.size() > mc.max_entries) ||
+	    (mc.max_bytes && mc.bytes > mc.max_bytes))) {
+	std::string key = mc.lru.front();
+
+	if (unlink(memo_path(mc, key).c_str()) == 0)
+	    mc.evictions++;
+
+	mc.bytes -= mc.entries[key].size;
+	mc.entries.erase(key);
+	mc.lru.pop_front();
+    }
+}
+
+//------------------------------------------------------------------------------
+// Memo Init
+//------------------------------------------------------------------------------
+
+bool		memo_init	    (MemoCache& mc, const std::string& path, size_t max_entries, size_t max_bytes) {
+    struct stat st;
+
+    if (stat(path.c_str(), &st) != 0 && mkdir(path.c_str(), 0755) != 0)
+	return (false);
+    if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+	return (false);
+
+    mc.path	   = path;
+    mc.max_entries = max_entries;
+    mc.max_bytes   = max_bytes;
+    mc.hits	   = 0;
+    mc.misses	   = 0;
+    mc.evictions   = 0;
+
+    memo_scan(mc);
+    memo_evict(mc);
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Memo Key
+//------------------------------------------------------------------------------
+
+std::string	memo_key	    (Machine& m, size_t budget) {
+    std::ostringstream	ss;
+    std::ostringstream	key;
+
+    // Everything that determines the outcome of a run from a pristine machine
+    write_words(ss, "memory", m.memory);
+    write_words(ss, "regfile", m.regfile);
+    write_words(ss, "pregfile", m.pregfile);
+    ss << "pc " << m.pc << " budget " << budget << " loop " << (m.loop != NULL);
+    ss << " cost " << m.cost.mem_cycles;
+    for (size_t i = 0; i < OP_SIZE; i++)
+	ss << " " << m.cost.op_cycles[i];
+    ss << " engine " << m.engine << " checked " << m.checked << " native " << (m.native != NULL);
+
+    key << std::hex << std::setfill('0')
+	<< std::setw(16) << memo_hash(ss.str(), 0xcbf29ce484222325ULL)
+	<< std::setw(16) << memo_hash(ss.str(), 0x84222325cbf29ce4ULL);
+
+    return (key.str());
+}
+
+//------------------------------------------------------------------------------
+// Memo Lookup
+//------------------------------------------------------------------------------
+
+bool		memo_lookup	    (MemoCache& mc, const std::string& key, Machine& m) {
+    std::ifstream   in;
+    std::string	    magic;
+    std::string	    tag;
+    std::string	    stored;
+    struct stat	    st;
+    Machine	    r;
+    bool	    found;
+    size_t	    loop_pc;
+    size_t	    period;
+
+    in.open(memo_path(mc, key).c_str());
+
+    if (!in.is_open() || !getline(in, magic) || magic != MemoMagic ||
+	!(in >> tag >> stored) || tag != "key" || stored != key ||
+	!(in >> tag >> r.pc >> r.steps >> r.cycles >> r.halted) || tag != "state" ||
+	!(in >> tag >> found >> loop_pc >> period) || tag != "loop" ||
+	!read_words(in, "regfile", r.regfile) ||
+	!read_words(in, "pregfile", r.pregfile) ||
+	!read_words(in, "memory", r.memory)) {
+	mc.misses++;
+	return (false);
+    }
+
+    m.memory   = r.memory;
+    m.regfile  = r.regfile;
+    m.pregfile = r.pregfile;
+    m.pc       = r.pc;
+    m.steps    = r.steps;
+    m.cycles   = r.cycles;
+    m.halted   = r.halted;
+
+    if (m.loop) {
+	loop_reset(*m.loop, m);
+	m.loop->found	= found;
+	m.loop->loop_pc = loop_pc;
+	m.loop->period	= period;
+    }
+
+    // Touch the entry so eviction sees it as recently used
+    utime(memo_path(mc, key).c_str(), NULL);
+    if (stat(memo_path(mc, key).c_str(), &st) == 0)
+	memo_touch(mc, key, st.st_size);
+
+    mc.hits++;
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Memo Store
+//------------------------------------------------------------------------------
+
+bool		memo_store	    (MemoCache& mc, const std::string& key, Machine& m) {
+    std::ofstream	out;
+    std::ostringstream	tmp;
+    size_t		size;
+
+    tmp << memo_path(mc, key) << "." << getpid();
+
+    out.open(tmp.str().c_str());
+    if (!out.is_open())
+	return (false);
+
+    out << MemoMagic << "\n";
+    out << "key " << key << "\n";
+    out << "state " << m.pc << " " << m.steps << " " << m.cycles << " " << m.halted << "\n";
+    out << "loop " << (m.loop && m.loop->found) << " "
+	<< (m.loop ? m.loop->loop_pc : 0) << " "
+	<< (m.loop ? m.loop->period : 0) << "\n";
+    write_words(out, "regfile", m.regfile);
+    write_words(out, "pregfile", m.pregfile);
+    write_words(out, "memory", m.memory);
+    size = out.tellp();
+    out.close();
+
+    // Rename into place so concurrent readers never see a partial entry
+    if (out.fail() || rename(tmp.str().c_str(), memo_path(mc, key).c_str()) != 0) {
+	unlink(tmp.str().c_str());
+	return (false);
+    }
+
+    memo_touch(mc, key, size);
+    memo_evict(mc);
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Print Memo
+//------------------------------------------------------------------------------
+
+void		print_memo	    (MemoCache& mc) {
+    std::cout << "Memo " << mc.path << ": "
+	      << mc.lru.size() << " entries, " << mc.bytes << " bytes, "
+	      << mc.hits << " hits, " << mc.misses << " misses, "
+	      << mc.evictions << " evictions (limits: "
+	      << mc.max_entries << " entries, " << mc.max_bytes << " bytes)" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
@@ -0,0 +1,384 @@
+//------------------------------------------------------------------------------
+// psim_mp.cc: psim shared-memory multiprocessor
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Global Constants
+//------------------------------------------------------------------------------
+
+static const size_t MaxCores	    = 64;		// Cores per word in the race masks
+static const size_t CorePregister   = PRF_SIZE - 1;	// Reads as the core number
+
+//------------------------------------------------------------------------------
+// Structures
+//------------------------------------------------------------------------------
+
+struct MpRun {
+    Multiprocessor     *mp;
+    size_t		threads;
+    size_t		slice;		// Instructions per core this quantum
+    bool		finished;	// Workers exit at the next start barrier
+    std::vector<size_t>	ran;		// Instructions per core this quantum
+    pthread_barrier_t	start;
+    pthread_barrier_t	done;
+};
+
+struct MpWorker {
+    MpRun	       *run;
+    size_t		index;
+    pthread_t		thread;
+};
+
+struct MpConflict {
+    uint64_t		readers;	// Core masks
+    uint64_t		writers;
+};
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static uint64_t	mp_random	    (Multiprocessor& mp) {
+    mp.random ^= mp.random << 13;
+    mp.random ^= mp.random >> 7;
+    mp.random ^= mp.random << 17;
+    return (mp.random);
+}
+
+static void	mp_quantum	    (MpRun& r, size_t first) {
+    Multiprocessor& mp = *r.mp;
+
+    for (size_t c = first; c < mp.cores; c += r.threads) {
+	mp.accesses[c].clear();
+	r.ran[c] = step(mp.machines[c], r.slice);
+    }
+}
+
+static void    *mp_worker	    (void *arg) {
+    MpWorker   *w = (MpWorker *)arg;
+
+    for (;;) {
+	pthread_barrier_wait(&w->run->start);
+	if (w->run->finished)
+	    break;
+
+	mp_quantum(*w->run, w->index);
+	pthread_barrier_wait(&w->run->done);
+    }
+
+    return (NULL);
+}
+
+// Stores become visible to the other cores at the barrier, in the order the
+// interleaving policy picks, so the outcome does not depend on the host
+// scheduler.
+
+static void	mp_commit	    (Multiprocessor& mp, Machine& mc) {
+    std::vector<size_t>		  order(mp.cores);
+    std::vector<size_t>		  written;
+    std::map<size_t, MpConflict>  conflicts;
+
+    for (size_t k = 0; k < mp.cores; k++) {
+	switch (mp.policy) {
+	    case IP_ORDER:   order[k] = k; break;
+	    case IP_REVERSE: order[k] = mp.cores - 1 - k; break;
+	    case IP_ROTATE:  order[k] = (k + mp.quanta) % mp.cores; break;
+	    case IP_RANDOM:  order[k] = k; break;
+	}
+    }
+
+    if (mp.policy == IP_RANDOM)
+	for (size_t k = mp.cores - 1; k > 0; k--)
+	    std::swap(order[k], order[mp_random(mp) % (k + 1)]);
+
+    for (size_t k = 0; k < mp.cores; k++) {
+	AccessLog& al = mp.accesses[order[k]];
+
+	for (size_t i = 0; i < al.size(); i++) {
+	    MpConflict& mf = conflicts[al[i].address];
+
+	    if (al[i].write) {
+		mc.memory[al[i].address] = al[i].value;
+		if (mc.pages) page_dirty(*mc.pages, al[i].address);
+		written.push_back(al[i].address);
+		mf.writers |= 1ULL << order[k];
+	    } else {
+		mf.readers |= 1ULL << order[k];
+	    }
+	}
+    }
+
+    for (size_t c = 0; c < mp.cores; c++)
+	for (size_t i = 0; i < written.size(); i++)
+	    mp.machines[c].memory[written[i]] = mc.memory[written[i]];
+
+    for (std::map<size_t, MpConflict>::iterator it = conflicts.begin(); it != conflicts.end(); it++) {
+	uint64_t cores = it->second.readers | it->second.writers;
+
+	if (it->second.writers && (cores & (cores - 1)))
+	    mp.races++;
+    }
+
+    if (mp.logging) {
+	for (size_t c = 0; c < mp.cores; c++) {
+	    for (size_t i = 0; i < mp.accesses[c].size(); i++) {
+		SharedAccess sa;
+		MpConflict&  mf = conflicts[mp.accesses[c][i].address];
+		uint64_t     cores = mf.readers | mf.writers;
+
+		sa.quantum = mp.quanta;
+		sa.core	   = c;
+		sa.access  = mp.accesses[c][i];
+		sa.race	   = mf.writers && (cores & (cores - 1));
+		mp.log.push_back(sa);
+	    }
+	}
+    }
+
+    mp.quanta++;
+}
+
+static const char *mp_policy_name   (INTERLEAVE_POLICY p) {
+    switch (p) {
+	case IP_ORDER:	 return ("order");
+	case IP_REVERSE: return ("reverse");
+	case IP_ROTATE:	 return ("rotate");
+	case IP_RANDOM:	 return ("random");
+    }
+
+    return ("unknown");
+}
+
+//------------------------------------------------------------------------------
+// MP Configure
+//------------------------------------------------------------------------------
+
+bool		mp_configure	    (Multiprocessor& mp, Machine& mc, size_t cores, size_t quantum, INTERLEAVE_POLICY policy, uint64_t seed) {
+    if (cores == 0 || cores > MaxCores || quantum == 0)
+	return (false);
+
+    mp.cores   = cores;
+    mp.quantum = quantum;
+    mp.policy  = policy;
+    mp.seed    = seed;
+    mp.threads = 0;
+    mp.logging = false;
+
+    mp_reset(mp, mc);
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// MP Reset
+//------------------------------------------------------------------------------
+
+void		mp_reset	    (Multiprocessor& mp, Machine& mc) {
+    mp.machines.assign(mp.cores, Machine());
+    mp.accesses.assign(mp.cores, AccessLog());
+    mp.log.clear();
+    mp.random = mp.seed ? mp.seed : 0x9e3779b97f4a7c15ULL;
+    mp.quanta = 0;
+    mp.races  = 0;
+
+    // Every core starts from the loaded machine with its number in P7
+    for (size_t c = 0; c < mp.cores; c++) {
+	Machine& core = mp.machines[c];
+
+	machine_init(core);
+	core.memory   = mc.memory;
+	core.regfile  = mc.regfile;
+	core.pregfile = mc.pregfile;
+	core.pregfile[CorePregister] = c;
+	core.pc	      = mc.pc;
+	core.trace    = false;
+	core.symbols  = mc.symbols;
+	core.cost     = mc.cost;
+	core.checked  = true;
+	core.accesses = &mp.accesses[c];
+    }
+}
+
+//------------------------------------------------------------------------------
+// MP Run
+//------------------------------------------------------------------------------
+
+size_t		mp_run		    (Multiprocessor& mp, Machine& mc, size_t s) {
+    MpRun		    r;
+    std::vector<MpWorker>   workers;
+    size_t		    before = 0;
+    size_t		    total  = 0;
+    bool		    halted;
+    bool		    stalled;
+
+    for (size_t c = 0; c < mp.cores; c++)
+	before += mp.machines[c].steps;
+
+    r.mp       = &mp;
+    r.threads  = std::min(mp.cores, mp.threads ? mp.threads : (size_t)sysconf(_SC_NPROCESSORS_ONLN));
+    r.threads  = std::max(r.threads, (size_t)1);
+    r.finished = false;
+    r.ran.assign(mp.cores, 0);
+
+    // The calling thread runs the first share of cores and commits
+    if (r.threads > 1) {
+	pthread_barrier_init(&r.start, NULL, r.threads);
+	pthread_barrier_init(&r.done, NULL, r.threads);
+
+	workers.resize(r.threads);
+	for (size_t t = 1; t < r.threads; t++) {
+	    workers[t].run   = &r;
+	    workers[t].index = t;
+	    pthread_create(&workers[t].thread, NULL, mp_worker, &workers[t]);
+	}
+    }
+
+    for (size_t remaining = s; remaining > 0; remaining -= r.slice) {
+	halted = true;
+	for (size_t c = 0; c < mp.cores; c++)
+	    halted = halted && mp.machines[c].halted;
+
+	if (halted || (mc.control && mc.control->stop.load(std::memory_order_relaxed)))
+	    break;
+
+	r.slice = std::min(mp.quantum, remaining);
+
+	if (r.threads > 1) pthread_barrier_wait(&r.start);
+	mp_quantum(r, 0);
+	if (r.threads > 1) pthread_barrier_wait(&r.done);
+
+	mp_commit(mp, mc);
+
+	// A core that stops short without halting hit a memory error
+	stalled = false;
+	for (size_t c = 0; c < mp.cores; c++)
+	    stalled = stalled || (r.ran[c] < r.slice && !mp.machines[c].halted);
+
+	total = 0;
+	for (size_t c = 0; c < mp.cores; c++)
+	    total += mp.machines[c].steps;
+	if (mc.control) control_publish(*mc.control, mp.machines[0].pc, total);
+
+	if (stalled)
+	    break;
+    }
+
+    if (r.threads > 1) {
+	r.finished = true;
+	pthread_barrier_wait(&r.start);
+	for (size_t t = 1; t < r.threads; t++)
+	    pthread_join(workers[t].thread, NULL);
+
+	pthread_barrier_destroy(&r.start);
+	pthread_barrier_destroy(&r.done);
+    }
+
+    // The machine reports core 0's PC, total steps and the slowest core's cycles
+    mc.pc     = mp.machines[0].pc;
+    mc.steps  = 0;
+    mc.cycles = 0;
+    mc.halted = true;
+    for (size_t c = 0; c < mp.cores; c++) {
+	mc.steps  += mp.machines[c].steps;
+	mc.cycles  = std::max(mc.cycles, mp.machines[c].cycles);
+	mc.halted  = mc.halted && mp.machines[c].halted;
+    }
+
+    return (mc.steps - before);
+}
+
+//------------------------------------------------------------------------------
+// MP Set Pregister
+//------------------------------------------------------------------------------
+
+void		mp_set_pregister    (Multiprocessor& mp, size_t p, DWord v) {
+    for (size_t c = 0; c < mp.cores; c++)
+	if (p < mp.machines[c].pregfile.size())
+	    mp.machines[c].pregfile[p] = v;
+}
+
+//------------------------------------------------------------------------------
+// Print MP
+//------------------------------------------------------------------------------
+
+void		print_mp	    (Multiprocessor& mp, SymbolTable *st) {
+    std::cout << "Multiprocessor: " << mp.cores << " cores, quantum " << mp.quantum
+	      << ", " << mp_policy_name(mp.policy) << " interleaving";
+    if (mp.policy == IP_RANDOM)
+	std::cout << " (seed " << mp.seed << ")";
+    std::cout << ", " << mp.quanta << " quanta, " << mp.races << " races" << std::endl;
+
+    for (size_t c = 0; c < mp.cores; c++) {
+	Machine& core = mp.machines[c];
+
+	std::cout << std::endl << "Core " << c << ": PC " << core.pc;
+	if (symbol_string(st, core.pc).size())
+	    std::cout << " " << symbol_string(st, core.pc);
+	std::cout << ", " << core.steps << " steps, " << core.cycles << " cycles"
+		  << (core.halted ? " (halted)" : "") << std::endl;
+	print_regfile(core.regfile, core.pc, st);
+	print_pregfile(core.pregfile);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Print MP Log
+//------------------------------------------------------------------------------
+
+void		print_mp_log	    (Multiprocessor& mp, std::ostream& out, SymbolTable *st) {
+    out << "Quantum Core Step       PC     Access Address Value  Race" << std::endl;
+    for (size_t i = 0; i < mp.log.size(); i++) {
+	SharedAccess& sa = mp.log[i];
+
+	out << std::setfill(' ') << std::setw(7) << sa.quantum << " "
+	    << std::setw(4) << sa.core << " "
+	    << std::setw(10) << sa.access.step << " "
+	    << std::setw(6) << sa.access.pc << " "
+	    << (sa.access.write ? "write " : "read  ") << " "
+	    << std::setw(7) << sa.access.address << " "
+	    << std::setw(6) << sa.access.value
+	    << (sa.race ? " *" : "");
+	if (symbol_name(st, sa.access.address).size())
+	    out << "\t" << symbol_name(st, sa.access.address);
+	out << std::endl;
+    }
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
@@ -0,0 +1,329 @@
+//------------------------------------------------------------------------------
+// psim_native.cc: psim runtime for translated programs
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+#include <unistd.h>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Global Constants
+//------------------------------------------------------------------------------
+
+// Steps per call into the translated program between run control checks
+static const size_t NativeChunk	= 1 << 16;
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static void	native_load	    (NativeState& ns, Machine& mc, std::vector<uint16_t>& memory) {
+    memory.resize(mc.memory.size());
+    for (size_t i = 0; i < mc.memory.size(); i++)   memory[i] = mc.memory[i].to_ulong();
+    for (size_t i = 0; i < RF_SIZE; i++)	    ns.regfile[i] = mc.regfile[i].to_ulong();
+    for (size_t i = 0; i < PRF_SIZE; i++)	    ns.pregfile[i] = mc.pregfile[i].to_ulong();
+
+    ns.memory	= memory.size() ? &memory[0] : NULL;
+    ns.size	= memory.size();
+    ns.pc	= mc.pc;
+    ns.steps	= mc.steps;
+    ns.cycles	= mc.cycles;
+    ns.halted	= mc.halted;
+    ns.fallback = false;
+    ns.stale	= false;
+    ns.cost	= &mc.cost;
+    ns.guarded	= mc.native->guarded;
+}
+
+static void	native_store	    (NativeState& ns, Machine& mc) {
+    for (size_t i = 0; i < ns.size && mc.pages; i++)
+	if (mc.memory[i].to_ulong() != ns.memory[i])
+	    page_dirty(*mc.pages, i);
+
+    for (size_t i = 0; i < ns.size; i++)    mc.memory[i] = ns.memory[i];
+    for (size_t i = 0; i < RF_SIZE; i++)    mc.regfile[i] = ns.regfile[i];
+    for (size_t i = 0; i < PRF_SIZE; i++)   mc.pregfile[i] = ns.pregfile[i];
+
+    mc.pc     = ns.pc;
+    mc.steps  = ns.steps;
+    mc.cycles = ns.cycles;
+    mc.halted = ns.halted;
+}
+
+static size_t	native_interpret    (Machine& mc, size_t s) {
+    const NativeImage *ni = mc.native;
+    size_t	       i;
+
+    mc.native = NULL;
+    i = step(mc, s);
+    mc.native = ni;
+
+    return (i);
+}
+
+//------------------------------------------------------------------------------
+// Native Attach
+//------------------------------------------------------------------------------
+
+bool		native_attach	    (Machine& mc, const std::string& path) {
+    const NativeImage *ni;
+    void	      *handle;
+
+    // A bare file name would make dlopen search the library path instead
+    if ((handle = dlopen((path.find('/') == std::string::npos ? "./" + path : path).c_str(), RTLD_NOW)) == NULL) {
+	std::cerr << dlerror() << std::endl;
+	return (false);
+    }
+
+    if ((ni = (const NativeImage *)dlsym(handle, "psim_native")) == NULL) {
+	dlclose(handle);
+	return (false);
+    }
+
+    mc.native = ni;
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Native Execute
+//------------------------------------------------------------------------------
+
+// Embedded interpreter for translated instructions whose memory word was
+// overwritten; returns false when the instruction must be left to step().
+
+bool		native_execute	    (NativeState& ns) {
+    uint16_t		w = ns.memory[ns.pc];
+    const DecodedInst&	d = DecodeTable[w];
+    size_t		a = 0;
+
+    switch (d.op) {
+	case OP_LOAD:
+	case OP_STORE:
+	    if ((a = d.imm) >= ns.size) return (false);
+	    break;
+	case OP_MOVR:
+	    if ((a = ns.regfile[d.rb] + d.rc) >= ns.size) return (false);
+	    break;
+	case OP_UNKNOWN:
+	    return (false);
+    }
+
+    ns.steps++;
+    ns.cycles += ns.cost->mem_cycles + ns.cost->op_cycles[d.op];
+
+    switch (d.op) {
+	case OP_LOAD:
+	    ns.regfile[d.ra] = ns.memory[a];
+	    ns.cycles += ns.cost->mem_cycles;
+	    break;
+	case OP_STORE:
+	    // Only guarded addresses notice a change to their instruction word
+	    if (!ns.guarded[a] && ns.memory[a] != ns.regfile[d.ra])
+		ns.stale = true;
+	    ns.memory[a] = ns.regfile[d.ra];
+	    ns.cycles += ns.cost->mem_cycles;
+	    break;
+	case OP_ADD:
+	    ns.regfile[d.ra] = ns.regfile[d.rb] + ns.regfile[d.rc];
+	    break;
+	case OP_LOADC:
+	    ns.regfile[d.ra] = d.imm;
+	    break;
+	case OP_SUB:
+	    ns.regfile[d.ra] = ns.regfile[d.rb] - ns.regfile[d.rc];
+	    break;
+	case OP_JMPZ:
+	    if (ns.regfile[d.ra] == 0) ns.pc = ns.pc + d.imm - 1;
+	    break;
+	case OP_JMPN:
+	    if (ns.regfile[d.ra] & 0x8000) ns.pc = ns.pc + d.imm - 1;
+	    break;
+	case OP_JMP:
+	    ns.pc = ns.pc + d.imm - 1;
+	    break;
+	case OP_MOVR:
+	    ns.regfile[d.ra] = ns.memory[a];
+	    ns.cycles += ns.cost->mem_cycles;
+	    break;
+	case OP_IO:
+	    if (d.rc)
+		ns.pregfile[d.rb] = ns.regfile[d.ra];
+	    else
+		ns.regfile[d.ra] = ns.pregfile[d.rb];
+	    break;
+	case OP_END:
+	    ns.halted = true;
+	    return (true);
+    }
+
+    ns.pc++;
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Native Main
+//------------------------------------------------------------------------------
+
+// Entry point of standalone translated programs (see ptrans).
+
+int		native_main	    (int argc, char *argv[], const NativeImage& ni) {
+    Machine	mc;
+    std::string	arg;
+    size_t	budget;
+    size_t	i;
+    int		c;
+
+    machine_init(mc);
+    mc.trace  = false;
+    mc.native = &ni;
+    mc.memory.assign(ni.image, ni.image + ni.size);
+    budget    = 1000000;
+
+    while ((c = getopt(argc, argv, "n:i:m:Ih")) != -1) {
+	arg = optarg ? optarg : "";
+
+	switch (c) {
+	    case 'n': budget	= strtol(optarg, NULL, 10); break;
+	    case 'm': mc.cost.mem_cycles = strtol(optarg, NULL, 10); break;
+	    case 'I': mc.native	= NULL; break;
+	    case 'i':
+		if ((i = arg.find('=')) == std::string::npos ||
+		    strtoul(arg.substr(0, i).c_str(), NULL, 10) >= PRF_SIZE) {
+		    std::cerr << "Invalid pregister input: " << arg << std::endl;
+		    return (EXIT_FAILURE);
+		}
+		mc.pregfile[strtol(arg.substr(0, i).c_str(), NULL, 10)] = strtol(arg.substr(i + 1).c_str(), NULL, 10);
+		break;
+	    default:
+		std::cerr << "usage: " << argv[0] << " [-n steps] [-i <p>=<v>] [-m mem_cycles] [-I]" << std::endl;
+		return (EXIT_FAILURE);
+	}
+    }
+
+    step(mc, budget);
+
+    print_regfile(mc.regfile, mc.pc, NULL);
+    print_pregfile(mc.pregfile);
+    print_memory(mc.memory, 0, mc.memory.size(), NULL);
+    std::cout << "Steps " << mc.steps << ", cycles " << mc.cycles
+	      << (mc.halted ? ", halted" : "") << std::endl;
+
+    return (EXIT_SUCCESS);
+}
+
+//------------------------------------------------------------------------------
+// Native Run
+//------------------------------------------------------------------------------
+
+size_t		native_run	    (Machine& mc, size_t s) {
+    std::vector<uint16_t> memory;
+    NativeState		  ns;
+    size_t		  start = mc.steps;
+
+    if (!native_valid(mc))
+	return (native_interpret(mc, s));
+
+    native_load(ns, mc, memory);
+
+    while (ns.steps - start < s && !ns.halted && !ns.stale && ns.pc < ns.size) {
+	if (mc.control) {
+	    control_publish(*mc.control, ns.pc, ns.steps);
+	    if (mc.control->stop.load(std::memory_order_relaxed))
+		break;
+	}
+
+	mc.native->program(ns, std::min(s - (ns.steps - start), NativeChunk));
+
+	if (ns.fallback) {
+	    native_store(ns, mc);
+	    native_interpret(mc, 1);
+	    native_load(ns, mc, memory);
+	}
+    }
+
+    native_store(ns, mc);
+    if (mc.control) control_publish(*mc.control, mc.pc, mc.steps);
+
+    // A store rewrote an unguarded word, so the rest of the run is interpreted
+    if (ns.stale && mc.steps - start < s)
+	native_interpret(mc, s - (mc.steps - start));
+
+    return (mc.steps - start);
+}
+
+//------------------------------------------------------------------------------
+// Native Valid
+//------------------------------------------------------------------------------
+
+bool		native_valid	    (Machine& mc) {
+    const NativeImage *ni = mc.native;
+    PageTable	      *pt = mc.pages;
+    size_t	       p;
+
+    if (ni == NULL || ni->size != mc.memory.size())
+	return (false);
+
+    // Translated code ignores page protection, so the image must be open
+    for (p = 0; pt && (p << pt->shift) < ni->size; p++)
+	if ((pt->flags[p] & PF_RWX) != PF_RWX)
+	    return (false);
+
+    // Pages found clean against this translation are only compared again
+    // once a store dirties them
+    for (p = 0; p < (pt ? pt->flags.size() : 0) && (p << pt->shift) < ni->size; p++) {
+	if (pt->checked == ni && !(pt->flags[p] & PF_DIRTY))
+	    continue;
+
+	for (size_t i = p << pt->shift; i < ((p + 1) << pt->shift) && i < ni->size; i++)
+	    if (!ni->guarded[i] && mc.memory[i].to_ulong() != ni->image[i])
+		return (false);
+
+	pt->flags[p] &= ~PF_DIRTY;
+    }
+
+    if (pt) {
+	pt->checked = ni;
+	return (true);
+    }
+
+    for (size_t i = 0; i < ni->size; i++)
+	if (!ni->guarded[i] && mc.memory[i].to_ulong() != ni->image[i])
+	    return (false);
+
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
@@ -0,0 +1,250 @@
+//------------------------------------------------------------------------------
+// psim_object.cc: psim relocatable objects and linker
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Global Constants
+//------------------------------------------------------------------------------
+
+static const char *ObjectMagic = "psim-object 1";
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static bool	read_section	    (std::istream& in, const char *name, DataList& words) {
+    std::string	tag;
+    size_t	n;
+    size_t	w;
+
+    if (!(in >> tag >> n) || tag != name)
+	return (false);
+
+    words.resize(n);
+    for (size_t i = 0; i < n; i++) {
+	if (!(in >> w) || w >> WORD_SIZE)
+	    return (false);
+	words[i] = DWord(w);
+    }
+
+    return (true);
+}
+
+static void	write_section	    (std::ostream& out, const char *name, DataList& words) {
+    out << name << " " << words.size() << "\n";
+    for (size_t i = 0; i < words.size(); i++)
+	out << words[i].to_ulong() << "\n";
+}
+
+// A module's own labels take precedence over the exports of other modules,
+// so every module can have its own LOOP.
+
+static long	resolve_symbol	    (std::vector<ObjectModule>& objs, size_t m, const std::string& name,
+				     std::vector<size_t>& text_base, std::vector<size_t>& data_base,
+				     LabelTable& globals, size_t data_start) {
+    ObjectModule& om = objs[m];
+
+    if (om.text_labels.find(name) != om.text_labels.end())
+	return (text_base[m] + om.text_labels[name]);
+    if (om.data_labels.find(name) != om.data_labels.end())
+	return (data_start + data_base[m] + om.data_labels[name]);
+    if (globals.find(name) != globals.end())
+	return (globals[name]);
+
+    return (-1);
+}
+
+//------------------------------------------------------------------------------
+// Link Objects
+//------------------------------------------------------------------------------
+
+// Lays out the text of every module in order, followed by (unified) or
+// alongside (split) their data, and fills in every relocated operand.  The
+// first module's text runs first.
+
+bool		link_objects	    (std::vector<ObjectModule>& objs, bool unified, Memory& image, std::string& error) {
+    std::vector<size_t> text_base(objs.size());
+    std::vector<size_t> data_base(objs.size());
+    LabelTable		globals;
+    size_t		text_size = 0;
+    size_t		data_size = 0;
+    size_t		data_start;
+
+    for (size_t m = 0; m < objs.size(); m++) {
+	text_base[m] = text_size;
+	data_base[m] = data_size;
+	text_size   += objs[m].text.size();
+	data_size   += objs[m].data.size();
+    }
+    data_start = (unified ? text_size : 0);
+
+    for (size_t m = 0; m < objs.size(); m++) {
+	for (size_t e = 0; e < objs[m].exports.size(); e++) {
+	    std::string& name = objs[m].exports[e];
+	    long	 a;
+
+	    if (globals.find(name) != globals.end()) {
+		error = "duplicate global " + name + " in " + objs[m].source;
+		return (false);
+	    }
+	    if ((a = resolve_symbol(objs, m, name, text_base, data_base, globals, data_start)) < 0) {
+		error = "undefined global " + name + " in " + objs[m].source;
+		return (false);
+	    }
+	    globals[name] = a;
+	}
+    }
+
+    image.clear();
+    for (size_t m = 0; m < objs.size(); m++)
+	image.insert(image.end(), objs[m].text.begin(), objs[m].text.end());
+
+    for (size_t m = 0; m < objs.size(); m++) {
+	for (size_t r = 0; r < objs[m].relocations.size(); r++) {
+	    Relocation&	rl    = objs[m].relocations[r];
+	    size_t	where = text_base[m] + rl.address;
+	    long	v     = resolve_symbol(objs, m, rl.symbol, text_base, data_base, globals, data_start);
+	    long	low   = (rl.relative ? -(1L << (rl.width - 1)) : 0);
+	    long	high  = (rl.relative ? (1L << (rl.width - 1)) : (1L << rl.width)) - 1;
+	    std::ostringstream ss;
+
+	    if (v < 0) {
+		error = "undefined symbol " + rl.symbol + " in " + objs[m].source;
+		return (false);
+	    }
+	    if (rl.address >= objs[m].text.size()) {
+		error = "relocation outside the text in " + objs[m].source;
+		return (false);
+	    }
+
+	    if (rl.relative)
+		v -= where;
+	    if (v < low || v > high) {
+		ss << rl.symbol << " (" << v << ") does not fit " << rl.width << " bits at text word "
+		   << rl.address << " in " << objs[m].source;
+		error = ss.str();
+		return (false);
+	    }
+
+	    image[where] = DWord(image[where].to_ulong() | ((v & ((1L << rl.width) - 1)) << rl.shift));
+	}
+    }
+
+    // Split memory binaries hold only the text, like pasm's
+    if (unified)
+	for (size_t m = 0; m < objs.size(); m++)
+	    image.insert(image.end(), objs[m].data.begin(), objs[m].data.end());
+
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Object Load
+//------------------------------------------------------------------------------
+
+bool		object_load	    (std::istream& in, ObjectModule& om) {
+    std::string	line;
+    std::string	tag;
+
+    om.source.clear();
+    om.text_labels.clear();
+    om.data_labels.clear();
+    om.exports.clear();
+    om.relocations.clear();
+
+    if (!getline(in, line) || line != ObjectMagic || !(in >> tag) || tag != "source" || !getline(in, om.source))
+	return (false);
+    trim_whitespace(om.source);
+
+    if (!read_section(in, "text", om.text) || !read_section(in, "data", om.data))
+	return (false);
+
+    while (in >> tag) {
+	if (tag == "symbol") {
+	    std::string name;
+	    std::string section;
+	    long	value;
+
+	    if (!(in >> name >> section >> value) || (section != "T" && section != "D") || value < 0)
+		return (false);
+	    (section == "T" ? om.text_labels : om.data_labels)[name] = value;
+	} else if (tag == "global") {
+	    if (!(in >> tag))
+		return (false);
+	    om.exports.push_back(tag);
+	} else if (tag == "reloc") {
+	    Relocation	rl;
+	    std::string	kind;
+
+	    if (!(in >> rl.address >> rl.shift >> rl.width >> kind >> rl.symbol) ||
+		(kind != "abs" && kind != "rel") || rl.width == 0 || rl.shift + rl.width > WORD_SIZE)
+		return (false);
+	    rl.relative = (kind == "rel");
+	    om.relocations.push_back(rl);
+	} else {
+	    return (false);
+	}
+    }
+
+    return (in.eof());
+}
+
+//------------------------------------------------------------------------------
+// Object Write
+//------------------------------------------------------------------------------
+
+void		object_write	    (std::ostream& out, ObjectModule& om) {
+    out << ObjectMagic << "\n";
+    out << "source " << om.source << "\n";
+    write_section(out, "text", om.text);
+    write_section(out, "data", om.data);
+
+    for (LabelTable::iterator it = om.text_labels.begin(); it != om.text_labels.end(); it++)
+	out << "symbol " << it->first << " T " << it->second << "\n";
+    for (LabelTable::iterator it = om.data_labels.begin(); it != om.data_labels.end(); it++)
+	out << "symbol " << it->first << " D " << it->second << "\n";
+    for (size_t e = 0; e < om.exports.size(); e++)
+	out << "global " << om.exports[e] << "\n";
+    for (size_t r = 0; r < om.relocations.size(); r++) {
+	Relocation& rl = om.relocations[r];
+
+	out << "reloc " << rl.address << " " << rl.shift << " " << rl.width << " "
+	    << (rl.relative ? "rel" : "abs") << " " << rl.symbol << "\n";
+    }
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
@@ -0,0 +1,997 @@
+//------------------------------------------------------------------------------
+// psim_opt.cc: pasm peephole, jump threading and dead code optimizer
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Global Constants
+//------------------------------------------------------------------------------
+
+static const long   JumpRange[OP_SIZE] = {	// Largest forward offset per opcode
+    0, 0, 0, 0, 0, 127, 127, 2047, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+//------------------------------------------------------------------------------
+// Enumerations
+//------------------------------------------------------------------------------
+
+typedef enum {
+    RS_UNDEF = 0,	// No path reaches the instruction yet
+    RS_CONST,
+    RS_UNKNOWN
+} REG_STATE;
+
+typedef enum {
+    BK_NUMBER	= 1,	// Computed from # constants only
+    BK_ADDRESS	= 2,	// A data address plus or minus numbers
+    BK_OTHER	= 4	// Read from memory or a pregister
+} BASE_KIND;
+
+//------------------------------------------------------------------------------
+// Structures
+//------------------------------------------------------------------------------
+
+struct OptInst {
+    Tokens	tokens;
+    SourceLine	line;
+    long	op;		// OPCODE
+    long	ra;
+    long	rb;
+    long	rc;		// Direction for IO
+    long	imm;		// LOADC constant
+    bool	address;	// LOADC of a data address (known only after layout)
+    long	target;		// Jump target index, -1 when not a jump
+    std::string	memory;		// LOAD and STORE operand, by label or data address
+    bool	pinned;		// Text word read as data
+    bool	removed;
+};
+
+typedef std::vector<OptInst> OptProgram;
+
+struct RewriteInst {
+    long	op;		// OPCODE
+    long	regs[3];	// Register variables in operand order
+    size_t	nregs;
+    long	imm;		// LOADC constant or MOVR offset
+    std::string	address;	// LOAD and STORE address variable
+};
+
+struct RegState {
+    uint8_t	kind[RF_SIZE];	// REG_STATE
+    uint16_t	value[RF_SIZE];
+};
+
+struct BaseState {
+    uint8_t	kind[RF_SIZE];	// BASE_KIND bits the register may hold, 0 when unreached
+};
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static bool	opt_register	    (std::string& s, long& r) {
+    if (!token_is_register(s))
+	return (false);
+
+    r = strtol(s.substr(1).c_str(), NULL, 10);
+    return (r >= 0 && r < (long)RF_SIZE);
+}
+
+// Memory operands are keyed by text label (instructions move) or by data
+// address, so two data labels for one word alias.
+
+static bool	opt_memory	    (OptInst& in, std::string& s, LabelTable& text, LabelTable& data, bool unified, std::string& why) {
+    std::ostringstream ss;
+
+    if (token_is_label(s) && text.find(s) != text.end()) {
+	ss << "T" << s;
+    } else if (token_is_label(s) && data.find(s) != data.end()) {
+	ss << "D" << data[s];
+    } else if (token_is_number(s) && !unified) {
+	ss << "D" << (strtol(s.c_str(), NULL, 10) & 0xff);
+    } else {
+	why = (token_is_number(s) ? "numeric memory address " : "unknown label ") + s;
+	return (false);
+    }
+
+    in.memory = ss.str();
+    return (true);
+}
+
+static bool	opt_target	    (OptInst& in, std::string& s, size_t i, size_t n, LabelTable& text, std::string& why) {
+    if (token_is_label(s) && text.find(s) != text.end())
+	in.target = text[s];
+    else if (token_is_number(s))
+	in.target = (long)i + strtol(s.c_str(), NULL, 10);
+    else
+	in.target = -1;
+
+    if (in.target < 0 || in.target > (long)n) {
+	why = "jump outside the text (" + tokens_to_string(in.tokens) + ")";
+	return (false);
+    }
+
+    return (true);
+}
+
+static bool	opt_decode	    (OptInst& in, size_t i, size_t n, LabelTable& text, LabelTable& data, bool unified, std::string& why) {
+    Tokens& t = in.tokens;
+
+    in.op      = OP_UNKNOWN;
+    in.ra      = in.rb = in.rc = in.imm = 0;
+    in.address = false;
+    in.target  = -1;
+    in.pinned  = false;
+    in.removed = false;
+
+    if ((t[0] == "ADD" || t[0] == "SUB") && t.size() == 4) {
+	if (opt_register(t[1], in.ra) && opt_register(t[2], in.rb) && opt_register(t[3], in.rc))
+	    in.op = (t[0] == "ADD" ? OP_ADD : OP_SUB);
+    } else if (t[0] == "MOV" && t.size() == 3 && opt_register(t[1], in.ra)) {
+	if (token_is_constant(t[2])) {
+	    // The 8-bit immediate is sign extended
+	    in.op  = OP_LOADC;
+	    in.imm = (uint16_t)(int8_t)(strtol(t[2].substr(1).c_str(), NULL, 10) & 0xff);
+	} else if (token_is_address(t[2])) {
+	    if (text.find(t[2].substr(1)) != text.end()) {
+		why = "address of text label " + t[2].substr(1);
+		return (false);
+	    }
+	    in.op      = OP_LOADC;
+	    in.address = true;
+	} else if (token_is_label(t[2]) || token_is_number(t[2])) {
+	    if (!opt_memory(in, t[2], text, data, unified, why))
+		return (false);
+	    in.op = OP_LOAD;
+	}
+    } else if (t[0] == "MOV" && t.size() == 3 && opt_register(t[2], in.ra)) {
+	if (!opt_memory(in, t[1], text, data, unified, why))
+	    return (false);
+	in.op = OP_STORE;
+    } else if (t[0] == "MOV" && t.size() == 4) {
+	if (token_is_dio(t[1]) && opt_register(t[2], in.ra) && token_is_pio(t[3])) {
+	    in.op = OP_IO;
+	    in.rb = strtol(t[3].substr(1).c_str(), NULL, 10);
+	    in.rc = strtol(t[1].substr(1).c_str(), NULL, 10);
+	}
+    } else if (t[0] == "MOVR" && t.size() == 4) {
+	if (token_is_address(t[3]) && text.find(t[3].substr(1)) != text.end()) {
+	    why = "address of text label " + t[3].substr(1);
+	    return (false);
+	}
+	if (opt_register(t[1], in.ra) && opt_register(t[2], in.rb))
+	    in.op = OP_MOVR;
+    } else if ((t[0] == "JMPZ" || t[0] == "JMPN") && t.size() == 3 && opt_register(t[1], in.ra)) {
+	if (!opt_target(in, t[2], i, n, text, why))
+	    return (false);
+	in.op = (t[0] == "JMPZ" ? OP_JMPZ : OP_JMPN);
+    } else if (t[0] == "JMP" && t.size() == 2) {
+	if (!opt_target(in, t[1], i, n, text, why))
+	    return (false);
+	in.op = OP_JMP;
+    } else if (t[0] == "END" && t.size() == 1) {
+	in.op = OP_END;
+    }
+
+    if (in.op == OP_UNKNOWN) {
+	why = "invalid instruction (" + tokens_to_string(t) + ")";
+	return (false);
+    }
+
+    return (true);
+}
+
+static bool	opt_jump	    (OptInst& in) {
+    return (in.op == OP_JMP || in.op == OP_JMPZ || in.op == OP_JMPN);
+}
+
+// Words whose encoding holds an address that moves when the text shrinks:
+// text labels, and data labels when the data follows the text.
+
+static bool	opt_relocated	    (OptInst& in, bool unified) {
+    if (in.memory.size())
+	return (in.memory[0] == 'T' || unified);
+    if (in.op == OP_LOADC && in.address)
+	return (unified);
+    if (in.op == OP_MOVR && token_is_address(in.tokens[3]))
+	return (unified);
+
+    return (false);
+}
+
+// Removed instructions are no-ops that fall through to the next one.
+
+static void	opt_successors	    (OptProgram& p, size_t i, std::vector<size_t>& s) {
+    s.clear();
+
+    if (p[i].removed) {
+	s.push_back(i + 1);
+	return;
+    }
+
+    switch (p[i].op) {
+	case OP_JMP:
+	    s.push_back(p[i].target);
+	    break;
+	case OP_JMPZ:
+	case OP_JMPN:
+	    s.push_back(i + 1);
+	    s.push_back(p[i].target);
+	    break;
+	case OP_END:
+	    break;
+	default:
+	    s.push_back(i + 1);
+	    break;
+    }
+}
+
+static void	opt_transfer	    (OptInst& in, RegState& rs) {
+    if (in.removed)
+	return;
+
+    switch (in.op) {
+	case OP_LOADC:
+	    rs.kind[in.ra]  = (in.address ? RS_UNKNOWN : RS_CONST);
+	    rs.value[in.ra] = in.imm;
+	    break;
+	case OP_ADD:
+	case OP_SUB:
+	    if (rs.kind[in.rb] == RS_CONST && rs.kind[in.rc] == RS_CONST) {
+		rs.value[in.ra] = (in.op == OP_ADD ? rs.value[in.rb] + rs.value[in.rc] : rs.value[in.rb] - rs.value[in.rc]);
+		rs.kind[in.ra]	= RS_CONST;
+	    } else {
+		rs.kind[in.ra]	= RS_UNKNOWN;
+	    }
+	    break;
+	case OP_LOAD:
+	case OP_MOVR:
+	    rs.kind[in.ra] = RS_UNKNOWN;
+	    break;
+	case OP_IO:
+	    if (in.rc == 0)
+		rs.kind[in.ra] = RS_UNKNOWN;
+	    break;
+    }
+}
+
+static bool	opt_merge	    (RegState& dst, RegState& src) {
+    bool changed = false;
+
+    for (size_t r = 0; r < RF_SIZE; r++) {
+	if (src.kind[r] == RS_UNDEF || dst.kind[r] == RS_UNKNOWN)
+	    continue;
+
+	if (dst.kind[r] == RS_UNDEF) {
+	    dst.kind[r]	 = src.kind[r];
+	    dst.value[r] = src.value[r];
+	    changed	 = true;
+	} else if (src.kind[r] == RS_UNKNOWN || src.value[r] != dst.value[r]) {
+	    dst.kind[r]	 = RS_UNKNOWN;
+	    changed	 = true;
+	}
+    }
+
+    return (changed);
+}
+
+// Registers are zero when a program starts, so the entry state is all
+// constants; the worklist propagates them along the CFG.
+
+static void	opt_constants	    (OptProgram& p, std::vector<RegState>& in) {
+    std::vector<size_t>	work;
+    std::vector<size_t>	succ;
+    RegState		rs;
+
+    for (size_t r = 0; r < RF_SIZE; r++) {
+	rs.kind[r]  = RS_UNDEF;
+	rs.value[r] = 0;
+    }
+    in.assign(p.size(), rs);
+
+    if (p.empty())
+	return;
+
+    for (size_t r = 0; r < RF_SIZE; r++)
+	in[0].kind[r] = RS_CONST;
+    work.push_back(0);
+
+    while (!work.empty()) {
+	size_t i = work.back();
+
+	work.pop_back();
+	rs = in[i];
+	opt_transfer(p[i], rs);
+	opt_successors(p, i, succ);
+
+	for (size_t s = 0; s < succ.size(); s++)
+	    if (succ[s] < p.size() && opt_merge(in[succ[s]], rs))
+		work.push_back(succ[s]);
+    }
+}
+
+// Numbers stay numbers and a number moves an address to another address in
+// the same data; the difference of two data addresses is a number again.
+
+static uint8_t	opt_base_combine    (uint8_t b, uint8_t c, bool sub) {
+    uint8_t k = 0;
+
+    if (b & c & BK_NUMBER)
+	k |= BK_NUMBER;
+    if ((b & BK_ADDRESS) && (c & BK_NUMBER))
+	k |= BK_ADDRESS;
+    if ((b & BK_NUMBER) && (c & BK_ADDRESS))
+	k |= (sub ? BK_OTHER : BK_ADDRESS);
+    if (b & c & BK_ADDRESS)
+	k |= (sub ? BK_NUMBER : BK_OTHER);
+    if ((b | c) & BK_OTHER)
+	k |= BK_OTHER;
+
+    return (k);
+}
+
+static void	opt_base_transfer   (OptInst& in, BaseState& bs, uint8_t memory) {
+    switch (in.op) {
+	case OP_LOADC:
+	    bs.kind[in.ra] = (in.address ? BK_ADDRESS : BK_NUMBER);
+	    break;
+	case OP_ADD:
+	case OP_SUB:
+	    bs.kind[in.ra] = opt_base_combine(bs.kind[in.rb], bs.kind[in.rc], in.op == OP_SUB);
+	    break;
+	case OP_LOAD:
+	case OP_MOVR:
+	    bs.kind[in.ra] = BK_OTHER | memory;
+	    break;
+	case OP_IO:
+	    if (in.rc == 0)
+		bs.kind[in.ra] = BK_OTHER;
+	    break;
+    }
+}
+
+// A MOVR with a # offset reads an absolute address when its base register
+// may hold a plain number, and that address moves when the text shrinks in
+// unified memory.  Numbers stored to memory may come back through any load.
+
+static bool	opt_numeric_base    (OptProgram& p, std::string& why) {
+    std::vector<BaseState> in;
+    std::vector<size_t>	   work;
+    std::vector<size_t>	   succ;
+    BaseState		   bs;
+    uint8_t		   memory = 0;
+    uint8_t		   stored;
+
+    if (p.empty())
+	return (false);
+
+    while (true) {
+	for (size_t r = 0; r < RF_SIZE; r++)
+	    bs.kind[r] = 0;
+	in.assign(p.size(), bs);
+
+	// Registers start at zero
+	for (size_t r = 0; r < RF_SIZE; r++)
+	    in[0].kind[r] = BK_NUMBER;
+	work.push_back(0);
+
+	while (!work.empty()) {
+	    size_t i = work.back();
+
+	    work.pop_back();
+	    bs = in[i];
+	    opt_base_transfer(p[i], bs, memory);
+	    opt_successors(p, i, succ);
+
+	    for (size_t s = 0; s < succ.size(); s++) {
+		bool changed = false;
+
+		if (succ[s] >= p.size())
+		    continue;
+
+		for (size_t r = 0; r < RF_SIZE; r++) {
+		    if (bs.kind[r] & ~in[succ[s]].kind[r]) {
+			in[succ[s]].kind[r] |= bs.kind[r];
+			changed = true;
+		    }
+		}
+		if (changed)
+		    work.push_back(succ[s]);
+	    }
+	}
+
+	stored = memory;
+	for (size_t i = 0; i < p.size(); i++)
+	    if (p[i].op == OP_STORE)
+		stored |= in[i].kind[p[i].ra];
+	if (stored == memory)
+	    break;
+	memory = stored;
+    }
+
+    for (size_t i = 0; i < p.size(); i++) {
+	if (p[i].op == OP_MOVR && !token_is_address(p[i].tokens[3]) && (in[i].kind[p[i].rb] & BK_NUMBER)) {
+	    why = "numeric base address (" + tokens_to_string(p[i].tokens) + ")";
+	    return (true);
+	}
+    }
+
+    return (false);
+}
+
+static bool	opt_reached	    (RegState& rs) {
+    for (size_t r = 0; r < RF_SIZE; r++)
+	if (rs.kind[r] != RS_UNDEF)
+	    return (true);
+
+    return (false);
+}
+
+static bool	opt_known	    (RegState& rs, long r, uint16_t v) {
+    return (rs.kind[r] == RS_CONST && rs.value[r] == v);
+}
+
+// Level 1: jumps to jumps go straight to the final target, as long as the
+// new offset fits the instruction.
+
+static size_t	opt_thread	    (OptProgram& p) {
+    size_t  threaded = 0;
+
+    for (size_t i = 0; i < p.size(); i++) {
+	long	t     = p[i].target;
+	size_t	hops  = 0;
+
+	if (p[i].removed || p[i].pinned || !opt_jump(p[i]))
+	    continue;
+
+	while (t < (long)p.size() && !p[t].removed && !p[t].pinned && p[t].op == OP_JMP && hops++ < p.size())
+	    t = p[t].target;
+
+	// A cycle of JMPs never gets anywhere; leave it be
+	if (hops > p.size())
+	    continue;
+
+	if (t != p[i].target && labs(t - (long)i) <= JumpRange[p[i].op]) {
+	    p[i].target = t;
+	    threaded++;
+	}
+    }
+
+    return (threaded);
+}
+
+static size_t	opt_jump_next	    (OptProgram& p) {
+    size_t  jumps = 0;
+
+    for (size_t i = 0; i < p.size(); i++) {
+	if (!p[i].removed && !p[i].pinned && opt_jump(p[i]) && p[i].target == (long)i + 1) {
+	    p[i].removed = true;
+	    jumps++;
+	}
+    }
+
+    return (jumps);
+}
+
+// Within a basic block, a LOAD of a word a register already holds (from a
+// LOAD or STORE of the same word) does nothing.
+
+static size_t	opt_reloads	    (OptProgram& p) {
+    std::vector<bool>	    leader(p.size() + 1, false);
+    std::vector<std::string> holds(RF_SIZE);
+    size_t		    redundant = 0;
+
+    for (size_t i = 0; i < p.size(); i++) {
+	if (p[i].removed)
+	    continue;
+	if (opt_jump(p[i]))
+	    leader[p[i].target] = true;
+	if (opt_jump(p[i]) || p[i].op == OP_END)
+	    leader[i + 1] = true;
+    }
+
+    for (size_t i = 0; i < p.size(); i++) {
+	OptInst& in = p[i];
+
+	if (leader[i])
+	    holds.assign(RF_SIZE, "");
+
+	if (in.removed)
+	    continue;
+
+	switch (in.op) {
+	    case OP_LOAD:
+		if (holds[in.ra] == in.memory && !in.pinned) {
+		    in.removed = true;
+		    redundant++;
+		}
+		holds[in.ra] = in.memory;
+		break;
+	    case OP_STORE:
+		for (size_t r = 0; r < RF_SIZE; r++)
+		    if (holds[r] == in.memory)
+			holds[r] = "";
+		holds[in.ra] = in.memory;
+		break;
+	    case OP_ADD:
+	    case OP_SUB:
+	    case OP_LOADC:
+	    case OP_MOVR:
+		holds[in.ra] = "";
+		break;
+	    case OP_IO:
+		if (in.rc == 0)
+		    holds[in.ra] = "";
+		break;
+	}
+    }
+
+    return (redundant);
+}
+
+// Level 2: instructions whose effect is already in place (constant loads,
+// adding or subtracting a known zero) go away, and conditional branches on
+// a known register are folded.
+
+static void	opt_fold	    (OptProgram& p, OptimizeStats& os) {
+    std::vector<RegState> in;
+
+    opt_constants(p, in);
+
+    for (size_t i = 0; i < p.size(); i++) {
+	OptInst&  x  = p[i];
+	RegState& rs = in[i];
+
+	if (x.removed || x.pinned || !opt_reached(rs))
+	    continue;
+
+	if ((x.op == OP_LOADC && !x.address && opt_known(rs, x.ra, x.imm)) ||
+	    (x.op == OP_ADD && x.ra == x.rb && opt_known(rs, x.rc, 0)) ||
+	    (x.op == OP_ADD && x.ra == x.rc && opt_known(rs, x.rb, 0)) ||
+	    (x.op == OP_SUB && x.ra == x.rb && opt_known(rs, x.rc, 0))) {
+	    x.removed = true;
+	    os.redundant++;
+	} else if ((x.op == OP_JMPZ || x.op == OP_JMPN) && rs.kind[x.ra] == RS_CONST) {
+	    bool taken = (x.op == OP_JMPZ ? rs.value[x.ra] == 0 : (rs.value[x.ra] >> (WORD_SIZE - 1)) != 0);
+
+	    if (taken)
+		x.op = OP_JMP;
+	    else
+		x.removed = true;
+	    os.folded++;
+	}
+    }
+}
+
+static size_t	opt_dead	    (OptProgram& p) {
+    std::vector<bool>	reached(p.size(), false);
+    std::vector<size_t>	work;
+    std::vector<size_t>	succ;
+    size_t		dead = 0;
+
+    if (p.empty())
+	return (0);
+
+    reached[0] = true;
+    work.push_back(0);
+    while (!work.empty()) {
+	size_t i = work.back();
+
+	work.pop_back();
+	opt_successors(p, i, succ);
+	for (size_t s = 0; s < succ.size(); s++) {
+	    if (succ[s] < p.size() && !reached[succ[s]]) {
+		reached[succ[s]] = true;
+		work.push_back(succ[s]);
+	    }
+	}
+    }
+
+    for (size_t i = 0; i < p.size(); i++) {
+	if (!reached[i] && !p[i].removed && !p[i].pinned) {
+	    p[i].removed = true;
+	    dead++;
+	}
+    }
+
+    return (dead);
+}
+
+// Pattern instructions use the assembler syntax with registers and address
+// variables as operands.
+
+static bool	rw_decode	    (Tokens& t, RewriteInst& ri) {
+    ri.op    = OP_UNKNOWN;
+    ri.nregs = 0;
+    ri.imm   = 0;
+    ri.address.clear();
+
+    for (size_t j = 1; j < t.size(); j++) {
+	if (opt_register(t[j], ri.regs[ri.nregs < 3 ? ri.nregs : 2]))
+	    ri.nregs++;
+	else if (token_is_constant(t[j]))
+	    ri.imm = strtol(t[j].substr(1).c_str(), NULL, 10);
+	else if (token_is_label(t[j]) || token_is_number(t[j]))
+	    ri.address = t[j];
+	else
+	    return (false);
+    }
+
+    if ((t[0] == "ADD" || t[0] == "SUB") && t.size() == 4 && ri.nregs == 3)
+	ri.op = (t[0] == "ADD" ? OP_ADD : OP_SUB);
+    else if (t[0] == "MOV" && t.size() == 3 && ri.nregs == 1 && token_is_constant(t[2]))
+	ri.op = OP_LOADC;
+    else if (t[0] == "MOV" && t.size() == 3 && ri.nregs == 1 && ri.address.size())
+	ri.op = (token_is_register(t[1]) ? OP_LOAD : OP_STORE);
+    else if (t[0] == "MOVR" && t.size() == 4 && ri.nregs == 2 && token_is_constant(t[3]))
+	ri.op = OP_MOVR;
+
+    // Constants are compared as encoded
+    if (ri.op == OP_LOADC)
+	ri.imm = (uint16_t)(int8_t)(ri.imm & 0xff);
+    if (ri.op == OP_MOVR)
+	ri.imm &= 0xf;
+
+    return (ri.op != OP_UNKNOWN);
+}
+
+static bool	rw_bind		    (std::map<std::string, std::string>& vars, std::map<std::string, std::string>& used,
+				     const std::string& var, const std::string& value) {
+    if (vars.count(var))
+	return (vars[var] == value);
+    if (used.count(value))
+	return (false);
+
+    vars[var]	= value;
+    used[value] = var;
+    return (true);
+}
+
+static bool	rw_match	    (OptInst& in, Tokens& pt, std::map<std::string, std::string>& vars,
+				     std::map<std::string, std::string>& used, std::map<std::string, std::string>& names) {
+    RewriteInst	pi;
+    std::string	operand;
+    long	regs[3] = { in.ra, in.rb, in.rc };
+
+    if (!rw_decode(pt, pi) || pi.op != in.op || in.pinned)
+	return (false);
+
+    switch (in.op) {
+	case OP_LOADC:
+	    if (in.address || pi.imm != in.imm)
+		return (false);
+	    break;
+	case OP_MOVR:
+	    if (!token_is_constant(in.tokens[3]) ||
+		(strtol(in.tokens[3].substr(1).c_str(), NULL, 10) & 0xf) != pi.imm)
+		return (false);
+	    break;
+	case OP_LOAD:
+	case OP_STORE:
+	    // Only data words, which cannot alias under different keys
+	    operand = (in.op == OP_LOAD ? in.tokens[2] : in.tokens[1]);
+	    if (in.memory.empty() || in.memory[0] != 'D' || !rw_bind(vars, used, "@" + pi.address, in.memory))
+		return (false);
+	    names[pi.address] = operand;
+	    break;
+    }
+
+    for (size_t r = 0; r < pi.nregs; r++) {
+	std::ostringstream v;
+	std::ostringstream c;
+
+	v << "R" << pi.regs[r];
+	c << "R" << regs[r];
+	if (!rw_bind(vars, used, v.str(), c.str()))
+	    return (false);
+    }
+
+    return (true);
+}
+
+// Replaces a straight-line window that matches a rewrite pattern with the
+// shorter sequence.  Only the first instruction of the window may be entered
+// from elsewhere, and the instructions saved are marked removed.
+
+static size_t	opt_rewrite	    (OptProgram& p, RewriteTable& rt, LabelTable& text, LabelTable& data, bool unified) {
+    std::vector<bool>	entered(p.size() + 1, false);
+    size_t		saved = 0;
+    std::string		why;
+
+    for (size_t i = 0; i < p.size(); i++)
+	if (!p[i].removed && opt_jump(p[i]))
+	    entered[p[i].target] = true;
+    for (LabelTable::iterator it = text.begin(); it != text.end(); it++)
+	entered[it->second] = true;
+
+    for (size_t i = 0; i < p.size(); i++) {
+	for (size_t r = 0; r < rt.size() && !p[i].removed; r++) {
+	    std::map<std::string, std::string> vars;
+	    std::map<std::string, std::string> used;
+	    std::map<std::string, std::string> names;
+	    std::vector<size_t>		       window;
+	    OptProgram			       repl;
+	    bool			       match = true;
+
+	    for (size_t j = i; j < p.size() && window.size() < rt[r].pattern.size() && match; j++) {
+		if (j > i && entered[j])
+		    match = false;
+		else if (!p[j].removed)
+		    window.push_back(j);
+	    }
+
+	    for (size_t k = 0; k < window.size() && match; k++)
+		match = rw_match(p[window[k]], rt[r].pattern[k], vars, used, names);
+	    if (!match || window.size() != rt[r].pattern.size() || rt[r].replacement.size() >= window.size())
+		continue;
+
+	    for (size_t k = 0; k < rt[r].replacement.size() && match; k++) {
+		Tokens	t = rt[r].replacement[k];
+
+		for (size_t j = 1; j < t.size(); j++) {
+		    if (token_is_register(t[j]) && vars.count(t[j]))
+			t[j] = vars[t[j]];
+		    else if (token_is_label(t[j]) && names.count(t[j]))
+			t[j] = names[t[j]];
+		    else if (!token_is_constant(t[j]) && !token_is_number(t[j]))
+			match = false;
+		}
+
+		repl.push_back(p[window[k]]);
+		repl[k].tokens = t;
+		match = match && opt_decode(repl[k], window[k], p.size(), text, data, unified, why);
+	    }
+	    if (!match)
+		continue;
+
+	    for (size_t k = 0; k < window.size(); k++) {
+		if (k < repl.size())
+		    p[window[k]] = repl[k];
+		else
+		    p[window[k]].removed = true;
+	    }
+	    saved += window.size() - repl.size();
+	}
+    }
+
+    return (saved);
+}
+
+// Drops removed instructions; jumps and labels that pointed at one now point
+// at the next instruction that remains, which is where execution went anyway.
+
+static void	opt_compact	    (OptProgram& p, LabelTable& text) {
+    std::vector<long>	remap(p.size() + 1);
+    OptProgram		kept;
+    std::string		label;
+
+    remap[p.size()] = 0;
+    for (size_t i = 0; i < p.size(); i++)
+	if (!p[i].removed)
+	    remap[p.size()]++;
+
+    for (long i = p.size() - 1, next = remap[p.size()]; i >= 0; i--) {
+	if (!p[i].removed)
+	    next--;
+	remap[i] = next;
+    }
+
+    for (size_t i = 0; i < p.size(); i++) {
+	if (p[i].removed) {
+	    if (label.empty())
+		label = p[i].line.label;
+	    continue;
+	}
+
+	if (p[i].line.label.empty())
+	    p[i].line.label = label;
+	label.clear();
+
+	if (p[i].target >= 0)
+	    p[i].target = remap[p[i].target];
+	kept.push_back(p[i]);
+    }
+
+    for (LabelTable::iterator it = text.begin(); it != text.end(); it++)
+	it->second = remap[it->second];
+
+    p.swap(kept);
+}
+
+static void	opt_encode	    (OptInst& in, size_t i) {
+    std::ostringstream ss;
+
+    if (!opt_jump(in))
+	return;
+
+    ss << in.target - (long)i;
+    if (in.op == OP_JMP) {
+	in.tokens.resize(2);
+	in.tokens[0] = "JMP";
+	in.tokens[1] = ss.str();
+    } else {
+	in.tokens[2] = ss.str();
+    }
+}
+
+//------------------------------------------------------------------------------
+// Optimize Text
+//------------------------------------------------------------------------------
+
+// Rewrites the parsed text in place before data labels are relocated, so the
+// data section simply follows the shorter text.  Words read as data are kept
+// as they are; text that is written as data is left alone entirely.
+
+bool		optimize_text	    (TextList& tl, SourceMap& sm, LabelTable& text, LabelTable& data, size_t level, bool unified, RewriteTable *rt, OptimizeStats& os) {
+    OptProgram	p(tl.size());
+    size_t	changes;
+
+    os.before	 = os.after = tl.size();
+    os.threaded	 = os.folded = os.redundant = os.jumps = os.dead = os.rewritten = 0;
+    os.skipped.clear();
+
+    for (size_t i = 0; i < tl.size(); i++) {
+	p[i].tokens = tl[i];
+	p[i].line   = sm[i];
+	if (!opt_decode(p[i], i, tl.size(), text, data, unified, os.skipped))
+	    return (false);
+    }
+
+    if (unified && opt_numeric_base(p, os.skipped))
+	return (false);
+
+    for (size_t i = 0; i < p.size(); i++) {
+	if (p[i].memory.size() && p[i].memory[0] == 'T') {
+	    OptInst& w = p[text[p[i].memory.substr(1)]];
+
+	    // Stored words may encode any address in the old layout, and the
+	    // encoding of a jump or of a moving address depends on the layout
+	    if (p[i].op == OP_STORE) {
+		os.skipped = "self-modifying code (" + tokens_to_string(p[i].tokens) + ")";
+		return (false);
+	    }
+	    if (opt_jump(w)) {
+		os.skipped = "jump read as data (" + tokens_to_string(w.tokens) + ")";
+		return (false);
+	    }
+	    if (opt_relocated(w, unified)) {
+		os.skipped = "address read as data (" + tokens_to_string(w.tokens) + ")";
+		return (false);
+	    }
+
+	    w.pinned = true;
+	}
+    }
+
+    do {
+	changes = os.threaded + os.folded + os.redundant + os.jumps + os.dead + os.rewritten;
+
+	os.threaded += opt_thread(p);
+	os.jumps    += opt_jump_next(p);
+	os.redundant += opt_reloads(p);
+	if (level >= 2) {
+	    opt_fold(p, os);
+	    os.dead += opt_dead(p);
+	}
+	if (rt)
+	    os.rewritten += opt_rewrite(p, *rt, text, data, unified);
+
+	opt_compact(p, text);
+    } while (changes != os.threaded + os.folded + os.redundant + os.jumps + os.dead + os.rewritten);
+
+    tl.clear();
+    sm.clear();
+    for (size_t i = 0; i < p.size(); i++) {
+	opt_encode(p[i], i);
+	p[i].line.address = i;
+	tl.push_back(p[i].tokens);
+	sm.push_back(p[i].line);
+    }
+    os.after = tl.size();
+
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Rewrite Load
+//------------------------------------------------------------------------------
+
+bool		rewrite_load	    (std::istream& in, RewriteTable& rt) {
+    std::string	line;
+    Tokens	tokens;
+    TextList   *section = NULL;
+    Rewrite	rw;
+
+    if (!getline(in, line) || line != "psim-rewrite 1")
+	return (false);
+
+    while (getline(in, line)) {
+	trim_comment(line);
+	trim_whitespace(line);
+	if (line.size() == 0)
+	    continue;
+
+	tokens = tokenize(line);
+
+	if (tokens[0] == "rewrite" && section == NULL) {
+	    rw.pattern.clear();
+	    rw.replacement.clear();
+	    rw.proved = true;
+	    section   = &rw.pattern;
+	} else if (tokens[0] == "replace" && section == &rw.pattern) {
+	    section = &rw.replacement;
+	} else if (tokens[0] == "end" && section == &rw.replacement) {
+	    if (rw.pattern.empty() || rw.replacement.size() >= rw.pattern.size())
+		return (false);
+	    rt.push_back(rw);
+	    section = NULL;
+	} else if (section) {
+	    section->push_back(tokens);
+	} else {
+	    return (false);
+	}
+    }
+
+    return (section == NULL);
+}
+
+//------------------------------------------------------------------------------
+// Rewrite Write
+//------------------------------------------------------------------------------
+
+void		rewrite_write	    (std::ostream& out, RewriteTable& rt) {
+    out << "psim-rewrite 1" << std::endl;
+
+    for (size_t r = 0; r < rt.size(); r++) {
+	TextList *sections[2] = { &rt[r].pattern, &rt[r].replacement };
+
+	for (size_t s = 0; s < 2; s++) {
+	    out << (s == 0 ? "rewrite" : "replace") << std::endl;
+	    for (size_t i = 0; i < sections[s]->size(); i++) {
+		Tokens& t = (*sections[s])[i];
+
+		out << "    " << t[0];
+		for (size_t j = 1; j < t.size(); j++)
+		    out << (j == 1 ? " " : ", ") << t[j];
+		out << std::endl;
+	    }
+	}
+	out << "end" << std::endl;
+    }
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
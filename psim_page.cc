@@ -0,0 +1,239 @@
+//------------------------------------------------------------------------------
+// psim_page.cc: psim paged sparse memory
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Global Constants
+//------------------------------------------------------------------------------
+
+// Memory keys of the loop detector's state hash end where the registers start
+static const size_t PageLimit	= LK_REGFILE;
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static std::string page_string	    (uint8_t f) {
+    std::string	s = "---";
+
+    if (f & PF_READ)  s[0] = 'r';
+    if (f & PF_WRITE) s[1] = 'w';
+    if (f & PF_EXEC)  s[2] = 'x';
+
+    return (s);
+}
+
+//------------------------------------------------------------------------------
+// Memory Word
+//------------------------------------------------------------------------------
+
+// Word at any address the machine can access, 0 past the end
+uint16_t	memory_word	    (Machine& mc, size_t a) {
+    if (a < mc.memory.size())
+	return (mc.memory[a].to_ulong());
+    if (mc.pages && a < mc.pages->size)
+	return (page_read(*mc.pages, a).to_ulong());
+
+    return (0);
+}
+
+//------------------------------------------------------------------------------
+// Page Dirty
+//------------------------------------------------------------------------------
+
+void		page_dirty	    (PageTable& pt, size_t a) {
+    uint8_t& f = pt.flags[a >> pt.shift];
+
+    if ((f & (PF_EXEC | PF_DIRTY)) == PF_EXEC) {
+	f |= PF_DIRTY;
+	pt.dirtied++;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Page Fault
+//------------------------------------------------------------------------------
+
+bool		page_fault	    (PageTable& pt, size_t pc, size_t a, PAGE_FLAG need) {
+    pt.faults++;
+
+    if (a >= pt.size) {
+	std::cerr << "Memory access out of bounds at PC " << pc << ": address " << a << std::endl;
+	return (false);
+    }
+
+    std::cerr << "Page protection fault at PC " << pc << ": "
+	      << (need == PF_EXEC ? "execute" : need == PF_WRITE ? "write" : "read")
+	      << " of address " << a << " on " << page_string(pt.flags[a >> pt.shift])
+	      << " page " << (a >> pt.shift) << std::endl;
+    return (false);
+}
+
+//------------------------------------------------------------------------------
+// Page Permissions
+//------------------------------------------------------------------------------
+
+// Parses "rwx" style permissions, with '-' for each one denied
+bool		page_permissions    (const std::string& s, uint8_t& f) {
+    if (s.size() != 3 ||
+	(s[0] != 'r' && s[0] != '-') || (s[1] != 'w' && s[1] != '-') || (s[2] != 'x' && s[2] != '-'))
+	return (false);
+
+    f = (s[0] == 'r' ? PF_READ : 0) | (s[1] == 'w' ? PF_WRITE : 0) | (s[2] == 'x' ? PF_EXEC : 0);
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Page Read
+//------------------------------------------------------------------------------
+
+// Pages never written read as zeros without being allocated
+DWord		page_read	    (PageTable& pt, size_t a) {
+    Memory& f = pt.frames[a >> pt.shift];
+
+    return (f.empty() ? DWord(0) : f[a & ((1 << pt.shift) - 1)]);
+}
+
+//------------------------------------------------------------------------------
+// Page Write
+//------------------------------------------------------------------------------
+
+void		page_write	    (PageTable& pt, size_t a, DWord v) {
+    Memory& f = pt.frames[a >> pt.shift];
+
+    if (f.empty()) {
+	f.assign(1 << pt.shift, DWord(0));
+	pt.allocated++;
+    }
+
+    f[a & ((1 << pt.shift) - 1)] = v;
+}
+
+//------------------------------------------------------------------------------
+// Pages Configure
+//------------------------------------------------------------------------------
+
+bool		pages_configure	    (PageTable& pt, Machine& mc, size_t size, size_t page) {
+    if (size == 0 || size > PageLimit || page == 0 || page > PageLimit || (page & (page - 1)))
+	return (false);
+
+    pt.reserved = size;
+    for (pt.shift = 0; ((size_t)1 << pt.shift) < page; pt.shift++)
+	;
+
+    pages_reset(pt, mc);
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Pages Copy
+//------------------------------------------------------------------------------
+
+// The address space up to (not including) end as one flat memory
+void		pages_copy	    (Machine& mc, size_t end, Memory& m) {
+    end = std::min(end, std::max(mc.memory.size(), mc.pages ? mc.pages->size : 0));
+
+    m.assign(mc.memory.begin(), mc.memory.begin() + std::min(end, mc.memory.size()));
+    for (size_t a = m.size(); a < end; a++)
+	m.push_back(page_read(*mc.pages, a));
+}
+
+//------------------------------------------------------------------------------
+// Pages Protect
+//------------------------------------------------------------------------------
+
+// Sets the permissions of every page holding an address from s to e; pages
+// that are no longer executable are not dirty either.
+bool		pages_protect	    (PageTable& pt, size_t s, size_t e, uint8_t f) {
+    if (s > e || e >= pt.size)
+	return (false);
+
+    for (size_t p = s >> pt.shift; p <= (e >> pt.shift); p++)
+	pt.flags[p] = (f & PF_RWX) | (f & PF_EXEC ? pt.flags[p] & PF_DIRTY : 0);
+
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Pages Reset
+//------------------------------------------------------------------------------
+
+// Image pages hold code and data alike, so they start readable, writable and
+// executable; the pages past the image are readable and writable.
+void		pages_reset	    (PageTable& pt, Machine& mc) {
+    size_t  n;
+
+    pt.image = mc.memory.size();
+    pt.size  = std::min(std::max(pt.reserved, pt.image), PageLimit);
+    n	     = (pt.size + (1 << pt.shift) - 1) >> pt.shift;
+
+    pt.flags.assign(n, PF_READ | PF_WRITE);
+    for (size_t p = 0; (p << pt.shift) < pt.image; p++)
+	pt.flags[p] = PF_RWX;
+
+    pt.frames.assign(n, Memory());
+    pt.checked	 = NULL;
+    pt.allocated = 0;
+    pt.faults	 = 0;
+    pt.dirtied	 = 0;
+}
+
+//------------------------------------------------------------------------------
+// Print Pages
+//------------------------------------------------------------------------------
+
+// Runs of pages with the same permissions, dirty bit and backing
+void		print_pages	    (PageTable& pt) {
+    size_t  words = (size_t)1 << pt.shift;
+
+    std::cout << "Address space: " << pt.size << " words in " << pt.flags.size() << " pages of " << words
+	      << " (" << pt.image << " words of image), " << pt.allocated << " pages allocated, "
+	      << pt.faults << " faults, " << pt.dirtied << " code pages dirtied" << std::endl;
+
+    for (size_t p = 0, q; p < pt.flags.size(); p = q) {
+	for (q = p + 1; q < pt.flags.size() && pt.flags[q] == pt.flags[p] &&
+			pt.frames[q].empty() == pt.frames[p].empty() &&
+			((q << pt.shift) < pt.image) == ((p << pt.shift) < pt.image); q++)
+	    ;
+
+	std::cout << "    Pages " << p << "-" << q - 1 << " (" << (p << pt.shift) << "-"
+		  << std::min(q << pt.shift, pt.size) - 1 << "): " << page_string(pt.flags[p])
+		  << ((p << pt.shift) < pt.image ? " image" : pt.frames[p].size() ? " allocated" : "")
+		  << (pt.flags[p] & PF_DIRTY ? " dirty" : "") << std::endl;
+    }
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
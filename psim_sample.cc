@@ -0,0 +1,237 @@
+//------------------------------------------------------------------------------
+// psim_sample.cc: psim sampled simulation
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Global Constants
+//------------------------------------------------------------------------------
+
+static const char *OpNames[OP_SIZE] = {
+    "LOAD", "STORE", "ADD", "LOADC", "SUB", "JMPZ", "JMPN", "JMP",
+    "MOVR", NULL, NULL, NULL, NULL, NULL, "IO", "END"
+};
+
+static const double Z95	    = 1.96;	// Normal quantile for 95% confidence
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static void	metric_add	    (SampleMetric& sm, double v) {
+    sm.sum  += v;
+    sm.sum2 += v * v;
+    sm.n++;
+}
+
+static double	metric_mean	    (SampleMetric& sm) {
+    return (sm.n ? sm.sum / sm.n : 0.0);
+}
+
+// Half width of the 95% confidence interval of the mean, from the variance
+// between windows.
+
+static double	metric_error	    (SampleMetric& sm) {
+    double var;
+
+    if (sm.n < 2)
+	return (NAN);
+
+    var = (sm.sum2 - sm.sum * sm.sum / sm.n) / (sm.n - 1);
+    return (Z95 * sqrt(std::max(var, 0.0) / sm.n));
+}
+
+static void	print_error	    (SampleMetric& sm, double scale, int width) {
+    if (std::isnan(metric_error(sm)))
+	std::cout << std::setw(width) << "-";
+    else
+	std::cout << std::setw(width) << scale * metric_error(sm);
+}
+
+// A detailed window single-steps the machine so that every instruction can
+// be decoded and its outcome observed; the trace follows the machine's
+// setting.
+
+static size_t	sample_window	    (SampleStats& ss, Machine& mc, size_t s) {
+    size_t  ops[OP_SIZE];
+    size_t  taken[OP_SIZE];
+    size_t  cycles = mc.cycles;
+    size_t  i;
+    size_t  pc;
+    size_t  op;
+
+    std::fill(ops, ops + OP_SIZE, 0);
+    std::fill(taken, taken + OP_SIZE, 0);
+
+    for (i = 0; i < s && !mc.halted && mc.pc < mc.memory.size(); i++) {
+	pc = mc.pc;
+	op = DecodeTable[mc.memory[pc].to_ulong()].op;
+
+	if (step(mc, 1) == 0)
+	    break;
+
+	if (op < OP_SIZE) {
+	    ops[op]++;
+	    if ((op == OP_JMPZ || op == OP_JMPN) && mc.pc != pc + 1)
+		taken[op]++;
+	}
+    }
+
+    if (i == 0)
+	return (0);
+
+    for (size_t o = 0; o < OP_SIZE; o++) {
+	ss.ops[o]   += ops[o];
+	ss.taken[o] += taken[o];
+	metric_add(ss.mix[o], (double)ops[o] / i);
+	if (ops[o] && (o == OP_JMPZ || o == OP_JMPN))
+	    metric_add(ss.taken_rate[o], (double)taken[o] / ops[o]);
+    }
+    metric_add(ss.cpi, (double)(mc.cycles - cycles) / i);
+
+    ss.windows++;
+    ss.detailed += i;
+    return (i);
+}
+
+//------------------------------------------------------------------------------
+// Sample Init
+//------------------------------------------------------------------------------
+
+void		sample_init	    (SampleStats& ss, size_t period, size_t window) {
+    SampleMetric zero = { 0.0, 0.0, 0 };
+
+    ss.period	= period;
+    ss.window	= window;
+    ss.windows	= 0;
+    ss.steps	= 0;
+    ss.detailed = 0;
+
+    for (size_t o = 0; o < OP_SIZE; o++) {
+	ss.ops[o]	 = 0;
+	ss.taken[o]	 = 0;
+	ss.mix[o]	 = zero;
+	ss.taken_rate[o] = zero;
+    }
+    ss.cpi = zero;
+}
+
+//------------------------------------------------------------------------------
+// Sample Run
+//------------------------------------------------------------------------------
+
+// Alternates untraced fast-forwarding with detailed windows on the same
+// machine, so switching costs nothing beyond finishing the current step call.
+
+size_t		sample_run	    (SampleStats& ss, Machine& mc, size_t s) {
+    bool    trace = mc.trace;
+    size_t  total = 0;
+    size_t  n;
+    size_t  ran;
+
+    while (total < s && !mc.halted) {
+	if (mc.control && mc.control->stop.load())
+	    break;
+
+	n	   = std::min(ss.period, s - total);
+	mc.trace   = false;
+	ran	   = step(mc, n);
+	mc.trace   = trace;
+	total	  += ran;
+	if (ran < n)
+	    break;
+
+	n	   = std::min(ss.window, s - total);
+	ran	   = sample_window(ss, mc, n);
+	total	  += ran;
+	if (ran < n)
+	    break;
+    }
+
+    ss.steps += total;
+    return (total);
+}
+
+//------------------------------------------------------------------------------
+// Print Sample
+//------------------------------------------------------------------------------
+
+void		print_sample	    (SampleStats& ss) {
+    std::ios::fmtflags flags	 = std::cout.flags();
+    std::streamsize    precision = std::cout.precision();
+
+    std::cout << "Sampled " << ss.windows << " windows of " << ss.window << " instructions every "
+	      << ss.period << " (" << ss.detailed << " of " << ss.steps << " instructions detailed)" << std::endl;
+    std::cout << "----------------------------------------" << std::endl;
+    std::cout << "Op       Sampled    Mix %  +/- 95%      Estimated" << std::endl;
+    std::cout << "----------------------------------------" << std::endl;
+
+    std::cout << std::fixed << std::setprecision(2) << std::setfill(' ');
+    for (size_t o = 0; o < OP_SIZE; o++) {
+	if (OpNames[o] == NULL || ss.ops[o] == 0)
+	    continue;
+
+	std::cout << std::left << std::setw(6) << OpNames[o] << std::right
+		  << std::setw(10) << ss.ops[o]
+		  << std::setw(9) << 100.0 * metric_mean(ss.mix[o]);
+	print_error(ss.mix[o], 100.0, 9);
+	std::cout << std::setw(15) << std::setprecision(0) << metric_mean(ss.mix[o]) * ss.steps
+		  << std::setprecision(2) << std::endl;
+    }
+    std::cout << "----------------------------------------" << std::endl;
+
+    for (size_t o = 0; o < OP_SIZE; o++) {
+	if (o != OP_JMPZ && o != OP_JMPN)
+	    continue;
+
+	std::cout << OpNames[o] << " taken: ";
+	if (ss.taken_rate[o].n) {
+	    std::cout << 100.0 * metric_mean(ss.taken_rate[o]) << "% +/- ";
+	    print_error(ss.taken_rate[o], 100.0, 0);
+	    std::cout << "% (" << ss.taken[o] << " of " << ss.ops[o] << " sampled)" << std::endl;
+	} else {
+	    std::cout << "not sampled" << std::endl;
+	}
+    }
+
+    std::cout << "CPI: " << std::setprecision(3) << metric_mean(ss.cpi) << " +/- ";
+    print_error(ss.cpi, 1.0, 0);
+    std::cout << " (estimated " << std::setprecision(0) << metric_mean(ss.cpi) * ss.steps << " cycles)" << std::endl;
+
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
@@ -0,0 +1,454 @@
+//------------------------------------------------------------------------------
+// psim_server.cc: psim local socket simulation server
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Global Constants
+//------------------------------------------------------------------------------
+
+// Frames are a 32-bit payload length and a request type or status byte
+// followed by the payload, all integers in host byte order.
+
+static const size_t ServerHeader     = 5;
+static const size_t ServerMaxRequest = 1 << 26;	// Largest payload accepted
+static const size_t ServerMaxImages  = 256;	// Cached images before the oldest is dropped
+static const size_t ServerMaxSteps   = (size_t)1 << 32; // SV_RUN budget 0 stops here without END
+
+//------------------------------------------------------------------------------
+// Structures
+//------------------------------------------------------------------------------
+
+// The hash only finds an entry; a load compares the text as well, so two
+// texts with the same hash never run each other's image.
+
+struct CachedImage {
+    std::string	text;
+    Memory	memory;
+};
+
+struct ImageCache {
+    std::map<uint64_t, CachedImage> images;
+    std::deque<uint64_t>	order;	// Oldest first
+    pthread_mutex_t		lock;
+};
+
+struct Snapshot {
+    Memory	    memory;
+    RegisterFile    regfile;
+    RegisterFile    pregfile;
+    size_t	    pc;
+    size_t	    steps;
+    size_t	    cycles;
+    bool	    halted;
+};
+
+// Each worker owns one session for its lifetime and reuses the machine,
+// snapshot and buffers for every connection it serves, so steady state
+// requests allocate nothing.
+
+struct Session {
+    Machine		machine;
+    Snapshot		snapshot;
+    bool		saved;
+    bool		loaded;
+    uint64_t		image;
+    Memory		original;	// As loaded, for a reset without a snapshot
+    std::vector<char>	request;
+    std::string		reply;
+};
+
+struct Server {
+    int			listener;
+    ImageCache		cache;
+};
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static uint64_t image_hash	    (const char *p, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < n; i++) {
+	h ^= (unsigned char)p[i];
+	h *= 0x100000001b3ULL;
+    }
+
+    return (h);
+}
+
+static bool	read_full	    (int fd, char *p, size_t n) {
+    ssize_t r;
+
+    while (n > 0) {
+	if ((r = read(fd, p, n)) <= 0) {
+	    if (r < 0 && errno == EINTR)
+		continue;
+	    return (false);
+	}
+	p += r;
+	n -= r;
+    }
+
+    return (true);
+}
+
+static bool	write_full	    (int fd, const char *p, size_t n) {
+    ssize_t w;
+
+    while (n > 0) {
+	if ((w = send(fd, p, n, MSG_NOSIGNAL)) <= 0) {
+	    if (w < 0 && errno == EINTR)
+		continue;
+	    return (false);
+	}
+	p += w;
+	n -= w;
+    }
+
+    return (true);
+}
+
+template <class T>
+static void	put		    (std::string& s, T v) {
+    s.append((const char *)&v, sizeof(v));
+}
+
+template <class T>
+static bool	get		    (std::vector<char>& b, size_t& o, T& v) {
+    if (o + sizeof(v) > b.size())
+	return (false);
+
+    memcpy(&v, &b[o], sizeof(v));
+    o += sizeof(v);
+    return (true);
+}
+
+static void	snapshot_save	    (Snapshot& ss, Machine& mc) {
+    ss.memory	= mc.memory;
+    ss.regfile	= mc.regfile;
+    ss.pregfile = mc.pregfile;
+    ss.pc	= mc.pc;
+    ss.steps	= mc.steps;
+    ss.cycles	= mc.cycles;
+    ss.halted	= mc.halted;
+}
+
+static void	snapshot_restore    (Snapshot& ss, Machine& mc) {
+    mc.memory	= ss.memory;
+    mc.regfile	= ss.regfile;
+    mc.pregfile = ss.pregfile;
+    mc.pc	= ss.pc;
+    mc.steps	= ss.steps;
+    mc.cycles	= ss.cycles;
+    mc.halted	= ss.halted;
+}
+
+static void	image_reset	    (Machine& mc) {
+    mc.regfile.assign(RF_SIZE, DWord(0));
+    mc.pregfile.assign(PRF_SIZE, DWord(0));
+    machine_reset(mc);
+}
+
+// Copies a cached image into the session machine; false when it is unknown
+// or, given the text, cached for a different text with the same hash
+static bool	image_load	    (ImageCache& ic, uint64_t h, std::vector<char> *text, Machine& mc) {
+    std::map<uint64_t, CachedImage>::iterator i;
+    bool    found;
+
+    pthread_mutex_lock(&ic.lock);
+    found = (i = ic.images.find(h)) != ic.images.end() &&
+	    (text == NULL || (i->second.text.size() == text->size() &&
+			      memcmp(i->second.text.data(), text->data(), text->size()) == 0));
+    if (found)
+	mc.memory = i->second.memory;
+    pthread_mutex_unlock(&ic.lock);
+
+    if (!found)
+	return (false);
+
+    image_reset(mc);
+    return (true);
+}
+
+// A colliding text replaces the entry, so a load hash gets the latest image
+static void	image_store	    (ImageCache& ic, uint64_t h, std::vector<char>& text, Memory& m) {
+    pthread_mutex_lock(&ic.lock);
+    if (ic.images.find(h) == ic.images.end()) {
+	if (ic.images.size() >= ServerMaxImages) {
+	    ic.images.erase(ic.order.front());
+	    ic.order.pop_front();
+	}
+	ic.order.push_back(h);
+    }
+    ic.images[h].text.assign(text.begin(), text.end());
+    ic.images[h].memory = m;
+    pthread_mutex_unlock(&ic.lock);
+}
+
+static bool	reply_error	    (Session& s, const std::string& message) {
+    s.reply.clear();
+    put<uint32_t>(s.reply, message.size());
+    put<uint8_t>(s.reply, SS_ERROR);
+    s.reply += message;
+    return (false);
+}
+
+// Handles one request in s.request and leaves the reply frame in s.reply;
+// false replies are errors, the connection stays open either way.
+
+static bool	serve_request	    (Server& sv, Session& s, uint8_t type) {
+    Machine&	mc = s.machine;
+    size_t	o  = 0;
+    uint64_t	h;
+    uint64_t	budget;
+    uint32_t	p;
+    uint32_t	v;
+    uint32_t	start;
+    uint32_t	count;
+    size_t	n;
+
+    s.reply.assign(ServerHeader, '\0');
+
+    switch (type) {
+	case SV_LOAD:
+	    h = image_hash(s.request.data(), s.request.size());
+	    if (!image_load(sv.cache, h, &s.request, mc)) {
+		std::istringstream in(std::string(s.request.begin(), s.request.end()));
+
+		load_stream(in, mc.memory, mc.regfile, mc.pregfile);
+		if (mc.memory.empty())
+		    return (reply_error(s, "image has no words"));
+		image_store(sv.cache, h, s.request, mc.memory);
+		machine_reset(mc);
+	    }
+	    s.loaded   = true;
+	    s.saved    = false;
+	    s.image    = h;
+	    s.original = mc.memory;
+	    put<uint64_t>(s.reply, h);
+	    put<uint32_t>(s.reply, mc.memory.size());
+	    break;
+	case SV_LOAD_HASH:
+	    if (!get(s.request, o, h))
+		return (reply_error(s, "missing image hash"));
+	    if (!image_load(sv.cache, h, NULL, mc))
+		return (reply_error(s, "unknown image hash"));
+	    s.loaded   = true;
+	    s.saved    = false;
+	    s.image    = h;
+	    s.original = mc.memory;
+	    put<uint32_t>(s.reply, mc.memory.size());
+	    break;
+	case SV_INPUT:
+	    while (get(s.request, o, p) && get(s.request, o, v)) {
+		if (p >= PRF_SIZE)
+		    return (reply_error(s, "pregister out of range"));
+		mc.pregfile[p] = v;
+	    }
+	    break;
+	case SV_RUN:
+	    if (!s.loaded)
+		return (reply_error(s, "no image loaded"));
+	    if (!get(s.request, o, budget))
+		budget = 0;
+	    n = step(mc, budget ? budget : ServerMaxSteps);
+	    put<uint64_t>(s.reply, n);
+	    put<uint64_t>(s.reply, mc.pc);
+	    put<uint64_t>(s.reply, mc.steps);
+	    put<uint64_t>(s.reply, mc.cycles);
+	    put<uint8_t>(s.reply, mc.halted);
+	    break;
+	case SV_STATE:
+	    if (!get(s.request, o, start) || !get(s.request, o, count)) {
+		start = 0;
+		count = mc.memory.size();
+	    }
+	    start = std::min<size_t>(start, mc.memory.size());
+	    count = std::min<size_t>(count, mc.memory.size() - start);
+	    put<uint64_t>(s.reply, mc.pc);
+	    put<uint64_t>(s.reply, mc.steps);
+	    put<uint64_t>(s.reply, mc.cycles);
+	    put<uint8_t>(s.reply, mc.halted);
+	    for (size_t r = 0; r < RF_SIZE; r++)
+		put<uint16_t>(s.reply, mc.regfile[r].to_ulong());
+	    for (size_t r = 0; r < PRF_SIZE; r++)
+		put<uint16_t>(s.reply, mc.pregfile[r].to_ulong());
+	    put<uint32_t>(s.reply, start);
+	    put<uint32_t>(s.reply, count);
+	    for (size_t a = start; a < start + count; a++)
+		put<uint16_t>(s.reply, mc.memory[a].to_ulong());
+	    break;
+	case SV_SNAPSHOT:
+	    if (!s.loaded)
+		return (reply_error(s, "no image loaded"));
+	    snapshot_save(s.snapshot, mc);
+	    s.saved = true;
+	    break;
+	case SV_RESET:
+	    if (s.saved) {
+		snapshot_restore(s.snapshot, mc);
+	    } else if (s.loaded) {
+		mc.memory = s.original;
+		image_reset(mc);
+	    } else {
+		return (reply_error(s, "nothing to reset to"));
+	    }
+	    break;
+	default:
+	    return (reply_error(s, "unknown request"));
+    }
+
+    // Fill in the header now that the payload length is known
+    v = s.reply.size() - ServerHeader;
+    memcpy(&s.reply[0], &v, sizeof(v));
+    s.reply[4] = SS_OK;
+    return (true);
+}
+
+static void	serve_connection    (Server& sv, Session& s, int fd) {
+    char	header[ServerHeader];
+    uint32_t	length;
+
+    machine_init(s.machine);
+    s.machine.trace = false;
+    s.loaded	    = false;
+    s.saved	    = false;
+
+    while (read_full(fd, header, ServerHeader)) {
+	memcpy(&length, header, sizeof(length));
+	if (length > ServerMaxRequest)
+	    break;
+
+	s.request.resize(length);
+	if (length && !read_full(fd, s.request.data(), length))
+	    break;
+
+	serve_request(sv, s, header[4]);
+	if (!write_full(fd, s.reply.data(), s.reply.size()))
+	    break;
+    }
+
+    close(fd);
+}
+
+static void    *serve_worker	    (void *arg) {
+    Server  *sv = (Server *)arg;
+    Session  s;
+    int	     fd;
+
+    while (true) {
+	if ((fd = accept(sv->listener, NULL, NULL)) < 0) {
+	    if (errno == EINTR || errno == ECONNABORTED)
+		continue;
+	    break;
+	}
+	serve_connection(*sv, s, fd);
+    }
+
+    return (NULL);
+}
+
+//------------------------------------------------------------------------------
+// Server Run
+//------------------------------------------------------------------------------
+
+// Every worker blocks in accept() on the shared socket and serves one client
+// connection at a time, so the pool size is the number of concurrent clients.
+
+bool		server_run	    (const std::string& path, size_t threads) {
+    std::vector<pthread_t>  workers;
+    struct sockaddr_un	    addr;
+    Server		    sv;
+    size_t		    started;
+    int			    e;
+
+    if (path.size() >= sizeof(addr.sun_path)) {
+	std::cerr << "Socket path too long: " << path << std::endl;
+	return (false);
+    }
+
+    if (threads == 0 && (threads = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+	threads = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+
+    unlink(path.c_str());
+    if ((sv.listener = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+	bind(sv.listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	listen(sv.listener, 64) < 0) {
+	std::cerr << "Unable to listen on " << path << ": " << strerror(errno) << std::endl;
+	return (false);
+    }
+
+    pthread_mutex_init(&sv.cache.lock, NULL);
+
+    std::cerr << "Serving on " << path << " with " << threads << " workers" << std::endl;
+
+    workers.resize(threads);
+    for (started = 0; started < threads; started++) {
+	if ((e = pthread_create(&workers[started], NULL, serve_worker, &sv)) != 0) {
+	    std::cerr << "Unable to create worker thread: " << strerror(e) << std::endl;
+	    break;
+	}
+    }
+    for (size_t i = 0; i < started; i++)
+	pthread_join(workers[i], NULL);
+
+    pthread_mutex_destroy(&sv.cache.lock);
+    close(sv.listener);
+    unlink(path.c_str());
+
+    return (started > 0);
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
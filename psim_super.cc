@@ -0,0 +1,524 @@
+//------------------------------------------------------------------------------
+// psim_super.cc: psim superoptimizer search
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Global Constants
+//------------------------------------------------------------------------------
+
+static const size_t SuperVectors     = 16;	// Random test vectors every candidate must pass
+static const size_t SuperTests	     = 256;	// Further random vectors when no proof applies
+static const size_t SuperMemory	     = 256;	// Words reachable by LOAD and STORE
+static const size_t SuperWideMemory  = 65536 + 16; // Words reachable by MOVR
+
+//------------------------------------------------------------------------------
+// Structures
+//------------------------------------------------------------------------------
+
+struct SuperState {
+    uint16_t		  reg[RF_SIZE];
+    std::vector<uint16_t> mem;
+};
+
+struct SuperUndo {
+    uint16_t   *word;
+    uint16_t	value;
+};
+
+struct SuperSearch {
+    std::vector<DecodedInst> target;
+    std::vector<DecodedInst> alphabet;
+    std::vector<size_t>	     stores;	// Addresses the target may change
+    std::vector<size_t>	     inputs;	// Addresses read or written by any candidate
+    std::vector<SuperState>  vectors;
+    std::vector<SuperState>  expected;	// Target result for each vector
+    bool		     affine;	// No MOVR, so every sequence is affine
+    size_t		     length;	// Candidate length being searched
+    size_t		     next;	// Next first instruction to hand out
+    std::vector<size_t>	     best;	// Lowest equivalent candidate, by alphabet index
+    bool		     found;
+    size_t		     candidates;
+    size_t		     survivors;
+    pthread_mutex_t	     lock;
+};
+
+struct SuperWorker {
+    SuperSearch		    *search;
+    pthread_t		     thread;
+    SuperState		     state;
+    SuperState		     scratch;
+    SuperState		     proof;
+    std::vector<size_t>	     sequence;
+    std::vector<SuperUndo>   undo;
+    size_t		     candidates;
+    size_t		     survivors;
+};
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static double	super_now	    () {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec + tv.tv_usec / 1000000.0);
+}
+
+static uint64_t super_random	    (uint64_t& s) {
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return (s);
+}
+
+// The same semantics as the step engine on the decoded instruction, minus
+// timing and bounds (the memory covers every address an operand can form).
+
+static inline void super_execute    (const DecodedInst& d, SuperState& s) {
+    switch (d.op) {
+	case OP_LOAD:  s.reg[d.ra] = s.mem[(uint8_t)d.imm]; break;
+	case OP_STORE: s.mem[(uint8_t)d.imm] = s.reg[d.ra]; break;
+	case OP_ADD:   s.reg[d.ra] = s.reg[d.rb] + s.reg[d.rc]; break;
+	case OP_SUB:   s.reg[d.ra] = s.reg[d.rb] - s.reg[d.rc]; break;
+	case OP_LOADC: s.reg[d.ra] = d.imm; break;
+	case OP_MOVR:  s.reg[d.ra] = s.mem[s.reg[d.rb] + d.rc]; break;
+    }
+}
+
+static bool	super_same	    (SuperSearch& ss, SuperState& a, SuperState& b) {
+    if (memcmp(a.reg, b.reg, sizeof(a.reg)) != 0)
+	return (false);
+
+    for (size_t i = 0; i < ss.stores.size(); i++)
+	if (a.mem[ss.stores[i]] != b.mem[ss.stores[i]])
+	    return (false);
+
+    return (true);
+}
+
+static void	super_run	    (SuperSearch& ss, std::vector<size_t>& seq, SuperState& s) {
+    for (size_t i = 0; i < seq.size(); i++)
+	super_execute(ss.alphabet[seq[i]], s);
+}
+
+static void	super_target	    (SuperSearch& ss, SuperState& s) {
+    for (size_t i = 0; i < ss.target.size(); i++)
+	super_execute(ss.target[i], s);
+}
+
+// Sequences of ADD, SUB, LOADC, LOAD and STORE compute an affine function of
+// the registers and the words they read, modulo 2^16.  Two affine functions
+// that agree on zero and on every unit vector agree everywhere, so this is
+// an exhaustive check over the whole register and memory domain.
+
+static bool	super_prove	    (SuperSearch& ss, SuperWorker& w, std::vector<size_t>& seq) {
+    size_t  dims = RF_SIZE + ss.inputs.size();
+
+    for (size_t d = 0; d <= dims; d++) {
+	memset(w.proof.reg, 0, sizeof(w.proof.reg));
+	std::fill(w.proof.mem.begin(), w.proof.mem.end(), 0);
+
+	if (d < RF_SIZE)
+	    w.proof.reg[d] = 1;
+	else if (d < dims)
+	    w.proof.mem[ss.inputs[d - RF_SIZE]] = 1;
+
+	w.scratch = w.proof;
+	super_target(ss, w.proof);
+	super_run(ss, seq, w.scratch);
+	if (!super_same(ss, w.proof, w.scratch))
+	    return (false);
+    }
+
+    return (true);
+}
+
+static bool	super_check	    (SuperSearch& ss, SuperWorker& w, std::vector<size_t>& seq) {
+    for (size_t v = 1; v < ss.vectors.size(); v++) {
+	w.scratch = ss.vectors[v];
+	super_run(ss, seq, w.scratch);
+	if (!super_same(ss, w.scratch, ss.expected[v]))
+	    return (false);
+    }
+
+    return (true);
+}
+
+// Depth-first over the alphabet with an undo log, so each candidate costs
+// one instruction on top of its prefix for the first test vector.
+
+static void	super_search	    (SuperWorker& w, size_t depth) {
+    SuperSearch& ss = *w.search;
+
+    if (depth == ss.length) {
+	w.candidates++;
+	if (!super_same(ss, w.state, ss.expected[0]))
+	    return;
+
+	w.survivors++;
+	if (!super_check(ss, w, w.sequence) || (ss.affine && !super_prove(ss, w, w.sequence)))
+	    return;
+
+	pthread_mutex_lock(&ss.lock);
+	if (!ss.found || w.sequence < ss.best) {
+	    ss.best  = w.sequence;
+	    ss.found = true;
+	}
+	pthread_mutex_unlock(&ss.lock);
+	return;
+    }
+
+    for (size_t a = 0; a < ss.alphabet.size(); a++) {
+	const DecodedInst& d   = ss.alphabet[a];
+	size_t		   log = w.undo.size();
+	SuperUndo	   u;
+
+	u.word	= (d.op == OP_STORE ? &w.state.mem[(uint8_t)d.imm] : &w.state.reg[d.ra]);
+	u.value = *u.word;
+	w.undo.push_back(u);
+
+	w.sequence[depth] = a;
+	super_execute(d, w.state);
+	super_search(w, depth + 1);
+
+	*w.undo[log].word = w.undo[log].value;
+	w.undo.resize(log);
+    }
+}
+
+static void    *super_worker	    (void *arg) {
+    SuperWorker *w  = (SuperWorker *)arg;
+    SuperSearch& ss = *w->search;
+    size_t	 first;
+    bool	 done;
+
+    w->sequence.assign(ss.length, 0);
+
+    while (true) {
+	pthread_mutex_lock(&ss.lock);
+	first = ss.next++;
+	done  = (ss.found && ss.length > 0 && first > ss.best[0]);
+	pthread_mutex_unlock(&ss.lock);
+
+	// Nothing after the best candidate so far can replace it
+	if (done || first >= std::max<size_t>(ss.alphabet.size(), 1) || (ss.length == 0 && first > 0))
+	    break;
+
+	w->state = ss.vectors[0];
+	w->undo.clear();
+
+	if (ss.length == 0) {
+	    super_search(*w, 0);
+	    continue;
+	}
+
+	w->sequence[0] = first;
+	super_execute(ss.alphabet[first], w->state);
+	super_search(*w, 1);
+    }
+
+    return (NULL);
+}
+
+// Registers and addresses are renamed in order of first use, so the result
+// is a pattern for any distinct registers and words.
+
+static bool	super_parse	    (TextList& text, std::vector<DecodedInst>& target, std::vector<long>& regs,
+				     std::vector<std::string>& addrs, bool& movr, std::string& error) {
+    std::map<long, long>	reg_map;
+    std::map<std::string, long> addr_map;
+
+    movr = false;
+    for (size_t i = 0; i < text.size(); i++)
+	if (text[i][0] == "MOVR")
+	    movr = true;
+
+    for (size_t i = 0; i < text.size(); i++) {
+	Tokens&	    t = text[i];
+	long	    r[3] = { 0, 0, 0 };
+	size_t	    nr	 = 0;
+	long	    imm	 = 0;
+	OPCODE	    op;
+	std::string	a;
+
+	for (size_t j = 1; j < t.size(); j++) {
+	    if (token_is_register(t[j]) && nr < 3) {
+		long v = strtol(t[j].substr(1).c_str(), NULL, 10);
+
+		if (v < 0 || v >= (long)RF_SIZE)
+		    goto SP_ERROR;
+		if (reg_map.find(v) == reg_map.end()) {
+		    reg_map[v] = regs.size();
+		    regs.push_back(v);
+		}
+		r[nr++] = reg_map[v];
+	    } else if (token_is_constant(t[j])) {
+		imm = strtol(t[j].substr(1).c_str(), NULL, 10);
+	    } else if (token_is_label(t[j]) || token_is_number(t[j])) {
+		a = t[j];
+	    } else {
+		goto SP_ERROR;
+	    }
+	}
+
+	// MOVR reaches absolute addresses, so its snippets keep numeric ones
+	if (a.size()) {
+	    if (movr && !token_is_number(a)) {
+		error = "MOVR snippets need numeric addresses (" + tokens_to_string(t) + ")";
+		return (false);
+	    }
+	    if (addr_map.find(a) == addr_map.end()) {
+		addr_map[a] = (movr ? strtol(a.c_str(), NULL, 10) & 0xff : addrs.size());
+		addrs.push_back(a);
+	    }
+	    imm = addr_map[a];
+	}
+
+	if ((t[0] == "ADD" || t[0] == "SUB") && t.size() == 4 && nr == 3)
+	    op = (t[0] == "ADD" ? OP_ADD : OP_SUB);
+	else if (t[0] == "MOV" && t.size() == 3 && nr == 1 && token_is_constant(t[2]))
+	    op = OP_LOADC;
+	else if (t[0] == "MOV" && t.size() == 3 && nr == 1 && a.size() && token_is_register(t[1]))
+	    op = OP_LOAD;
+	else if (t[0] == "MOV" && t.size() == 3 && nr == 1 && a.size())
+	    op = OP_STORE;
+	else if (t[0] == "MOVR" && t.size() == 4 && nr == 2 && token_is_constant(t[3]))
+	    op = OP_MOVR;
+	else
+	    goto SP_ERROR;
+
+	if (op == OP_ADD || op == OP_SUB)
+	    target.push_back(DecodeTable[isa_encode(op, r[0], r[1], r[2]).to_ulong()]);
+	else if (op == OP_MOVR)
+	    target.push_back(DecodeTable[isa_encode(op, r[0], r[1], imm).to_ulong()]);
+	else
+	    target.push_back(DecodeTable[isa_encode(op, r[0], imm).to_ulong()]);
+	continue;
+
+SP_ERROR:
+	error = "only straight-line ADD, SUB, MOV and MOVR are searched (" + tokens_to_string(t) + ")";
+	return (false);
+    }
+
+    return (true);
+}
+
+static Tokens	super_tokens	    (const DecodedInst& d, bool movr) {
+    std::ostringstream	ss;
+    std::ostringstream	a;
+    std::string		line;
+
+    // Numeric for MOVR snippets, otherwise the address variable
+    a << (movr ? "" : "A") << (long)(uint8_t)d.imm;
+
+    switch (d.op) {
+	case OP_LOAD:  ss << "MOV R" << (int)d.ra << " " << a.str(); break;
+	case OP_STORE: ss << "MOV " << a.str() << " R" << (int)d.ra; break;
+	case OP_ADD:   ss << "ADD R" << (int)d.ra << " R" << (int)d.rb << " R" << (int)d.rc; break;
+	case OP_SUB:   ss << "SUB R" << (int)d.ra << " R" << (int)d.rb << " R" << (int)d.rc; break;
+	case OP_LOADC: ss << "MOV R" << (int)d.ra << " #" << d.imm; break;
+	case OP_MOVR:  ss << "MOVR R" << (int)d.ra << " R" << (int)d.rb << " #" << (int)d.rc; break;
+    }
+
+    line = ss.str();
+    return (tokenize(line));
+}
+
+//------------------------------------------------------------------------------
+// Superoptimize
+//------------------------------------------------------------------------------
+
+// Searches lengths from zero up to one less than the target for the first
+// sequence of ADD, SUB, LOADC, LOAD, STORE and MOVR over the target's
+// registers, addresses and constants (plus 0, 1, -1 and the constants the
+// target computes) that leaves every register and memory word as the target
+// does.  The first instruction of each candidate is handed out to the
+// workers in turn, so results do not depend on the number of threads.
+
+bool		superoptimize	    (TextList& text, size_t max_length, size_t threads, Rewrite& result, SuperStats& stats, std::string& error) {
+    std::vector<SuperWorker>	workers;
+    std::vector<std::string>	addrs;
+    std::vector<long>		regs;
+    std::vector<long>		constants;
+    std::vector<long>		offsets;
+    std::vector<size_t>		loads;
+    SuperSearch			ss;
+    uint64_t			seed = 0x9e3779b97f4a7c15ULL;
+    double			start = super_now();
+    bool			movr;
+
+    stats.alphabet = stats.candidates = stats.survivors = 0;
+
+    if (!super_parse(text, ss.target, regs, addrs, movr, error))
+	return (false);
+
+    if (threads == 0)
+	threads = 1;
+    if (max_length == 0 || max_length >= ss.target.size())
+	max_length = ss.target.size() - 1;
+
+    ss.affine = !movr;
+
+    // Test vectors are random registers and memory
+    ss.vectors.resize(SuperVectors + (ss.affine ? 0 : SuperTests));
+    for (size_t v = 0; v < ss.vectors.size(); v++) {
+	ss.vectors[v].mem.resize(movr ? SuperWideMemory : SuperMemory);
+	for (size_t r = 0; r < RF_SIZE; r++)
+	    ss.vectors[v].reg[r] = super_random(seed);
+	for (size_t a = 0; a < ss.vectors[v].mem.size(); a++)
+	    ss.vectors[v].mem[a] = super_random(seed);
+    }
+
+    constants.push_back(0);
+    constants.push_back(1);
+    constants.push_back(-1);
+
+    for (size_t i = 0; i < ss.target.size(); i++) {
+	DecodedInst& d = ss.target[i];
+
+	if (d.op == OP_LOADC)
+	    constants.push_back(d.imm);
+	if (d.op == OP_MOVR)
+	    offsets.push_back(d.rc);
+	if (d.op == OP_LOAD || d.op == OP_STORE)
+	    loads.push_back((uint8_t)d.imm);
+	if (d.op == OP_STORE)
+	    ss.stores.push_back((uint8_t)d.imm);
+    }
+
+    // Values the target writes that are the same whatever the input are
+    // constants a shorter sequence may load directly
+    for (size_t i = 0; i < ss.target.size(); i++) {
+	SuperState  a = ss.vectors[0];
+	SuperState  b = ss.vectors[1];
+	long	    va;
+	long	    vb;
+
+	for (size_t j = 0; j <= i; j++) {
+	    super_execute(ss.target[j], a);
+	    super_execute(ss.target[j], b);
+	}
+
+	va = (ss.target[i].op == OP_STORE ? a.mem[(uint8_t)ss.target[i].imm] : a.reg[ss.target[i].ra]);
+	vb = (ss.target[i].op == OP_STORE ? b.mem[(uint8_t)ss.target[i].imm] : b.reg[ss.target[i].ra]);
+	if (va == vb && (int16_t)va >= -128 && (int16_t)va <= 127)
+	    constants.push_back((int16_t)va);
+    }
+
+    std::sort(constants.begin(), constants.end());
+    constants.erase(std::unique(constants.begin(), constants.end()), constants.end());
+    std::sort(offsets.begin(), offsets.end());
+    offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+    std::sort(loads.begin(), loads.end());
+    loads.erase(std::unique(loads.begin(), loads.end()), loads.end());
+    std::sort(ss.stores.begin(), ss.stores.end());
+    ss.stores.erase(std::unique(ss.stores.begin(), ss.stores.end()), ss.stores.end());
+    ss.inputs = loads;
+
+    // ADD is commutative, so only one operand order is tried
+    for (size_t a = 0; a < regs.size(); a++) {
+	for (size_t b = 0; b < regs.size(); b++) {
+	    for (size_t c = 0; c < regs.size(); c++) {
+		if (b <= c)
+		    ss.alphabet.push_back(DecodeTable[isa_encode(OP_ADD, a, b, c).to_ulong()]);
+		ss.alphabet.push_back(DecodeTable[isa_encode(OP_SUB, a, b, c).to_ulong()]);
+	    }
+	    for (size_t o = 0; o < offsets.size(); o++)
+		ss.alphabet.push_back(DecodeTable[isa_encode(OP_MOVR, a, b, offsets[o]).to_ulong()]);
+	}
+	for (size_t c = 0; c < constants.size(); c++)
+	    ss.alphabet.push_back(DecodeTable[isa_encode(OP_LOADC, a, constants[c]).to_ulong()]);
+	for (size_t l = 0; l < loads.size(); l++)
+	    ss.alphabet.push_back(DecodeTable[isa_encode(OP_LOAD, a, loads[l]).to_ulong()]);
+	for (size_t s = 0; s < ss.stores.size(); s++)
+	    ss.alphabet.push_back(DecodeTable[isa_encode(OP_STORE, a, ss.stores[s]).to_ulong()]);
+    }
+    stats.alphabet = ss.alphabet.size();
+
+    ss.expected = ss.vectors;
+    for (size_t v = 0; v < ss.expected.size(); v++)
+	super_target(ss, ss.expected[v]);
+
+    pthread_mutex_init(&ss.lock, NULL);
+    ss.found = false;
+
+    workers.resize(threads);
+    for (ss.length = 0; ss.length <= max_length && !ss.found; ss.length++) {
+	ss.next = 0;
+
+	for (size_t t = 0; t < threads; t++) {
+	    workers[t].search	  = &ss;
+	    workers[t].candidates = workers[t].survivors = 0;
+	    workers[t].scratch	  = ss.vectors[0];
+	    workers[t].proof	  = ss.vectors[0];
+	    pthread_create(&workers[t].thread, NULL, super_worker, &workers[t]);
+	}
+	for (size_t t = 0; t < threads; t++) {
+	    pthread_join(workers[t].thread, NULL);
+	    stats.candidates += workers[t].candidates;
+	    stats.survivors  += workers[t].survivors;
+	}
+    }
+
+    pthread_mutex_destroy(&ss.lock);
+    stats.seconds = super_now() - start;
+
+    if (!ss.found) {
+	error = "no shorter sequence";
+	return (false);
+    }
+
+    result.pattern.clear();
+    result.replacement.clear();
+    for (size_t i = 0; i < ss.target.size(); i++)
+	result.pattern.push_back(super_tokens(ss.target[i], movr));
+    for (size_t i = 0; i < ss.best.size(); i++)
+	result.replacement.push_back(super_tokens(ss.alphabet[ss.best[i]], movr));
+
+    result.proved = ss.affine;
+
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
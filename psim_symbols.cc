@@ -0,0 +1,199 @@
+//------------------------------------------------------------------------------
+// psim_symbols.cc: psim source map symbols
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Global Constants
+//------------------------------------------------------------------------------
+
+static const std::string NoSymbol;
+
+//------------------------------------------------------------------------------
+// Load Symbols
+//------------------------------------------------------------------------------
+
+bool		load_symbols	    (std::istream& in, SymbolTable& st) {
+    std::string	line;
+    std::string	text_label;
+    std::string	data_label;
+    size_t	text_addr;
+    size_t	data_addr;
+    bool	unified;
+    Tokens	tokens;
+    SourceLine	sl;
+
+    st.file.clear();
+    st.lines.clear();
+    st.names.clear();
+    st.locations.clear();
+    st.strings.clear();
+    st.labels.clear();
+
+    if (!getline(in, line) || line != "psim-map 1")
+	return (false);
+
+    unified = true;
+
+    while (getline(in, line)) {
+	trim_whitespace(line);
+	if (line.size() == 0)
+	    continue;
+
+	tokens = tokenize(line);
+
+	if (tokens[0] == "memory") {
+	    unified = (tokens.size() == 2 && tokens[1] == "unified");
+	} else if (tokens[0] == "file") {
+	    st.file = line.substr(line.find_first_not_of(" \t", 4));
+	} else if (tokens.size() >= 3 && token_is_number(tokens[0]) && token_is_number(tokens[1])) {
+	    sl.address = strtol(tokens[0].c_str(), NULL, 10);
+	    sl.line    = strtol(tokens[1].c_str(), NULL, 10);
+	    sl.data    = (tokens[2] == "D");
+	    sl.label   = (tokens.size() > 3 ? tokens[3] : "");
+
+	    // Split memory data addresses overlap the text and cannot be loaded
+	    if (sl.data && !unified)
+		continue;
+
+	    if (st.lines.size() <= sl.address) {
+		SourceLine	empty;
+
+		empty.address = 0;
+		empty.line    = 0;
+		empty.data    = false;
+		st.lines.resize(sl.address + 1, empty);
+	    }
+
+	    st.lines[sl.address] = sl;
+	    if (sl.label.size())
+		st.labels[sl.label] = sl.address;
+	} else {
+	    return (false);
+	}
+    }
+
+    // Precompute names and locations so lookups (once per traced
+    // instruction) are a single index
+    st.names.resize(st.lines.size());
+    st.locations.resize(st.lines.size());
+    st.strings.resize(st.lines.size());
+    text_addr = data_addr = 0;
+    for (size_t a = 0; a < st.lines.size(); a++) {
+	std::string&	   label = (st.lines[a].data ? data_label : text_label);
+	size_t&		   addr	 = (st.lines[a].data ? data_addr : text_addr);
+	std::ostringstream ss;
+	std::ostringstream ls;
+
+	if (st.lines[a].line == 0)
+	    continue;
+
+	if (st.lines[a].label.size()) {
+	    label = st.lines[a].label;
+	    addr  = a;
+	}
+
+	if (label.size()) {
+	    ss << label;
+	    if (a > addr)
+		ss << "+" << a - addr;
+	    st.names[a] = ss.str();
+	}
+
+	ls << st.file << ":" << st.lines[a].line;
+	st.locations[a] = ls.str();
+	st.strings[a]	= (st.names[a].empty() ? st.locations[a] : st.names[a] + " (" + st.locations[a] + ")");
+    }
+
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Symbol Address
+//------------------------------------------------------------------------------
+
+long		symbol_address	    (SymbolTable& st, std::string s) {
+    std::string	offset;
+    size_t	i;
+    long	a;
+
+    if ((i = s.find('+')) != std::string::npos) {
+	offset = s.substr(i + 1);
+	s      = s.substr(0, i);
+	if (!token_is_number(offset))
+	    return (-1);
+    }
+
+    a = get_label_value(st.labels, s);
+    if (a >= 0 && offset.size())
+	a += strtol(offset.c_str(), NULL, 10);
+
+    return (a);
+}
+
+//------------------------------------------------------------------------------
+// Symbol Location
+//------------------------------------------------------------------------------
+
+const std::string& symbol_location (SymbolTable *st, size_t a) {
+    if (st == NULL || a >= st->locations.size())
+	return (NoSymbol);
+
+    return (st->locations[a]);
+}
+
+//------------------------------------------------------------------------------
+// Symbol Name
+//------------------------------------------------------------------------------
+
+const std::string& symbol_name	   (SymbolTable *st, size_t a) {
+    if (st == NULL || a >= st->names.size())
+	return (NoSymbol);
+
+    return (st->names[a]);
+}
+
+//------------------------------------------------------------------------------
+// Symbol String
+//------------------------------------------------------------------------------
+
+const std::string& symbol_string   (SymbolTable *st, size_t a) {
+    if (st == NULL || a >= st->strings.size())
+	return (NoSymbol);
+
+    return (st->strings[a]);
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
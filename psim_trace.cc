@@ -0,0 +1,454 @@
+//------------------------------------------------------------------------------
+// psim_trace.cc: psim binary instruction traces
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <zlib.h>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Global Constants
+//------------------------------------------------------------------------------
+
+static const char  *TraceMagic	    = "psim-trace 1\n";
+static const char  *TraceTrailer    = "psimidx1";	// Last 8 bytes of the file
+static const size_t TraceChunkSteps = 1 << 16;		// Records per compressed chunk
+static const size_t TraceIndexEntry = 28;		// Bytes per chunk in the index
+static const size_t TraceValues	    = RF_SIZE + PRF_SIZE;	// Addresses follow the registers
+
+// Record flags: the low two bits are the TRACE_KIND and the high four bits
+// the register or pregister written
+static const uint8_t TraceJump	    = 1 << 2;	// pc is not the previous pc plus one
+static const uint8_t TraceWord	    = 1 << 3;	// Instruction word differs from the last one at pc
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static inline void trace_varint	    (std::vector<uint8_t>& b, uint64_t v) {
+    while (v >= 0x80) {
+	b.push_back(v | 0x80);
+	v >>= 7;
+    }
+    b.push_back(v);
+}
+
+static inline bool trace_get_varint (std::vector<uint8_t>& b, size_t& i, uint64_t& v) {
+    v = 0;
+    for (size_t shift = 0; i < b.size() && shift < 64; shift += 7) {
+	v |= (uint64_t)(b[i] & 0x7f) << shift;
+	if ((b[i++] & 0x80) == 0)
+	    return (true);
+    }
+
+    return (false);
+}
+
+static inline uint64_t trace_zigzag (int64_t v) {
+    return (((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static inline int64_t trace_unzigzag (uint64_t v) {
+    return ((int64_t)(v >> 1) ^ -(int64_t)(v & 1));
+}
+
+static void	trace_put	    (std::vector<uint8_t>& b, uint64_t v, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++)
+	b.push_back(v >> (8 * i));
+}
+
+static uint64_t trace_get	    (const uint8_t *b, size_t bytes) {
+    uint64_t v = 0;
+
+    for (size_t i = 0; i < bytes; i++)
+	v |= (uint64_t)b[i] << (8 * i);
+
+    return (v);
+}
+
+static size_t	trace_slot	    (uint8_t kind, size_t location) {
+    return (kind == TK_REGISTER ? location : kind == TK_PREGISTER ? RF_SIZE + location : TraceValues + location);
+}
+
+static void	trace_reset	    (TraceFile& tf) {
+    tf.raw.clear();
+    tf.records = 0;
+    tf.pc      = 0;
+    std::fill(tf.words.begin(), tf.words.end(), 0);
+    std::fill(tf.values.begin(), tf.values.end(), 0);
+}
+
+static bool	trace_flush	    (TraceFile& tf) {
+    TraceChunk	c;
+    uLongf	bytes;
+
+    if (tf.records == 0)
+	return (true);
+
+    bytes = compressBound(tf.raw.size());
+    tf.packed.resize(bytes);
+    if (compress2(&tf.packed[0], &bytes, &tf.raw[0], tf.raw.size(), 1) != Z_OK)
+	return (false);
+
+    c.offset = tf.offset;
+    c.first  = tf.steps - tf.records;
+    c.steps  = tf.records;
+    c.bytes  = bytes;
+    c.raw    = tf.raw.size();
+    tf.index.push_back(c);
+
+    tf.offset += bytes;
+    trace_reset(tf);
+
+    return (fwrite(&tf.packed[0], 1, bytes, tf.file) == bytes);
+}
+
+// Each record is a flags byte, the pc as a difference from the expected one
+// when control transferred, the instruction word when it is not the last one
+// seen at that pc, the address for a memory write and the written value as a
+// difference from the last value written to the same place.
+
+static void	trace_encode	    (TraceFile& tf, size_t pc, uint16_t ir, uint8_t kind, size_t location, uint16_t value) {
+    uint8_t flags = kind;
+    size_t  slot;
+
+    if (pc >= tf.words.size())
+	tf.words.resize(pc + 1, 0);
+    if (pc != tf.pc)
+	flags |= TraceJump;
+    if (tf.words[pc] != ir)
+	flags |= TraceWord;
+    if (kind == TK_REGISTER || kind == TK_PREGISTER)
+	flags |= location << 4;
+
+    tf.raw.push_back(flags);
+    if (flags & TraceJump)
+	trace_varint(tf.raw, trace_zigzag((int64_t)pc - (int64_t)tf.pc));
+    if (flags & TraceWord)
+	trace_put(tf.raw, ir, 2);
+
+    if (kind != TK_NONE) {
+	if (kind == TK_MEMORY)
+	    trace_varint(tf.raw, location);
+
+	slot = trace_slot(kind, location);
+	if (slot >= tf.values.size())
+	    tf.values.resize(slot + 1, 0);
+	trace_varint(tf.raw, trace_zigzag((int16_t)(uint16_t)(value - tf.values[slot])));
+	tf.values[slot] = value;
+    }
+
+    tf.words[pc] = ir;
+    tf.pc	 = pc + 1;
+}
+
+// The value an instruction wrote is read back from the machine after it ran
+static void	trace_complete	    (TraceFile& tf, Machine& mc) {
+    const DecodedInst& d    = DecodeTable[tf.pending_ir];
+    uint8_t	       kind = TK_NONE;
+    size_t	       loc  = 0;
+    uint16_t	       v    = 0;
+
+    switch (d.op) {
+	case OP_LOAD:
+	case OP_ADD:
+	case OP_LOADC:
+	case OP_SUB:
+	case OP_MOVR:
+	    kind = TK_REGISTER;
+	    loc	 = d.ra;
+	    break;
+	case OP_STORE:
+	    kind = TK_MEMORY;
+	    loc	 = (uint8_t)d.imm;
+	    break;
+	case OP_IO:
+	    kind = (d.rc ? TK_PREGISTER : TK_REGISTER);
+	    loc	 = (d.rc ? d.rb : d.ra);
+	    break;
+    }
+
+    if (kind == TK_REGISTER)
+	v = mc.regfile[loc].to_ulong();
+    else if (kind == TK_PREGISTER)
+	v = mc.pregfile[loc].to_ulong();
+    else if (kind == TK_MEMORY)
+	v = memory_word(mc, loc);
+
+    trace_encode(tf, tf.pending_pc, tf.pending_ir, kind, loc, v);
+    tf.pending = false;
+    tf.steps++;
+
+    if (++tf.records == TraceChunkSteps)
+	trace_flush(tf);
+}
+
+//------------------------------------------------------------------------------
+// Tracefile Open
+//------------------------------------------------------------------------------
+
+bool		tracefile_open	    (TraceFile& tf, const std::string& path) {
+    if ((tf.file = fopen(path.c_str(), "wb")) == NULL)
+	return (false);
+
+    tf.index.clear();
+    tf.words.assign(1 << 8, 0);
+    tf.values.assign(TraceValues + (1 << 8), 0);
+    tf.steps   = 0;
+    tf.offset  = strlen(TraceMagic);
+    tf.pending = false;
+    trace_reset(tf);
+
+    return (fwrite(TraceMagic, 1, tf.offset, tf.file) == tf.offset);
+}
+
+//------------------------------------------------------------------------------
+// Tracefile Record
+//------------------------------------------------------------------------------
+
+// Called before the instruction at pc executes; the previous instruction's
+// record is completed now that its result is in the machine.
+
+void		tracefile_record    (TraceFile& tf, Machine& mc, size_t pc, uint16_t ir) {
+    if (tf.pending)
+	trace_complete(tf, mc);
+
+    tf.pending	  = true;
+    tf.pending_pc = pc;
+    tf.pending_ir = ir;
+}
+
+//------------------------------------------------------------------------------
+// Tracefile Finish
+//------------------------------------------------------------------------------
+
+void		tracefile_finish    (TraceFile& tf, Machine& mc) {
+    if (tf.pending)
+	trace_complete(tf, mc);
+}
+
+//------------------------------------------------------------------------------
+// Tracefile Close
+//------------------------------------------------------------------------------
+
+// The index follows the last chunk, with its offset, the number of chunks
+// and the trailer in the last 24 bytes, so a reader finds it with one seek.
+
+bool		tracefile_close	    (TraceFile& tf) {
+    std::vector<uint8_t> b;
+    bool		 ok;
+
+    if (tf.file == NULL)
+	return (false);
+
+    ok = trace_flush(tf);
+
+    for (size_t c = 0; c < tf.index.size(); c++) {
+	trace_put(b, tf.index[c].offset, 8);
+	trace_put(b, tf.index[c].first, 8);
+	trace_put(b, tf.index[c].steps, 4);
+	trace_put(b, tf.index[c].bytes, 4);
+	trace_put(b, tf.index[c].raw, 4);
+    }
+    trace_put(b, tf.offset, 8);
+    trace_put(b, tf.index.size(), 8);
+    b.insert(b.end(), TraceTrailer, TraceTrailer + 8);
+
+    ok = (fwrite(&b[0], 1, b.size(), tf.file) == b.size()) && ok;
+    ok = (fclose(tf.file) == 0) && ok;
+    tf.file = NULL;
+
+    return (ok);
+}
+
+//------------------------------------------------------------------------------
+// Tracefile Index
+//------------------------------------------------------------------------------
+
+bool		tracefile_index	    (FILE *f, std::vector<TraceChunk>& index) {
+    char		 magic[32];
+    uint8_t		 trailer[24];
+    std::vector<uint8_t> b;
+    uint64_t		 offset;
+    uint64_t		 chunks;
+
+    index.clear();
+
+    if (fseeko(f, 0, SEEK_SET) != 0 || fread(magic, 1, strlen(TraceMagic), f) != strlen(TraceMagic) ||
+	memcmp(magic, TraceMagic, strlen(TraceMagic)) != 0)
+	return (false);
+
+    if (fseeko(f, -24, SEEK_END) != 0 || fread(trailer, 1, 24, f) != 24 || memcmp(trailer + 16, TraceTrailer, 8) != 0)
+	return (false);
+
+    offset = trace_get(trailer, 8);
+    chunks = trace_get(trailer + 8, 8);
+
+    b.resize(chunks * TraceIndexEntry + 1);
+    if (fseeko(f, offset, SEEK_SET) != 0 || fread(&b[0], 1, chunks * TraceIndexEntry, f) != chunks * TraceIndexEntry)
+	return (false);
+
+    for (size_t c = 0; c < chunks; c++) {
+	const uint8_t *e = &b[c * TraceIndexEntry];
+	TraceChunk     tc;
+
+	tc.offset = trace_get(e, 8);
+	tc.first  = trace_get(e + 8, 8);
+	tc.steps  = trace_get(e + 16, 4);
+	tc.bytes  = trace_get(e + 20, 4);
+	tc.raw	  = trace_get(e + 24, 4);
+	index.push_back(tc);
+    }
+
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Tracefile Read
+//------------------------------------------------------------------------------
+
+bool		tracefile_read	    (FILE *f, const TraceChunk& c, std::vector<uint8_t>& packed) {
+    packed.resize(c.bytes);
+
+    return (fseeko(f, c.offset, SEEK_SET) == 0 && fread(&packed[0], 1, c.bytes, f) == c.bytes);
+}
+
+//------------------------------------------------------------------------------
+// Tracefile Decode
+//------------------------------------------------------------------------------
+
+bool		tracefile_decode    (const TraceChunk& c, std::vector<uint8_t>& packed, std::vector<TraceStep>& steps) {
+    std::vector<uint8_t>  raw(c.raw);
+    std::vector<uint16_t> words(1 << 8, 0);
+    std::vector<uint16_t> values(TraceValues + (1 << 8), 0);
+    uLongf		  bytes = c.raw;
+    size_t		  i	= 0;
+    size_t		  pc	= 0;
+    uint64_t		  v;
+
+    steps.clear();
+
+    if (uncompress(&raw[0], &bytes, &packed[0], packed.size()) != Z_OK || bytes != c.raw)
+	return (false);
+
+    for (size_t r = 0; r < c.steps; r++) {
+	TraceStep ts;
+	uint8_t	  flags;
+	size_t	  slot;
+
+	if (i >= raw.size())
+	    return (false);
+	flags = raw[i++];
+
+	ts.step	    = c.first + r;
+	ts.kind	    = flags & 3;
+	ts.location = flags >> 4;
+	ts.value    = 0;
+	ts.pc	    = pc;
+
+	if (flags & TraceJump) {
+	    if (!trace_get_varint(raw, i, v))
+		return (false);
+	    ts.pc = pc + trace_unzigzag(v);
+	}
+	if (ts.pc >= words.size())
+	    words.resize(ts.pc + 1, 0);
+	if (flags & TraceWord) {
+	    if (i + 2 > raw.size())
+		return (false);
+	    words[ts.pc] = trace_get(&raw[i], 2);
+	    i += 2;
+	}
+	ts.ir = words[ts.pc];
+
+	if (ts.kind != TK_NONE) {
+	    if (ts.kind == TK_MEMORY && !trace_get_varint(raw, i, v))
+		return (false);
+	    if (ts.kind == TK_MEMORY)
+		ts.location = v;
+
+	    slot = trace_slot(ts.kind, ts.location);
+	    if (slot >= values.size())
+		values.resize(slot + 1, 0);
+	    if (!trace_get_varint(raw, i, v))
+		return (false);
+	    values[slot] += trace_unzigzag(v);
+	    ts.value	  = values[slot];
+	}
+
+	pc = ts.pc + 1;
+	steps.push_back(ts);
+    }
+
+    return (i == raw.size());
+}
+
+//------------------------------------------------------------------------------
+// Tracefile String
+//------------------------------------------------------------------------------
+
+std::string	tracefile_string    (TraceStep& ts) {
+    std::ostringstream ss;
+    char	       text[ISA_FORMAT_SIZE];
+
+    ss << "[" << ts.step << "] [PC = " << std::setfill('0') << std::setw(6) << ts.pc << "] "
+       << "Inst = " << dword_to_pretty_string(DWord(ts.ir))
+       << " -> " << std::string(text, isa_format(text, ts.ir));
+
+    if (ts.kind == TK_REGISTER)
+	ss << " (R" << ts.location;
+    else if (ts.kind == TK_PREGISTER)
+	ss << " (P" << ts.location;
+    else if (ts.kind == TK_MEMORY)
+	ss << " (M[" << ts.location << "]";
+    if (ts.kind != TK_NONE)
+	ss << " = " << (int16_t)ts.value << ")";
+
+    return (ss.str());
+}
+
+//------------------------------------------------------------------------------
+// Print Tracefile
+//------------------------------------------------------------------------------
+
+void		print_tracefile	    (TraceFile& tf) {
+    std::cout << "Binary trace: " << tf.steps << " steps in " << tf.index.size() << " chunks, "
+	      << tf.offset << " bytes written" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
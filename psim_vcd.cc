@@ -0,0 +1,311 @@
+//------------------------------------------------------------------------------
+// psim_vcd.cc: psim VCD waveform export
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Global Constants
+//------------------------------------------------------------------------------
+
+static const size_t WaveBuffer	= 1 << 20;	// Bytes collected before each write
+static const size_t WaveSlack	= 128;		// Room for a timestamp and a change
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static std::string wave_name	    (size_t s) {
+    std::ostringstream ss;
+
+    if (s == WS_PC)
+	return ("pc");
+    if (s == WS_IR)
+	return ("ir");
+
+    if (s < WS_PREGFILE)
+	ss << "r" << s - WS_REGFILE;
+    else
+	ss << "p" << s - WS_PREGFILE;
+
+    return (ss.str());
+}
+
+static void	wave_flush	    (Waveform& wf) {
+    if (wf.used)
+	fwrite(&wf.buffer[0], 1, wf.used, wf.file);
+
+    wf.bytes += wf.used;
+    wf.used   = 0;
+}
+
+static inline void wave_put	    (Waveform& wf, const char *s, size_t n) {
+    if (wf.used + n > wf.buffer.size())
+	wave_flush(wf);
+
+    memcpy(&wf.buffer[wf.used], s, n);
+    wf.used += n;
+}
+
+static inline void wave_time	    (Waveform& wf, size_t t) {
+    char    text[32];
+    char   *p = text + sizeof(text);
+
+    *--p = '\n';
+    do {
+	*--p = '0' + t % 10;
+	t   /= 10;
+    } while (t);
+    *--p = '#';
+
+    wave_put(wf, p, text + sizeof(text) - p);
+}
+
+// Vectors are written without leading zeros, which VCD zero-extends
+static inline void wave_value	    (Waveform& wf, size_t s, uint16_t v) {
+    char    text[24];
+    char   *p = text + sizeof(text);
+
+    *--p = '\n';
+    *--p = '!' + s;
+    *--p = ' ';
+    do {
+	*--p = '0' + (v & 1);
+	v  >>= 1;
+    } while (v);
+    *--p = 'b';
+
+    wave_put(wf, p, text + sizeof(text) - p);
+}
+
+// Writes the timestamp before the first change at a time, so times at which
+// nothing changed cost nothing.
+
+static inline void wave_change	    (Waveform& wf, size_t s, uint16_t v, size_t t) {
+    if (!(wf.selected & (1U << s)) || wf.value[s] == v)
+	return;
+
+    if (t != wf.time) {
+	wave_time(wf, t);
+	wf.time = t;
+    }
+
+    wave_value(wf, s, v);
+    wf.value[s] = v;
+    wf.changes++;
+}
+
+static long	wave_written	    (uint16_t w) {
+    const DecodedInst& d = DecodeTable[w];
+
+    switch (d.op) {
+	case OP_LOAD:
+	case OP_ADD:
+	case OP_LOADC:
+	case OP_SUB:
+	case OP_MOVR:
+	    return (WS_REGFILE + d.ra);
+	case OP_IO:
+	    return (d.rc ? WS_PREGFILE + d.rb : WS_REGFILE + d.ra);
+    }
+
+    return (-1);
+}
+
+//------------------------------------------------------------------------------
+// Waveform Select
+//------------------------------------------------------------------------------
+
+bool		waveform_select	    (Tokens& tokens, size_t first, uint32_t& selected) {
+    selected = 0;
+
+    for (size_t t = first; t < tokens.size(); t++) {
+	std::string s	 = tokens[t];
+	std::string rest = (s.size() > 1 ? s.substr(1) : "");
+	long	    n	 = (token_is_number(rest) ? strtol(rest.c_str(), NULL, 10) : -1);
+
+	if (s == "all")
+	    selected |= (1U << WS_SIZE) - 1;
+	else if (s == "pc")
+	    selected |= 1U << WS_PC;
+	else if (s == "ir")
+	    selected |= 1U << WS_IR;
+	else if (s == "r")
+	    selected |= ((1U << RF_SIZE) - 1) << WS_REGFILE;
+	else if (s == "p")
+	    selected |= ((1U << PRF_SIZE) - 1) << WS_PREGFILE;
+	else if (s[0] == 'r' && n >= 0 && n < (long)RF_SIZE)
+	    selected |= 1U << (WS_REGFILE + n);
+	else if (s[0] == 'p' && n >= 0 && n < (long)PRF_SIZE)
+	    selected |= 1U << (WS_PREGFILE + n);
+	else
+	    return (false);
+    }
+
+    if (selected == 0)
+	selected = (1U << WS_SIZE) - 1;
+
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Waveform Open
+//------------------------------------------------------------------------------
+
+// A .gz file is compressed on the fly by a gzip process at its fastest level,
+// so compression runs in parallel with the simulation.
+
+bool		waveform_open	    (Waveform& wf, const std::string& path, uint32_t selected) {
+    std::ostringstream header;
+
+    wf.piped = (path.size() > 3 && path.compare(path.size() - 3, 3, ".gz") == 0);
+
+    if (wf.piped) {
+	if (path.find('\'') != std::string::npos)
+	    return (false);
+	wf.file = popen(("gzip -1 -c > '" + path + "'").c_str(), "w");
+    } else {
+	wf.file = fopen(path.c_str(), "w");
+    }
+
+    if (wf.file == NULL)
+	return (false);
+
+    wf.buffer.resize(WaveBuffer);
+    wf.used	= 0;
+    wf.selected = selected;
+    wf.started	= false;
+    wf.time	= 0;
+    wf.offset	= 0;
+    wf.written	= -1;
+    wf.changes	= 0;
+    wf.bytes	= 0;
+
+    header << "$version psim $end\n"
+	   << "$comment one time unit per instruction $end\n"
+	   << "$timescale 1ns $end\n"
+	   << "$scope module psim $end\n";
+    for (size_t s = 0; s < WS_SIZE; s++)
+	if (selected & (1U << s))
+	    header << "$var reg 16 " << (char)('!' + s) << " " << wave_name(s) << " $end\n";
+    header << "$upscope $end\n"
+	   << "$enddefinitions $end\n";
+
+    wave_put(wf, header.str().c_str(), header.str().size());
+    return (true);
+}
+
+//------------------------------------------------------------------------------
+// Waveform Close
+//------------------------------------------------------------------------------
+
+void		waveform_close	    (Waveform& wf) {
+    if (wf.file == NULL)
+	return;
+
+    wave_flush(wf);
+    if (wf.piped)
+	pclose(wf.file);
+    else
+	fclose(wf.file);
+
+    wf.file = NULL;
+}
+
+//------------------------------------------------------------------------------
+// Waveform Sample
+//------------------------------------------------------------------------------
+
+// Called before the instruction at time t executes, so the registers hold
+// what every earlier instruction wrote.  Only the register the previous
+// instruction wrote can have changed, plus the pregisters when devices may
+// have written them; a full sample compares everything (between runs).
+
+void		waveform_sample	    (Waveform& wf, Machine& mc, size_t t, size_t pc, uint16_t ir, bool full) {
+    // Times never go back, even after the machine is reset
+    if (t + wf.offset < wf.time)
+	wf.offset = wf.time - t;
+    t += wf.offset;
+
+    if (!wf.started) {
+	wave_time(wf, t);
+	wave_put(wf, "$dumpvars\n", 10);
+	for (size_t s = 0; s < WS_SIZE; s++) {
+	    wf.value[s] = (s == WS_PC ? pc : s == WS_IR ? ir : s < WS_PREGFILE ?
+			   mc.regfile[s - WS_REGFILE].to_ulong() : mc.pregfile[s - WS_PREGFILE].to_ulong());
+	    if (wf.selected & (1U << s))
+		wave_value(wf, s, wf.value[s]);
+	}
+	wave_put(wf, "$end\n", 5);
+
+	wf.started = true;
+	wf.time	   = t;
+	wf.written = wave_written(ir);
+	return;
+    }
+
+    wave_change(wf, WS_PC, pc, t);
+    wave_change(wf, WS_IR, ir, t);
+
+    if (full) {
+	for (size_t r = 0; r < RF_SIZE; r++)
+	    wave_change(wf, WS_REGFILE + r, mc.regfile[r].to_ulong(), t);
+    } else if (wf.written >= 0 && wf.written < (long)WS_PREGFILE) {
+	wave_change(wf, wf.written, mc.regfile[wf.written - WS_REGFILE].to_ulong(), t);
+    }
+
+    if (full || mc.devices) {
+	for (size_t p = 0; p < PRF_SIZE; p++)
+	    wave_change(wf, WS_PREGFILE + p, mc.pregfile[p].to_ulong(), t);
+    } else if (wf.written >= (long)WS_PREGFILE) {
+	wave_change(wf, wf.written, mc.pregfile[wf.written - WS_PREGFILE].to_ulong(), t);
+    }
+
+    wf.written = wave_written(ir);
+}
+
+//------------------------------------------------------------------------------
+// Print Waveform
+//------------------------------------------------------------------------------
+
+void		print_waveform	    (Waveform& wf) {
+    std::cout << "Waveform: " << wf.changes << " value changes, "
+	      << wf.bytes + wf.used << " bytes" << (wf.piped ? " before compression" : "")
+	      << ", last time " << wf.time << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
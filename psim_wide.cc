@@ -0,0 +1,394 @@
+//------------------------------------------------------------------------------
+// psim_wide.cc: psim word-width generic machine
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+
+#include <bitset>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+// Field positions and masks are folded into each instantiation, so reading an
+// operand is a shift and a mask whatever the word width.
+
+template <size_t W, OPCODE Op, size_t F>
+static inline long wide_operand	    (typename WordTraits<W>::Word w) {
+    constexpr IsaField	    f	 = isa_wide_field<W>(IsaTable[Op].fields[F]);
+    constexpr unsigned long mask = (1UL << f.width) - 1;
+    long		    v	 = (w >> f.shift) & mask;
+
+    return (f.sign && (v >> (f.width - 1)) ? v - (1L << f.width) : v);
+}
+
+template <size_t W>
+static long	wide_field	    (const IsaField& g, typename WordTraits<W>::Word w) {
+    IsaField	f = isa_wide_field<W>(g);
+    long	v = (w >> f.shift) & ((1UL << f.width) - 1);
+
+    return (f.sign && (v >> (f.width - 1)) ? v - (1L << f.width) : v);
+}
+
+template <size_t W>
+static std::string wide_to_pretty_string (typename WordTraits<W>::Word w) {
+    std::stringstream ss;
+    std::string	      bits = std::bitset<W>(w).to_string();
+
+    ss << std::setfill(' ') << std::setw(W == 16 ? 7 : 11) << (long)(typename WordTraits<W>::Signed)w;
+    ss << " 0x" << std::hex << std::setfill('0') << std::setw(W/4) << (unsigned long)w;
+    for (size_t i = 0; i < W/4; i++)
+	ss << " " << bits.substr(i*4, 4);
+
+    return (ss.str());
+}
+
+template <size_t W>
+static std::string wide_header	    (const char *tag) {
+    std::stringstream ss;
+
+    ss << tag << " " << std::setw(W == 16 ? 7 : 11) << "Decimal" << " "
+       << std::left << std::setw(W/4 + 2) << "Hex" << " Binary";
+
+    return (ss.str());
+}
+
+template <size_t W>
+static std::string wide_format	    (typename WordTraits<W>::Word w) {
+    const IsaOp&      op = IsaTable[w >> (W - 4)];
+    std::stringstream ss;
+
+    if (op.name == NULL)
+	return ("???");
+
+    for (const char *f = op.format; *f; f++) {
+	if (*f != '%') {
+	    ss << *f;
+	    continue;
+	}
+
+	f++;
+	for (size_t i = 0; i < 3; i++) {
+	    if ((*f == 'a' && op.fields[i].slot == IS_RA) ||
+		(*f == 'b' && op.fields[i].slot == IS_RB) ||
+		(*f == 'c' && op.fields[i].slot == IS_RC) ||
+		(*f == 'i' && op.fields[i].slot == IS_IMM))
+		ss << wide_field<W>(op.fields[i], w);
+	}
+    }
+
+    return (ss.str());
+}
+
+template <size_t W>
+static void	wide_trace	    (WideMachine<W>& mc, size_t pc, typename WordTraits<W>::Word w) {
+    size_t  op	= w >> (W - 4);
+    long    imm = -1;
+
+    if (IsaTable[op].name == NULL)
+	return;
+    if (op == OP_LOAD || op == OP_STORE)
+	imm = wide_operand<W, OP_LOAD, 1>(w);
+
+    std::cout << "[PC = " << std::setfill('0') << std::setw(6) << pc << "] "
+	      << "Inst = " << wide_to_pretty_string<W>(w)
+	      << " -> " << wide_format<W>(w)
+	      << trace_symbol(mc.symbols, pc, imm)
+	      << std::endl;
+}
+
+template <size_t W>
+static bool	wide_address	    (WideMachine<W>& mc, size_t pc, size_t op, typename WordTraits<W>::Word w, size_t& a) {
+    switch (op) {
+	case OP_LOAD:
+	case OP_STORE:
+	    a = wide_operand<W, OP_LOAD, 1>(w);
+	    break;
+	case OP_MOVR:
+	    a = mc.regfile[wide_operand<W, OP_MOVR, 1>(w)] + wide_operand<W, OP_MOVR, 2>(w);
+	    break;
+	default:
+	    return (true);
+    }
+
+    if (a < mc.memory.size())
+	return (true);
+
+    std::cerr << "Memory access out of bounds at PC " << pc << ": address " << a << std::endl;
+    return (false);
+}
+
+//------------------------------------------------------------------------------
+// Step Generic
+//------------------------------------------------------------------------------
+
+// Runs the 16-bit machine on the word-width template, so the generic engine
+// can be checked against the specialized one on the same images.
+
+size_t		step_generic	    (Machine& mc, size_t s) {
+    WideMachine<16> wm;
+    size_t	    n;
+
+    wm.memory.resize(mc.memory.size());
+    for (size_t a = 0; a < mc.memory.size(); a++)
+	wm.memory[a] = mc.memory[a].to_ulong();
+    for (size_t r = 0; r < RF_SIZE; r++)
+	wm.regfile[r] = mc.regfile[r].to_ulong();
+    for (size_t p = 0; p < PRF_SIZE; p++)
+	wm.pregfile[p] = mc.pregfile[p].to_ulong();
+
+    wm.pc      = mc.pc;
+    wm.steps   = mc.steps;
+    wm.cycles  = mc.cycles;
+    wm.halted  = mc.halted;
+    wm.trace   = mc.trace;
+    wm.cost    = mc.cost;
+    wm.symbols = mc.symbols;
+    wm.control = mc.control;
+
+    n = wide_step(wm, s);
+
+    for (size_t a = 0; a < mc.memory.size(); a++)
+	mc.memory[a] = wm.memory[a];
+    for (size_t r = 0; r < RF_SIZE; r++)
+	mc.regfile[r] = wm.regfile[r];
+    for (size_t p = 0; p < PRF_SIZE; p++)
+	mc.pregfile[p] = wm.pregfile[p];
+
+    mc.pc     = wm.pc;
+    mc.steps  = wm.steps;
+    mc.cycles = wm.cycles;
+    mc.halted = wm.halted;
+
+    return (n);
+}
+
+//------------------------------------------------------------------------------
+// Wide Load
+//------------------------------------------------------------------------------
+
+template <size_t W>
+bool		wide_load	    (std::istream& in, WideMachine<W>& mc) {
+    std::string	word;
+
+    mc.memory.clear();
+
+    while (getline(in, word)) {
+	if (word.size() == W && word.find_first_not_of("01") == std::string::npos)
+	    mc.memory.push_back(strtoul(word.c_str(), NULL, 2));
+    }
+
+    for (size_t r = 0; r < RF_SIZE; r++)    mc.regfile[r]  = 0;
+    for (size_t p = 0; p < PRF_SIZE; p++)   mc.pregfile[p] = 0;
+
+    return (!mc.memory.empty());
+}
+
+//------------------------------------------------------------------------------
+// Wide Print Memory
+//------------------------------------------------------------------------------
+
+template <size_t W>
+void		wide_print_memory   (WideMachine<W>& mc, size_t s, size_t e) {
+    std::cout << wide_header<W>("<MEM>") << std::endl;
+    std::cout << std::string(W == 16 ? 40 : 64, '-') << std::endl;
+    for (; s <= e && s < mc.memory.size(); s++) {
+	std::cout << "<" << std::setfill('0') << std::setw(3) << s << "> " << wide_to_pretty_string<W>(mc.memory[s]);
+	if (symbol_name(mc.symbols, s).size())
+	    std::cout << " " << symbol_name(mc.symbols, s);
+	std::cout << std::endl;
+    }
+    std::cout << std::string(W == 16 ? 40 : 64, '-') << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// Wide Print PRegister File
+//------------------------------------------------------------------------------
+
+template <size_t W>
+void		wide_print_pregfile (WideMachine<W>& mc) {
+    std::cout << wide_header<W>("|REG|") << std::endl;
+    std::cout << std::string(W == 16 ? 40 : 64, '-') << std::endl;
+    for (size_t p = 0; p < PRF_SIZE; p++)
+	std::cout << "|P" << std::setfill('0') << std::setw(2) << p << "| " << wide_to_pretty_string<W>(mc.pregfile[p]) << std::endl;
+    std::cout << std::string(W == 16 ? 40 : 64, '-') << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// Wide Print Register File
+//------------------------------------------------------------------------------
+
+template <size_t W>
+void		wide_print_regfile  (WideMachine<W>& mc) {
+    std::cout << wide_header<W>("|REG|") << std::endl;
+    std::cout << std::string(W == 16 ? 40 : 64, '-') << std::endl;
+    for (size_t r = 0; r < RF_SIZE; r++)
+	std::cout << "|R" << std::setfill('0') << std::setw(2) << r << "| " << wide_to_pretty_string<W>(mc.regfile[r]) << std::endl;
+    std::cout << std::string(W == 16 ? 40 : 64, '-') << std::endl;
+    std::cout << "[PC ] " << wide_to_pretty_string<W>(mc.pc);
+    if (symbol_string(mc.symbols, mc.pc).size())
+	std::cout << " " << symbol_string(mc.symbols, mc.pc);
+    std::cout << std::endl;
+    std::cout << std::string(W == 16 ? 40 : 64, '-') << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// Wide Reset
+//------------------------------------------------------------------------------
+
+template <size_t W>
+void		wide_reset	    (WideMachine<W>& mc) {
+    mc.pc     = 0;
+    mc.steps  = 0;
+    mc.cycles = 0;
+    mc.halted = false;
+}
+
+//------------------------------------------------------------------------------
+// Wide Step
+//------------------------------------------------------------------------------
+
+// The same loop as the specialized engine with only tracing and run control,
+// written against WideMachine so it compiles once per word width.
+
+template <size_t W>
+size_t		wide_step	    (WideMachine<W>& mc, size_t s) {
+    typedef typename WordTraits<W>::Word Word;
+
+    std::vector<Word>& m   = mc.memory;
+    Word	      *rf  = mc.regfile;
+    Word	      *prf = mc.pregfile;
+    RunControl	      *ctl = mc.control;
+    size_t	       pc  = mc.pc;
+    size_t	       i;
+
+    Word	w;
+    size_t	op;
+    size_t	a;
+
+    for (i = 0; i < s && !mc.halted && pc < m.size(); i++) {
+	if (ctl) {
+	    if (ctl->stop.load(std::memory_order_relaxed))
+		break;
+	    if ((i & 0xff) == 0)
+		control_publish(*ctl, pc, mc.steps + i);
+	}
+
+	w  = m[pc];
+	op = w >> (W - 4);
+
+	// Memory operands are checked before anything is accounted for
+	if (!wide_address(mc, pc, op, w, a))
+	    break;
+
+	mc.cycles += mc.cost.mem_cycles + mc.cost.op_cycles[op];
+
+	if (mc.trace)
+	    wide_trace(mc, pc, w);
+
+	switch (op) {
+	    case OP_LOAD:
+		rf[wide_operand<W, OP_LOAD, 0>(w)] = m[a];
+		mc.cycles += mc.cost.mem_cycles;
+		break;
+	    case OP_STORE:
+		m[a] = rf[wide_operand<W, OP_STORE, 0>(w)];
+		mc.cycles += mc.cost.mem_cycles;
+		break;
+	    case OP_ADD:
+		rf[wide_operand<W, OP_ADD, 0>(w)] = rf[wide_operand<W, OP_ADD, 1>(w)] + rf[wide_operand<W, OP_ADD, 2>(w)];
+		break;
+	    case OP_LOADC:
+		rf[wide_operand<W, OP_LOADC, 0>(w)] = wide_operand<W, OP_LOADC, 1>(w);
+		break;
+	    case OP_SUB:
+		rf[wide_operand<W, OP_SUB, 0>(w)] = rf[wide_operand<W, OP_SUB, 1>(w)] - rf[wide_operand<W, OP_SUB, 2>(w)];
+		break;
+	    case OP_JMPZ:
+		if (rf[wide_operand<W, OP_JMPZ, 0>(w)] == 0) pc = pc + wide_operand<W, OP_JMPZ, 1>(w) - 1;
+		break;
+	    case OP_JMPN:
+		if (rf[wide_operand<W, OP_JMPN, 0>(w)] >> (W - 1)) pc = pc + wide_operand<W, OP_JMPN, 1>(w) - 1;
+		break;
+	    case OP_JMP:
+		pc = pc + wide_operand<W, OP_JMP, 0>(w) - 1;
+		break;
+	    case OP_MOVR:
+		rf[wide_operand<W, OP_MOVR, 0>(w)] = m[a];
+		mc.cycles += mc.cost.mem_cycles;
+		break;
+	    case OP_IO:
+		if (wide_operand<W, OP_IO, 2>(w))
+		    prf[wide_operand<W, OP_IO, 1>(w)] = rf[wide_operand<W, OP_IO, 0>(w)];
+		else
+		    rf[wide_operand<W, OP_IO, 0>(w)] = prf[wide_operand<W, OP_IO, 1>(w)];
+		break;
+	    case OP_END:
+		mc.halted = true;
+		continue;
+	    default:
+		std::cerr << "Unknown opcode: " << OWord(op) << " in " << wide_to_pretty_string<W>(w) << std::endl;
+		break;
+	}
+
+	pc++;
+    }
+
+    mc.pc     = pc;
+    mc.steps += i;
+    if (ctl) control_publish(*ctl, mc.pc, mc.steps);
+
+    return (i);
+}
+
+//------------------------------------------------------------------------------
+// Instantiations
+//------------------------------------------------------------------------------
+
+template bool	wide_load<16>		(std::istream&, WideMachine<16>&);
+template void	wide_print_memory<16>	(WideMachine<16>&, size_t, size_t);
+template void	wide_print_pregfile<16> (WideMachine<16>&);
+template void	wide_print_regfile<16>	(WideMachine<16>&);
+template void	wide_reset<16>		(WideMachine<16>&);
+template size_t wide_step<16>		(WideMachine<16>&, size_t);
+
+template bool	wide_load<32>		(std::istream&, WideMachine<32>&);
+template void	wide_print_memory<32>	(WideMachine<32>&, size_t, size_t);
+template void	wide_print_pregfile<32> (WideMachine<32>&);
+template void	wide_print_regfile<32>	(WideMachine<32>&);
+template void	wide_reset<32>		(WideMachine<32>&);
+template size_t wide_step<32>		(WideMachine<32>&, size_t);
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
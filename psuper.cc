@@ -0,0 +1,196 @@
+//------------------------------------------------------------------------------
+// psuper.cc: psim superoptimizer
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static bool	read_snippet	    (std::istream& in, TextList& text) {
+    std::string	line;
+    std::string	label;
+    Tokens	tokens;
+
+    while (getline(in, line)) {
+	trim_comment(line);
+	label = get_label(line);
+	trim_whitespace(line);
+
+	// A label would let control enter the middle of the snippet
+	if (label.find_first_not_of(" \t") != std::string::npos)
+	    return (false);
+	if (line.size() == 0)
+	    continue;
+
+	tokens = tokenize(line);
+	for (size_t i = 0; i < tokens.size(); i++)
+	    trim_comma(tokens[i]);
+	text.push_back(tokens);
+    }
+
+    return (text.size() > 0);
+}
+
+static void	print_text	    (const char *name, TextList& text) {
+    std::cout << "    " << name << ":" << std::endl;
+    for (size_t i = 0; i < text.size(); i++)
+	std::cout << "\t" << tokens_to_string(text[i]) << std::endl;
+}
+
+static bool	uses_memory	    (TextList& text, bool movr) {
+    for (size_t i = 0; i < text.size(); i++)
+	if ((text[i][0] == "MOVR") == movr && (movr || (text[i][0] == "MOV" && text[i].size() == 3 && !token_is_constant(text[i][2]))))
+	    return (true);
+
+    return (false);
+}
+
+static void	usage		    () {
+    std::cerr << "usage: psuper [options] s0.snip s1.snip ..." << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "    -d <file>       Add proved rewrites to this rewrite database" << std::endl;
+    std::cerr << "    -j <n>          Number of threads (defaults to online cores)" << std::endl;
+    std::cerr << "    -n <n>          Longest sequence to search (defaults to one less than the snippet)" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// Main
+//------------------------------------------------------------------------------
+
+int		main		    (int argc, char *argv[]) {
+    RewriteTable db;
+    std::string	 db_file;
+    size_t	 jobs;
+    size_t	 max_length;
+    size_t	 added;
+    int		 c;
+
+    jobs       = sysconf(_SC_NPROCESSORS_ONLN);
+    max_length = 0;
+    added      = 0;
+
+    while ((c = getopt(argc, argv, "d:j:n:h")) != -1) {
+	switch (c) {
+	    case 'd': db_file	 = optarg; break;
+	    case 'j': jobs	 = strtol(optarg, NULL, 10); break;
+	    case 'n': max_length = strtol(optarg, NULL, 10); break;
+	    default:
+		usage();
+		return (EXIT_FAILURE);
+	}
+    }
+
+    if (optind >= argc || jobs == 0) {
+	usage();
+	return (EXIT_FAILURE);
+    }
+
+    // An existing database is extended, not replaced
+    if (db_file.size()) {
+	std::ifstream in(db_file.c_str());
+
+	if (in.is_open() && !rewrite_load(in, db)) {
+	    std::cerr << "Unable to load rewrite database: " << db_file << std::endl;
+	    return (EXIT_FAILURE);
+	}
+    }
+
+    for (int i = optind; i < argc; i++) {
+	std::ifstream	src(argv[i]);
+	TextList	text;
+	Rewrite		rw;
+	SuperStats	stats;
+	std::string	error;
+	bool		found;
+	bool		known;
+
+	if (!src.is_open() || !read_snippet(src, text)) {
+	    std::cerr << argv[i] << ": unable to read straight-line snippet" << std::endl;
+	    return (EXIT_FAILURE);
+	}
+
+	found = superoptimize(text, max_length, jobs, rw, stats, error);
+	if (!found && stats.alphabet == 0) {
+	    std::cerr << argv[i] << ": " << error << std::endl;
+	    return (EXIT_FAILURE);
+	}
+
+	std::cout << argv[i] << ": " << (found ? rw.replacement.size() : text.size()) << " of "
+		  << text.size() << " instructions (" << stats.alphabet << " alphabet, "
+		  << stats.candidates << " candidates, " << stats.survivors << " survivors, "
+		  << stats.seconds << " seconds, "
+		  << (size_t)(stats.candidates / (stats.seconds > 0 ? stats.seconds : 1)) << " candidates/s)" << std::endl;
+
+	if (!found) {
+	    std::cout << "    " << error << std::endl;
+	    continue;
+	}
+
+	print_text("pattern", rw.pattern);
+	print_text(rw.proved ? "replacement (proved)" : "replacement (tested)", rw.replacement);
+
+	// MOVR and LOAD/STORE may alias, which the pattern variables cannot say
+	if (!rw.proved || (uses_memory(rw.pattern, true) && uses_memory(rw.pattern, false)))
+	    continue;
+
+	known = false;
+	for (size_t r = 0; r < db.size() && !known; r++)
+	    known = (db[r].pattern == rw.pattern);
+	if (!known) {
+	    db.push_back(rw);
+	    added++;
+	}
+    }
+
+    if (db_file.size()) {
+	std::ofstream out(db_file.c_str());
+
+	if (!out.is_open()) {
+	    std::cerr << "Unable to write rewrite database: " << db_file << std::endl;
+	    return (EXIT_FAILURE);
+	}
+	rewrite_write(out, db);
+	std::cout << db_file << ": " << added << " rewrites added, " << db.size() << " total" << std::endl;
+    }
+
+    return (EXIT_SUCCESS);
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
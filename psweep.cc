@@ -0,0 +1,498 @@
+//------------------------------------------------------------------------------
+// psweep.cc: psim design-space sweep driver
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Enumerations
+//------------------------------------------------------------------------------
+
+typedef enum {
+    SP_MEM_CYCLES = 0,
+    SP_CACHE_SIZE,
+    SP_LINE_SIZE,
+    SP_WAYS,
+    SP_POLICY,
+    SP_ORGANIZATION,
+    SP_HIT_CYCLES,
+    SP_OP_CYCLES			// One dimension per -O option follows
+} SWEEP_PARAM;
+
+//------------------------------------------------------------------------------
+// Structures
+//------------------------------------------------------------------------------
+
+struct SweepParam {
+    std::string		    name;
+    size_t		    opcode;	// Only for SP_OP_CYCLES dimensions
+    Tokens		    values;
+};
+
+struct SweepRun {
+    size_t		    image;
+    std::vector<size_t>	    index;	// Value index per parameter dimension
+
+    size_t		    steps;
+    size_t		    cycles;
+    bool		    halted;
+    bool		    looping;
+    size_t		    loop_pc;
+    size_t		    period;
+    bool		    cached;
+    bool		    unified;
+    double		    imiss;
+    double		    dmiss;
+    double		    miss;
+};
+
+struct Sweep {
+    std::vector<std::string>	names;
+    std::vector<Memory>		images;	// Loaded once, shared read-only
+    std::vector<SweepParam>	params;
+    std::vector<SweepRun>	runs;
+    RegisterFile		inputs;
+    size_t			budget;
+    bool			detect;	// Stop runs on non-terminating loops
+    bool			checked; // Stop runs on out-of-range memory accesses
+    STEP_ENGINE			engine;
+
+    size_t			next;
+    pthread_mutex_t		lock;
+};
+
+//------------------------------------------------------------------------------
+// Global Constants
+//------------------------------------------------------------------------------
+
+static const char *OpNames[OP_SIZE] = {
+    "LOAD", "STORE", "ADD", "LOADC", "SUB", "JMPZ", "JMPN", "JMP",
+    "MOVR", NULL, NULL, NULL, NULL, NULL, "IO", "END"
+};
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static size_t	param_value	    (Sweep& sw, SweepRun& r, size_t p) {
+    return (strtol(sw.params[p].values[r.index[p]].c_str(), NULL, 10));
+}
+
+static double	miss_rate	    (Cache& c) {
+    size_t accesses = c.reads + c.writes;
+
+    return (accesses ? (double)(c.read_misses + c.write_misses) / accesses : 0.0);
+}
+
+static void	sweep_simulate	    (Sweep& sw, SweepRun& r) {
+    Machine	mc;
+    CacheModel	cm;
+    LoopCheck	lc;
+
+    machine_init(mc);
+    mc.trace	= false;
+    mc.memory	= sw.images[r.image];
+    mc.pregfile = sw.inputs;
+    mc.engine	= sw.engine;
+    mc.checked	= sw.checked;
+
+    mc.cost.mem_cycles = param_value(sw, r, SP_MEM_CYCLES);
+    for (size_t p = SP_OP_CYCLES; p < sw.params.size(); p++)
+	mc.cost.op_cycles[sw.params[p].opcode] = param_value(sw, r, p);
+
+    r.cached  = param_value(sw, r, SP_CACHE_SIZE) > 0;
+    r.unified = sw.params[SP_ORGANIZATION].values[r.index[SP_ORGANIZATION]] == "unified";
+
+    if (r.cached) {
+	cache_configure(cm, param_value(sw, r, SP_CACHE_SIZE),
+			    param_value(sw, r, SP_LINE_SIZE),
+			    param_value(sw, r, SP_WAYS),
+			    param_value(sw, r, SP_HIT_CYCLES),
+			    mc.cost.mem_cycles,
+			    sw.params[SP_POLICY].values[r.index[SP_POLICY]] == "wt" ? WP_WRITE_THROUGH : WP_WRITE_BACK,
+			    r.unified);
+	mc.cache = &cm;
+    }
+
+    if (sw.detect) {
+	mc.loop = &lc;
+	loop_reset(lc, mc);
+    }
+
+    step(mc, sw.budget);
+
+    r.steps   = mc.steps;
+    r.cycles  = mc.cycles;
+    r.halted  = mc.halted;
+    r.looping = sw.detect && lc.found;
+    r.loop_pc = r.looping ? lc.loop_pc : 0;
+    r.period  = r.looping ? lc.period : 0;
+    r.imiss   = r.dmiss = r.miss = 0.0;
+
+    if (r.cached) {
+	r.imiss = miss_rate(cm.icache);
+	r.dmiss = miss_rate(cm.dcache);
+	if (r.unified) {
+	    r.miss = r.dmiss;
+	} else {
+	    size_t accesses = cm.icache.reads + cm.dcache.reads + cm.dcache.writes;
+	    size_t misses   = cm.icache.read_misses + cm.dcache.read_misses + cm.dcache.write_misses;
+	    r.miss = accesses ? (double)misses / accesses : 0.0;
+	}
+    }
+}
+
+static void    *sweep_worker	    (void *arg) {
+    Sweep  *sw = (Sweep *)arg;
+    size_t  r;
+
+    while (true) {
+	pthread_mutex_lock(&sw->lock);
+	r = sw->next++;
+	pthread_mutex_unlock(&sw->lock);
+
+	if (r >= sw->runs.size())
+	    break;
+
+	sweep_simulate(*sw, sw->runs[r]);
+    }
+
+    return (NULL);
+}
+
+static void	sweep_enumerate	    (Sweep& sw) {
+    SweepRun	r;
+    size_t	combinations;
+    bool	valid;
+
+    combinations = 1;
+    for (size_t p = 0; p < sw.params.size(); p++)
+	combinations *= sw.params[p].values.size();
+
+    r.index.resize(sw.params.size());
+
+    for (size_t i = 0; i < sw.images.size(); i++) {
+	r.image = i;
+
+	for (size_t c = 0; c < combinations; c++) {
+	    for (size_t p = 0, k = c; p < sw.params.size(); p++) {
+		r.index[p] = k % sw.params[p].values.size();
+		k /= sw.params[p].values.size();
+	    }
+
+	    // Skip cache geometries that do not apply or cannot be built
+	    if (param_value(sw, r, SP_CACHE_SIZE) == 0) {
+		valid = r.index[SP_LINE_SIZE] == 0 && r.index[SP_WAYS] == 0 &&
+			r.index[SP_POLICY] == 0 && r.index[SP_ORGANIZATION] == 0 &&
+			r.index[SP_HIT_CYCLES] == 0;
+	    } else {
+		size_t block = param_value(sw, r, SP_LINE_SIZE) * param_value(sw, r, SP_WAYS);
+		valid = block > 0 && param_value(sw, r, SP_CACHE_SIZE) % block == 0;
+	    }
+
+	    if (valid)
+		sw.runs.push_back(r);
+	}
+    }
+}
+
+static void	print_csv	    (std::ostream& out, Sweep& sw) {
+    out << "image";
+    for (size_t p = 0; p < sw.params.size(); p++)
+	out << "," << sw.params[p].name;
+    out << ",steps,cycles,cpi,miss_rate,icache_miss_rate,dcache_miss_rate,halted,loop_pc,loop_period\n";
+
+    out << std::fixed << std::setprecision(4);
+    for (size_t i = 0; i < sw.runs.size(); i++) {
+	SweepRun& r = sw.runs[i];
+
+	out << sw.names[r.image];
+	for (size_t p = 0; p < sw.params.size(); p++)
+	    out << "," << sw.params[p].values[r.index[p]];
+	out << "," << r.steps << "," << r.cycles << ","
+	    << (r.steps ? (double)r.cycles / r.steps : 0.0) << ",";
+	if (r.cached)
+	    out << r.miss;
+	out << ",";
+	if (r.cached && !r.unified)
+	    out << r.imiss;
+	out << ",";
+	if (r.cached && !r.unified)
+	    out << r.dmiss;
+	out << "," << (r.halted ? 1 : 0) << ",";
+	if (r.looping)
+	    out << r.loop_pc << "," << r.period;
+	else
+	    out << ",";
+	out << "\n";
+    }
+}
+
+static void	print_json	    (std::ostream& out, Sweep& sw) {
+    out << "[\n";
+    out << std::fixed << std::setprecision(4);
+    for (size_t i = 0; i < sw.runs.size(); i++) {
+	SweepRun& r = sw.runs[i];
+
+	out << "  {\"image\": \"" << sw.names[r.image] << "\"";
+	for (size_t p = 0; p < sw.params.size(); p++) {
+	    out << ", \"" << sw.params[p].name << "\": ";
+	    if (p == SP_POLICY || p == SP_ORGANIZATION)
+		out << "\"" << sw.params[p].values[r.index[p]] << "\"";
+	    else
+		out << sw.params[p].values[r.index[p]];
+	}
+	out << ", \"steps\": " << r.steps
+	    << ", \"cycles\": " << r.cycles
+	    << ", \"cpi\": " << (r.steps ? (double)r.cycles / r.steps : 0.0);
+	if (r.cached) {
+	    out << ", \"miss_rate\": " << r.miss;
+	    if (!r.unified)
+		out << ", \"icache_miss_rate\": " << r.imiss
+		    << ", \"dcache_miss_rate\": " << r.dmiss;
+	}
+	out << ", \"halted\": " << (r.halted ? "true" : "false");
+	if (r.looping)
+	    out << ", \"loop_pc\": " << r.loop_pc << ", \"loop_period\": " << r.period;
+	out << "}"
+	    << (i + 1 < sw.runs.size() ? ",\n" : "\n");
+    }
+    out << "]\n";
+}
+
+static void	usage		    () {
+    std::cerr << "usage: psweep [options] i0.ubin i1.ubin ..." << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "    -j <n>          Number of worker threads (defaults to online cores)" << std::endl;
+    std::cerr << "    -n <n>          Step budget per run (defaults to 1000000)" << std::endl;
+    std::cerr << "    -f csv|json     Output format (defaults to csv)" << std::endl;
+    std::cerr << "    -o <file>       Output file (defaults to stdout)" << std::endl;
+    std::cerr << "    -i <p>=<v>      Set pregister <p> to <v> before each run" << std::endl;
+    std::cerr << "    -L              Stop runs early on non-terminating loops" << std::endl;
+    std::cerr << "    -E <engine>     Step engine, template, reference or generic (defaults to template)" << std::endl;
+    std::cerr << "    -U              Skip memory bounds checks (only for images known to stay in range)" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "  Parameter grid (comma separated lists):" << std::endl;
+    std::cerr << "    -m <list>       Memory latencies in cycles (defaults to 0)" << std::endl;
+    std::cerr << "    -c <list>       Cache sizes in words, 0 disables cache (defaults to 0)" << std::endl;
+    std::cerr << "    -l <list>       Cache line sizes in words (defaults to 1)" << std::endl;
+    std::cerr << "    -w <list>       Cache associativities (defaults to 1)" << std::endl;
+    std::cerr << "    -p <list>       Cache write policies, wb or wt (defaults to wb)" << std::endl;
+    std::cerr << "    -u <list>       Cache organizations, split or unified (defaults to split)" << std::endl;
+    std::cerr << "    -H <list>       Cache hit latencies in cycles (defaults to 0)" << std::endl;
+    std::cerr << "    -O <op>=<list>  Execute cycles for opcode <op> (defaults to 1)" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "  Every instruction costs its execute cycles.  Without a cache each fetch, load" << std::endl;
+    std::cerr << "  and store adds the memory latency; with one it adds the hit latency, plus the" << std::endl;
+    std::cerr << "  memory latency for each line fill, writeback and write-through store." << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// Main
+//------------------------------------------------------------------------------
+
+int		main		    (int argc, char *argv[]) {
+    Sweep		    sw;
+    std::vector<pthread_t>  workers;
+    std::string		    format;
+    std::string		    output;
+    std::string		    arg;
+    size_t		    jobs;
+    size_t		    i;
+    int			    c;
+
+    const char *names[] = { "mem_cycles", "cache_size", "line_size", "ways", "policy", "organization", "hit_cycles" };
+    const char *values[] = { "0", "0", "1", "1", "wb", "split", "0" };
+
+    sw.params.resize(SP_OP_CYCLES);
+    for (i = 0; i < SP_OP_CYCLES; i++) {
+	arg = values[i];
+	sw.params[i].name   = names[i];
+	sw.params[i].opcode = OP_UNKNOWN;
+	sw.params[i].values = tokenize(arg);
+    }
+
+    sw.inputs.assign(PRF_SIZE, DWord(0));
+    sw.budget = 1000000;
+    sw.detect = false;
+    sw.checked = true;
+    sw.engine = SE_TEMPLATE;
+    sw.next   = 0;
+    format    = "csv";
+    jobs      = sysconf(_SC_NPROCESSORS_ONLN);
+
+    while ((c = getopt(argc, argv, "j:n:f:o:i:LE:Um:c:l:w:p:u:H:O:h")) != -1) {
+	arg = optarg ? optarg : "";
+
+	switch (c) {
+	    case 'j': jobs	= strtol(optarg, NULL, 10); break;
+	    case 'n': sw.budget	= strtol(optarg, NULL, 10); break;
+	    case 'f': format	= arg; break;
+	    case 'o': output	= arg; break;
+	    case 'L': sw.detect	= true; break;
+	    case 'U': sw.checked = false; break;
+	    case 'E':
+		if (arg != "template" && arg != "reference" && arg != "generic") {
+		    std::cerr << "Invalid step engine: " << arg << std::endl;
+		    return (EXIT_FAILURE);
+		}
+		sw.engine = (arg == "reference" ? SE_REFERENCE : arg == "generic" ? SE_GENERIC : SE_TEMPLATE);
+		break;
+	    case 'i':
+		if ((i = arg.find('=')) == std::string::npos ||
+		    strtoul(arg.substr(0, i).c_str(), NULL, 10) >= PRF_SIZE) {
+		    std::cerr << "Invalid pregister input: " << arg << std::endl;
+		    return (EXIT_FAILURE);
+		}
+		sw.inputs[strtol(arg.substr(0, i).c_str(), NULL, 10)] = strtol(arg.substr(i + 1).c_str(), NULL, 10);
+		break;
+	    case 'm': sw.params[SP_MEM_CYCLES].values	= tokenize(arg); break;
+	    case 'c': sw.params[SP_CACHE_SIZE].values	= tokenize(arg); break;
+	    case 'l': sw.params[SP_LINE_SIZE].values	= tokenize(arg); break;
+	    case 'w': sw.params[SP_WAYS].values		= tokenize(arg); break;
+	    case 'p': sw.params[SP_POLICY].values	= tokenize(arg); break;
+	    case 'u': sw.params[SP_ORGANIZATION].values	= tokenize(arg); break;
+	    case 'H': sw.params[SP_HIT_CYCLES].values	= tokenize(arg); break;
+	    case 'O': {
+		SweepParam sp;
+
+		if ((i = arg.find('=')) != std::string::npos) {
+		    sp.name   = arg.substr(0, i);
+		    sp.opcode = OP_UNKNOWN;
+		    for (size_t o = 0; o < OP_SIZE; o++)
+			if (OpNames[o] && sp.name == OpNames[o])
+			    sp.opcode = o;
+		    arg = arg.substr(i + 1);
+		    sp.values = tokenize(arg);
+		}
+
+		if (i == std::string::npos || sp.opcode == OP_UNKNOWN || sp.values.empty()) {
+		    std::cerr << "Invalid opcode cost: " << optarg << std::endl;
+		    return (EXIT_FAILURE);
+		}
+
+		sp.name = "op_" + sp.name;
+		sw.params.push_back(sp);
+		break;
+	    }
+	    default:
+		usage();
+		return (EXIT_FAILURE);
+	}
+    }
+
+    if (optind >= argc || jobs == 0 || (format != "csv" && format != "json")) {
+	usage();
+	return (EXIT_FAILURE);
+    }
+
+    for (i = 0; i < sw.params.size(); i++) {
+	if (sw.params[i].values.empty()) {
+	    std::cerr << "Empty parameter list for " << sw.params[i].name << std::endl;
+	    return (EXIT_FAILURE);
+	}
+
+	for (size_t v = 0; v < sw.params[i].values.size(); v++) {
+	    std::string& value = sw.params[i].values[v];
+
+	    if (i == SP_POLICY ? value != "wb" && value != "wt" :
+		i == SP_ORGANIZATION ? value != "split" && value != "unified" :
+		!token_is_number(value) || value[0] == '-') {
+		std::cerr << "Invalid " << sw.params[i].name << " value: " << value << std::endl;
+		return (EXIT_FAILURE);
+	    }
+	}
+    }
+
+    for (; optind < argc; optind++) {
+	std::ifstream	src;
+	RegisterFile	rf(RF_SIZE);
+	RegisterFile	prf(PRF_SIZE);
+
+	src.open(argv[optind]);
+	sw.images.push_back(Memory());
+
+	if (!src.is_open() || !load_stream(src, sw.images.back(), rf, prf)) {
+	    std::cerr << "Unable to load binary file: " << argv[optind] << std::endl;
+	    return (EXIT_FAILURE);
+	}
+
+	sw.names.push_back(argv[optind]);
+    }
+
+    sweep_enumerate(sw);
+
+    if (jobs > sw.runs.size())
+	jobs = sw.runs.size();
+
+    pthread_mutex_init(&sw.lock, NULL);
+    workers.resize(jobs);
+    for (i = 0; i < jobs; i++) {
+	if (pthread_create(&workers[i], NULL, sweep_worker, &sw) != 0) {
+	    std::cerr << "Unable to create worker thread" << std::endl;
+	    break;
+	}
+    }
+
+    // The workers that did start share out every run between them
+    if (jobs && i == 0)
+	return (EXIT_FAILURE);
+    for (jobs = i, i = 0; i < jobs; i++)
+	pthread_join(workers[i], NULL);
+    pthread_mutex_destroy(&sw.lock);
+
+    if (output.size()) {
+	std::ofstream tgt(output.c_str());
+
+	if (!tgt.is_open()) {
+	    std::cerr << "Unable to open output file: " << output << std::endl;
+	    return (EXIT_FAILURE);
+	}
+
+	if (format == "json") print_json(tgt, sw); else print_csv(tgt, sw);
+    } else {
+	if (format == "json") print_json(std::cout, sw); else print_csv(std::cout, sw);
+    }
+
+    return (EXIT_SUCCESS);
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------
@@ -0,0 +1,268 @@
+//------------------------------------------------------------------------------
+// ptrans.cc: psim ahead-of-time translator
+//------------------------------------------------------------------------------
+
+// Copyright (c) 2007 Peter Bui. All Rights Reserved.
+
+// This software is provided 'as-is', without any express or implied warranty.
+// In no event will the authors be held liable for any damages arising from the
+// use of this software.
+
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software in a
+// product, an acknowledgment in the product documentation would be appreciated
+// but is not required.
+
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+
+// 3. This notice may not be removed or altered from any source distribution.
+//
+// Peter Bui <pbui@cse.nd.edu>
+
+//------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "psim.h"
+
+//------------------------------------------------------------------------------
+// Local Functions
+//------------------------------------------------------------------------------
+
+static std::string format	    (const char *fmt, long a, long b = 0, long c = 0, long d = 0) {
+    char buffer[BUFSIZ];
+
+    snprintf(buffer, sizeof(buffer), fmt, a, b, c, d);
+    return (buffer);
+}
+
+// Jumps to a translated address become a goto; anything else leaves the
+// program with the new PC so the driver stops (just like step() does).
+
+static std::string jump		    (std::vector<uint16_t>& m, size_t a) {
+    long t = (long)a + DecodeTable[m[a]].imm;
+
+    if (t >= 0 && (size_t)t < m.size())
+	return (format("goto L%ld;", t));
+    return (format("{ ns.pc = (size_t)%ldL; return; }", t));
+}
+
+static void	translate	    (std::ostream& out, std::vector<uint16_t>& m, std::vector<uint8_t>& guarded, size_t a) {
+    uint16_t		w = m[a];
+    const DecodedInst&	d = DecodeTable[w];
+    char		text[ISA_FORMAT_SIZE];
+
+    out << format("L%ld:", a) << "\t// " << std::string(text, isa_format(text, w)) << "\n";
+    out << format("    if (ns.steps == end) { ns.pc = %ld; return; }\n", a);
+
+    // Words that a STORE may overwrite are checked before running natively
+    if (guarded[a])
+	out << format("    if (m[%ld] != 0x%04lx) { ns.pc = %ld; goto interpret; }\n", a, w, a);
+
+    switch (d.op) {
+	case OP_LOAD:
+	case OP_STORE:
+	    if ((size_t)d.imm >= m.size()) {
+		out << format("    ns.pc = %ld; goto interpret;\n", a);
+		return;
+	    }
+	    break;
+	case OP_MOVR:
+	    out << format("    x = r[%ld] + %ld;\n", d.rb, d.rc);
+	    out << format("    if (x >= ns.size) { ns.pc = %ld; goto interpret; }\n", a);
+	    break;
+	case OP_UNKNOWN:
+	    out << format("    ns.pc = %ld; goto interpret;\n", a);
+	    return;
+    }
+
+    out << "    ns.steps++;\n";
+    if (d.op == OP_LOAD || d.op == OP_STORE || d.op == OP_MOVR)
+	out << format("    ns.cycles += mem + mem + op[%ld];\n", d.op);
+    else
+	out << format("    ns.cycles += mem + op[%ld];\n", d.op);
+
+    switch (d.op) {
+	case OP_LOAD:	out << format("    r[%ld] = m[%ld];\n", d.ra, d.imm); break;
+	case OP_STORE:	out << format("    m[%ld] = r[%ld];\n", d.imm, d.ra); break;
+	case OP_ADD:	out << format("    r[%ld] = r[%ld] + r[%ld];\n", d.ra, d.rb, d.rc); break;
+	case OP_LOADC:	out << format("    r[%ld] = 0x%04lx;\n", d.ra, d.imm & 0xffff); break;
+	case OP_SUB:	out << format("    r[%ld] = r[%ld] - r[%ld];\n", d.ra, d.rb, d.rc); break;
+	case OP_JMPZ:	out << format("    if (r[%ld] == 0) ", d.ra) << jump(m, a) << "\n"; break;
+	case OP_JMPN:	out << format("    if (r[%ld] & 0x8000) ", d.ra) << jump(m, a) << "\n"; break;
+	case OP_JMP:	out << "    " << jump(m, a) << "\n"; break;
+	case OP_MOVR:	out << format("    r[%ld] = m[x];\n", d.ra); break;
+	case OP_IO:
+	    if (d.rc)
+		out << format("    p[%ld] = r[%ld];\n", d.rb, d.ra);
+	    else
+		out << format("    r[%ld] = p[%ld];\n", d.ra, d.rb);
+	    break;
+	case OP_END:
+	    out << format("    ns.halted = true; ns.pc = %ld; return;\n", a);
+	    break;
+    }
+}
+
+static void	usage		    () {
+    std::cerr << "usage: ptrans [-o output.cpp] image.ubin" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// Main
+//------------------------------------------------------------------------------
+
+int		main		    (int argc, char *argv[]) {
+    std::vector<uint16_t>   m;
+    std::vector<uint8_t>    guarded;
+    std::ifstream	    src;
+    std::ofstream	    tgt;
+    std::string		    input;
+    std::string		    output;
+    Memory		    memory;
+    RegisterFile	    rf(RF_SIZE);
+    RegisterFile	    prf(PRF_SIZE);
+    bool		    data;
+    bool		    io;
+    bool		    movr;
+    bool		    fallback;
+    int			    c;
+
+    while ((c = getopt(argc, argv, "o:h")) != -1) {
+	switch (c) {
+	    case 'o': output = optarg; break;
+	    default:
+		usage();
+		return (EXIT_FAILURE);
+	}
+    }
+
+    if (optind + 1 != argc) {
+	usage();
+	return (EXIT_FAILURE);
+    }
+
+    input = argv[optind];
+    if (output.empty()) {
+	output = input;
+	output.erase(output.rfind(".") == std::string::npos ? output.size() : output.rfind("."));
+	output += ".native.cpp";
+    }
+
+    src.open(input.c_str());
+    if (!src.is_open() || !load_stream(src, memory, rf, prf) || memory.empty()) {
+	std::cerr << "Unable to load binary file: " << input << std::endl;
+	return (EXIT_FAILURE);
+    }
+
+    // Every STORE target is known statically, so only those words need guards
+    data = io = movr = fallback = false;
+    m.resize(memory.size());
+    guarded.assign(memory.size(), 0);
+    for (size_t a = 0; a < memory.size(); a++) {
+	m[a] = memory[a].to_ulong();
+	if (DecodeTable[m[a]].op == OP_STORE && (size_t)DecodeTable[m[a]].imm < memory.size())
+	    guarded[DecodeTable[m[a]].imm] = 1;
+    }
+
+    for (size_t a = 0; a < m.size(); a++) {
+	switch (DecodeTable[m[a]].op) {
+	    case OP_IO:
+		io = true;
+		break;
+	    case OP_MOVR:
+		data = movr = fallback = true;
+		break;
+	    case OP_LOAD:
+	    case OP_STORE:
+		data	 = true;
+		fallback = fallback || (size_t)DecodeTable[m[a]].imm >= m.size();
+		break;
+	    case OP_UNKNOWN:
+		fallback = true;
+		break;
+	}
+	fallback = fallback || guarded[a];
+    }
+
+    tgt.open(output.c_str());
+    if (!tgt.is_open()) {
+	std::cerr << "Unable to open output file: " << output << std::endl;
+	return (EXIT_FAILURE);
+    }
+
+    tgt << "//------------------------------------------------------------------------------\n";
+    tgt << "// " << output << ": ptrans translation of " << input << "\n";
+    tgt << "//------------------------------------------------------------------------------\n\n";
+    tgt << "#include \"psim.h\"\n\n";
+
+    tgt << "static const uint16_t Image[] = {";
+    for (size_t a = 0; a < m.size(); a++)
+	tgt << (a % 8 ? " " : "\n    ") << format("0x%04lx,", m[a]);
+    tgt << "\n};\n\n";
+
+    tgt << "static const uint8_t Guarded[] = {";
+    for (size_t a = 0; a < m.size(); a++)
+	tgt << (a % 16 ? " " : "\n    ") << (int)guarded[a] << ",";
+    tgt << "\n};\n\n";
+
+    tgt << "static void program(NativeState& ns, size_t s) {\n";
+    if (data)
+	tgt << "    uint16_t	   *m	= ns.memory;\n";
+    tgt << "    uint16_t	   *r	= ns.regfile;\n";
+    if (io)
+	tgt << "    uint16_t	   *p	= ns.pregfile;\n";
+    tgt << "    const size_t    mem = ns.cost->mem_cycles;\n";
+    tgt << "    const size_t   *op	= ns.cost->op_cycles;\n";
+    tgt << "    const size_t    end = ns.steps + s;\n";
+    if (movr)
+	tgt << "    size_t	    x;\n";
+    tgt << "\n    ns.fallback = false;\n\n";
+
+    if (fallback)
+	tgt << "dispatch:\n";
+    tgt << "    switch (ns.pc) {\n";
+    for (size_t a = 0; a < m.size(); a++)
+	tgt << format("\tcase %ld: goto L%ld;\n", a, a);
+    tgt << "\tdefault: return;\n";
+    tgt << "    }\n\n";
+
+    for (size_t a = 0; a < m.size(); a++)
+	translate(tgt, m, guarded, a);
+
+    tgt << format("    ns.pc = %ld;\n", m.size());
+    tgt << "    return;\n";
+
+    if (fallback) {
+	tgt << "\ninterpret:\n";
+	tgt << "    if (!native_execute(ns)) { ns.fallback = true; return; }\n";
+	tgt << "    if (ns.halted || ns.stale) return;\n";
+	tgt << "    goto dispatch;\n";
+    }
+    tgt << "}\n\n";
+
+    tgt << "extern \"C\" const NativeImage psim_native = { Image, Guarded, " << m.size() << ", program };\n\n";
+    tgt << "#ifndef PSIM_NATIVE_LIBRARY\n";
+    tgt << "int main(int argc, char *argv[]) {\n";
+    tgt << "    return (native_main(argc, argv, psim_native));\n";
+    tgt << "}\n";
+    tgt << "#endif\n";
+
+    return (EXIT_SUCCESS);
+}
+
+//------------------------------------------------------------------------------
+// vim: sts=4 sw=4 ts=8 ft=cpp
+//------------------------------------------------------------------------------